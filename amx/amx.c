@@ -37,6 +37,7 @@
   #include <sclinux.h>
   #if !defined AMX_NODYNALOAD
     #include <dlfcn.h>
+    #include <pthread.h>
   #endif
   #if defined AMX_JIT
     #include <sys/types.h>
@@ -46,12 +47,20 @@
 #if defined __LCC__ || defined __LINUX__
   #include <wchar.h>    /* for wcslen() */
 #endif
+#if defined AMX_PROFILE
+  #include <time.h>     /* for clock_gettime() */
+  #if defined _MSC_VER
+    #include <intrin.h> /* for __rdtsc() */
+  #endif
+#endif
 
 #if defined __ECOS__
   /* eCos puts include files in cyg/package_name */
   #include <cyg/pawn/amx.h>
+  #include <cyg/pawn/amxsimd.h>
 #else
   #include "amx.h"
+  #include "amxsimd.h"
 #endif
 
 #if (defined _Windows && !defined AMX_NODYNALOAD) || (defined AMX_JIT && __WIN32__)
@@ -84,7 +93,10 @@
 #if defined AMX_XXXPUBLICS  || defined AMX_XXXPUBVARS   || defined AMX_XXXSTRING
   #define AMX_EXPLIT_FUNCTIONS
 #endif
-#if defined AMX_XXXTAGS     || defined AMX_XXXUSERDATA
+#if defined AMX_XXXTAGS     || defined AMX_XXXUSERDATA  || defined AMX_XXXSNAPSHOT
+  #define AMX_EXPLIT_FUNCTIONS
+#endif
+#if defined AMX_XXXFUEL      || defined AMX_NAMEINDEX    || defined AMX_STACKLIMIT
   #define AMX_EXPLIT_FUNCTIONS
 #endif
 #if !defined AMX_EXPLIT_FUNCTIONS
@@ -96,22 +108,26 @@
   #define AMX_CLONE             /* amx_Clone() */
   #define AMX_EXEC              /* amx_Exec() */
   #define AMX_FLAGS             /* amx_Flags() */
-  #define AMX_INIT              /* amx_Init() and amx_InitJIT() */
+  #define AMX_INIT              /* amx_Init(), amx_InitJIT(), amx_InitAOT() and amx_BuildID() */
   #define AMX_MEMINFO           /* amx_MemInfo() */
+  #define AMX_NAMEINDEX         /* amx_IndexSize(), amx_BuildIndex() and amx_FindPublics() */
   #define AMX_NAMELENGTH        /* amx_NameLength() */
   #define AMX_NATIVEINFO        /* amx_NativeInfo() */
   #define AMX_PUSHXXX           /* amx_Push(), amx_PushAddress(), amx_PushArray() and amx_PushString() */
   #define AMX_RAISEERROR        /* amx_RaiseError() */
-  #define AMX_REGISTER          /* amx_Register() */
+  #define AMX_REGISTER          /* amx_Register(), amx_RegisterRegistry() and amx_RegistryXXX() */
   #define AMX_SETCALLBACK       /* amx_SetCallback() */
   #define AMX_SETDEBUGHOOK      /* amx_SetDebugHook() */
+  #define AMX_STACKLIMIT        /* amx_GetStackLimit(), amx_SetStackLimit() and amx_SetStackHook() */
   #define AMX_UTF8XXX           /* amx_UTF8Check(), amx_UTF8Get(), amx_UTF8Len() and amx_UTF8Put() */
+  #define AMX_XXXFUEL           /* amx_GetFuel(), amx_SetFuel() and amx_SetFuelHook() */
   #define AMX_XXXNATIVES        /* amx_NumNatives(), amx_GetNative() and amx_FindNative() */
   #define AMX_XXXPUBLICS        /* amx_NumPublics(), amx_GetPublic() and amx_FindPublic() */
   #define AMX_XXXPUBVARS        /* amx_NumPubVars(), amx_GetPubVar() and amx_FindPubVar() */
-  #define AMX_XXXSTRING         /* amx_StrLen(), amx_GetString() and amx_SetString() */
+  #define AMX_XXXSNAPSHOT       /* amx_Snapshot() and amx_Restore() */
+  #define AMX_XXXSTRING         /* amx_StrLen(), amx_StrView(), amx_GetString() and amx_SetString() */
   #define AMX_XXXTAGS           /* amx_NumTags(), amx_GetTag() and amx_FindTagId() */
-  #define AMX_XXXUSERDATA       /* amx_GetUserData() and amx_SetUserData() */
+  #define AMX_XXXUSERDATA       /* amx_GetUserData(), amx_SetUserData(), amx_GetModuleData() and amx_SetModuleData() */
 #endif
 #undef AMX_EXPLIT_FUNCTIONS
 #if defined AMX_ANSIONLY
@@ -123,7 +139,14 @@
 #if AMX_USERNUM <= 0
   #undef AMX_XXXUSERDATA
 #endif
-#if defined AMX_JIT
+#if defined AMX_JIT && defined __x86_64__ && (defined __GNUC__ || defined __ICC) && !defined AMX_ASM && !defined _WIN64
+  /* the x86-64 JIT (AMXJIT_X64.C) supports macro instructions and packed
+   * opcodes, and it runs next to the ANSI-C core (which is used for any
+   * abstract machine that is not JIT-compiled)
+   */
+  #define AMX_JIT_X64
+#endif
+#if defined AMX_JIT && !defined AMX_JIT_X64
   /* JIT is incompatible with macro instructions, packed opcodes and overlays */
   #if !defined AMX_NO_MACRO_INSTR
     #define AMX_NO_MACRO_INSTR
@@ -135,12 +158,18 @@
     #define AMX_NO_OVERLAY
   #endif
 #endif
-#if (defined AMX_ASM || defined AMX_JIT) && !defined AMX_ALTCORE
+#if (defined AMX_ASM || defined AMX_JIT && !defined AMX_JIT_X64) && !defined AMX_ALTCORE
   /* do not use the standard ANSI-C amx_Exec() function */
   #define AMX_ALTCORE
 #endif
-#if !defined AMX_NO_PACKED_OPC && !defined AMX_TOKENTHREADING
-  #define AMX_TOKENTHREADING    /* packed opcodes require token threading */
+#if (!defined AMX_NO_PACKED_OPC || defined AMX_PROFILE) && !defined AMX_TOKENTHREADING
+  #define AMX_TOKENTHREADING    /* packed opcodes and the profiler require token threading */
+#endif
+#if (defined AMX_NO_MACRO_INSTR || defined AMX_ASM) && !defined AMX_NO_FUSED_OPC
+  /* superinstructions are built from macro instructions, and only the ANSI-C
+   * and GNU GCC cores implement them
+   */
+  #define AMX_NO_FUSED_OPC
 #endif
 
 #if defined _I64_MAX || defined __x86_64__ || defined HAVE_I64
@@ -197,6 +226,11 @@
   #endif /* __WIN32__ */
 #else
   int amx_exec_list(AMX *amx,const cell **opcodelist,int *numopcodes);
+  #if defined AMX_JIT_X64
+    extern cell amx_jit_compile(void *pcode, void *jumparray, void *nativecode);
+    extern cell amx_jit_run(AMX *amx,cell *retval,unsigned char *data);
+    extern int  amx_jit_list(const AMX *amx,const cell **opcodelist,int *numopcodes);
+  #endif
 #endif /* AMX_ALTCORE */
 
 typedef enum {
@@ -385,7 +419,54 @@ typedef enum {
   OP_BOUNDS_P,
 #endif
   /* ----- */
-  OP_NUM_OPCODES
+  OP_NUM_OPCODES,
+#if !defined AMX_NO_FUSED_OPC
+  /* fused instructions (superinstructions); these are created by FusePcode()
+   * and they never appear in a compiled script
+   */
+  OP_LOAD_S_PUSH=OP_NUM_OPCODES,
+  OP_LIDX_PUSH,
+  OP_PUSH_C_CALL,
+  OP_CONST_ALT_JEQ,
+  OP_CONST_ALT_JNEQ,
+  OP_CONST_ALT_JSLESS,
+  OP_CONST_ALT_JSLEQ,
+  OP_CONST_ALT_JSGRTR,
+  OP_CONST_ALT_JSGEQ,
+  #if !defined AMX_NO_PACKED_OPC
+    OP_LOAD_P_S_PUSH,
+    OP_PUSH_P_C_CALL,
+    OP_CONST_P_ALT_JEQ,
+    OP_CONST_P_ALT_JNEQ,
+    OP_CONST_P_ALT_JSLESS,
+    OP_CONST_P_ALT_JSLEQ,
+    OP_CONST_P_ALT_JSGRTR,
+    OP_CONST_P_ALT_JSGEQ,
+  #endif
+  /* memory accesses without address check; these are created by ProvePcode()
+   * for the accesses that are proven to stay inside the data segment or the
+   * current stack frame
+   */
+  OP_LOAD_I_NC,
+  OP_LODB_I_NC,
+  OP_STOR_I_NC,
+  OP_STRB_I_NC,
+  OP_LIDX_NC,
+  OP_LIDX_B_NC,
+  OP_MOVS_NC,
+  OP_CMPS_NC,
+  OP_FILL_NC,
+  #if !defined AMX_NO_PACKED_OPC
+    OP_LODB_P_I_NC,
+    OP_STRB_P_I_NC,
+    OP_LIDX_P_B_NC,
+    OP_MOVS_P_NC,
+    OP_CMPS_P_NC,
+    OP_FILL_P_NC,
+  #endif
+  /* ----- */
+  OP_NUM_FUSED
+#endif
 } OPCODE;
 
 #define NUMENTRIES(hdr,field,nextfield) \
@@ -556,9 +637,13 @@ int AMXAPI amx_Callback(AMX *amx, cell index, cell *result, const cell *params)
    * subsequent call will call the function directly (bypassing this
    * callback).
    * This trick cannot work in the JIT, because the program would need to
-   * be re-JIT-compiled after patching a P-code instruction.
+   * be re-JIT-compiled after patching a P-code instruction. It is also not
+   * done when the P-code must stay read-only (AMX_FLAG_ROCODE): then every
+   * call goes through the native function table in the header, which
+   * amx_Register() fills in, and the code may be mapped read-only and be
+   * shared by any number of abstract machines (see amx_Clone()).
    */
-  assert((amx->flags & AMX_FLAG_JITC)==0 || amx->sysreq_d==0);
+  assert((amx->flags & (AMX_FLAG_JITC | AMX_FLAG_ROCODE))==0 || amx->sysreq_d==0);
   if (amx->sysreq_d!=0) {
     /* at the point of the call, the CIP pseudo-register points directly
      * behind the SYSREQ(.N) instruction and its parameter(s)
@@ -591,13 +676,13 @@ int AMXAPI amx_Callback(AMX *amx, cell index, cell *result, const cell *params)
 #endif /* defined AMX_DEFCALLBACK */
 
 
-#if defined AMX_JIT
+#if defined AMX_JIT && !defined AMX_JIT_X64
   /* convert from relative addresses to absolute physical addresses */
   #define RELOC_ABS(base,off)   (*(ucell *)((base)+(int)(off)) += (ucell)(base)+(int)(off)-sizeof(cell))
 #else
   #define JUMPREL(ip)           ((cell*)((intptr_t)(ip)+*(cell*)(ip)-sizeof(cell)))
 #endif
-#if defined AMX_ASM || defined AMX_JIT
+#if defined AMX_ASM || defined AMX_JIT && !defined AMX_JIT_X64
   #define RELOCATE_ADDR(base,v) ((v)+((ucell)(base)))
 #else
   #define RELOCATE_ADDR(base,v) (v)
@@ -618,6 +703,898 @@ int AMXAPI amx_Callback(AMX *amx, cell index, cell *result, const cell *params)
 
 #if defined AMX_INIT
 
+/* CaseTableFits() checks that a case table with "num" records, starting at
+ * "cip" (the address behind the number of records), lies in the code; the
+ * number of records comes from the program, so the check must not overflow
+ */
+static int CaseTableFits(const AMX *amx,cell cip,cell num)
+{
+  ucell cells;
+
+  if (num<0 || cip<0 || cip>=amx->codesize)
+    return 0;
+  cells=(ucell)(amx->codesize-cip)/sizeof(cell); /* >= 1 */
+  return (ucell)num<=(cells-1)/2;
+}
+
+/* SortCaseTable() makes sure that the records of a case table are in
+ * ascending order of the case values, so that the SWITCH instructions can
+ * index a dense table directly, and use a binary search on a sparse table.
+ * The compiler already emits the table sorted, so this normally reduces to a
+ * single pass over the table. Duplicate case values (which the compiler
+ * flags as an error) get the jump target of the first occurrence, because
+ * with a linear scan, the first occurrence was the one that matched.
+ * Parameter "offs" is the code offset of the first record; when "reljump" is
+ * set, the jump targets in the records are relative (CASETBL), otherwise
+ * they are overlay indices (CASETBL_OVL).
+ * The table comes from the program, so the sort must not take quadratic
+ * time on a crafted table: it is a merge sort, which needs room for a copy of
+ * the table in "scratch". The function returns 0 if the table is not sorted
+ * and the scratch area is too small.
+ */
+static int SortCaseTable(unsigned char *code, cell offs, cell num, int reljump,
+                         cell *scratch, int scratchsize)
+{
+  cell *rec=(cell *)(code+(int)offs);
+  cell *src,*dst,*tmp;
+  cell width,lo,mid,hi,l,r,k;
+  int i;
+
+  for (i=1; i<num && rec[2*i]>rec[2*(i-1)]; i++)
+    /* nothing */;
+  if (i>=num)
+    return 1;     /* sorted, and no duplicates */
+  if ((ucell)num>(ucell)scratchsize/(2*sizeof(cell)))
+    return 0;
+
+  /* jump targets are relative to their own position in the table, so they
+   * must be made absolute before records are moved */
+  if (reljump)
+    for (i=0; i<num; i++)
+      rec[2*i+1]+=offs+2*i*sizeof(cell);
+  /* bottom-up merge sort; on equal values, the record from the left run goes
+   * first, so that records with equal values keep their original order
+   */
+  src=rec;
+  dst=scratch;
+  for (width=1; width<num; width*=2) {
+    for (lo=0; lo<num; lo+=2*width) {
+      mid=(lo+width<num) ? lo+width : num;
+      hi=(mid+width<num) ? mid+width : num;
+      for (l=lo, r=mid, k=lo; k<hi; k++) {
+        if (l<mid && (r>=hi || src[2*l]<=src[2*r])) {
+          dst[2*k]=src[2*l];
+          dst[2*k+1]=src[2*l+1];
+          l++;
+        } else {
+          dst[2*k]=src[2*r];
+          dst[2*k+1]=src[2*r+1];
+          r++;
+        } /* if */
+      } /* for */
+    } /* for */
+    tmp=src;
+    src=dst;
+    dst=tmp;
+  } /* for */
+  if (src!=rec)
+    memcpy(rec,src,(size_t)num*2*sizeof(cell));
+  for (i=1; i<num; i++)
+    if (rec[2*i]==rec[2*(i-1)])
+      rec[2*i+1]=rec[2*(i-1)+1];
+  if (reljump)
+    for (i=0; i<num; i++)
+      rec[2*i+1]-=offs+2*i*sizeof(cell);
+  return 1;
+}
+
+#if !defined AMX_NO_FUSED_OPC
+#define BIT_SET(map,i)    ((map)[(i)>>3] |= (unsigned char)(1 << ((i) & 7)))
+#define BIT_TEST(map,i)   (((map)[(i)>>3] & (1 << ((i) & 7)))!=0)
+
+/* FusePcode() replaces pairs of instructions that occur frequently by a
+ * single superinstruction, to save a dispatch. Only the opcode of the first
+ * instruction is changed: the superinstruction reads the parameters of both
+ * instructions where they are, and it then skips the second instruction. So
+ * the layout of the code is unchanged and relative jumps stay valid. A pair
+ * is not fused when the second instruction is a jump target. Instructions
+ * after which execution may resume (CALL, SYSREQ, BREAK) are never the first
+ * instruction of a pair.
+ * The "starts" and "targets" bitmaps (one bit per code cell) are filled in by
+ * VerifyPcode(). The function returns the number of superinstructions.
+ */
+static int FusePcode(AMX *amx,const unsigned char *starts,const unsigned char *targets,cell opmask)
+{
+  cell *code=(cell *)amx->code;
+  int num=(int)(amx->codesize/sizeof(cell));
+  int i,next,count;
+  cell op,fused;
+
+  count=0;
+  for (i=0; i<num; i=next) {
+    for (next=i+1; next<num && !BIT_TEST(starts,next); next++)
+      /* nothing */;
+    if (next>=num || BIT_TEST(targets,next))
+      continue;
+    op=code[next] & opmask;
+    fused=0;
+    switch (code[i] & opmask) {
+    case OP_LOAD_S_PRI:
+      if (op==OP_PUSH_PRI)
+        fused=OP_LOAD_S_PUSH;
+      break;
+    case OP_LIDX:
+      if (op==OP_PUSH_PRI)
+        fused=OP_LIDX_PUSH;
+      break;
+    case OP_PUSH_C:
+      if (op==OP_CALL)
+        fused=OP_PUSH_C_CALL;
+      break;
+    case OP_CONST_ALT:
+      if (op>=OP_JEQ && op<=OP_JSGEQ)
+        fused=OP_CONST_ALT_JEQ+(op-OP_JEQ);
+      break;
+#if !defined AMX_NO_PACKED_OPC
+    case OP_LOAD_P_S_PRI:
+      if (op==OP_PUSH_PRI)
+        fused=OP_LOAD_P_S_PUSH;
+      break;
+    case OP_PUSH_P_C:
+      if (op==OP_CALL)
+        fused=OP_PUSH_P_C_CALL;
+      break;
+    case OP_CONST_P_ALT:
+      if (op>=OP_JEQ && op<=OP_JSGEQ)
+        fused=OP_CONST_P_ALT_JEQ+(op-OP_JEQ);
+      break;
+#endif
+    } /* switch */
+    if (fused!=0) {
+      /* keep the packed parameter (if any) of the first instruction */
+      code[i]=(code[i] & ~opmask) | fused;
+      count++;
+      /* the second instruction is skipped, so it cannot start a new pair */
+      for (next++; next<num && !BIT_TEST(starts,next); next++)
+        /* nothing */;
+    } /* if */
+  } /* for */
+  return count;
+}
+
+/* abstract values for ProvePcode(): a range of numbers, or a range of
+ * addresses relative to FRM
+ */
+#define AV_UNKNOWN      0
+#define AV_DATA         1       /* a number, or an address in the data segment */
+#define AV_FRAME        2       /* an address relative to FRM */
+
+typedef struct tagAVALUE {
+  int base;
+  cell lo,hi;
+} AVALUE;
+
+#define MAX_TEMPS       8       /* number of pushed values that are tracked */
+#define DEPTH_UNSET     (-32768)
+#define DEPTH_UNKNOWN   (-32767)
+#define DEPTH_PINNED    (-32766)  /* unknown, after a failed assumption */
+#define MAX_RETRIES     16
+
+typedef struct tagPROVESTATE {
+  AVALUE pri,alt;
+  AVALUE temp[MAX_TEMPS];       /* values pushed on the stack, the last one is on top */
+  cell tempoffs[MAX_TEMPS];     /* addresses of these values, relative to FRM */
+  int numtemps;
+  int depth;                    /* STK-FRM in cells, or DEPTH_UNKNOWN */
+  int reachable;                /* whether the previous instruction falls through */
+  int numcells;                 /* size of the code, in cells */
+  int conflict;                 /* target where an assumed stack depth was wrong, or -1 */
+  cell limit;                   /* ranges beyond +/- limit are dropped */
+  cell datasize,stacksize;
+} PROVESTATE;
+
+static void av_set(const PROVESTATE *ps,AVALUE *v,int base,cell lo,cell hi)
+{
+  if (base==AV_UNKNOWN || lo>hi || lo< -ps->limit || hi>ps->limit) {
+    v->base=AV_UNKNOWN;
+  } else {
+    v->base=base;
+    v->lo=lo;
+    v->hi=hi;
+  } /* if */
+}
+
+/* a+b, where at most one of the two can be an address relative to FRM */
+static void av_add(const PROVESTATE *ps,AVALUE *v,const AVALUE *a,const AVALUE *b)
+{
+  if (a->base==AV_UNKNOWN || b->base==AV_UNKNOWN || a->base==AV_FRAME && b->base==AV_FRAME)
+    v->base=AV_UNKNOWN;
+  else
+    av_set(ps,v,(a->base==AV_FRAME) ? AV_FRAME : b->base,a->lo+b->lo,a->hi+b->hi);
+}
+
+/* a-b, where b must be a number */
+static void av_sub(const PROVESTATE *ps,AVALUE *v,const AVALUE *a,const AVALUE *b)
+{
+  if (a->base==AV_UNKNOWN || b->base!=AV_DATA)
+    v->base=AV_UNKNOWN;
+  else
+    av_set(ps,v,a->base,a->lo-b->hi,a->hi-b->lo);
+}
+
+/* a<<shift, for a number and a small shift */
+static void av_shift(const PROVESTATE *ps,AVALUE *v,const AVALUE *a,cell shift)
+{
+  if (a->base!=AV_DATA || shift<0 || shift>3)
+    v->base=AV_UNKNOWN;
+  else
+    av_set(ps,v,AV_DATA,a->lo*((cell)1<<(int)shift),a->hi*((cell)1<<(int)shift));
+}
+
+/* av_inside() returns whether "size" bytes at the address in "v" are always
+ * valid: either inside the data segment, or between STK and FRM (excluding
+ * the saved frame pointer)
+ */
+static int av_inside(const PROVESTATE *ps,const AVALUE *v,cell size)
+{
+  if (size<=0)
+    return 0;
+  if (v->base==AV_DATA)
+    return v->lo>=0 && v->hi<=ps->datasize-size;
+  if (v->base==AV_FRAME && ps->depth!=DEPTH_UNKNOWN)
+    return v->lo>=(cell)ps->depth*(cell)sizeof(cell) && v->lo>= -ps->stacksize && v->hi<= -size;
+  return 0;
+}
+
+static void setdepth(PROVESTATE *ps,long depth)
+{
+  if (ps->depth==DEPTH_UNKNOWN || depth<=DEPTH_UNKNOWN || depth>32767) {
+    ps->depth=DEPTH_UNKNOWN;
+    ps->numtemps=0;
+  } else {
+    ps->depth=(int)depth;
+    /* drop the values that were popped off the stack */
+    while (ps->numtemps>0 && ps->tempoffs[ps->numtemps-1]<(cell)ps->depth*(cell)sizeof(cell))
+      ps->numtemps--;
+  } /* if */
+}
+
+/* adjust the stack depth by a number of bytes */
+static void adjustdepth(PROVESTATE *ps,cell bytes)
+{
+  if (bytes % (cell)sizeof(cell)!=0 || bytes< -ps->limit || bytes>ps->limit)
+    setdepth(ps,DEPTH_UNKNOWN);
+  else
+    setdepth(ps,(long)ps->depth+(long)(bytes/(cell)sizeof(cell)));
+}
+
+/* push a value, the stack depth must already have been adjusted */
+static void pushtemp(PROVESTATE *ps,const AVALUE *v)
+{
+  if (ps->depth==DEPTH_UNKNOWN || v->base==AV_UNKNOWN)
+    return;
+  if (ps->numtemps==MAX_TEMPS) {
+    memmove(ps->temp,ps->temp+1,(MAX_TEMPS-1)*sizeof(AVALUE));
+    memmove(ps->tempoffs,ps->tempoffs+1,(MAX_TEMPS-1)*sizeof(cell));
+    ps->numtemps--;
+  } /* if */
+  ps->temp[ps->numtemps]=*v;
+  ps->tempoffs[ps->numtemps]=(cell)ps->depth*(cell)sizeof(cell);
+  ps->numtemps++;
+}
+
+/* pop a value, before the stack depth is adjusted */
+static void poptemp(PROVESTATE *ps,AVALUE *v)
+{
+  if (ps->depth!=DEPTH_UNKNOWN && ps->numtemps>0
+      && ps->tempoffs[ps->numtemps-1]==(cell)ps->depth*(cell)sizeof(cell))
+    *v=ps->temp[--ps->numtemps];
+  else
+    v->base=AV_UNKNOWN;
+}
+
+/* forget the pushed values that a memory write may change; "v" is the
+ * address range and "size" the number of bytes written at each address
+ */
+static void clobber(PROVESTATE *ps,const AVALUE *v,cell size)
+{
+  int i;
+
+  if (v->base==AV_DATA)
+    return;             /* the data segment holds no pushed values */
+  for (i=0; i<ps->numtemps; i++)
+    if (v->base==AV_UNKNOWN
+        || ps->tempoffs[i]>v->lo-(cell)sizeof(cell) && ps->tempoffs[i]<v->hi+size)
+      ps->temp[i].base=AV_UNKNOWN;
+}
+
+/* mergedepth() records the stack depth at the target of a jump; it returns
+ * 0 if the target is not the start of an instruction; a backward jump that
+ * conflicts with the depth that was assumed at the target is noted in the
+ * "conflict" field
+ */
+static int mergedepth(PROVESTATE *ps,int16_t *depths,const unsigned char *starts,int from,cell target,int depth)
+{
+  int to;
+
+  if (target<0 || target % (cell)sizeof(cell)!=0)
+    return 0;
+  to=(int)(target/sizeof(cell));
+  if (to>=ps->numcells || !BIT_TEST(starts,to))
+    return 0;
+  if (to<=from) {
+    if (depths[to]!=DEPTH_UNKNOWN && depths[to]!=DEPTH_PINNED && depths[to]!=depth && ps->conflict<0)
+      ps->conflict=to;
+  } else if (depths[to]==DEPTH_UNSET) {
+    depths[to]=(int16_t)depth;
+  } else if (depths[to]!=depth && depths[to]!=DEPTH_PINNED) {
+    depths[to]=DEPTH_UNKNOWN;
+  } /* if */
+  return 1;
+}
+
+/* ProvePcode() runs an abstract interpretation over the verified code, to
+ * find the memory accesses whose address check can be dropped. It tracks the
+ * value ranges of PRI, ALT and of the values pushed on the stack, as numbers
+ * or as addresses relative to FRM, plus the stack depth (STK-FRM) at every
+ * instruction. An index gets a range from a BOUNDS instruction, so what is
+ * proven are accesses to arrays at a known address: global arrays and local
+ * arrays of the current function. These are replaced by the unchecked
+ * instructions. The register state is dropped at jump targets and after
+ * calls; the stack depth is merged at jump targets. Code that is only reached
+ * by a backward jump (typically the increment of a "for" loop) is assumed to
+ * start at the stack depth of the code before it; when a backward jump
+ * disagrees, the first pass is redone with an unknown depth at that target.
+ * As with LOAD.S and STOR.S, FRM is trusted; an unchecked access relative to
+ * FRM never goes more than "stacksize" bytes below it.
+ * The function makes two passes: the first one verifies the jumps, the
+ * second one replaces the instructions. The "starts" and "targets" bitmaps
+ * are those of FusePcode(), and "depths" has an entry per code cell. The
+ * function returns the number of instructions that were replaced.
+ */
+static int ProvePcode(AMX *amx,const unsigned char *starts,const unsigned char *targets,int16_t *depths,cell opmask)
+{
+  AMX_HEADER *hdr=(AMX_HEADER *)amx->base;
+  cell *code=(cell *)amx->code;
+  int num=(int)(amx->codesize/sizeof(cell));
+  PROVESTATE ps;
+  AVALUE v,w;
+  int pass,retries,i,k,next,count,cellshift;
+  cell op,p,pp,nc,tgt;
+
+  memset(&ps,0,sizeof ps);
+  ps.datasize=hdr->hea-hdr->dat;
+  ps.stacksize=hdr->stp-hdr->hea;
+  ps.limit=hdr->stp-hdr->dat;
+  ps.numcells=num;
+  if (ps.limit>(cell)(((ucell)~(ucell)0 >> 1)/16))
+    return 0;   /* ranges could overflow */
+  for (cellshift=0; ((cell)1 << cellshift)<(cell)sizeof(cell); cellshift++)
+    /* nothing */;
+
+  for (i=0; i<num; i++)
+    depths[i]=DEPTH_UNSET;
+  count=0;
+  retries=0;
+  for (pass=0; pass<2; pass++) {
+    for (i=0; i<num; i++)
+      if (depths[i]!=DEPTH_PINNED)
+        depths[i]=DEPTH_UNSET;
+    ps.reachable=0;
+    ps.conflict=-1;
+    count=0;
+    for (i=0; i<num; i=next) {
+      for (next=i+1; next<num && !BIT_TEST(starts,next); next++)
+        /* nothing */;
+      if (BIT_TEST(targets,i)) {
+        /* merge the stack depth of the jumps with that of the fall-through */
+        k=depths[i];
+        if (k==DEPTH_PINNED)
+          k=DEPTH_UNKNOWN;
+        else if (k==DEPTH_UNSET)
+          depths[i]=(int16_t)(k=ps.depth);
+        else if (ps.reachable && k!=ps.depth)
+          depths[i]=(int16_t)(k=DEPTH_UNKNOWN);
+        ps.depth=k;
+        ps.pri.base=ps.alt.base=AV_UNKNOWN;
+        ps.numtemps=0;
+      } else if (!ps.reachable) {
+        ps.depth=DEPTH_UNKNOWN;
+        ps.pri.base=ps.alt.base=AV_UNKNOWN;
+        ps.numtemps=0;
+      } /* if */
+      ps.reachable=1;
+      op=code[i] & opmask;
+      p=(next>i+1) ? code[i+1] : 0;
+      #if defined AMX_NO_PACKED_OPC
+        pp=0;
+      #else
+        GETPARAM_P(pp,code[i]);
+      #endif
+      nc=0;
+      switch (op) {
+      /* function entry and exit, calls and jumps */
+      case OP_PROC:
+        ps.depth=0;
+        ps.numtemps=0;
+        break;
+      case OP_RET:
+      case OP_RETN:
+        ps.reachable=0;
+        break;
+      case OP_CALL:
+        /* the stack depth at the target is not known (a function entry
+         * resets it)
+         */
+        if (!mergedepth(&ps,depths,starts,i,(cell)(i*sizeof(cell))+p,DEPTH_UNKNOWN))
+          return 0;
+        /* the function removes its arguments and the argument count */
+        poptemp(&ps,&v);
+        if (v.base==AV_DATA && v.lo==v.hi)
+          adjustdepth(&ps,v.lo+(cell)sizeof(cell));
+        else
+          setdepth(&ps,DEPTH_UNKNOWN);
+        ps.pri.base=ps.alt.base=AV_UNKNOWN;
+        ps.numtemps=0;
+        break;
+      case OP_JUMP:
+        ps.reachable=0;
+        /* drop through */
+      case OP_JZER:
+      case OP_JNZ:
+      case OP_JEQ:
+      case OP_JNEQ:
+      case OP_JSLESS:
+      case OP_JSLEQ:
+      case OP_JSGRTR:
+      case OP_JSGEQ:
+        if (!mergedepth(&ps,depths,starts,i,(cell)(i*sizeof(cell))+p,ps.depth))
+          return 0;
+        break;
+      case OP_SWITCH:
+        /* the parameter points to the case table */
+        tgt=(cell)(i*sizeof(cell))+p;
+        if (tgt<0 || tgt>=(cell)amx->codesize || tgt % (cell)sizeof(cell)!=0)
+          return 0;
+        tgt/=(cell)sizeof(cell);
+        if (!BIT_TEST(starts,(int)tgt) || (code[tgt] & opmask)!=OP_CASETBL)
+          return 0;
+        for (k=0; k<=code[tgt+1]; k++) {
+          cell rec=tgt+2+2*k;
+          if (!mergedepth(&ps,depths,starts,i,(rec-1)*(cell)sizeof(cell)+code[rec],ps.depth))
+            return 0;
+        } /* for */
+        ps.reachable=0;
+        break;
+      case OP_CASETBL:
+        ps.reachable=0;
+        break;
+      case OP_HALT:
+      case OP_BREAK:
+      case OP_SYSREQ:
+#if !defined AMX_NO_PACKED_OPC
+      case OP_HALT_P:
+#endif
+        /* the host may change registers and memory */
+        ps.pri.base=ps.alt.base=AV_UNKNOWN;
+        ps.numtemps=0;
+        break;
+      case OP_SYSREQ_N:
+        ps.pri.base=ps.alt.base=AV_UNKNOWN;
+        ps.numtemps=0;
+        adjustdepth(&ps,code[i+2]);
+        break;
+
+      /* stack */
+      case OP_PUSH_PRI:
+      case OP_PUSH_ALT:
+        adjustdepth(&ps,-(cell)sizeof(cell));
+        pushtemp(&ps,(op==OP_PUSH_PRI) ? &ps.pri : &ps.alt);
+        break;
+      case OP_PUSH_C:
+      case OP_PUSH_ADR:
+        adjustdepth(&ps,-(cell)sizeof(cell));
+        av_set(&ps,&v,(op==OP_PUSH_C) ? AV_DATA : AV_FRAME,p,p);
+        pushtemp(&ps,&v);
+        break;
+      case OP_PUSHR_PRI:
+      case OP_PUSH:
+      case OP_PUSH_S:
+      case OP_PUSHR_C:
+      case OP_PUSHR_S:
+      case OP_PUSHR_ADR:
+        adjustdepth(&ps,-(cell)sizeof(cell));
+        break;
+      case OP_PUSHM_C:
+      case OP_PUSHM:
+      case OP_PUSHM_S:
+      case OP_PUSHM_ADR:
+      case OP_PUSHRM_C:
+      case OP_PUSHRM_S:
+      case OP_PUSHRM_ADR:
+        adjustdepth(&ps,-p*(cell)sizeof(cell));
+        break;
+      case OP_POP_PRI:
+        poptemp(&ps,&ps.pri);
+        adjustdepth(&ps,sizeof(cell));
+        break;
+      case OP_POP_ALT:
+        poptemp(&ps,&ps.alt);
+        adjustdepth(&ps,sizeof(cell));
+        break;
+      case OP_SWAP_PRI:
+      case OP_SWAP_ALT:
+        poptemp(&ps,&v);
+        pushtemp(&ps,(op==OP_SWAP_PRI) ? &ps.pri : &ps.alt);
+        if (op==OP_SWAP_PRI)
+          ps.pri=v;
+        else
+          ps.alt=v;
+        break;
+      case OP_STACK:
+        ps.alt.base=AV_UNKNOWN;
+        adjustdepth(&ps,p);
+        break;
+      case OP_SCTRL:
+        if (p==4 || p==5)
+          setdepth(&ps,DEPTH_UNKNOWN);
+        break;
+
+      /* register values and address arithmetic */
+      case OP_CONST_PRI:
+      case OP_ZERO_PRI:
+        av_set(&ps,&ps.pri,AV_DATA,(op==OP_CONST_PRI) ? p : 0,(op==OP_CONST_PRI) ? p : 0);
+        break;
+      case OP_CONST_ALT:
+      case OP_ZERO_ALT:
+        av_set(&ps,&ps.alt,AV_DATA,(op==OP_CONST_ALT) ? p : 0,(op==OP_CONST_ALT) ? p : 0);
+        break;
+      case OP_ADDR_PRI:
+        av_set(&ps,&ps.pri,AV_FRAME,p,p);
+        break;
+      case OP_ADDR_ALT:
+        av_set(&ps,&ps.alt,AV_FRAME,p,p);
+        break;
+      case OP_XCHG:
+        v=ps.pri;
+        ps.pri=ps.alt;
+        ps.alt=v;
+        break;
+      case OP_BOUNDS:
+        /* after the check, PRI is between 0 and the parameter */
+        if (p<0)
+          ps.pri.base=AV_UNKNOWN;
+        else if (ps.pri.base==AV_DATA && ps.pri.lo>=0 && ps.pri.hi<=p)
+          break;
+        else
+          av_set(&ps,&ps.pri,AV_DATA,0,p);
+        break;
+      case OP_IDXADDR:
+      case OP_IDXADDR_B:
+        av_shift(&ps,&v,&ps.pri,(op==OP_IDXADDR) ? cellshift : p);
+        av_add(&ps,&ps.pri,&v,&ps.alt);
+        break;
+      case OP_ADD:
+        av_add(&ps,&ps.pri,&ps.pri,&ps.alt);
+        break;
+      case OP_SUB:
+        av_sub(&ps,&ps.pri,&ps.alt,&ps.pri);
+        break;
+      case OP_SUB_INV:
+        av_sub(&ps,&ps.pri,&ps.pri,&ps.alt);
+        break;
+      case OP_ADD_C:
+      case OP_INC_PRI:
+      case OP_DEC_PRI:
+        av_set(&ps,&v,AV_DATA,(op==OP_ADD_C) ? p : (op==OP_INC_PRI) ? 1 : -1,(op==OP_ADD_C) ? p : (op==OP_INC_PRI) ? 1 : -1);
+        av_add(&ps,&ps.pri,&ps.pri,&v);
+        break;
+      case OP_INC_ALT:
+      case OP_DEC_ALT:
+        av_set(&ps,&v,AV_DATA,(op==OP_INC_ALT) ? 1 : -1,(op==OP_INC_ALT) ? 1 : -1);
+        av_add(&ps,&ps.alt,&ps.alt,&v);
+        break;
+      case OP_SHL_C_PRI:
+        av_shift(&ps,&ps.pri,&ps.pri,p);
+        break;
+      case OP_SHL_C_ALT:
+        av_shift(&ps,&ps.alt,&ps.alt,p);
+        break;
+      case OP_ALIGN_PRI:
+        /* the low bits of PRI may be flipped */
+        if (ps.pri.base==AV_DATA && ps.pri.lo>=0)
+          av_set(&ps,&ps.pri,AV_DATA,ps.pri.lo & ~((cell)sizeof(cell)-1),ps.pri.hi | ((cell)sizeof(cell)-1));
+        else
+          av_set(&ps,&ps.pri,ps.pri.base,ps.pri.lo-((cell)sizeof(cell)-1),ps.pri.hi+((cell)sizeof(cell)-1));
+        break;
+
+      /* memory accesses through PRI or ALT */
+      case OP_LOAD_I:
+        if (av_inside(&ps,&ps.pri,sizeof(cell)))
+          nc=OP_LOAD_I_NC;
+        ps.pri.base=AV_UNKNOWN;
+        break;
+      case OP_LODB_I:
+        if (av_inside(&ps,&ps.pri,p))
+          nc=OP_LODB_I_NC;
+        ps.pri.base=AV_UNKNOWN;
+        break;
+      case OP_STOR_I:
+      case OP_STRB_I:
+        v=ps.alt;
+        if (!av_inside(&ps,&v,(op==OP_STOR_I) ? (cell)sizeof(cell) : p))
+          v.base=AV_UNKNOWN;
+        else
+          nc=(op==OP_STOR_I) ? OP_STOR_I_NC : OP_STRB_I_NC;
+        clobber(&ps,&v,(op==OP_STOR_I) ? (cell)sizeof(cell) : p);
+        break;
+      case OP_LIDX:
+      case OP_LIDX_B:
+        av_shift(&ps,&v,&ps.pri,(op==OP_LIDX) ? cellshift : p);
+        av_add(&ps,&v,&v,&ps.alt);
+        if (av_inside(&ps,&v,sizeof(cell)))
+          nc=(op==OP_LIDX) ? OP_LIDX_NC : OP_LIDX_B_NC;
+        ps.pri.base=AV_UNKNOWN;
+        break;
+      case OP_MOVS:
+      case OP_CMPS:
+        v=ps.alt;
+        if (!av_inside(&ps,&ps.pri,p) || !av_inside(&ps,&v,p))
+          v.base=AV_UNKNOWN;
+        else
+          nc=(op==OP_MOVS) ? OP_MOVS_NC : OP_CMPS_NC;
+        if (op==OP_MOVS)
+          clobber(&ps,&v,p);
+        else
+          ps.pri.base=AV_UNKNOWN;
+        break;
+      case OP_FILL:
+        v=ps.alt;
+        if (!av_inside(&ps,&v,p))
+          v.base=AV_UNKNOWN;
+        else
+          nc=OP_FILL_NC;
+        clobber(&ps,&v,p);
+        break;
+
+      /* writes to the stack frame or to an unknown address */
+      case OP_STOR_S:
+      case OP_ZERO_S:
+      case OP_INC_S:
+      case OP_DEC_S:
+      case OP_CONST_S:
+        av_set(&ps,&v,AV_FRAME,p,p);
+        clobber(&ps,&v,sizeof(cell));
+        break;
+      case OP_SREF_S:
+      case OP_INC_I:
+      case OP_DEC_I:
+        v.base=AV_UNKNOWN;
+        clobber(&ps,&v,sizeof(cell));
+        break;
+
+      case OP_STOR:
+      case OP_ZERO:
+      case OP_INC:
+      case OP_DEC:
+      case OP_CONST:
+        /* a fixed address may still lie on the stack */
+        av_set(&ps,&v,AV_DATA,p,p);
+        if (!av_inside(&ps,&v,sizeof(cell))) {
+          v.base=AV_UNKNOWN;
+          clobber(&ps,&v,sizeof(cell));
+        } /* if */
+        break;
+
+      /* instructions that change neither PRI and ALT, nor the stack */
+      case OP_NOP:
+        break;
+
+      /* instructions that change only PRI */
+      case OP_LOAD_PRI:
+      case OP_LOAD_S_PRI:
+      case OP_LREF_S_PRI:
+      case OP_LCTRL:
+      case OP_PICK:
+      case OP_SHL:
+      case OP_SHR:
+      case OP_SSHR:
+      case OP_SMUL:
+      case OP_AND:
+      case OP_OR:
+      case OP_XOR:
+      case OP_NOT:
+      case OP_NEG:
+      case OP_INVERT:
+      case OP_EQ:
+      case OP_NEQ:
+      case OP_SLESS:
+      case OP_SLEQ:
+      case OP_SGRTR:
+      case OP_SGEQ:
+      case OP_SMUL_C:
+      case OP_EQ_C_PRI:
+        ps.pri.base=AV_UNKNOWN;
+        break;
+
+      /* instructions that change only ALT */
+      case OP_LOAD_ALT:
+      case OP_LOAD_S_ALT:
+      case OP_LREF_S_ALT:
+      case OP_HEAP:
+      case OP_EQ_C_ALT:
+        ps.alt.base=AV_UNKNOWN;
+        break;
+
+#if !defined AMX_NO_PACKED_OPC
+      /* packed instructions, with the parameter in the opcode cell */
+      case OP_PUSH_P_C:
+      case OP_PUSH_P_ADR:
+        adjustdepth(&ps,-(cell)sizeof(cell));
+        av_set(&ps,&v,(op==OP_PUSH_P_C) ? AV_DATA : AV_FRAME,pp,pp);
+        pushtemp(&ps,&v);
+        break;
+      case OP_PUSH_P:
+      case OP_PUSH_P_S:
+      case OP_PUSHR_P_C:
+      case OP_PUSHR_P_S:
+      case OP_PUSHR_P_ADR:
+        adjustdepth(&ps,-(cell)sizeof(cell));
+        break;
+      case OP_PUSHM_P_C:
+      case OP_PUSHM_P:
+      case OP_PUSHM_P_S:
+      case OP_PUSHM_P_ADR:
+      case OP_PUSHRM_P_C:
+      case OP_PUSHRM_P_S:
+      case OP_PUSHRM_P_ADR:
+        adjustdepth(&ps,-pp*(cell)sizeof(cell));
+        break;
+      case OP_STACK_P:
+        ps.alt.base=AV_UNKNOWN;
+        adjustdepth(&ps,pp);
+        break;
+      case OP_CONST_P_PRI:
+        av_set(&ps,&ps.pri,AV_DATA,pp,pp);
+        break;
+      case OP_CONST_P_ALT:
+        av_set(&ps,&ps.alt,AV_DATA,pp,pp);
+        break;
+      case OP_ADDR_P_PRI:
+        av_set(&ps,&ps.pri,AV_FRAME,pp,pp);
+        break;
+      case OP_ADDR_P_ALT:
+        av_set(&ps,&ps.alt,AV_FRAME,pp,pp);
+        break;
+      case OP_BOUNDS_P:
+        if (pp<0)
+          ps.pri.base=AV_UNKNOWN;
+        else if (ps.pri.base!=AV_DATA || ps.pri.lo<0 || ps.pri.hi>pp)
+          av_set(&ps,&ps.pri,AV_DATA,0,pp);
+        break;
+      case OP_IDXADDR_P_B:
+        av_shift(&ps,&v,&ps.pri,pp);
+        av_add(&ps,&ps.pri,&v,&ps.alt);
+        break;
+      case OP_ADD_P_C:
+        av_set(&ps,&v,AV_DATA,pp,pp);
+        av_add(&ps,&ps.pri,&ps.pri,&v);
+        break;
+      case OP_SHL_P_C_PRI:
+        av_shift(&ps,&ps.pri,&ps.pri,pp);
+        break;
+      case OP_SHL_P_C_ALT:
+        av_shift(&ps,&ps.alt,&ps.alt,pp);
+        break;
+      case OP_ALIGN_P_PRI:
+        if (ps.pri.base==AV_DATA && ps.pri.lo>=0)
+          av_set(&ps,&ps.pri,AV_DATA,ps.pri.lo & ~((cell)sizeof(cell)-1),ps.pri.hi | ((cell)sizeof(cell)-1));
+        else
+          av_set(&ps,&ps.pri,ps.pri.base,ps.pri.lo-((cell)sizeof(cell)-1),ps.pri.hi+((cell)sizeof(cell)-1));
+        break;
+      case OP_LODB_P_I:
+        if (av_inside(&ps,&ps.pri,pp))
+          nc=OP_LODB_P_I_NC;
+        ps.pri.base=AV_UNKNOWN;
+        break;
+      case OP_STRB_P_I:
+        v=ps.alt;
+        if (!av_inside(&ps,&v,pp))
+          v.base=AV_UNKNOWN;
+        else
+          nc=OP_STRB_P_I_NC;
+        clobber(&ps,&v,pp);
+        break;
+      case OP_LIDX_P_B:
+        av_shift(&ps,&v,&ps.pri,pp);
+        av_add(&ps,&v,&v,&ps.alt);
+        if (av_inside(&ps,&v,sizeof(cell)))
+          nc=OP_LIDX_P_B_NC;
+        ps.pri.base=AV_UNKNOWN;
+        break;
+      case OP_MOVS_P:
+      case OP_CMPS_P:
+        v=ps.alt;
+        if (!av_inside(&ps,&ps.pri,pp) || !av_inside(&ps,&v,pp))
+          v.base=AV_UNKNOWN;
+        else
+          nc=(op==OP_MOVS_P) ? OP_MOVS_P_NC : OP_CMPS_P_NC;
+        if (op==OP_MOVS_P)
+          clobber(&ps,&v,pp);
+        else
+          ps.pri.base=AV_UNKNOWN;
+        break;
+      case OP_FILL_P:
+        v=ps.alt;
+        if (!av_inside(&ps,&v,pp))
+          v.base=AV_UNKNOWN;
+        else
+          nc=OP_FILL_P_NC;
+        clobber(&ps,&v,pp);
+        break;
+      case OP_STOR_P_S:
+      case OP_ZERO_P_S:
+      case OP_INC_P_S:
+      case OP_DEC_P_S:
+        av_set(&ps,&v,AV_FRAME,pp,pp);
+        clobber(&ps,&v,sizeof(cell));
+        break;
+      case OP_SREF_P_S:
+        v.base=AV_UNKNOWN;
+        clobber(&ps,&v,sizeof(cell));
+        break;
+      case OP_STOR_P:
+      case OP_ZERO_P:
+      case OP_INC_P:
+      case OP_DEC_P:
+        av_set(&ps,&v,AV_DATA,pp,pp);
+        if (!av_inside(&ps,&v,sizeof(cell))) {
+          v.base=AV_UNKNOWN;
+          clobber(&ps,&v,sizeof(cell));
+        } /* if */
+        break;
+      case OP_LOAD_P_PRI:
+      case OP_LOAD_P_S_PRI:
+      case OP_LREF_P_S_PRI:
+      case OP_SMUL_P_C:
+      case OP_EQ_P_C_PRI:
+        ps.pri.base=AV_UNKNOWN;
+        break;
+      case OP_LOAD_P_ALT:
+      case OP_LOAD_P_S_ALT:
+      case OP_LREF_P_S_ALT:
+      case OP_HEAP_P:
+      case OP_EQ_P_C_ALT:
+        ps.alt.base=AV_UNKNOWN;
+        break;
+#endif
+
+      default:
+        /* anything else (LOAD2, SDIV, ...): forget all but the stack depth */
+        ps.pri.base=ps.alt.base=AV_UNKNOWN;
+        w.base=AV_UNKNOWN;
+        clobber(&ps,&w,sizeof(cell));
+        break;
+      } /* switch */
+      if (nc!=0) {
+        if (pass>0)
+          code[i]=(code[i] & ~opmask) | nc;
+        count++;
+      } /* if */
+    } /* for */
+    if (ps.conflict>=0) {
+      /* only the first pass can fail, the second one takes the same path */
+      assert(pass==0);
+      if (++retries>MAX_RETRIES)
+        return 0;
+      depths[ps.conflict]=DEPTH_PINNED;
+      pass=-1;
+    } /* if */
+  } /* for */
+  return count;
+}
+#endif /* !AMX_NO_FUSED_OPC */
+
 static int VerifyPcode(AMX *amx)
 {
   AMX_HEADER *hdr;
@@ -625,6 +1602,12 @@ static int VerifyPcode(AMX *amx)
   int sysreq_flg,max_opcode;
   int datasize,stacksize;
   const cell *opcode_list;
+  unsigned char *scratch;
+  int scratchsize;
+  #if !defined AMX_NO_FUSED_OPC
+    unsigned char *starts=NULL,*targets=NULL;
+    int mapsize=0;
+  #endif
   #if defined AMX_JIT
     int opcode_count=0;
     int reloc_count=0;
@@ -639,7 +1622,7 @@ static int VerifyPcode(AMX *amx)
   datasize=hdr->hea-hdr->dat;
   stacksize=hdr->stp-hdr->hea;
 
-  #if defined AMX_ASM && defined AMX_JIT
+  #if defined AMX_ASM && defined AMX_JIT || defined AMX_JIT_X64
     if ((amx->flags & AMX_FLAG_JITC)!=0)
       jit_codesize=amx_jit_list(amx,&opcode_list,&max_opcode);
     else
@@ -660,6 +1643,7 @@ static int VerifyPcode(AMX *amx)
 
   /* sanity checks */
   assert_static(OP_XCHG==21);
+  assert_static(OP_CALL==33);   /* see RETSITE() in AMXEXEC_GCC.C */
   assert_static(OP_SMUL==42);
   assert_static(OP_MOVS==64);
   #if !defined AMX_NO_MACRO_INSTR
@@ -687,6 +1671,40 @@ static int VerifyPcode(AMX *amx)
   } /* if */
   amx->sysreq_d=0;      /* preset */
 
+  #if !defined AMX_NO_FUSED_OPC
+    /* fusing instructions and dropping memory checks needs bitmaps of the
+     * instruction starts and of the jump targets; these are built in the
+     * stack/heap area of the data segment, which is not in use yet; both are
+     * skipped if the code is to be JIT-compiled, if it uses overlays, if the
+     * core does not support the extra instructions, or if the stack/heap area
+     * is too small
+     */
+    amx->fused=0;
+    amx->unchecked=0;
+    if ((amx->flags & (AMX_FLAG_FUSE | AMX_FLAG_PROVE))!=0
+        && (amx->flags & AMX_FLAG_JITC)==0
+        && opcode_list==NULL && max_opcode>=OP_NUM_FUSED
+        && (hdr->flags & AMX_FLAG_OVERLAY)==0) {
+      mapsize=(int)(amx->codesize/sizeof(cell))/8 + 1;
+      if (2*mapsize<=stacksize-(int)sizeof(cell)) {
+        starts=((amx->data!=NULL) ? amx->data : amx->base+(int)hdr->dat) + datasize;
+        targets=starts+mapsize;
+        memset(starts,0,2*mapsize);
+      } /* if */
+    } /* if */
+  #endif
+
+  /* the rest of the stack/heap area is scratch memory for SortCaseTable() */
+  scratch=((amx->data!=NULL) ? amx->data : amx->base+(int)hdr->dat) + datasize;
+  scratchsize=stacksize;
+  #if !defined AMX_NO_FUSED_OPC
+    if (starts!=NULL) {
+      int used=(2*mapsize+(int)sizeof(cell)-1) & ~((int)sizeof(cell)-1);
+      scratch+=used;
+      scratchsize-=used;
+    } /* if */
+  #endif
+
   /* start browsing code */
   assert(amx->code!=NULL);  /* should already have been set in amx_Init() */
   for (cip=0; cip<amx->codesize; ) {
@@ -695,6 +1713,18 @@ static int VerifyPcode(AMX *amx)
       amx->flags &= ~AMX_FLAG_VERIFY;
       return AMX_ERR_INVINSTR;
     } /* if */
+    #if !defined AMX_NO_FUSED_OPC
+      if (starts!=NULL) {
+        BIT_SET(starts,(int)(cip/sizeof(cell)));
+        /* code that reads or sets CIP may jump anywhere, so do not fuse */
+        if (((op & opmask)==OP_LCTRL || (op & opmask)==OP_SCTRL)
+            && cip+sizeof(cell)<(ucell)amx->codesize
+            && *(cell *)(amx->code+(int)cip+sizeof(cell))==6) {
+          memset(starts,0,2*mapsize);
+          starts=NULL;
+        } /* if */
+      } /* if */
+    #endif
     /* relocate opcode (only works if the size of an opcode is at least
      * as big as the size of a pointer (jump address); so basically we
      * rely on the opcode and a pointer being 32-bit
@@ -800,13 +1830,20 @@ static int VerifyPcode(AMX *amx)
     case OP_ZERO_P_S:
     case OP_EQ_P_C_PRI:
     case OP_EQ_P_C_ALT:
-    case OP_MOVS_P:
-    case OP_CMPS_P:
-    case OP_FILL_P:
     case OP_HALT_P:
     case OP_BOUNDS_P:
       break;
 
+    case OP_MOVS_P:     /* block instructions with the size packed inside the same cell */
+    case OP_CMPS_P:
+    case OP_FILL_P:
+      GETPARAM_P(tgt,op); /* verify size, see OP_MOVS below */
+      if (tgt<0) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_BOUNDS;
+      } /* if */
+      break;
+
     case OP_LOAD_P_PRI: /* data instructions with 1 parameter packed inside the same cell */
     case OP_LOAD_P_ALT:
     case OP_STOR_P:
@@ -860,9 +1897,6 @@ static int VerifyPcode(AMX *amx)
     case OP_HEAP:
     case OP_SHL_C_PRI:
     case OP_SHL_C_ALT:
-    case OP_MOVS:
-    case OP_CMPS:
-    case OP_FILL:
     case OP_HALT:
     case OP_BOUNDS:
 #if !defined AMX_NO_MACRO_INSTR
@@ -882,10 +1916,24 @@ static int VerifyPcode(AMX *amx)
       cip+=sizeof(cell);
       break;
 
-    case OP_LOAD_PRI:
-    case OP_LOAD_ALT:
-    case OP_STOR:
-#if !defined AMX_NO_MACRO_INSTR
+    case OP_MOVS:
+    case OP_CMPS:
+    case OP_FILL:
+      /* verify size; the cores check the range of the block only at its two
+       * ends, so the size may not be negative
+       */
+      tgt=*(cell*)(amx->code+(int)cip);
+      if (tgt<0) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_BOUNDS;
+      } /* if */
+      cip+=sizeof(cell);
+      break;
+
+    case OP_LOAD_PRI:
+    case OP_LOAD_ALT:
+    case OP_STOR:
+#if !defined AMX_NO_MACRO_INSTR
     case OP_PUSH:
     case OP_INC:
     case OP_DEC:
@@ -986,8 +2034,14 @@ static int VerifyPcode(AMX *amx)
         amx->flags &= ~AMX_FLAG_VERIFY;
         return AMX_ERR_BOUNDS;
       } /* if */
+      #if !defined AMX_NO_FUSED_OPC
+        if (starts!=NULL)
+          BIT_SET(targets,(int)(tgt/sizeof(cell)));
+      #endif
       #if defined AMX_JIT
         reloc_count++;
+      #endif
+      #if defined AMX_JIT && !defined AMX_JIT_X64
         RELOC_ABS(amx->code, cip);  /* change to absolute physical address */
       #endif
       cip+=sizeof(cell);
@@ -1018,6 +2072,14 @@ static int VerifyPcode(AMX *amx)
     case OP_CASETBL_OVL: {
       cell num;
       DBGPARAM(num);    /* number of records follows the opcode */
+      if (!CaseTableFits(amx,cip,num)) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_BOUNDS;
+      } /* if */
+      if (!SortCaseTable(amx->code, cip+sizeof(cell), num, 0, (cell *)scratch, scratchsize)) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_INVINSTR;
+      } /* if */
       cip+=(2*num + 1)*sizeof(cell);
       if (amx->overlay==NULL)
         return AMX_ERR_OVERLAY;       /* no overlay callback */
@@ -1040,6 +2102,14 @@ static int VerifyPcode(AMX *amx)
       cell num,offs;
       int i;
       DBGPARAM(num);    /* number of records follows the opcode */
+      if (!CaseTableFits(amx,cip,num)) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_BOUNDS;
+      } /* if */
+      if (!SortCaseTable(amx->code, cip+sizeof(cell), num, 1, (cell *)scratch, scratchsize)) {
+        amx->flags &= ~AMX_FLAG_VERIFY;
+        return AMX_ERR_INVINSTR;
+      } /* if */
       for (i=0; i<=num; i++) {
         offs=cip+2*i*sizeof(cell);
         tgt=*(cell*)(amx->code+(int)offs)+offs-sizeof(cell);
@@ -1047,10 +2117,16 @@ static int VerifyPcode(AMX *amx)
           amx->flags &= ~AMX_FLAG_VERIFY;
           return AMX_ERR_BOUNDS;
         } /* if */
+        #if !defined AMX_NO_FUSED_OPC
+          if (starts!=NULL)
+            BIT_SET(targets,(int)(tgt/sizeof(cell)));
+        #endif
         #if defined AMX_JIT
-          RELOC_ABS(amx->code, cip+2*i*sizeof(cell));
           reloc_count++;
         #endif
+        #if defined AMX_JIT && !defined AMX_JIT_X64
+          RELOC_ABS(amx->code, cip+2*i*sizeof(cell));
+        #endif
       } /* for */
       cip+=(2*num + 1)*sizeof(cell);
       break;
@@ -1062,11 +2138,13 @@ static int VerifyPcode(AMX *amx)
     } /* switch */
   } /* for */
 
-  #if !defined AMX_DONT_RELOCATE
+  #if !defined AMX_DONT_RELOCATE && !defined AMX_PROFILE
     /* only either type of system request opcode should be found (otherwise,
-     * we probably have a non-conforming compiler
+     * we probably have a non-conforming compiler; read-only code must not be
+     * patched by amx_Callback(); the profiler needs the native function's
+     * index, so SYSREQ is not patched in that case either
      */
-    if ((sysreq_flg==0x01 || sysreq_flg==0x02) && (amx->flags & AMX_FLAG_JITC)==0) {
+    if ((sysreq_flg==0x01 || sysreq_flg==0x02) && (amx->flags & (AMX_FLAG_JITC | AMX_FLAG_ROCODE))==0) {
       /* to use direct system requests, a function pointer must fit in a cell;
        * because the native function's address will be stored as the parameter
        * of SYSREQ.(N)D
@@ -1080,7 +2158,33 @@ static int VerifyPcode(AMX *amx)
     } /* if */
   #endif
 
-  #if defined AMX_JIT
+  #if !defined AMX_NO_FUSED_OPC
+    if (starts!=NULL) {
+      int depthsize=0;
+      if ((amx->flags & AMX_FLAG_PROVE)!=0) {
+        /* the stack depths (16-bit, per code cell) go after the bitmaps */
+        int16_t *depths=(int16_t *)(starts+((2*mapsize+1) & ~1));
+        if (((2*mapsize+1) & ~1)+(int)(amx->codesize/sizeof(cell))*(int)sizeof(int16_t)<=stacksize-(int)sizeof(cell)) {
+          depthsize=(int)(amx->codesize/sizeof(cell))*(int)sizeof(int16_t);
+          amx->unchecked=ProvePcode(amx,starts,targets,depths,opmask);
+        } /* if */
+      } /* if */
+      if ((amx->flags & AMX_FLAG_FUSE)!=0)
+        amx->fused=FusePcode(amx,starts,targets,opmask);
+      memset(starts,0,((2*mapsize+1) & ~1)+depthsize);
+    } /* if */
+  #endif
+
+  #if defined AMX_JIT_X64
+    if ((amx->flags & AMX_FLAG_JITC)!=0) {
+      /* adjust the code size to mean: estimated size of the compiled image;
+       * the x86-64 JIT gives a bound per P-code cell (not per instruction),
+       * plus the exit stubs that it generates in front of the code
+       */
+      amx->codesize=jit_codesize*(amx->codesize/sizeof(cell) + 16) + hdr->cod + (hdr->stp - hdr->dat);
+      amx->reloc_size=2*sizeof(cell)*(reloc_count+1);
+    } /* if */
+  #elif defined AMX_JIT
     /* adjust the code size to mean: estimated code size of the native code
      * (instead of the size of the P-code)
      */
@@ -1124,6 +2228,206 @@ static int VerifyPcode(AMX *amx)
       strcat(libname,".so");
     #endif
   }
+
+  /* The extension modules are loaded once per process: the registry holds the
+   * handle, the entry points and the native functions of every module that a
+   * program referred to, so that the next abstract machine that uses it does
+   * not search for it again. The modules stay loaded until the process exits.
+   *
+   * A module that could not be loaded is remembered too (often, these are
+   * linked into the host instead), and it is not searched for again during
+   * the lifetime of the process, even if it is installed later or if AMXLIB
+   * changes.
+   *
+   * A module may export its table of native functions as "<name>_Natives",
+   * with the name in lower case (e.g. "string_Natives" for the String
+   * module). The registry then keeps these functions in a hash table, which
+   * amx_Init() passes to amx_RegisterRegistry() before it calls the module's
+   * initialization function. The module still registers its natives itself
+   * (for hosts without a registry), but then finds them resolved already.
+   *
+   * In the program's library table, amx_Init() stores the index in the
+   * registry plus one (a handle does not fit in the 32-bit field). When the
+   * registry is full, amx_Init() loads the remaining modules for each
+   * abstract machine, as without the registry, and marks these with
+   * MODULE_PRIVATE; amx_Cleanup() unloads them again.
+   */
+  #if !defined AMX_MAXMODULES
+    #define AMX_MAXMODULES  32
+  #endif
+  #if !defined AMX_MODULEHASH
+    #define AMX_MODULEHASH  6   /* 2^6 entries, for up to 48 native functions */
+  #endif
+  #define MODULE_PRIVATE    (AMX_MAXMODULES+1)
+  typedef struct tagAMX_MODULE {
+    char name[sNAMEMAX+1];
+    #if defined _Windows
+      HINSTANCE handle;
+    #else
+      void *handle;
+    #endif
+    AMX_ENTRY init,cleanup;
+    #if defined AMX_REGISTER
+      AMX_REGISTRY natives;     /* natives.table==NULL if there is no table */
+      AMX_REGENTRY table[1 << AMX_MODULEHASH];
+    #endif
+  } AMX_MODULE;
+  static AMX_MODULE modules[AMX_MAXMODULES];
+  static int nummodules;
+
+  /* the registry may be used from multiple threads; the lock is held while
+   * looking up (and loading) a module, but not while calling its functions;
+   * an entry does not change after it is added, so it may be read without
+   * the lock once findmodule() returned its index
+   */
+  #if defined _Windows && defined __WIN32__
+    static HANDLE modlock;
+    static void lockmodules(void)
+    {
+      if (modlock==NULL) {
+        HANDLE mutex=CreateMutex(NULL,FALSE,NULL);
+        if (InterlockedCompareExchangePointer((PVOID volatile *)&modlock,mutex,NULL)!=NULL)
+          CloseHandle(mutex);   /* another thread created the lock first */
+      } /* if */
+      WaitForSingleObject(modlock,INFINITE);
+    }
+    #define MODULES_LOCK()    lockmodules()
+    #define MODULES_UNLOCK()  ReleaseMutex(modlock)
+  #elif defined _Windows
+    #define MODULES_LOCK()    /* 16-bit Windows has no threads */
+    #define MODULES_UNLOCK()
+  #else
+    static pthread_mutex_t modlock=PTHREAD_MUTEX_INITIALIZER;
+    #define MODULES_LOCK()    pthread_mutex_lock(&modlock)
+    #define MODULES_UNLOCK()  pthread_mutex_unlock(&modlock)
+  #endif
+
+  /* getsymbol() looks up "<prefix><name><suffix>" in the module; without a
+   * prefix, the name is in lower case (as in "string_Natives")
+   */
+  static void *getsymbol(const AMX_MODULE *module,const char *prefix,const char *suffix)
+  {
+    char symname[sNAMEMAX+13]; /* +1 for '\0', +4 for 'amx_', +8 for '_Natives' */
+    int i;
+
+    assert(strlen(prefix)+strlen(module->name)+strlen(suffix)<sizeof symname);
+    strcpy(symname,prefix);
+    strcat(symname,module->name);
+    if (*prefix=='\0')
+      for (i=0; symname[i]!='\0'; i++)
+        if (symname[i]>='A' && symname[i]<='Z')
+          symname[i]=(char)(symname[i]-'A'+'a');
+    strcat(symname,suffix);
+    #if defined _Windows
+      return (void *)GetProcAddress(module->handle,symname);
+    #else
+      return dlsym(module->handle,symname);
+    #endif
+  }
+
+  static void loadmodule(AMX_MODULE *module,const char *name)
+  {
+    #if defined _Windows
+      char libname[sNAMEMAX+8]; /* +1 for '\0', +3 for 'amx' prefix, +4 for extension */
+    #else
+      char libname[_MAX_PATH];
+    #endif
+    #if defined AMX_REGISTER
+      const AMX_NATIVE_INFO *list;
+    #endif
+    int i;
+
+    memset(module,0,sizeof(AMX_MODULE));
+    for (i=0; i<sNAMEMAX && name[i]!='\0'; i++)
+      module->name[i]=name[i];
+    getlibname(libname,module->name);
+    #if defined _Windows
+      #if defined __WIN32__
+        module->handle=LoadLibraryA(libname);
+      #else
+        module->handle=LoadLibrary(libname);
+        if (module->handle<=HINSTANCE_ERROR)
+          module->handle=NULL;
+      #endif
+    #else
+      module->handle=dlopen(libname,RTLD_NOW);
+    #endif
+    if (module->handle==NULL)
+      return;
+    module->init=(AMX_ENTRY)getsymbol(module,"amx_","Init");
+    module->cleanup=(AMX_ENTRY)getsymbol(module,"amx_","Cleanup");
+    #if defined AMX_REGISTER
+      /* when the table overflows, the module's initialization function
+       * registers the remaining native functions
+       */
+      list=(const AMX_NATIVE_INFO *)getsymbol(module,"","_Natives");
+      if (list!=NULL && amx_RegistryInit(&module->natives,module->table,AMX_MODULEHASH)==AMX_ERR_NONE)
+        amx_RegistryAdd(&module->natives,list,-1);
+    #endif
+  }
+
+  /* findmodule() returns the index of the module in the registry plus one,
+   * after loading the module if needed; when the registry is full, it loads
+   * the module into "local" and returns MODULE_PRIVATE
+   */
+  static int findmodule(const char *name,AMX_MODULE *local)
+  {
+    int i;
+
+    MODULES_LOCK();
+    for (i=0; i<nummodules && strncmp(modules[i].name,name,sNAMEMAX)!=0; i++)
+      /* nothing */;
+    if (i>=nummodules && nummodules<AMX_MAXMODULES)
+      loadmodule(&modules[nummodules++],name);
+    MODULES_UNLOCK();
+    if (i>=AMX_MAXMODULES) {
+      loadmodule(local,name);
+      return MODULE_PRIVATE;
+    } /* if */
+    return i+1;
+  }
+
+  /* unloadmodule() calls the cleanup function of a module that amx_Init()
+   * loaded outside the registry, and closes it; it only looks the module up,
+   * it does not load it if it is not loaded already
+   */
+  static void unloadmodule(AMX *amx,const char *name)
+  {
+    #if defined _Windows
+      char libname[sNAMEMAX+8]; /* +1 for '\0', +3 for 'amx' prefix, +4 for extension */
+    #else
+      char libname[_MAX_PATH];
+    #endif
+    AMX_MODULE module;
+    int i;
+
+    memset(&module,0,sizeof(AMX_MODULE));
+    for (i=0; i<sNAMEMAX && name[i]!='\0'; i++)
+      module.name[i]=name[i];
+    getlibname(libname,module.name);
+    #if defined _Windows
+      #if defined __WIN32__
+        module.handle=GetModuleHandleA(libname);
+      #else
+        module.handle=GetModuleHandle(libname);
+        if (module.handle<=HINSTANCE_ERROR)
+          module.handle=NULL;
+      #endif
+    #else
+      module.handle=dlopen(libname,RTLD_NOW | RTLD_NOLOAD);
+    #endif
+    if (module.handle==NULL)
+      return;
+    module.cleanup=(AMX_ENTRY)getsymbol(&module,"amx_","Cleanup");
+    if (module.cleanup!=NULL)
+      module.cleanup(amx);
+    #if defined _Windows
+      FreeLibrary(module.handle);   /* GetModuleHandle() took no reference */
+    #else
+      dlclose(module.handle);       /* the reference of dlopen(RTLD_NOLOAD) */
+      dlclose(module.handle);       /* the reference of amx_Init() */
+    #endif
+  }
 #endif
 
 int AMXAPI amx_Init(AMX *amx,void *program)
@@ -1276,8 +2580,19 @@ int AMXAPI amx_Init(AMX *amx,void *program)
   } /* local */
   #endif
 
-  /* verify P-code and relocate address in the case of the JIT */
-  if ((hdr->flags & AMX_FLAG_OVERLAY)==0) {
+  /* verify P-code and relocate address in the case of the JIT; P-code that
+   * was verified on an earlier load (a ready-to-run image, see amx_BuildID())
+   * is used as is: the caller has also restored the fields "fused" and
+   * "unchecked" and the flag AMX_FLAG_SYSREQN, as VerifyPcode() set them; the
+   * SYSREQ opcodes are not patched, because "sysreq_d" is not restored
+   */
+  if ((amx->flags & AMX_FLAG_VERIFIED)!=0 && (hdr->flags & AMX_FLAG_OVERLAY)==0
+      && (amx->flags & AMX_FLAG_JITC)==0 && amx_BuildID(NULL)==AMX_ERR_NONE) {
+    amx->sysreq_d=0;
+    amx->flags|=AMX_FLAG_INIT;
+    err=AMX_ERR_NONE;
+  } else if ((hdr->flags & AMX_FLAG_OVERLAY)==0) {
+    amx->flags&=~AMX_FLAG_VERIFIED;
     err=VerifyPcode(amx);
   } else {
     int i;
@@ -1297,49 +2612,26 @@ int AMXAPI amx_Init(AMX *amx,void *program)
   /* load any extension modules that the AMX refers to */
   #if (defined _Windows || defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__) && !defined AMX_NODYNALOAD
   { /* local */
-    #if defined _Windows
-      char libname[sNAMEMAX+8]; /* +1 for '\0', +3 for 'amx' prefix, +4 for extension */
-      HINSTANCE hlib;
-    #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-      char libname[_MAX_PATH];
-      void *hlib;
-    #endif
-    int numlibraries,i;
+    const AMX_MODULE *module;
+    AMX_MODULE local;
+    int numlibraries,i,index;
     AMX_FUNCSTUB *lib;
-    AMX_ENTRY libinit;
     hdr=(AMX_HEADER *)amx->base;
     numlibraries=NUMENTRIES(hdr,libraries,pubvars);
     for (i=0; i<numlibraries; i++) {
       lib=GETENTRY(hdr,libraries,i);
-      getlibname(libname,GETENTRYNAME(hdr,lib));
-      #if defined _Windows
-        #if defined __WIN32__
-          hlib=LoadLibraryA(libname);
-        #else
-          hlib=LoadLibrary(libname);
-          if (hlib<=HINSTANCE_ERROR)
-            hlib=NULL;
-        #endif
-      #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-        hlib=dlopen(libname,RTLD_NOW);
+      index=findmodule(GETENTRYNAME(hdr,lib),&local);
+      module=(index==MODULE_PRIVATE) ? &local : &modules[index-1];
+      /* a library that cannot be loaded or that does not have the required
+       * initialization function is simply ignored
+       */
+      #if defined AMX_REGISTER
+        if (module->natives.table!=NULL)
+          amx_RegisterRegistry(amx,&module->natives);
       #endif
-      if (hlib!=NULL) {
-        /* a library that cannot be loaded or that does not have the required
-         * initialization function is simply ignored
-         */
-        char funcname[sNAMEMAX+9]; /* +1 for '\0', +4 for 'amx_', +4 for 'Init' */
-        strcpy(funcname,"amx_");
-        strcat(funcname,GETENTRYNAME(hdr,lib));
-        strcat(funcname,"Init");
-        #if defined _Windows
-          libinit=(AMX_ENTRY)GetProcAddress(hlib,funcname);
-        #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-          libinit=(AMX_ENTRY)dlsym(hlib,funcname);
-        #endif
-        if (libinit!=NULL)
-          libinit(amx);
-      } /* if */
-      lib->address=(ucell)(intptr_t)hlib;
+      if (module->init!=NULL)
+        module->init(amx);
+      lib->address=(module->handle!=NULL) ? (uint32_t)index : 0;
     } /* for */
   } /* local */
   #endif
@@ -1347,6 +2639,103 @@ int AMXAPI amx_Init(AMX *amx,void *program)
   return AMX_ERR_NONE;
 }
 
+/* amx_BuildID() returns an identifier for the build of the abstract machine:
+ * the code that amx_Init() verified and rewrote may be saved (before any
+ * native function is registered) and loaded again with AMX_FLAG_VERIFIED, by
+ * an abstract machine with the same build identifier only. The function
+ * returns AMX_ERR_GENERAL if the rewritten code cannot be saved at all,
+ * because the core translates the opcodes to (process-specific) addresses, or
+ * because amx_Init() swaps the header and the code (on Big Endian machines).
+ * The identifier is made from AMX_IMAGE_VERSION and from every configuration
+ * macro that changes the rewritten code, so it is the same for every build of
+ * the same sources with the same configuration (and reproducible builds work).
+ * The parameter "id" may be NULL.
+ */
+#define AMX_IMAGE_VERSION 1   /* raise this when amx_Init() rewrites the code differently */
+
+int AMXAPI amx_BuildID(uint32_t *id)
+{
+  uint32_t hash=2166136261u;    /* FNV-1a */
+  uint32_t config=0;
+
+  if (id!=NULL) {
+    #if defined AMX_NO_PACKED_OPC
+      config|=0x0001;
+    #endif
+    #if defined AMX_NO_MACRO_INSTR
+      config|=0x0002;
+    #endif
+    #if defined AMX_NO_FUSED_OPC
+      config|=0x0004;
+    #else
+      config|=0x0008;           /* ProvePcode() is built with the superinstructions */
+    #endif
+    #if defined AMX_TOKENTHREADING
+      config|=0x0010;
+    #endif
+    #if defined AMX_ALTCORE
+      config|=0x0020;
+    #endif
+    #if defined AMX_JIT_X64
+      config|=0x0040;
+    #endif
+    hash=(hash ^ (uint32_t)AMX_IMAGE_VERSION) * 16777619u;
+    hash=(hash ^ config) * 16777619u;
+    hash=(hash ^ (uint32_t)sizeof(cell)) * 16777619u;
+    hash=(hash ^ (uint32_t)CUR_FILE_VERSION) * 16777619u;
+    hash=(hash ^ (uint32_t)OP_NUM_OPCODES) * 16777619u;
+    #if !defined AMX_NO_FUSED_OPC
+      hash=(hash ^ (uint32_t)OP_NUM_FUSED) * 16777619u;
+    #endif
+    *id=hash;
+  } /* if */
+  #if defined AMX_ALTCORE && !defined AMX_TOKENTHREADING || BYTE_ORDER==BIG_ENDIAN
+    return AMX_ERR_GENERAL;
+  #else
+    return AMX_ERR_NONE;
+  #endif
+}
+
+/* amx_InitAOT() attaches a translation of the program to C (made by amx2c and
+ * compiled by the host, see AMX_AOTINFO) to an abstract machine that amx_Init()
+ * set up; amx_Exec() then runs the translation. The P-code must still be as
+ * it is in the file: the translation is checked against a hash of it, so the
+ * function must be called before the first call to amx_Exec(), and it fails
+ * on code that amx_Init() rewrote (see AMX_FLAG_FUSE and AMX_FLAG_PROVE) or
+ * compiled (see AMX_FLAG_JITC). Overlays are not supported. When "info" is
+ * NULL, the abstract machine runs the P-code again.
+ */
+int AMXAPI amx_InitAOT(AMX *amx, const AMX_AOTINFO *info)
+{
+  AMX_HEADER *hdr;
+  uint32_t hash=2166136261u;    /* FNV-1a */
+  long i;
+
+  assert(amx!=NULL);
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  if (info==NULL) {
+    amx->aot=NULL;
+    return AMX_ERR_NONE;
+  } /* if */
+  hdr=(AMX_HEADER *)amx->base;
+  if (info->version!=AMX_AOT_VERSION || info->cellsize!=(int)sizeof(cell) || info->amxsize!=(int)sizeof(AMX))
+    return AMX_ERR_VERSION;
+  if (hdr->overlays!=hdr->nametable)
+    return AMX_ERR_OVERLAY;
+  if ((amx->flags & AMX_FLAG_JITC)!=0 || amx->fused>0 || amx->unchecked>0)
+    return AMX_ERR_INIT;
+  if (info->cod!=hdr->cod || info->dat!=hdr->dat || info->hea!=hdr->hea || info->stp!=hdr->stp)
+    return AMX_ERR_FORMAT;
+  for (i=0; i<amx->codesize; i++)
+    hash=(hash ^ amx->code[i]) * 16777619u;
+  if (hash!=info->hash)
+    return AMX_ERR_FORMAT;
+  amx->sysreq_d=0;              /* the P-code is no longer patched */
+  amx->aot=info->run;
+  return AMX_ERR_NONE;
+}
+
 #if defined AMX_JIT
 
   #define CODESIZE_JIT    8192  /* approximate size of the code for the JIT */
@@ -1410,15 +2799,21 @@ int AMXAPI amx_InitJIT(AMX *amx, void *reloc_table, void *native_code)
    */
   assert(amx->sysreq_d==0);
 
-  if (mprotect(ALIGN(amx_jit_compile), CODESIZE_JIT, PROT_READ | PROT_WRITE | PROT_EXEC) != 0)
-    return AMX_ERR_INIT_JIT;
+  #if !defined AMX_JIT_X64
+    if (mprotect(ALIGN(amx_jit_compile), CODESIZE_JIT, PROT_READ | PROT_WRITE | PROT_EXEC) != 0)
+      return AMX_ERR_INIT_JIT;
+  #endif
 
   /* MP: added check for correct compilation */
   if ((res = amx_jit_compile(amx->base, reloc_table, native_code)) == 0) {
     /* update the required memory size (the previous value was a
      * conservative estimate, now we know the exact size)
      */
-    amx->codesize = (hdr->dat + hdr->stp + sizeof(cell)) & ~(sizeof(cell)-1);
+    #if defined AMX_JIT_X64
+      amx->codesize = hdr->stp;
+    #else
+      amx->codesize = (hdr->dat + hdr->stp + sizeof(cell)) & ~(sizeof(cell)-1);
+    #endif
     /* The compiled code is relocatable, since only relative jumps are
      * used for destinations within the generated code, and absolute
      * addresses are only for jumps into the runtime, which is fixed
@@ -1427,7 +2822,9 @@ int AMXAPI amx_InitJIT(AMX *amx, void *reloc_table, void *native_code)
     /* set the new pointers */
     amx->base = (unsigned char*)native_code;
     amx->code = amx->base + (int)hdr->cod;
-    amx->cip = hdr->cip;
+    #if !defined AMX_JIT_X64
+      amx->cip = hdr->cip;
+    #endif
   } /* if */
 
   return (res == 0) ? AMX_ERR_NONE : AMX_ERR_INIT_JIT;
@@ -1451,58 +2848,30 @@ int AMXAPI amx_InitJIT(AMX *amx,void *compiled_program,void *reloc_table)
 int AMXAPI amx_Cleanup(AMX *amx)
 {
   #if (defined _Windows || defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__) && !defined AMX_NODYNALOAD
-    #if defined _Windows
-      char libname[sNAMEMAX+8]; /* +1 for '\0', +3 for 'amx' prefix, +4 for extension */
-      HINSTANCE hlib;
-    #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-      char libname[_MAX_PATH];
-      void *hlib;
-    #endif
+    const AMX_MODULE *module;
     AMX_HEADER *hdr;
     AMX_FUNCSTUB *lib;
-    AMX_ENTRY libcleanup;
     int numlibraries,i;
   #endif
 
-  /* unload all extension modules */
+  /* clean up all extension modules; these stay loaded, unless they are not
+   * in the registry (see findmodule())
+   */
   #if (defined _Windows || defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__) && !defined AMX_NODYNALOAD
     hdr=(AMX_HEADER *)amx->base;
     assert(hdr->magic==AMX_MAGIC);
     numlibraries=NUMENTRIES(hdr,libraries,pubvars);
     for (i=0; i<numlibraries; i++) {
       lib=GETENTRY(hdr,libraries,i);
-      if (lib->address!=0) {
-        getlibname(libname,GETENTRYNAME(hdr,lib));
-        #if defined _Windows
-          #if defined __WIN32__
-            hlib=GetModuleHandleA(libname);
-          #else
-            hlib=GetModuleHandle(libname);
-            if (hlib<=HINSTANCE_ERROR)
-              hlib=NULL;
-          #endif
-        #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-          hlib=dlopen(libname,RTLD_NOLOAD);
-        #endif
-        if (hlib!=NULL) {
-          char funcname[sNAMEMAX+12]; /* +1 for '\0', +4 for 'amx_', +7 for 'Cleanup' */
-          strcpy(funcname,"amx_");
-          strcat(funcname,GETENTRYNAME(hdr,lib));
-          strcat(funcname,"Cleanup");
-          #if defined _Windows
-            libcleanup=(AMX_ENTRY)GetProcAddress(hlib,funcname);
-          #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-            libcleanup=(AMX_ENTRY)dlsym(hlib,funcname);
-          #endif
-          if (libcleanup!=NULL)
-            libcleanup(amx);
-          #if defined _Windows
-            FreeLibrary(hlob);
-          #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-            dlclose(hlib);
-          #endif
-        } /* if (hlib!=NULL) */
-      } /* if (lib->address!=0) */
+      if (lib->address==MODULE_PRIVATE) {
+        unloadmodule(amx,GETENTRYNAME(hdr,lib));
+        lib->address=0;     /* so that a second call does not close it again */
+      } else if (lib->address!=0) {
+        assert(lib->address<=AMX_MAXMODULES);
+        module=&modules[lib->address-1];
+        if (module->cleanup!=NULL)
+          module->cleanup(amx);
+      } /* if */
     } /* for */
   #else
     (void)amx;
@@ -1516,6 +2885,7 @@ int AMXAPI amx_Clone(AMX *amxClone, AMX *amxSource, void *data)
 {
   AMX_HEADER *hdr;
   unsigned char _FAR *dataSource;
+  int dseg_init;
 
   if (amxSource==NULL)
     return AMX_ERR_FORMAT;
@@ -1533,6 +2903,9 @@ int AMXAPI amx_Clone(AMX *amxClone, AMX *amxSource, void *data)
   amxClone->base=amxSource->base;
   amxClone->code=amxSource->code;
   amxClone->codesize=amxSource->codesize;
+  amxClone->unchecked=amxSource->unchecked; /* the clone runs the same rewritten code */
+  amxClone->nameindex=amxSource->nameindex; /* the name index is per program, not per instance */
+  amxClone->aot=amxSource->aot;             /* and so is the translation to C */
   amxClone->hlw=hdr->hea - hdr->dat; /* stack and heap relative to data segment */
   amxClone->stp=hdr->stp - hdr->dat - sizeof(cell);
   amxClone->hea=amxClone->hlw;
@@ -1541,18 +2914,26 @@ int AMXAPI amx_Clone(AMX *amxClone, AMX *amxSource, void *data)
     amxClone->callback=amxSource->callback;
   if (amxClone->debug==NULL)
     amxClone->debug=amxSource->debug;
-  amxClone->flags=amxSource->flags;
+  dseg_init=amxClone->flags & AMX_FLAG_DSEG_INIT;
+  amxClone->flags=(amxSource->flags & ~AMX_FLAG_DSEG_INIT) | dseg_init;
 
-  /* copy the data segment; the stack and the heap can be left uninitialized */
+  /* copy the data segment; the stack and the heap can be left uninitialized;
+   * if AMX_FLAG_DSEG_INIT is set in the clone, the caller has already set up
+   * the data segment (for example, as a copy-on-write mapping of an image)
+   */
   assert(data!=NULL);
   amxClone->data=(unsigned char _FAR *)data;
-  dataSource=(amxSource->data!=NULL) ? amxSource->data : amxSource->base+(int)hdr->dat;
-  memcpy(amxClone->data,dataSource,(size_t)(hdr->hea-hdr->dat));
+  if (dseg_init==0) {
+    dataSource=(amxSource->data!=NULL) ? amxSource->data : amxSource->base+(int)hdr->dat;
+    memcpy(amxClone->data,dataSource,(size_t)(hdr->hea-hdr->dat));
+  } /* if */
 
   /* Set a zero cell at the top of the stack, which functions
-   * as a sentinel for strings.
+   * as a sentinel for strings (it is only written when needed, so that a
+   * demand-zero page is not touched).
    */
-  * (cell *)(amxClone->data+(int)amxClone->stp) = 0;
+  if (* (cell *)(amxClone->data+(int)amxClone->stp) != 0)
+    * (cell *)(amxClone->data+(int)amxClone->stp) = 0;
 
   return AMX_ERR_NONE;
 }
@@ -1582,6 +2963,112 @@ int AMXAPI amx_MemInfo(AMX *amx, long *codesize, long *datasize, long *stackheap
 }
 #endif /* AMX_MEMINFO */
 
+#if defined AMX_XXXSNAPSHOT
+#if !defined AMX_SNAPBLOCK
+  #define AMX_SNAPBLOCK 256     /* granularity of amx_Restore(), in bytes */
+#endif
+
+/* amx_Snapshot() saves the registers and the memory in use (the data section
+ * plus the heap, and the stack) of an abstract machine. The "image" buffer
+ * must be as large as the data, heap and stack together (see amx_MemInfo()).
+ */
+int AMXAPI amx_Snapshot(AMX *amx, AMX_SNAPSHOT *snapshot, void *image)
+{
+  AMX_HEADER *hdr;
+  unsigned char _FAR *data;
+
+  if (amx==NULL || snapshot==NULL || image==NULL)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  hdr=(AMX_HEADER *)amx->base;
+  data=(amx->data!=NULL) ? amx->data : amx->base+(int)hdr->dat;
+
+  snapshot->base=amx->base;
+  snapshot->image=(unsigned char _FAR *)image;
+  snapshot->cip=amx->cip;
+  snapshot->frm=amx->frm;
+  snapshot->hea=amx->hea;
+  snapshot->stk=amx->stk;
+  snapshot->pri=amx->pri;
+  snapshot->alt=amx->alt;
+  snapshot->reset_stk=amx->reset_stk;
+  snapshot->reset_hea=amx->reset_hea;
+  snapshot->paramcount=amx->paramcount;
+  snapshot->ovl_index=amx->ovl_index;
+  snapshot->restored=0;
+
+  /* the free space between the heap and the stack is not saved (the stack
+   * top includes the sentinel cell)
+   */
+  memcpy(snapshot->image,data,(size_t)amx->hea);
+  memcpy(snapshot->image+(int)amx->stk,data+(int)amx->stk,(size_t)(amx->stp-amx->stk+sizeof(cell)));
+  return AMX_ERR_NONE;
+}
+
+static long RestoreBlocks(unsigned char _FAR *dest,const unsigned char _FAR *src,size_t size)
+{
+  long count=0;
+  size_t n;
+
+  while (size>0) {
+    n=(size>AMX_SNAPBLOCK) ? AMX_SNAPBLOCK : size;
+    if (memcmp(dest,src,n)!=0) {
+      memcpy(dest,src,n);
+      count++;
+    } /* if */
+    dest+=n;
+    src+=n;
+    size-=n;
+  } /* while */
+  return count;
+}
+
+/* amx_Restore() returns the abstract machine to the state of the snapshot.
+ * Only the blocks that were modified since the snapshot are copied back, so
+ * that pages that the script did not write to are not touched (and stay
+ * shared, for a copy-on-write clone).
+ */
+int AMXAPI amx_Restore(AMX *amx, AMX_SNAPSHOT *snapshot)
+{
+  AMX_HEADER *hdr;
+  unsigned char _FAR *data;
+  int err;
+
+  if (amx==NULL || snapshot==NULL)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  if (snapshot->base!=amx->base)
+    return AMX_ERR_PARAMS;
+  hdr=(AMX_HEADER *)amx->base;
+  data=(amx->data!=NULL) ? amx->data : amx->base+(int)hdr->dat;
+
+  if ((hdr->flags & AMX_FLAG_OVERLAY)!=0 && amx->ovl_index!=snapshot->ovl_index) {
+    if (amx->overlay==NULL)
+      return AMX_ERR_OVERLAY;
+    amx->ovl_index=snapshot->ovl_index;
+    if ((err=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
+      return err;
+  } /* if */
+
+  snapshot->restored=RestoreBlocks(data,snapshot->image,(size_t)snapshot->hea)
+                    +RestoreBlocks(data+(int)snapshot->stk,snapshot->image+(int)snapshot->stk,
+                                   (size_t)(amx->stp-snapshot->stk+sizeof(cell)));
+  amx->cip=snapshot->cip;
+  amx->frm=snapshot->frm;
+  amx->hea=snapshot->hea;
+  amx->stk=snapshot->stk;
+  amx->pri=snapshot->pri;
+  amx->alt=snapshot->alt;
+  amx->reset_stk=snapshot->reset_stk;
+  amx->reset_hea=snapshot->reset_hea;
+  amx->paramcount=snapshot->paramcount;
+  amx->error=AMX_ERR_NONE;
+  return AMX_ERR_NONE;
+}
+#endif /* AMX_XXXSNAPSHOT */
+
 #if defined AMX_NAMELENGTH
 int AMXAPI amx_NameLength(AMX *amx, int *length)
 {
@@ -1598,62 +3085,258 @@ int AMXAPI amx_NameLength(AMX *amx, int *length)
 }
 #endif /* AMX_NAMELENGTH */
 
-#if defined AMX_XXXNATIVES
-int AMXAPI amx_NumNatives(AMX *amx, int *number)
+#if defined AMX_NAMEINDEX || defined AMX_REGISTER
+/* namehash() returns the FNV-1a hash of a name */
+static uint32_t namehash(const char *name)
 {
-  AMX_HEADER *hdr=(AMX_HEADER *)amx->base;
-  assert(hdr!=NULL);
-  assert(hdr->magic==AMX_MAGIC);
-  assert(hdr->natives<=hdr->libraries);
-  *number=NUMENTRIES(hdr,natives,libraries);
-  return AMX_ERR_NONE;
+  uint32_t hash=2166136261UL;
+
+  while (*name!='\0')
+    hash=(hash ^ (unsigned char)*name++)*16777619UL;
+  return hash;
 }
+#endif
 
-int AMXAPI amx_GetNative(AMX *amx, int index, char *name)
-{
-  AMX_HEADER *hdr;
-  AMX_FUNCSTUB *func;
+#if defined AMX_NAMEINDEX
+/* The name index holds a hash table (with linear probing) for each of the
+ * tables in the header. An entry stores the hash of the name (or of the tag
+ * id for the tag table), the index in the header table and a copy of the
+ * offset of the name in the name table. The lookups compare the names in the
+ * name table directly, and they keep working on 64-bit hosts after
+ * amx_Register() has overwritten the name offsets of the native functions.
+ */
+typedef struct tagINDEXENTRY {
+  uint32_t hash;
+  int32_t index;            /* index in the header table, -1 for a free entry */
+  uint32_t nameofs;
+} INDEXENTRY;
+
+enum {
+  IDX_PUBLICS,
+  IDX_NATIVES,
+  IDX_PUBVARS,
+  IDX_TAGS,
+  /* ----- */
+  IDX_COUNT
+};
 
-  hdr=(AMX_HEADER *)amx->base;
-  assert(hdr!=NULL);
-  assert(hdr->magic==AMX_MAGIC);
-  assert(hdr->natives<=hdr->libraries);
-  if (index>=(cell)NUMENTRIES(hdr,natives,libraries))
-    return AMX_ERR_INDEX;
+typedef struct tagNAMEINDEX {
+  uint32_t mask[IDX_COUNT]; /* size of each hash table minus 1 */
+  INDEXENTRY *table[IDX_COUNT];
+} NAMEINDEX;
 
-  func=GETENTRY(hdr,natives,index);
-  strcpy(name,GETENTRYNAME(hdr,func));
-  return AMX_ERR_NONE;
+#define NOINDEX   (-2)      /* findindex() result when there is no index */
+
+static void indexcounts(const AMX_HEADER *hdr, unsigned count[IDX_COUNT])
+{
+  count[IDX_PUBLICS]=NUMENTRIES(hdr,publics,natives);
+  count[IDX_NATIVES]=NUMENTRIES(hdr,natives,libraries);
+  count[IDX_PUBVARS]=NUMENTRIES(hdr,pubvars,tags);
+  if (hdr->file_version<5)      /* the tagname table appeared in file format 5 */
+    count[IDX_TAGS]=0;
+  else if (hdr->file_version<7) /* file version 7 introduced the name table */
+    count[IDX_TAGS]=NUMENTRIES(hdr,tags,cod);
+  else
+    count[IDX_TAGS]=NUMENTRIES(hdr,tags,nametable);
 }
 
-int AMXAPI amx_FindNative(AMX *amx, const char *name, int *index)
+/* at most half of the entries in a hash table are used, so that there is
+ * always a free entry to stop the probing
+ */
+static uint32_t indexsize(unsigned count)
 {
-  int idx,last;
-  char pname[sNAMEMAX+1];
+  uint32_t size=1;
 
-  amx_NumNatives(amx, &last);
-  /* linear search, the natives table is not sorted alphabetically */
-  for (idx=0; idx<last; idx++) {
-    amx_GetNative(amx,idx,pname);
-    if (strcmp(pname,name)==0) {
-      *index=idx;
-      return AMX_ERR_NONE;
-    } /* if */
-  } /* for */
-  *index=INT_MAX;
-  return AMX_ERR_NOTFOUND;
+  while (size<2*count)
+    size<<=1;
+  return size;
 }
-#endif /* AMX_XXXNATIVES */
 
-#if defined AMX_XXXPUBLICS
-int AMXAPI amx_NumPublics(AMX *amx, int *number)
+static uint32_t taghash(cell tag_id)
 {
-  AMX_HEADER *hdr=(AMX_HEADER *)amx->base;
-  assert(hdr!=NULL);
-  assert(hdr->magic==AMX_MAGIC);
-  assert(hdr->publics<=hdr->natives);
-  *number=NUMENTRIES(hdr,publics,natives);
-  return AMX_ERR_NONE;
+  return (uint32_t)tag_id*2654435761UL;  /* Knuth's multiplicative hash */
+}
+
+/* findindex() returns the index of a public function, native function or
+ * public variable, -1 if the name is not in the table, or NOINDEX if the
+ * abstract machine has no index
+ */
+static int findindex(const AMX *amx, int type, const char *name)
+{
+  const NAMEINDEX *idx=(const NAMEINDEX *)amx->nameindex;
+  const INDEXENTRY *entry;
+  uint32_t hash,mask,i;
+
+  if (idx==NULL || idx->table[type]==NULL)
+    return NOINDEX;
+  hash=namehash(name);
+  mask=idx->mask[type];
+  for (i=hash & mask; (entry=&idx->table[type][i])->index>=0; i=(i+1) & mask)
+    if (entry->hash==hash && strcmp((const char *)amx->base+(unsigned)entry->nameofs,name)==0)
+      return entry->index;
+  return -1;
+}
+
+/* amx_IndexSize() returns the size of the memory block that amx_BuildIndex()
+ * needs. Both functions are called after amx_Init(), and amx_BuildIndex()
+ * should be called before registering the native functions. The block is
+ * allocated by the host and it must stay valid for as long as the abstract
+ * machine and its clones exist; it is read-only after amx_BuildIndex(), so
+ * any number of threads may do lookups on it.
+ */
+int AMXAPI amx_IndexSize(AMX *amx, size_t *size)
+{
+  AMX_HEADER *hdr;
+  unsigned count[IDX_COUNT];
+  int type;
+
+  if (amx==NULL || size==NULL)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  indexcounts(hdr,count);
+  *size=sizeof(NAMEINDEX);
+  for (type=0; type<IDX_COUNT; type++)
+    *size+=indexsize(count[type])*sizeof(INDEXENTRY);
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI amx_BuildIndex(AMX *amx, void *index)
+{
+  AMX_HEADER *hdr;
+  NAMEINDEX *idx;
+  INDEXENTRY *entry;
+  AMX_FUNCSTUB *func;
+  unsigned count[IDX_COUNT];
+  uint32_t hash,size,i;
+  int type;
+  unsigned n;
+
+  if (amx==NULL || index==NULL)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  indexcounts(hdr,count);
+
+  /* the hash tables follow the NAMEINDEX structure in the same block */
+  idx=(NAMEINDEX *)index;
+  entry=(INDEXENTRY *)(idx+1);
+  for (type=0; type<IDX_COUNT; type++) {
+    size=indexsize(count[type]);
+    idx->mask[type]=size-1;
+    idx->table[type]=entry;
+    for (i=0; i<size; i++)
+      entry[i].index=-1;
+    entry+=size;
+  } /* for */
+
+  for (type=0; type<IDX_COUNT; type++) {
+    for (n=0; n<count[type]; n++) {
+      switch (type) {
+      case IDX_PUBLICS:
+        func=GETENTRY(hdr,publics,n);
+        break;
+      case IDX_NATIVES:
+        func=GETENTRY(hdr,natives,n);
+        #if defined _I64_MAX || defined __x86_64__ || defined HAVE_I64
+          /* the name offset of a registered native function holds the high
+           * part of its address; it can no longer be looked up by name
+           */
+          if (func->address!=0)
+            continue;
+        #endif
+        break;
+      case IDX_PUBVARS:
+        func=GETENTRY(hdr,pubvars,n);
+        break;
+      default:
+        assert(type==IDX_TAGS);
+        func=GETENTRY(hdr,tags,n);
+        break;
+      } /* switch */
+      hash=(type==IDX_TAGS) ? taghash((cell)func->address) : namehash(GETENTRYNAME(hdr,func));
+      for (i=hash & idx->mask[type]; idx->table[type][i].index>=0; i=(i+1) & idx->mask[type])
+        /* nothing */;
+      idx->table[type][i].hash=hash;
+      idx->table[type][i].index=(int32_t)n;
+      idx->table[type][i].nameofs=func->nameofs;
+    } /* for */
+  } /* for */
+
+  amx->nameindex=idx;
+  return AMX_ERR_NONE;
+}
+#endif /* AMX_NAMEINDEX */
+
+#if defined AMX_XXXNATIVES
+int AMXAPI amx_NumNatives(AMX *amx, int *number)
+{
+  AMX_HEADER *hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  assert(hdr->natives<=hdr->libraries);
+  *number=NUMENTRIES(hdr,natives,libraries);
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI amx_GetNative(AMX *amx, int index, char *name)
+{
+  AMX_HEADER *hdr;
+  AMX_FUNCSTUB *func;
+
+  hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  assert(hdr->natives<=hdr->libraries);
+  if (index>=(cell)NUMENTRIES(hdr,natives,libraries))
+    return AMX_ERR_INDEX;
+
+  func=GETENTRY(hdr,natives,index);
+  strcpy(name,GETENTRYNAME(hdr,func));
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI amx_FindNative(AMX *amx, const char *name, int *index)
+{
+  AMX_HEADER *hdr;
+  int idx,last;
+
+  #if defined AMX_NAMEINDEX
+    if ((idx=findindex(amx,IDX_NATIVES,name))!=NOINDEX) {
+      *index=(idx>=0) ? idx : INT_MAX;
+      return (idx>=0) ? AMX_ERR_NONE : AMX_ERR_NOTFOUND;
+    } /* if */
+  #endif
+
+  hdr=(AMX_HEADER *)amx->base;
+  amx_NumNatives(amx, &last);
+  /* linear search, the natives table is not sorted alphabetically */
+  for (idx=0; idx<last; idx++) {
+    if (strcmp(GETENTRYNAME(hdr,GETENTRY(hdr,natives,idx)),name)==0) {
+      *index=idx;
+      return AMX_ERR_NONE;
+    } /* if */
+  } /* for */
+  *index=INT_MAX;
+  return AMX_ERR_NOTFOUND;
+}
+#endif /* AMX_XXXNATIVES */
+
+#if defined AMX_XXXPUBLICS
+int AMXAPI amx_NumPublics(AMX *amx, int *number)
+{
+  AMX_HEADER *hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  assert(hdr->publics<=hdr->natives);
+  *number=NUMENTRIES(hdr,publics,natives);
+  return AMX_ERR_NONE;
 }
 
 int AMXAPI amx_GetPublic(AMX *amx, int index, char *name, ucell *address)
@@ -1678,17 +3361,24 @@ int AMXAPI amx_GetPublic(AMX *amx, int index, char *name, ucell *address)
 
 int AMXAPI amx_FindPublic(AMX *amx, const char *name, int *index)
 {
+  AMX_HEADER *hdr;
   int first,last,result;
-  char pname[sNAMEMAX+1];
 
+  #if defined AMX_NAMEINDEX
+    if ((first=findindex(amx,IDX_PUBLICS,name))!=NOINDEX) {
+      *index=(first>=0) ? first : INT_MAX;
+      return (first>=0) ? AMX_ERR_NONE : AMX_ERR_NOTFOUND;
+    } /* if */
+  #endif
+
+  hdr=(AMX_HEADER *)amx->base;
   amx_NumPublics(amx, &last);
   last--;       /* last valid index is 1 less than the number of functions */
   first=0;
   /* binary search */
   while (first<=last) {
     int mid=(first+last)/2;
-    amx_GetPublic(amx,mid,pname,NULL);
-    result=strcmp(pname,name);
+    result=strcmp(GETENTRYNAME(hdr,GETENTRY(hdr,publics,mid)),name);
     if (result>0) {
       last=mid-1;
     } else if (result<0) {
@@ -1704,6 +3394,28 @@ int AMXAPI amx_FindPublic(AMX *amx, const char *name, int *index)
   *index=INT_MAX;
   return AMX_ERR_NOTFOUND;
 }
+
+#if defined AMX_NAMEINDEX
+/* amx_FindPublics() looks up a list of public functions in one call. The
+ * indices are the same for all abstract machines that run the same program
+ * (including clones), so a host can resolve the names once, after loading
+ * the program, and then call amx_Exec() on the indices. A name that is not
+ * found gets the index INT_MAX and the function returns AMX_ERR_NOTFOUND (but
+ * it still resolves the other names).
+ */
+int AMXAPI amx_FindPublics(AMX *amx, const char * const names[], int number, int index[])
+{
+  int i,err,result;
+
+  if (amx==NULL || names==NULL || index==NULL || number<0)
+    return AMX_ERR_PARAMS;
+  err=AMX_ERR_NONE;
+  for (i=0; i<number; i++)
+    if ((result=amx_FindPublic(amx,names[i],&index[i]))!=AMX_ERR_NONE)
+      err=result;
+  return err;
+}
+#endif
 #endif /* AMX_XXXPUBLICS */
 
 #if defined AMX_XXXPUBVARS
@@ -1744,8 +3456,25 @@ int AMXAPI amx_GetPubVar(AMX *amx, int index, char *name, cell **address)
 
 int AMXAPI amx_FindPubVar(AMX *amx, const char *name, cell **address)
 {
+  AMX_HEADER *hdr;
+  AMX_FUNCSTUB *var;
+  unsigned char *data;
   int first,last,result;
-  char pname[sNAMEMAX+1];
+
+  assert(address!=NULL);
+  hdr=(AMX_HEADER *)amx->base;
+  data=(amx->data!=NULL) ? amx->data : amx->base+(int)hdr->dat;
+  #if defined AMX_NAMEINDEX
+    if ((first=findindex(amx,IDX_PUBVARS,name))!=NOINDEX) {
+      if (first<0) {
+        *address=NULL;
+        return AMX_ERR_NOTFOUND;
+      } /* if */
+      var=GETENTRY(hdr,pubvars,first);
+      *address=(cell *)(data+(int)var->address);
+      return AMX_ERR_NONE;
+    } /* if */
+  #endif
 
   amx_NumPubVars(amx,&last);
   last--;       /* last valid index is 1 less than the number of functions */
@@ -1753,17 +3482,18 @@ int AMXAPI amx_FindPubVar(AMX *amx, const char *name, cell **address)
   /* binary search */
   while (first<=last) {
     int mid=(first+last)/2;
-    amx_GetPubVar(amx,mid,pname,address);
-    result=strcmp(pname,name);
-    if (result>0)
+    var=GETENTRY(hdr,pubvars,mid);
+    result=strcmp(GETENTRYNAME(hdr,var),name);
+    if (result>0) {
       last=mid-1;
-    else if (result<0)
+    } else if (result<0) {
       first=mid+1;
-    else
+    } else {
+      *address=(cell *)(data+(int)var->address);
       return AMX_ERR_NONE;
+    } /* if */
   } /* while */
   /* not found */
-  assert(address!=NULL);
   *address=NULL;
   return AMX_ERR_NOTFOUND;
 }
@@ -1822,9 +3552,31 @@ int AMXAPI amx_GetTag(AMX *amx, int index, char *tagname, cell *tag_id)
 
 int AMXAPI amx_FindTagId(AMX *amx, cell tag_id, char *tagname)
 {
+  AMX_HEADER *hdr;
+  AMX_FUNCSTUB *tag;
   int first,last;
   cell mid_id;
 
+  #if defined AMX_NAMEINDEX
+    if (amx->nameindex!=NULL) {
+      const NAMEINDEX *idx=(const NAMEINDEX *)amx->nameindex;
+      const INDEXENTRY *entry;
+      uint32_t hash=taghash(tag_id);
+      uint32_t mask=idx->mask[IDX_TAGS];
+      uint32_t i;
+      hdr=(AMX_HEADER *)amx->base;
+      for (i=hash & mask; (entry=&idx->table[IDX_TAGS][i])->index>=0; i=(i+1) & mask) {
+        tag=GETENTRY(hdr,tags,entry->index);
+        if (entry->hash==hash && (cell)tag->address==tag_id) {
+          strcpy(tagname,(const char *)amx->base+(unsigned)entry->nameofs);
+          return AMX_ERR_NONE;
+        } /* if */
+      } /* for */
+      *tagname='\0';
+      return AMX_ERR_NOTFOUND;
+    } /* if */
+  #endif
+
   #if !defined NDEBUG
     /* verify that the tagname table is sorted on the tag_id */
     amx_NumTags(amx, &last);
@@ -1839,19 +3591,23 @@ int AMXAPI amx_FindTagId(AMX *amx, cell tag_id, char *tagname)
     } /* if */
   #endif
 
+  hdr=(AMX_HEADER *)amx->base;
   amx_NumTags(amx, &last);
   last--;       /* last valid index is 1 less than the number of functions */
   first=0;
-  /* binary search */
+  /* binary search, only the matching name is copied */
   while (first<=last) {
     int mid=(first+last)/2;
-    amx_GetTag(amx,mid,tagname,&mid_id);
-    if (mid_id>tag_id)
+    tag=GETENTRY(hdr,tags,mid);
+    mid_id=(cell)tag->address;
+    if (mid_id>tag_id) {
       last=mid-1;
-    else if (mid_id<tag_id)
+    } else if (mid_id<tag_id) {
       first=mid+1;
-    else
+    } else {
+      strcpy(tagname,GETENTRYNAME(hdr,tag));
       return AMX_ERR_NONE;
+    } /* if */
   } /* while */
   /* not found */
   *tagname='\0';
@@ -1895,6 +3651,57 @@ int AMXAPI amx_SetUserData(AMX *amx, long tag, void *ptr)
   amx->userdata[index]=ptr;
   return AMX_ERR_NONE;
 }
+
+#define MODULEDATA_TAG  AMX_USERTAG('M','o','d','D')
+
+int AMXAPI amx_GetModuleData(AMX *amx, long tag, AMX_MODULEDATA **data)
+{
+  AMX_MODULEDATA *item;
+
+  assert(amx!=NULL);
+  assert(tag!=0);
+  assert(data!=NULL);
+  *data=NULL;
+  if (amx_GetUserData(amx,MODULEDATA_TAG,(void**)&item)!=AMX_ERR_NONE)
+    return AMX_ERR_USERDATA;
+  while (item!=NULL && item->tag!=tag)
+    item=item->next;
+  if (item==NULL)
+    return AMX_ERR_USERDATA;
+  *data=item;
+  return AMX_ERR_NONE;
+}
+
+/* amx_SetModuleData() adds the data of an extension module to the chain of
+ * the abstract machine, or replaces the data with the same tag. When "data" is
+ * NULL, the item with the tag is removed from the chain. The abstract machine
+ * does not allocate or free the data.
+ */
+int AMXAPI amx_SetModuleData(AMX *amx, long tag, AMX_MODULEDATA *data)
+{
+  AMX_MODULEDATA *root,*item,*prev;
+
+  assert(amx!=NULL);
+  assert(tag!=0);
+  if (amx_GetUserData(amx,MODULEDATA_TAG,(void**)&root)!=AMX_ERR_NONE)
+    root=NULL;
+  /* unlink the existing item with the same tag */
+  for (prev=NULL,item=root; item!=NULL && item->tag!=tag; prev=item,item=item->next)
+    /* nothing */;
+  if (item!=NULL) {
+    if (prev!=NULL)
+      prev->next=item->next;
+    else
+      root=item->next;
+  } /* if */
+  /* insert the new item at the head */
+  if (data!=NULL) {
+    data->tag=tag;
+    data->next=root;
+    root=data;
+  } /* if */
+  return amx_SetUserData(amx,MODULEDATA_TAG,root);
+}
 #endif /* AMX_XXXUSERDATA */
 
 #if defined AMX_REGISTER
@@ -1909,7 +3716,21 @@ static AMX_NATIVE findfunction(char *name, const AMX_NATIVE_INFO *list, int numb
   return NULL;
 }
 
-int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *list, int number)
+static AMX_NATIVE findregistry(const char *name, const AMX_REGISTRY *registry)
+{
+  uint32_t hash,mask,idx;
+  const AMX_REGENTRY *entry;
+
+  assert(registry!=NULL && registry->table!=NULL);
+  hash=namehash(name);
+  mask=((uint32_t)1 << registry->exponent)-1;
+  for (idx=hash & mask; (entry=&registry->table[idx])->native!=NULL; idx=(idx+1) & mask)
+    if (entry->hash==hash && strcmp(name,entry->native->name)==0)
+      return entry->native->func;
+  return NULL;
+}
+
+static int registernatives(AMX *amx, const AMX_NATIVE_INFO *list, int number, const AMX_REGISTRY *registry)
 {
   AMX_FUNCSTUB *func;
   AMX_HEADER *hdr;
@@ -1928,7 +3749,10 @@ int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *list, int number)
   for (i=0; i<numnatives; i++) {
     if (func->address==0) {
       /* this function is not yet located */
-      funcptr=(list!=NULL) ? findfunction(GETENTRYNAME(hdr,func),list,number) : NULL;
+      if (registry!=NULL)
+        funcptr=findregistry(GETENTRYNAME(hdr,func),registry);
+      else
+        funcptr=(list!=NULL) ? findfunction(GETENTRYNAME(hdr,func),list,number) : NULL;
       if (funcptr!=NULL) {
         func->address=(uint32_t)(intptr_t)funcptr;
         #if defined _I64_MAX || defined __x86_64__ || defined HAVE_I64
@@ -1945,6 +3769,79 @@ int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *list, int number)
     amx->flags|=AMX_FLAG_NTVREG;
   return err;
 }
+
+int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *list, int number)
+{
+  assert(amx!=NULL);
+  /* the addresses of the native functions are stored in the header of the
+   * program, so when all are resolved, there is nothing left to do; this is
+   * also the case for clones (which share the header with the original), and
+   * after amx_RegisterRegistry() found all native functions
+   */
+  if ((amx->flags & AMX_FLAG_NTVREG)!=0)
+    return AMX_ERR_NONE;
+  return registernatives(amx,list,number,NULL);
+}
+
+/* amx_RegistryInit() sets up an empty registry in the table, which must have
+ * 2^exponent entries; the table should be at least twice as large as the
+ * number of native functions that will be added.
+ */
+int AMXAPI amx_RegistryInit(AMX_REGISTRY *registry, AMX_REGENTRY *table, int exponent)
+{
+  if (registry==NULL || table==NULL || exponent<1 || exponent>30)
+    return AMX_ERR_PARAMS;
+  memset(table,0,((size_t)1 << exponent)*sizeof(AMX_REGENTRY));
+  registry->table=table;
+  registry->exponent=exponent;
+  registry->count=0;
+  return AMX_ERR_NONE;
+}
+
+/* amx_RegistryAdd() adds a list of native functions, in the same format as
+ * for amx_Register(). When a name is already in the registry, the earlier
+ * entry stays (as with successive calls to amx_Register()). The function
+ * returns AMX_ERR_MEMORY when the table would become more than 3/4 full.
+ */
+int AMXAPI amx_RegistryAdd(AMX_REGISTRY *registry, const AMX_NATIVE_INFO *list, int number)
+{
+  uint32_t hash,mask,idx;
+  AMX_REGENTRY *entry;
+  int i;
+
+  if (registry==NULL || registry->table==NULL || list==NULL)
+    return AMX_ERR_PARAMS;
+  mask=((uint32_t)1 << registry->exponent)-1;
+  for (i=0; (i<number || number==-1) && list[i].name!=NULL; i++) {
+    hash=namehash(list[i].name);
+    for (idx=hash & mask; (entry=&registry->table[idx])->native!=NULL; idx=(idx+1) & mask)
+      if (entry->hash==hash && strcmp(list[i].name,entry->native->name)==0)
+        break;
+    if (entry->native!=NULL)
+      continue;         /* duplicate name */
+    if ((uint32_t)registry->count>=mask-(mask >> 2))
+      return AMX_ERR_MEMORY;
+    entry->hash=hash;
+    entry->native=&list[i];
+    registry->count++;
+  } /* for */
+  return AMX_ERR_NONE;
+}
+
+/* amx_RegisterRegistry() resolves all native functions of the abstract
+ * machine with a registry, in a single pass. Like amx_Register(), it returns
+ * AMX_ERR_NOTFOUND if any native function remains unresolved; these can
+ * still be registered with amx_Register().
+ */
+int AMXAPI amx_RegisterRegistry(AMX *amx, const AMX_REGISTRY *registry)
+{
+  assert(amx!=NULL);
+  if (registry==NULL || registry->table==NULL)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_NTVREG)!=0)
+    return AMX_ERR_NONE;
+  return registernatives(amx,NULL,0,registry);
+}
 #endif /* AMX_REGISTER */
 
 #if defined AMX_NATIVEINFO
@@ -2098,11 +3995,295 @@ int amx_exec_list(AMX *amx,const cell **opcodelist,int *numopcodes)
   assert(opcodelist!=NULL);
   *opcodelist=NULL;
   assert(numopcodes!=NULL);
-  *numopcodes=OP_NUM_OPCODES;
+  #if defined AMX_NO_FUSED_OPC
+    *numopcodes=OP_NUM_OPCODES;
+  #else
+    *numopcodes=OP_NUM_FUSED;
+  #endif
   return 0;
 }
+
+/* fuelout() is called when the instruction budget drops below zero; it
+ * returns 0 if no budget was set (so the counter just wrapped around) or if
+ * the fuel hook lets the abstract machine run on, or 1 if amx_Exec() must
+ * stop; "cip" is the instruction that used up the budget
+ */
+static int fuelout(AMX *amx,cell cip,cell frm)
+{
+  if (amx->fuelmode==AMX_FUEL_NONE) {
+    amx->fuel=LONG_MAX;
+    return 0;
+  } /* if */
+  if (amx->fuelmode==AMX_FUEL_HOOK) {
+    amx->fuel=LONG_MAX;
+    amx->cip=cip;
+    amx->frm=frm;
+    if (amx->fuelhook==NULL || amx->fuelhook(amx)==AMX_ERR_NONE)
+      return 0;
+  } /* if */
+  amx->fuel=0;
+  return 1;
+}
+
+/* stackout() is called when the heap and the stack come closer than the
+ * limit that amx_SetStackLimit() set allows; it returns 0 if the stack hook
+ * raised the limit far enough for the abstract machine to run on, or 1 if
+ * amx_Exec() must stop with AMX_ERR_STACKERR
+ */
+static int stackout(AMX *amx,cell hea,cell stk)
+{
+  if (amx->stkreserve==0 || amx->stackhook==NULL)
+    return 1;
+  amx->hea=hea;
+  amx->stk=stk;
+  if (amx->stackhook(amx)!=AMX_ERR_NONE)
+    return 1;
+  return hea+STKMARGIN+amx->stkreserve>stk;
+}
+
+/* FindCase() returns a pointer to the record in the case table for "value",
+ * or NULL if there is no such record; "cptr" points to the number of records
+ * in the table. The records are sorted on their case value (VerifyPcode()
+ * takes care of that), so when the case values are consecutive, the record
+ * can be looked up directly; otherwise a binary search finds it.
+ */
+static cell *FindCase(cell *cptr, cell value)
+{
+  cell *rec=cptr+2;   /* skip number of records and "none-matched" target */
+  cell num=*cptr;
+  ucell diff;
+  int low,high,mid;
+
+  if (num<=0)
+    return NULL;
+  diff=(ucell)value-(ucell)rec[0];
+  if (diff>(ucell)rec[2*(num-1)]-(ucell)rec[0])
+    return NULL;        /* out of range */
+  if (diff<(ucell)num && rec[2*diff]==value)
+    return &rec[2*diff];/* dense table */
+  low=0;
+  high=(int)num-1;
+  while (low<high) {
+    mid=(low+high)/2;
+    if (rec[2*mid]<value)
+      low=mid+1;
+    else
+      high=mid;
+  } /* while */
+  return (rec[2*low]==value) ? &rec[2*low] : NULL;
+}
 #endif
 
+#if defined AMX_PROFILE
+/* With AMX_PROFILE, the ANSI-C and the GNU GCC cores count the instructions
+ * that they execute (per opcode) and the calls and the time of the native
+ * functions (per native function), and amx_Exec() counts the calls of the
+ * public functions. The counters are per abstract machine; the host allocates
+ * them and attaches them with amx_ProfileInit(). The JIT and the assembler
+ * cores do not count. Without AMX_PROFILE, none of this is compiled in.
+ */
+static const char * const opcodenames[] = {
+  "nop",          "load.pri",     "load.alt",     "load.s.pri",
+  "load.s.alt",   "lref.s.pri",   "lref.s.alt",   "load.i",
+  "lodb.i",       "const.pri",    "const.alt",    "addr.pri",
+  "addr.alt",     "stor",         "stor.s",       "sref.s",
+  "stor.i",       "strb.i",       "align.pri",    "lctrl",
+  "sctrl",        "xchg",         "push.pri",     "push.alt",
+  "pushr.pri",    "pop.pri",      "pop.alt",      "pick",
+  "stack",        "heap",         "proc",         "ret",
+  "retn",         "call",         "jump",         "jzer",
+  "jnz",          "shl",          "shr",          "sshr",
+  "shl.c.pri",    "shl.c.alt",    "smul",         "sdiv",
+  "add",          "sub",          "and",          "or",
+  "xor",          "not",          "neg",          "invert",
+  "eq",           "neq",          "sless",        "sleq",
+  "sgrtr",        "sgeq",         "inc.pri",      "inc.alt",
+  "inc.i",        "dec.pri",      "dec.alt",      "dec.i",
+  "movs",         "cmps",         "fill",         "halt",
+  "bounds",       "sysreq",       "switch",       "swap.pri",
+  "swap.alt",     "break",        "casetbl",
+  /* patched instructions */
+  "sysreq.d",     "sysreq.nd",
+  /* overlay instructions */
+  "call.ovl",     "retn.ovl",     "switch.ovl",   "casetbl.ovl",
+#if !defined AMX_NO_MACRO_INSTR
+  /* supplemental & macro instructions */
+  "lidx",         "lidx.b",       "idxaddr",      "idxaddr.b",
+  "push.c",       "push",         "push.s",       "push.adr",
+  "pushr.c",      "pushr.s",      "pushr.adr",    "jeq",
+  "jneq",         "jsless",       "jsleq",        "jsgrtr",
+  "jsgeq",        "sdiv.inv",     "sub.inv",      "add.c",
+  "smul.c",       "zero.pri",     "zero.alt",     "zero",
+  "zero.s",       "eq.c.pri",     "eq.c.alt",     "inc",
+  "inc.s",        "dec",          "dec.s",
+  /* macro instructions */
+  "sysreq.n",     "pushm.c",      "pushm",        "pushm.s",
+  "pushm.adr",    "pushrm.c",     "pushrm.s",     "pushrm.adr",
+  "load2",        "load2.s",      "const",        "const.s",
+#endif
+#if !defined AMX_NO_PACKED_OPC
+  /* packed instructions */
+  "load.p.pri",   "load.p.alt",   "load.p.s.pri", "load.p.s.alt",
+  "lref.p.s.pri", "lref.p.s.alt", "lodb.p.i",     "const.p.pri",
+  "const.p.alt",  "addr.p.pri",   "addr.p.alt",   "stor.p",
+  "stor.p.s",     "sref.p.s",     "strb.p.i",     "lidx.p.b",
+  "idxaddr.p.b",  "align.p.pri",  "push.p.c",     "push.p",
+  "push.p.s",     "push.p.adr",   "pushr.p.c",    "pushr.p.s",
+  "pushr.p.adr",  "pushm.p.c",    "pushm.p",      "pushm.p.s",
+  "pushm.p.adr",  "pushrm.p.c",   "pushrm.p.s",   "pushrm.p.adr",
+  "stack.p",      "heap.p",       "shl.p.c.pri",  "shl.p.c.alt",
+  "add.p.c",      "smul.p.c",     "zero.p",       "zero.p.s",
+  "eq.p.c.pri",   "eq.p.c.alt",   "inc.p",        "inc.p.s",
+  "dec.p",        "dec.p.s",      "movs.p",       "cmps.p",
+  "fill.p",       "halt.p",       "bounds.p",
+#endif
+#if !defined AMX_NO_FUSED_OPC
+  /* superinstructions, see FusePcode() */
+  "load.s.push",        "lidx.push",          "push.c.call",
+  "const.alt.jeq",      "const.alt.jneq",     "const.alt.jsless",
+  "const.alt.jsleq",    "const.alt.jsgrtr",   "const.alt.jsgeq",
+  #if !defined AMX_NO_PACKED_OPC
+    "load.p.s.push",      "push.p.c.call",      "const.p.alt.jeq",
+    "const.p.alt.jneq",   "const.p.alt.jsless", "const.p.alt.jsleq",
+    "const.p.alt.jsgrtr", "const.p.alt.jsgeq",
+  #endif
+  /* unchecked memory accesses, see ProvePcode() */
+  "load.i.nc",          "lodb.i.nc",          "stor.i.nc",
+  "strb.i.nc",          "lidx.nc",            "lidx.b.nc",
+  "movs.nc",            "cmps.nc",            "fill.nc",
+  #if !defined AMX_NO_PACKED_OPC
+    "lodb.p.i.nc",        "strb.p.i.nc",        "lidx.p.b.nc",
+    "movs.p.nc",          "cmps.p.nc",          "fill.p.nc",
+  #endif
+#endif
+};
+#define NUMPROFILED     (int)(sizeof opcodenames / sizeof opcodenames[0])
+
+/* amx_profile_ticks() is also used by AMXEXEC_GCC.C */
+uint64_t amx_profile_ticks(void)
+{
+  #if (defined __GNUC__ || defined __clang__) && (defined __i386__ || defined __x86_64__)
+    return __builtin_ia32_rdtsc();
+  #elif defined _MSC_VER && (defined _M_IX86 || defined _M_X64)
+    return __rdtsc();
+  #elif defined CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000u + (uint64_t)ts.tv_nsec;
+  #else
+    return (uint64_t)clock();
+  #endif
+}
+
+static void profilecalls(AMX *amx, int index, int count)
+{
+  AMX_PROFILEDATA *profile=amx->profile;
+  if (profile!=NULL) {
+    if (index==AMX_EXEC_MAIN)
+      profile->maincalls+=count;
+    else if (index>=0 && index<profile->numpublics)
+      profile->pubcalls[index]+=count;
+  } /* if */
+}
+
+/* amx_ProfileSize() returns the size of the block of counters that
+ * amx_ProfileInit() needs; both are called after amx_Init().
+ */
+int AMXAPI amx_ProfileSize(AMX *amx, size_t *size)
+{
+  AMX_HEADER *hdr;
+
+  #if defined AMX_NO_FUSED_OPC
+    assert_static(NUMPROFILED==OP_NUM_OPCODES);
+  #else
+    assert_static(NUMPROFILED==OP_NUM_FUSED);
+  #endif
+  if (amx==NULL || size==NULL)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  *size=(NUMPROFILED+2*NUMENTRIES(hdr,natives,libraries)+NUMENTRIES(hdr,publics,natives))*sizeof(uint64_t);
+  return AMX_ERR_NONE;
+}
+
+/* amx_ProfileInit() attaches the counters in "profile" to the abstract
+ * machine, with the arrays in the "counters" block, and clears them; the
+ * structure and the block must stay valid until the counters are detached
+ * (by passing NULL for "profile"). A clone of the abstract machine does not
+ * inherit the counters; it can be given its own.
+ */
+int AMXAPI amx_ProfileInit(AMX *amx, AMX_PROFILEDATA *profile, void *counters)
+{
+  AMX_HEADER *hdr;
+
+  if (amx==NULL || (profile!=NULL && counters==NULL))
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  amx->profile=profile;
+  if (profile==NULL)
+    return AMX_ERR_NONE;
+  hdr=(AMX_HEADER *)amx->base;
+  profile->numopcodes=NUMPROFILED;
+  profile->numnatives=(int)NUMENTRIES(hdr,natives,libraries);
+  profile->numpublics=(int)NUMENTRIES(hdr,publics,natives);
+  profile->opcodes=(uint64_t *)counters;
+  profile->natcalls=profile->opcodes+profile->numopcodes;
+  profile->natticks=profile->natcalls+profile->numnatives;
+  profile->pubcalls=profile->natticks+profile->numnatives;
+  return amx_ProfileReset(amx);
+}
+
+int AMXAPI amx_ProfileReset(AMX *amx)
+{
+  AMX_PROFILEDATA *profile;
+
+  if (amx==NULL)
+    return AMX_ERR_PARAMS;
+  if ((profile=amx->profile)==NULL)
+    return AMX_ERR_NONE;
+  memset(profile->opcodes,0,(profile->numopcodes+2*profile->numnatives+profile->numpublics)*sizeof(uint64_t));
+  profile->maincalls=0;
+  return AMX_ERR_NONE;
+}
+
+/* amx_ProfileOpcode() returns the mnemonic of an opcode, for a report of the
+ * "opcodes" counters
+ */
+int AMXAPI amx_ProfileOpcode(int opcode, const char **name)
+{
+  if (name==NULL || opcode<0 || opcode>=NUMPROFILED)
+    return AMX_ERR_PARAMS;
+  *name=opcodenames[opcode];
+  return AMX_ERR_NONE;
+}
+#endif /* AMX_PROFILE */
+
+static int ExecCore(AMX *amx, cell *retval, unsigned char *data, cell reset_stk, cell reset_hea, int newcall);
+
+/* NativesRegistered() verifies that all native functions have been registered
+ * (or do not need registering) and sets AMX_FLAG_NTVREG if so
+ */
+static int NativesRegistered(AMX *amx)
+{
+  AMX_HEADER *hdr=(AMX_HEADER *)amx->base;
+  AMX_FUNCSTUB *func;
+  int i,numnatives;
+
+  assert(hdr->natives<=hdr->libraries);
+  numnatives=NUMENTRIES(hdr,natives,libraries);
+  func=GETENTRY(hdr,natives,0);
+  for (i=0; i<numnatives && func->address!=0; i++)
+    func=(AMX_FUNCSTUB*)((unsigned char*)func+hdr->defsize);
+  if (i<numnatives)
+    return 0;
+  amx->flags|=AMX_FLAG_NTVREG;  /* no need to check this again */
+  return 1;
+}
+
 int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
 {
   AMX_HEADER *hdr;
@@ -2110,10 +4291,6 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
   unsigned char *data;
   cell reset_stk,reset_hea;
   int i;
-#if !defined AMX_ALTCORE
-  cell pri,alt,stk,frm,hea;
-  cell *cip,op,offs,val;
-#endif
 
   assert(amx!=NULL);
   if ((amx->flags & AMX_FLAG_INIT)==0)
@@ -2125,20 +4302,8 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
   assert(hdr!=NULL);
   assert(hdr->magic==AMX_MAGIC);
 
-  if ((amx->flags & AMX_FLAG_NTVREG)==0) {
-    /* verify that all native functions have been registered (or do not
-     * need registering)
-     */
-    int numnatives;
-    assert(hdr->natives<=hdr->libraries);
-    numnatives=NUMENTRIES(hdr,natives,libraries);
-    func=GETENTRY(hdr,natives,0);
-    for (i=0; i<numnatives && func->address!=0; i++)
-      func=(AMX_FUNCSTUB*)((unsigned char*)func+hdr->defsize);
-    if (i<numnatives)
-      return AMX_ERR_NOTFOUND;
-    amx->flags|=AMX_FLAG_NTVREG;  /* no need to check this again */
-  } /* if */
+  if ((amx->flags & AMX_FLAG_NTVREG)==0 && !NativesRegistered(amx))
+    return AMX_ERR_NOTFOUND;
   assert((amx->flags & AMX_FLAG_VERIFY)==0);
 
   /* set up the registers */
@@ -2188,6 +4353,193 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       amx->cip=0;
     } /* if */
   } /* if */
+  #if defined AMX_PROFILE
+    if (index!=AMX_EXEC_CONT)
+      profilecalls(amx,index,1);
+  #endif
+  return ExecCore(amx,retval,data,reset_stk,reset_hea,index!=AMX_EXEC_CONT);
+}
+
+/* amx_PrepareCall() looks up the entry point of a public function (or of
+ * main(), for AMX_EXEC_MAIN) and does the checks of amx_Exec() that do not
+ * depend on the state of the stack, once. amx_Invoke() then copies all
+ * arguments to the stack in one block and runs the function. The arguments
+ * are cells that are passed by value; for arrays and strings, the host
+ * allocates them with amx_Allot() and passes their address. The prepared
+ * call is valid until amx_Cleanup() (or until the overlay callback changes).
+ */
+int AMXAPI amx_PrepareCall(AMX *amx, int index, int nargs, AMX_CALL *call)
+{
+  AMX_HEADER *hdr;
+  AMX_FUNCSTUB *func;
+
+  if (amx==NULL || call==NULL || nargs<0)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  if (amx->callback==NULL)
+    return AMX_ERR_CALLBACK;
+  hdr=(AMX_HEADER *)amx->base;
+  assert(hdr!=NULL);
+  assert(hdr->magic==AMX_MAGIC);
+  if ((amx->flags & AMX_FLAG_NTVREG)==0 && !NativesRegistered(amx))
+    return AMX_ERR_NOTFOUND;
+  if (hdr->overlays!=hdr->nametable && amx->overlay==NULL)
+    return AMX_ERR_OVERLAY;
+  if ((long)nargs*sizeof(cell)+STKMARGIN>=(long)(hdr->stp-hdr->hea))
+    return AMX_ERR_STACKERR;    /* the arguments can never fit */
+
+  if (index==AMX_EXEC_MAIN) {
+    if (hdr->cip<0)
+      return AMX_ERR_INDEX;
+    call->cip=hdr->cip;
+  } else if (index<0 || index>=(int)NUMENTRIES(hdr,publics,natives)) {
+    return AMX_ERR_INDEX;
+  } else {
+    func=GETENTRY(hdr,publics,index);
+    call->cip=func->address;
+  } /* if */
+  if (hdr->overlays!=hdr->nametable) {
+    call->ovl_index=(int)call->cip;
+    call->cip=0;
+  } else {
+    call->ovl_index=-1;
+  } /* if */
+  call->amx=amx;
+  call->nargs=nargs;
+  call->index=index;
+  return AMX_ERR_NONE;
+}
+
+/* amx_Invoke() runs a call that amx_PrepareCall() set up; "args" holds the
+ * arguments in the order of the function's parameters (so the first argument
+ * is what amx_Push() would push last). Arguments pushed with amx_Push() may
+ * not be pending.
+ */
+int AMXAPI amx_Invoke(AMX_CALL *call, const cell *args, cell *retval)
+{
+  AMX *amx;
+  unsigned char *data;
+  cell reset_stk,reset_hea;
+  int err;
+
+  assert(call!=NULL && call->amx!=NULL);
+  amx=call->amx;
+  if (amx->paramcount!=0)
+    return AMX_ERR_PARAMS;
+  if (amx->stk-amx->hea-(cell)((call->nargs+2)*sizeof(cell))<STKMARGIN)
+    return AMX_ERR_STACKERR;
+
+  data=(amx->data!=NULL) ? amx->data : amx->base+(int)((AMX_HEADER *)amx->base)->dat;
+  if (call->nargs>0) {
+    assert(args!=NULL);
+    amx->stk-=call->nargs*sizeof(cell);
+    memcpy(data+(int)amx->stk,args,call->nargs*sizeof(cell));
+    amx->paramcount=call->nargs;
+  } /* if */
+  reset_stk=amx->stk;
+  reset_hea=amx->hea;
+  amx->error=AMX_ERR_NONE;
+  amx->cip=call->cip;
+  if (call->ovl_index>=0) {
+    amx->ovl_index=call->ovl_index;
+    if ((err=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE) {
+      amx->stk+=call->nargs*sizeof(cell);
+      amx->paramcount=0;
+      return err;
+    } /* if */
+  } /* if */
+  #if defined AMX_PROFILE
+    profilecalls(amx,call->index,1);
+  #endif
+  return ExecCore(amx,retval,data,reset_stk,reset_hea,1);
+}
+
+/* amx_ExecBatch() runs a public function (or main(), for AMX_EXEC_MAIN) once
+ * for each of "count" sets of "nargs" arguments. The argument sets are stored
+ * one after another in "argblocks", each in the order of the function's
+ * parameters (as for amx_Invoke()); the return values go to "results", which
+ * may be NULL. The batch stops at the first call that fails or that goes to
+ * sleep, and the function returns the error code of that call; "processed"
+ * (if not NULL) is set to the number of calls that completed, which is also
+ * the position of the call that stopped. A sleeping call is continued with
+ * amx_Exec() and AMX_EXEC_CONT, like any other; the host can then start a new
+ * batch on the remaining argument sets.
+ */
+int AMXAPI amx_ExecBatch(AMX *amx, int index, const cell *argblocks, int count, int nargs, cell *results, int *processed)
+{
+  AMX_CALL call;
+  AMX_BATCH batch;
+  cell retval;
+  int i,err;
+
+  if (processed!=NULL)
+    *processed=0;
+  if (count<0 || (count>0 && nargs>0 && argblocks==NULL))
+    return AMX_ERR_PARAMS;
+  if ((err=amx_PrepareCall(amx,index,nargs,&call))!=AMX_ERR_NONE)
+    return err;
+  if (count==0)
+    return AMX_ERR_NONE;
+
+  i=0;
+  if (call.ovl_index<0) {
+    /* let the core loop over the calls; it stores the return values */
+    batch.args=argblocks;
+    batch.results=results;
+    batch.count=count;
+    batch.done=0;
+    batch.nargs=nargs;
+    batch.cip=call.cip;
+    batch.stk=amx->stk;
+    batch.hea=amx->hea;
+    amx->batch=&batch;
+    err=amx_Invoke(&call,argblocks,&retval);
+    amx->batch=NULL;
+    i=batch.done;
+    #if defined AMX_PROFILE
+      /* amx_Invoke() counted the first call, the core started the others */
+      profilecalls(amx,index,(i<count) ? i : count-1);
+    #endif
+    if (err!=AMX_ERR_NONE || i>0) {
+      if (processed!=NULL)
+        *processed=i;
+      return err;
+    } /* if */
+    /* the core does not run batches (e.g. the JIT), the first call is done */
+    if (results!=NULL)
+      results[0]=retval;
+    i=1;
+  } /* if */
+  for ( ; i<count; i++) {
+    err=amx_Invoke(&call,(nargs>0) ? argblocks+(size_t)i*nargs : NULL,&retval);
+    if (err!=AMX_ERR_NONE)
+      break;
+    if (results!=NULL)
+      results[i]=retval;
+  } /* for */
+  if (processed!=NULL)
+    *processed=i;
+  return err;
+}
+
+/* ExecCore() runs the abstract machine from amx->cip, after amx_Exec() or
+ * amx_Invoke() has set it; for a new call ("newcall" is true), it pushes the
+ * size of the parameters and the return address first
+ */
+static int ExecCore(AMX *amx, cell *retval, unsigned char *data, cell reset_stk, cell reset_hea, int newcall)
+{
+  int i;
+#if !defined AMX_ALTCORE
+  AMX_HEADER *hdr=(AMX_HEADER *)amx->base;
+  AMX_BATCH *batch;
+  cell pri,alt,stk,frm,hea;
+  cell *cip,op,offs,val;
+  #if defined AMX_PROFILE
+    AMX_PROFILEDATA *profile;
+  #endif
+#endif
+
   /* check values just copied */
   if (amx->stk>amx->stp)
     return AMX_ERR_STACKLOW;
@@ -2219,7 +4571,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
     #error Unsupported cell size
   #endif
 
-  if (index!=AMX_EXEC_CONT) {
+  if (newcall) {
     reset_stk+=amx->paramcount*sizeof(cell);
     AMXPUSH(amx->paramcount*sizeof(cell));
     amx->paramcount=0;          /* push the parameter count to the stack & reset */
@@ -2229,6 +4581,41 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
   if (amx->hea+STKMARGIN>amx->stk)
     return AMX_ERR_STACKERR;
 
+  /* run the translation to C, if there is one (see amx_InitAOT()) */
+  if (amx->aot!=NULL) {
+    AMX_FUNCSTUB *natives=NULL;
+    #if defined AMX_DEFCALLBACK && !defined AMX_PROFILE
+      /* like SYSREQ.D, bypass the callback when it is the default one; the
+       * profiler needs the native function's index, so not with AMX_PROFILE
+       */
+      if (amx->callback==amx_Callback)
+        natives=GETENTRY((AMX_HEADER *)amx->base,natives,0);
+    #endif
+    i = amx->aot(amx,retval,data,natives);
+    if (i == AMX_ERR_SLEEP || (i == AMX_ERR_FUEL && amx->fuelmode == AMX_FUEL_SUSPEND)) {
+      amx->reset_stk=reset_stk;
+      amx->reset_hea=reset_hea;
+    } else {
+      amx->stk=reset_stk;
+      amx->hea=reset_hea;
+    } /* if */
+    return i;
+  } /* if */
+
+#if defined AMX_JIT_X64
+  if ((amx->flags & AMX_FLAG_JITC)!=0) {
+    i = amx_jit_run(amx,retval,data);
+    if (i == AMX_ERR_SLEEP || (i == AMX_ERR_FUEL && amx->fuelmode == AMX_FUEL_SUSPEND)) {
+      amx->reset_stk=reset_stk;
+      amx->reset_hea=reset_hea;
+    } else {
+      amx->stk=reset_stk;
+      amx->hea=reset_hea;
+    } /* if */
+    return i;
+  } /* if */
+#endif
+
 #if defined AMX_ALTCORE
 
   /* start running either the ARM or 80x86 assembler abstract machine or the JIT */
@@ -2243,7 +4630,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
     /* also for GNU GCC and Intel C/C++ versions */
     i = amx_exec_run(amx,retval,data);
   #endif
-  if (i == AMX_ERR_SLEEP) {
+  if (i == AMX_ERR_SLEEP || (i == AMX_ERR_FUEL && amx->fuelmode == AMX_FUEL_SUSPEND)) {
     amx->reset_stk=reset_stk;
     amx->reset_hea=reset_hea;
   } else {
@@ -2258,14 +4645,46 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
 
 #else
 
-  #define CHKMARGIN()   if (hea+STKMARGIN>stk) return AMX_ERR_STACKERR
+  #define CHKMARGIN()   if (hea+STKMARGIN+amx->stkreserve>stk && stackout(amx,hea,stk)) \
+                          return AMX_ERR_STACKERR
   #define CHKSTACK()    if (stk>amx->stp) return AMX_ERR_STACKLOW
   #define CHKHEAP()     if (hea<amx->hlw) return AMX_ERR_HEAPLOW
 
+  /* FUEL() takes one unit from the instruction budget, on calls and on
+   * backward jumps; when the budget is exhausted, the instruction restarts
+   * when the abstract machine continues, so "n" is the number of parameters
+   * of the instruction that have been read so far
+   */
+  #define FUEL(n)       if (--amx->fuel<0 && fuelout(amx,(cell)((unsigned char *)(cip-(n)-1)-amx->code),frm)) \
+                          { cip-=(n)+1; offs=AMX_ERR_FUEL; goto __halt; }
+  #define TAKEJUMP(n)   do { if (*cip<=0) FUEL(n); cip=JUMPREL(cip); } while (0)
+
+  /* when ProvePcode() has dropped memory checks, a function may only return
+   * directly behind a CALL instruction (or to the host), because the proofs
+   * assume the stack depth that the CALL leaves
+   */
+  #define RETSITE(offs) ((offs)==0 || ((offs)>=2*(cell)sizeof(cell) \
+                         && *(cell *)(amx->code+(int)(offs)-2*sizeof(cell))==OP_CALL))
+
   /* PUSH() and POP() are defined in terms of the _R() and _W() macros */
   #define PUSH(v)       ( stk-=sizeof(cell), _W(data,stk,v) )
   #define POP(v)        ( v=_R(data,stk), stk+=sizeof(cell) )
 
+  /* NATIVECALL() calls a native function through the callback; with the
+   * profiler, it also counts and times the call
+   */
+  #if defined AMX_PROFILE
+    #define NATIVECALL(err,index,params) \
+      { uint64_t start_=amx_profile_ticks(); \
+        err=amx->callback(amx,index,&pri,params); \
+        if (profile!=NULL && (ucell)(index)<(ucell)profile->numnatives) { \
+          profile->natcalls[index]++; \
+          profile->natticks[index]+=amx_profile_ticks()-start_; \
+        } }
+  #else
+    #define NATIVECALL(err,index,params) ( err=amx->callback(amx,index,&pri,params) )
+  #endif
+
   /* set up registers for ANSI-C core: pri, alt, frm, cip, hea, stk */
   pri=amx->pri;
   alt=amx->alt;
@@ -2273,10 +4692,19 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
   cip=(cell *)(amx->code+(int)amx->cip);
   hea=amx->hea;
   stk=amx->stk;
+  batch=amx->batch;
+  amx->batch=NULL;  /* a native function that calls amx_Exec() runs no batch */
+  #if defined AMX_PROFILE
+    profile=amx->profile;
+  #endif
 
   /* start running */
   for ( ;; ) {
     op=_RCODE();
+    #if defined AMX_PROFILE
+      if (profile!=NULL)
+        profile->opcodes[GETOPCODE(op)]++;
+    #endif
     switch (GETOPCODE(op)) {
     /* core instruction set */
     case OP_NOP:
@@ -2319,6 +4747,9 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       /* verify address */
       if (pri>=hea && pri<stk || (ucell)pri>=(ucell)amx->stp)
         ABORT(amx,AMX_ERR_MEMACCESS);
+#if !defined AMX_NO_FUSED_OPC
+    __lodb_i_nc:
+#endif
       switch ((int)offs) {
       case 1:
         pri=_R8(data,pri);
@@ -2370,6 +4801,9 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       /* verify address */
       if (alt>=hea && alt<stk || (ucell)alt>=(ucell)amx->stp)
         ABORT(amx,AMX_ERR_MEMACCESS);
+#if !defined AMX_NO_FUSED_OPC
+    __strb_i_nc:
+#endif
       switch ((int)offs) {
       case 1:
         _W8(data,alt,pri);
@@ -2484,7 +4918,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       POP(frm);
       POP(offs);
       /* verify the return address */
-      if ((long)offs>=amx->codesize)
+      if ((long)offs>=amx->codesize || amx->unchecked>0 && !RETSITE(offs))
         ABORT(amx,AMX_ERR_MEMACCESS);
       cip=(cell *)(amx->code+(int)offs);
       break;
@@ -2492,29 +4926,30 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       POP(frm);
       POP(offs);
       /* verify the return address */
-      if ((long)offs>=amx->codesize)
+      if ((long)offs>=amx->codesize || amx->unchecked>0 && !RETSITE(offs))
         ABORT(amx,AMX_ERR_MEMACCESS);
       cip=(cell *)(amx->code+(int)offs);
       stk+=_R(data,stk)+sizeof(cell);   /* remove parameters from the stack */
       break;
     case OP_CALL:
+      FUEL(0);
       PUSH(((unsigned char *)cip-amx->code)+sizeof(cell));/* skip address */
       cip=JUMPREL(cip);                 /* jump to the address */
       break;
     case OP_JUMP:
       /* since the GETPARAM() macro modifies cip, you cannot
        * do GETPARAM(cip) directly */
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
       break;
     case OP_JZER:
       if (pri==0)
-        cip=JUMPREL(cip);
+        TAKEJUMP(0);
       else
         SKIPPARAM(1);
       break;
     case OP_JNZ:
       if (pri!=0)
-        cip=JUMPREL(cip);
+        TAKEJUMP(0);
       else
         SKIPPARAM(1);
       break;
@@ -2643,6 +5078,9 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
         ABORT(amx,AMX_ERR_MEMACCESS);
       if ((alt+offs)>hea && (alt+offs)<stk || (ucell)(alt+offs)>(ucell)amx->stp)
         ABORT(amx,AMX_ERR_MEMACCESS);
+#if !defined AMX_NO_FUSED_OPC
+    __movs_nc:
+#endif
       #if defined _R_DEFAULT
         memcpy(data+(int)alt, data+(int)pri, (int)offs);
       #else
@@ -2670,6 +5108,9 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
         ABORT(amx,AMX_ERR_MEMACCESS);
       if ((alt+offs)>hea && (alt+offs)<stk || (ucell)(alt+offs)>(ucell)amx->stp)
         ABORT(amx,AMX_ERR_MEMACCESS);
+#if !defined AMX_NO_FUSED_OPC
+    __cmps_nc:
+#endif
       #if defined _R_DEFAULT
         pri=memcmp(data+(int)alt, data+(int)pri, (int)offs);
       #else
@@ -2688,20 +5129,42 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
         ABORT(amx,AMX_ERR_MEMACCESS);
       if ((alt+offs)>hea && (alt+offs)<stk || (ucell)(alt+offs)>(ucell)amx->stp)
         ABORT(amx,AMX_ERR_MEMACCESS);
-      for (i=(int)alt; (size_t)offs>=sizeof(cell); i+=sizeof(cell), offs-=sizeof(cell))
-        _W32(data,i,pri);
+#if !defined AMX_NO_FUSED_OPC
+    __fill_nc:
+#endif
+      #if defined _W_DEFAULT
+        simd_fill((cell *)(data+(int)alt),pri,(size_t)offs/sizeof(cell));
+      #else
+        for (i=(int)alt; (size_t)offs>=sizeof(cell); i+=sizeof(cell), offs-=sizeof(cell))
+          _W(data,i,pri);
+      #endif
       break;
     case OP_HALT:
       GETPARAM(offs);
     __halt:
       if (retval!=NULL)
         *retval=pri;
+      if (offs==AMX_ERR_NONE && batch!=NULL) {
+        /* start the next call of amx_ExecBatch() */
+        if (batch->results!=NULL)
+          batch->results[batch->done]=pri;
+        if (++batch->done<batch->count) {
+          stk=batch->stk-batch->nargs*sizeof(cell);
+          hea=batch->hea;
+          if (batch->nargs>0)
+            memcpy(data+(int)stk,batch->args+(size_t)batch->done*batch->nargs,batch->nargs*sizeof(cell));
+          PUSH(batch->nargs*sizeof(cell));
+          PUSH(0);
+          cip=(cell *)(amx->code+(int)batch->cip);
+          break;
+        } /* if */
+      } /* if */
       /* store complete status (stk and hea are already set in the ABORT macro) */
       amx->frm=frm;
       amx->pri=pri;
       amx->alt=alt;
       amx->cip=(cell)((unsigned char*)cip-amx->code);
-      if (offs==AMX_ERR_SLEEP) {
+      if (offs==AMX_ERR_SLEEP || (offs==AMX_ERR_FUEL && amx->fuelmode==AMX_FUEL_SUSPEND)) {
         amx->stk=stk;
         amx->hea=hea;
         amx->reset_stk=reset_stk;
@@ -2723,7 +5186,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       amx->hea=hea;
       amx->frm=frm;
       amx->stk=stk;
-      i=amx->callback(amx,offs,&pri,(cell *)(data+(int)stk));
+      NATIVECALL(i,offs,(cell *)(data+(int)stk));
       if (i!=AMX_ERR_NONE) {
         if (i==AMX_ERR_SLEEP) {
           amx->pri=pri;
@@ -2737,13 +5200,12 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       break;
     case OP_SWITCH: {
       cell *cptr=JUMPREL(cip)+1;/* +1, to skip the "casetbl" opcode */
+      cell *rec;
       assert(*JUMPREL(cip)==OP_CASETBL);
-      cip=JUMPREL(cptr+1);      /* preset to "none-matched" case */
-      i=(int)*cptr;             /* number of records in the case table */
-      for (cptr+=2; i>0 && *cptr!=pri; i--,cptr+=2)
-        /* nothing */;
-      if (i>0)
-        cip=JUMPREL(cptr+1);    /* case found */
+      if ((rec=FindCase(cptr,pri))!=NULL)
+        cip=JUMPREL(rec+1);     /* case found */
+      else
+        cip=JUMPREL(cptr+1);    /* "none-matched" case */
       break;
     } /* case */
     case OP_SWAP_PRI:
@@ -2827,6 +5289,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
     /* overlay instructions */
 #if !defined AMX_NO_OVERLAY
     case OP_CALL_OVL:
+      FUEL(0);
       offs=(cell)((unsigned char *)cip-amx->code+sizeof(cell)); /* skip address */
       assert(offs>=0 && offs<(1<<(sizeof(cell)*4)));
       PUSH((offs<<(sizeof(cell)*4)) | amx->ovl_index);
@@ -2851,13 +5314,12 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       break;
     case OP_SWITCH_OVL: {
       cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "icasetbl" opcode */
+      cell *rec;
       assert(*JUMPREL(cip)==OP_CASETBL_OVL);
-      amx->ovl_index=*(cptr+1);   /* preset to "none-matched" case */
-      i=(int)*cptr;               /* number of records in the case table */
-      for (cptr+=2; i>0 && *cptr!=pri; i--,cptr+=2)
-        /* nothing */;
-      if (i>0)
-        amx->ovl_index=*(cptr+1); /* case found */
+      if ((rec=FindCase(cptr,pri))!=NULL)
+        amx->ovl_index=*(rec+1);  /* case found */
+      else
+        amx->ovl_index=*(cptr+1); /* "none-matched" case */
       assert(amx->overlay!=NULL);
       if ((i=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
         ABORT(amx,i);
@@ -2920,37 +5382,37 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       break;
     case OP_JEQ:
       if (pri==alt)
-        cip=JUMPREL(cip);
+        TAKEJUMP(0);
       else
         SKIPPARAM(1);
       break;
     case OP_JNEQ:
       if (pri!=alt)
-        cip=JUMPREL(cip);
+        TAKEJUMP(0);
       else
         SKIPPARAM(1);
       break;
     case OP_JSLESS:
       if (pri<alt)
-        cip=JUMPREL(cip);
+        TAKEJUMP(0);
       else
         SKIPPARAM(1);
       break;
     case OP_JSLEQ:
       if (pri<=alt)
-        cip=JUMPREL(cip);
+        TAKEJUMP(0);
       else
         SKIPPARAM(1);
       break;
     case OP_JSGRTR:
       if (pri>alt)
-        cip=JUMPREL(cip);
+        TAKEJUMP(0);
       else
         SKIPPARAM(1);
       break;
     case OP_JSGEQ:
       if (pri>=alt)
-        cip=JUMPREL(cip);
+        TAKEJUMP(0);
       else
         SKIPPARAM(1);
       break;
@@ -3053,7 +5515,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       amx->hea=hea;
       amx->frm=frm;
       amx->stk=stk;
-      i=amx->callback(amx,offs,&pri,(cell *)(data+(int)stk));
+      NATIVECALL(i,offs,(cell *)(data+(int)stk));
       stk+=val+4;
       if (i!=AMX_ERR_NONE) {
         if (i==AMX_ERR_SLEEP) {
@@ -3398,6 +5860,196 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       } /* if */
       break;
 #endif /* AMX_NO_PACKED_OPC */
+#if !defined AMX_NO_FUSED_OPC
+    /* superinstructions, see FusePcode(); these skip the opcode of the
+     * second instruction
+     */
+    case OP_LOAD_S_PUSH:
+      GETPARAM(offs);
+      pri=_R(data,frm+offs);
+      SKIPPARAM(1);
+      PUSH(pri);
+      break;
+    case OP_LIDX_PUSH:
+      offs=pri*sizeof(cell)+alt;
+      /* verify address */
+      if (offs>=hea && offs<stk || (ucell)offs>=(ucell)amx->stp)
+        ABORT(amx,AMX_ERR_MEMACCESS);
+      pri=_R(data,offs);
+      SKIPPARAM(1);
+      PUSH(pri);
+      break;
+    case OP_PUSH_C_CALL:
+      FUEL(0);
+      GETPARAM(offs);
+      PUSH(offs);
+      SKIPPARAM(1);
+      PUSH(((unsigned char *)cip-amx->code)+sizeof(cell));/* skip address */
+      cip=JUMPREL(cip);                 /* jump to the address */
+      break;
+    case OP_CONST_ALT_JEQ:
+      GETPARAM(alt);
+      SKIPPARAM(1);
+      if (pri==alt)
+        TAKEJUMP(2);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_ALT_JNEQ:
+      GETPARAM(alt);
+      SKIPPARAM(1);
+      if (pri!=alt)
+        TAKEJUMP(2);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_ALT_JSLESS:
+      GETPARAM(alt);
+      SKIPPARAM(1);
+      if (pri<alt)
+        TAKEJUMP(2);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_ALT_JSLEQ:
+      GETPARAM(alt);
+      SKIPPARAM(1);
+      if (pri<=alt)
+        TAKEJUMP(2);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_ALT_JSGRTR:
+      GETPARAM(alt);
+      SKIPPARAM(1);
+      if (pri>alt)
+        TAKEJUMP(2);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_ALT_JSGEQ:
+      GETPARAM(alt);
+      SKIPPARAM(1);
+      if (pri>=alt)
+        TAKEJUMP(2);
+      else
+        SKIPPARAM(1);
+      break;
+#if !defined AMX_NO_PACKED_OPC
+    case OP_LOAD_P_S_PUSH:
+      GETPARAM_P(offs,op);
+      pri=_R(data,frm+offs);
+      SKIPPARAM(1);
+      PUSH(pri);
+      break;
+    case OP_PUSH_P_C_CALL:
+      FUEL(0);
+      GETPARAM_P(offs,op);
+      PUSH(offs);
+      SKIPPARAM(1);
+      PUSH(((unsigned char *)cip-amx->code)+sizeof(cell));/* skip address */
+      cip=JUMPREL(cip);                 /* jump to the address */
+      break;
+    case OP_CONST_P_ALT_JEQ:
+      GETPARAM_P(alt,op);
+      SKIPPARAM(1);
+      if (pri==alt)
+        TAKEJUMP(1);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_P_ALT_JNEQ:
+      GETPARAM_P(alt,op);
+      SKIPPARAM(1);
+      if (pri!=alt)
+        TAKEJUMP(1);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_P_ALT_JSLESS:
+      GETPARAM_P(alt,op);
+      SKIPPARAM(1);
+      if (pri<alt)
+        TAKEJUMP(1);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_P_ALT_JSLEQ:
+      GETPARAM_P(alt,op);
+      SKIPPARAM(1);
+      if (pri<=alt)
+        TAKEJUMP(1);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_P_ALT_JSGRTR:
+      GETPARAM_P(alt,op);
+      SKIPPARAM(1);
+      if (pri>alt)
+        TAKEJUMP(1);
+      else
+        SKIPPARAM(1);
+      break;
+    case OP_CONST_P_ALT_JSGEQ:
+      GETPARAM_P(alt,op);
+      SKIPPARAM(1);
+      if (pri>=alt)
+        TAKEJUMP(1);
+      else
+        SKIPPARAM(1);
+      break;
+#endif
+    /* memory accesses that ProvePcode() found to be always valid */
+    case OP_LOAD_I_NC:
+      pri=_R(data,pri);
+      break;
+    case OP_LODB_I_NC:
+      GETPARAM(offs);
+      goto __lodb_i_nc;
+    case OP_STOR_I_NC:
+      _W(data,alt,pri);
+      break;
+    case OP_STRB_I_NC:
+      GETPARAM(offs);
+      goto __strb_i_nc;
+    case OP_LIDX_NC:
+      pri=_R(data,pri*sizeof(cell)+alt);
+      break;
+    case OP_LIDX_B_NC:
+      GETPARAM(offs);
+      pri=_R(data,(pri << (int)offs)+alt);
+      break;
+    case OP_MOVS_NC:
+      GETPARAM(offs);
+      goto __movs_nc;
+    case OP_CMPS_NC:
+      GETPARAM(offs);
+      goto __cmps_nc;
+    case OP_FILL_NC:
+      GETPARAM(offs);
+      goto __fill_nc;
+#if !defined AMX_NO_PACKED_OPC
+    case OP_LODB_P_I_NC:
+      GETPARAM_P(offs,op);
+      goto __lodb_i_nc;
+    case OP_STRB_P_I_NC:
+      GETPARAM_P(offs,op);
+      goto __strb_i_nc;
+    case OP_LIDX_P_B_NC:
+      GETPARAM_P(offs,op);
+      pri=_R(data,(pri << (int)offs)+alt);
+      break;
+    case OP_MOVS_P_NC:
+      GETPARAM_P(offs,op);
+      goto __movs_nc;
+    case OP_CMPS_P_NC:
+      GETPARAM_P(offs,op);
+      goto __cmps_nc;
+    case OP_FILL_P_NC:
+      GETPARAM_P(offs,op);
+      goto __fill_nc;
+#endif
+#endif /* AMX_NO_FUSED_OPC */
     default:
       assert(0);  /* invalid instructions should already have been caught in VerifyPcode() */
       ABORT(amx,AMX_ERR_INVINSTR);
@@ -3427,6 +6079,107 @@ int AMXAPI amx_SetDebugHook(AMX *amx,AMX_DEBUG debug)
 }
 #endif /* AMX_SETDEBUGHOOK */
 
+#if defined AMX_XXXFUEL
+/* amx_SetFuel() sets the instruction budget of the abstract machine: the
+ * number of function calls plus backward jumps (loop iterations) that it may
+ * still execute before the action in "mode" is taken. A native function may
+ * call it too, to top up the budget. The budget is maintained by the ANSI C
+ * core, the GNU GCC core and the x86-64 JIT, but not by the assembler cores.
+ */
+int AMXAPI amx_SetFuel(AMX *amx,long fuel,int mode)
+{
+  assert(amx!=NULL);
+  if (mode<AMX_FUEL_NONE || mode>AMX_FUEL_HOOK || fuel<0)
+    return AMX_ERR_PARAMS;
+  amx->fuelmode=mode;
+  amx->fuel=(mode==AMX_FUEL_NONE) ? LONG_MAX : fuel;
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI amx_GetFuel(AMX *amx,long *fuel)
+{
+  assert(amx!=NULL);
+  assert(fuel!=NULL);
+  if (amx->fuelmode==AMX_FUEL_NONE)
+    *fuel=LONG_MAX;
+  else
+    *fuel=(amx->fuel>0) ? amx->fuel : 0;
+  return AMX_ERR_NONE;
+}
+
+/* amx_SetFuelHook() sets the function that is called when the budget runs out
+ * in the AMX_FUEL_HOOK mode. On entry, the "cip" and "frm" fields of the AMX
+ * structure hold the instruction that used up the budget and the current
+ * stack frame (the other registers are not updated), and no budget is set:
+ * the hook may set a new one with amx_SetFuel(), or the host may set one
+ * from elsewhere (e.g. a timer). The hook returns AMX_ERR_NONE to let the
+ * abstract machine run on; on any other value, amx_Exec() aborts with
+ * AMX_ERR_FUEL.
+ */
+int AMXAPI amx_SetFuelHook(AMX *amx,AMX_DEBUG hook)
+{
+  assert(amx!=NULL);
+  amx->fuelhook=hook;
+  return AMX_ERR_NONE;
+}
+#endif /* AMX_XXXFUEL */
+
+#if defined AMX_STACKLIMIT
+/* amx_SetStackLimit() sets a limit on the memory that the script may use for
+ * its stack and heap together, in bytes. The block for the stack and the heap
+ * keeps its size: the limit is a budget inside it, so that a host can give
+ * every abstract machine a large block that is only reserved (see
+ * aux_MapProgramStack()), while it keeps a script from using more of it than
+ * the host allows. When the script would go past the limit, the abstract
+ * machine calls the stack hook (see amx_SetStackHook()); without a hook, or
+ * when the hook does not raise the limit, amx_Exec() aborts with
+ * AMX_ERR_STACKERR. A limit of zero (or one that is at least the size of the
+ * block) removes the limit. The limit is kept by the ANSI C core, the GNU GCC
+ * core, the x86-64 JIT and the translations by amx2c, but not by the
+ * assembler cores. The API functions that push values or allocate memory on
+ * the heap (such as amx_Push() and amx_Allot()) are not bound by it.
+ */
+int AMXAPI amx_SetStackLimit(AMX *amx,long limit)
+{
+  cell size;
+
+  assert(amx!=NULL);
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  if (limit<0)
+    return AMX_ERR_PARAMS;
+  size=amx->stp-amx->hlw-STKMARGIN;   /* what the script may use without a limit */
+  amx->stkreserve=(limit>0 && limit<size) ? size-(cell)limit : 0;
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI amx_GetStackLimit(AMX *amx,long *limit)
+{
+  assert(amx!=NULL);
+  assert(limit!=NULL);
+  if ((amx->flags & AMX_FLAG_INIT)==0)
+    return AMX_ERR_INIT;
+  *limit=(long)(amx->stp-amx->hlw-STKMARGIN-amx->stkreserve);
+  return AMX_ERR_NONE;
+}
+
+/* amx_SetStackHook() sets the function that is called when the script reaches
+ * the limit of amx_SetStackLimit(). On entry, the "hea" and "stk" fields of
+ * the AMX structure hold the heap and the stack pointers that go past the
+ * limit (the other registers are not updated). The hook may raise the limit
+ * with amx_SetStackLimit(), for example up to a maximum that the host sets
+ * per abstract machine, and return AMX_ERR_NONE; the abstract machine then
+ * checks the new limit and runs on. On any other value, amx_Exec() aborts
+ * with AMX_ERR_STACKERR.
+ */
+int AMXAPI amx_SetStackHook(AMX *amx,AMX_DEBUG hook)
+{
+  assert(amx!=NULL);
+  amx->stackhook=hook;
+  return AMX_ERR_NONE;
+}
+#endif /* AMX_STACKLIMIT */
+
 #if defined AMX_RAISEERROR
 int AMXAPI amx_RaiseError(AMX *amx, int error)
 {
@@ -3515,14 +6268,76 @@ int AMXAPI amx_StrLen(const cell *cstr, int *length)
       } /* if */
     #endif
   } else {
-    for (len=0; cstr[len]!=0; len++)
-      /* nothing */;
+    #if defined AMX_SIMD_SSE2
+      len=simd_cellzero(cstr);
+    #else
+      for (len=0; cstr[len]!=0; len++)
+        /* nothing */;
+    #endif
   } /* if */
   *length = len;
   return AMX_ERR_NONE;
 }
 #endif
 
+#if defined AMX_XXXSTRING
+int AMXAPI amx_StrView(const cell *cstr, AMX_STRVIEW *view)
+{
+  int err;
+
+  assert(view!=NULL);
+  view->cells=cstr;
+  view->packed=(cstr!=NULL && (ucell)*cstr>UNPACKEDMAX);
+  err=amx_StrLen(cstr,&view->length);
+  return err;
+}
+
+int AMXAPI amx_StrViewGet(char *dest,const AMX_STRVIEW *view,int use_wchar,size_t size)
+{
+  int i,len;
+
+  assert(dest!=NULL && view!=NULL);
+  #if defined AMX_ANSIONLY
+    (void)use_wchar;    /* unused parameter (if ANSI only) */
+  #endif
+  if (size==0)
+    return AMX_ERR_NONE;
+  /* the length is known, so the loops need not look for the terminator */
+  len=view->length;
+  if ((size_t)len>=size)
+    len=(int)size-1;
+  #if !defined AMX_ANSIONLY
+    if (use_wchar) {
+      if (view->packed) {
+        for (i=0; i<len; i++)
+          ((wchar_t*)dest)[i]=(wchar_t)(char)amx_StrViewChar(view,i);
+      } else {
+        for (i=0; i<len; i++)
+          ((wchar_t*)dest)[i]=(wchar_t)view->cells[i];
+      } /* if */
+      ((wchar_t*)dest)[len]=0;
+      return AMX_ERR_NONE;
+    } /* if */
+  #endif
+  i=0;
+  if (view->packed) {
+    #if defined AMX_SIMD_SSE2
+      i=simd_swapcells(dest,view->cells,len/sizeof(cell))*sizeof(cell);
+    #endif
+    for ( ; i<len; i++)
+      dest[i]=(char)amx_StrViewChar(view,i);
+  } else {
+    #if defined AMX_SIMD_SSE2
+      i=simd_narrow((unsigned char*)dest,view->cells,len);
+    #endif
+    for ( ; i<len; i++)
+      dest[i]=(char)view->cells[i];
+  } /* if */
+  dest[len]='\0';
+  return AMX_ERR_NONE;
+}
+#endif /* AMX_XXXSTRING */
+
 #if defined AMX_XXXSTRING || defined AMX_PUSHXXX
 int AMXAPI amx_SetString(cell *dest,const char *source,int pack,int use_wchar,size_t size)
 {                 /* the memory blocks should not overlap */
@@ -3556,7 +6371,11 @@ int AMXAPI amx_SetString(cell *dest,const char *source,int pack,int use_wchar,si
      */
     assert(check_endian());
     #if BYTE_ORDER==LITTLE_ENDIAN
-      for (i=(int)(len/sizeof(cell)); i>=0; i--)
+      i=0;
+      #if defined AMX_SIMD_SSE2
+        i=simd_swapcells(dest,dest,(int)(len/sizeof(cell))+1);
+      #endif
+      for ( ; i<=(int)(len/sizeof(cell)); i++)
         amx_SwapCell((ucell *)&dest[i]);
     #endif
   } else {
@@ -3564,14 +6383,22 @@ int AMXAPI amx_SetString(cell *dest,const char *source,int pack,int use_wchar,si
     if (size<UNLIMITED && (size_t)len>=size)
       len=size-1;
     #if defined AMX_ANSIONLY
-      for (i=0; i<(int)len; i++)
+      i=0;
+      #if defined AMX_SIMD_SSE2
+        i=simd_widen(dest,(const unsigned char*)source,(int)len,CHAR_MIN<0);
+      #endif
+      for ( ; i<(int)len; i++)
         dest[i]=(cell)source[i];
     #else
       if (use_wchar) {
         for (i=0; i<(int)len; i++)
           dest[i]=(cell)(((wchar_t*)source)[i]);
       } else {
-        for (i=0; i<(int)len; i++)
+        i=0;
+        #if defined AMX_SIMD_SSE2
+          i=simd_widen(dest,(const unsigned char*)source,(int)len,CHAR_MIN<0);
+        #endif
+        for ( ; i<(int)len; i++)
           dest[i]=(cell)source[i];
       } /* if */
     #endif
@@ -3584,60 +6411,10 @@ int AMXAPI amx_SetString(cell *dest,const char *source,int pack,int use_wchar,si
 #if defined AMX_XXXSTRING
 int AMXAPI amx_GetString(char *dest,const cell *source,int use_wchar,size_t size)
 {
-  int len=0;
-  #if defined AMX_ANSIONLY
-    (void)use_wchar;    /* unused parameter (if ANSI only) */
-  #endif
-  if ((ucell)*source>UNPACKEDMAX) {
-    /* source string is packed */
-    cell c=0;           /* initialize to 0 to avoid a compiler warning */
-    int i=sizeof(cell)-1;
-    char ch;
-    while ((size_t)len<size) {
-      if (i==sizeof(cell)-1)
-        c=*source++;
-      ch=(char)(c >> i*CHARBITS);
-      if (ch=='\0')
-        break;          /* terminating zero character found */
-      #if defined AMX_ANSIONLY
-        dest[len++]=ch;
-      #else
-        if (use_wchar)
-          ((wchar_t*)dest)[len++]=ch;
-        else
-          dest[len++]=ch;
-      #endif
-      i=(i+sizeof(cell)-1) % sizeof(cell);
-    } /* while */
-  } else {
-    /* source string is unpacked */
-    #if defined AMX_ANSIONLY
-      while (*source!=0 && (size_t)len<size)
-        dest[len++]=(char)*source++;
-    #else
-      if (use_wchar) {
-        while (*source!=0 && (size_t)len<size)
-          ((wchar_t*)dest)[len++]=(wchar_t)*source++;
-      } else {
-        while (*source!=0 && (size_t)len<size)
-          dest[len++]=(char)*source++;
-      } /* if */
-    #endif
-  } /* if */
-  /* store terminator */
-  if ((size_t)len>=size)
-    len=(int)size-1;
-  if (len>=0) {
-    #if defined AMX_ANSIONLY
-      dest[len]='\0';
-    #else
-      if (use_wchar)
-        ((wchar_t*)dest)[len]=0;
-      else
-        dest[len]='\0';
-    #endif
-  } /* IF */
-  return AMX_ERR_NONE;
+  AMX_STRVIEW view;
+
+  amx_StrView(source,&view);
+  return amx_StrViewGet(dest,&view,use_wchar,size);
 }
 #endif /* AMX_XXXSTRING */
 
@@ -3802,6 +6579,14 @@ int AMXAPI amx_UTF8Check(const char *string, int *length)
   int err=AMX_ERR_NONE;
   int len=0;
   while (err==AMX_ERR_NONE && *string!='\0') {
+    #if defined AMX_SIMD_SSE2
+      /* skip runs of ASCII characters */
+      int ascii=simd_asciibytes((const unsigned char*)string);
+      string+=ascii;
+      len+=ascii;
+      if (*string=='\0')
+        break;
+    #endif
     err=amx_UTF8Get(string,&string,NULL);
     len++;
   } /* while */
@@ -3825,9 +6610,19 @@ int AMXAPI amx_UTF8Len(const cell *cstr, int *length)
     char buffer[10];  /* maximum UTF-8 code is 6 characters */
     char *endptr;
     int len=*length, count=0;
-    while (len-->0) {
+    while (len>0) {
+      #if defined AMX_SIMD_SSE2
+        /* ASCII characters take one byte each */
+        int ascii=simd_asciicells(cstr,len);
+        cstr+=ascii;
+        len-=ascii;
+        count+=ascii;
+        if (len==0)
+          break;
+      #endif
       amx_UTF8Put(buffer, &endptr, sizeof buffer, *cstr++);
       count+=(int)(endptr-buffer);
+      len--;
     } /* while */
     *length=count;
   } /* while */
@@ -204,12 +204,15 @@ extern  "C" {
 #define UNLIMITED     (~1u >> 1)
 
 struct tagAMX;
+struct tagFUNCSTUB;
 typedef cell (AMX_NATIVE_CALL *AMX_NATIVE)(struct tagAMX *amx, const cell *params);
 typedef int (AMXAPI *AMX_CALLBACK)(struct tagAMX *amx, cell index,
                                    cell *result, const cell *params);
 typedef int (AMXAPI *AMX_DEBUG)(struct tagAMX *amx);
 typedef int (AMXAPI *AMX_OVERLAY)(struct tagAMX *amx, int index);
 typedef int (AMXAPI *AMX_IDLE)(struct tagAMX *amx, int AMXAPI Exec(struct tagAMX *, cell *, int));
+typedef int (AMXAPI *AMX_AOTRUN)(struct tagAMX *amx, cell *retval, unsigned char *data,
+                                 const struct tagFUNCSTUB *natives);
 #if !defined _FAR
   #define _FAR
 #endif
@@ -315,6 +318,19 @@ typedef struct tagAMX {
     /* support variables for the JIT */
     int reloc_size;         /* required temporary buffer for relocations */
   #endif
+  int fused;                /* number of superinstructions created by amx_Init(), see AMX_FLAG_FUSE */
+  /* instruction budget, see amx_SetFuel() */
+  long fuel;                /* remaining budget, in calls and backward jumps */
+  int fuelmode;             /* action when the budget runs out, one of the AMX_FUEL_xxx values */
+  int unchecked;            /* number of memory accesses without run-time check, see AMX_FLAG_PROVE */
+  void _FAR *nameindex;     /* hash index on the names in the header, see amx_BuildIndex() */
+  struct tagAMX_BATCH _FAR *batch; /* calls still to run, for amx_ExecBatch() */
+  struct tagAMX_PROFILEDATA _FAR *profile; /* counters, see amx_ProfileInit() (AMX_PROFILE only) */
+  AMX_DEBUG fuelhook;       /* called when the budget runs out, see amx_SetFuelHook() */
+  /* limit on the stack and heap, see amx_SetStackLimit() */
+  cell stkreserve;          /* bytes between the heap and the stack that the script may not use */
+  AMX_DEBUG stackhook;      /* called when the script reaches the limit, see amx_SetStackHook() */
+  AMX_AOTRUN aot;           /* translated program, see amx_InitAOT() */
 } PACKED AMX;
 
 /* The AMX_HEADER structure is both the memory format as the file format. The
@@ -341,6 +357,140 @@ typedef struct tagAMX_HEADER {
   int32_t overlays;         /* offset to the overlay table */
 } PACKED AMX_HEADER;
 
+/* Extension modules keep their state per abstract machine, in a structure
+ * that starts with an AMX_MODULEDATA header; see amx_SetModuleData(). All
+ * module data of an abstract machine is chained from a single user data field
+ * (tag "ModD").
+ *
+ * Thread safety: distinct abstract machines may run concurrently in different
+ * threads, provided that each abstract machine is used by one thread at a time.
+ * This holds for the core and for the extension modules in this package, with
+ * these exceptions:
+ * - the property list of the core module (getproperty() and friends) is
+ *   shared by all abstract machines, and it is protected by a lock;
+ * - a garbage collector context (amxgc.c) may be shared by several abstract
+ *   machines, and then the host must serialize the calls;
+ * - amx_NativeInfo() returns a pointer to a static structure;
+ * - the console, the system clock and the current directory are, by their
+ *   nature, shared by all threads; the text attributes that the console
+ *   module keeps for an ANSI terminal are protected by a lock.
+ */
+typedef struct tagAMX_MODULEDATA {
+  struct tagAMX_MODULEDATA _FAR *next;
+  long tag;
+} PACKED AMX_MODULEDATA;
+
+/* The AMX_SNAPSHOT structure holds the state of an abstract machine, saved by
+ * amx_Snapshot(); the image buffer is allocated by the caller.
+ */
+typedef struct tagAMX_SNAPSHOT {
+  unsigned char _FAR *base; /* abstract machine that the snapshot was taken from */
+  unsigned char _FAR *image;/* copy of data, heap and stack, same layout as the data section */
+  cell cip, frm, hea, stk;  /* registers */
+  cell pri, alt;
+  cell reset_stk, reset_hea;
+  int paramcount;
+  int ovl_index;
+  long restored;            /* number of blocks that the last amx_Restore() copied */
+} PACKED AMX_SNAPSHOT;
+
+/* The AMX_REGISTRY structure is a hash table of native functions, which is
+ * filled once and then used for any number of abstract machines; see
+ * amx_RegisterRegistry(). The table (2^exponent entries) is allocated by the
+ * caller, and it points into the native function lists that were added, so
+ * these must stay valid. A filled registry is only read from, so it may be
+ * used from several threads at a time.
+ */
+typedef struct tagAMX_REGENTRY {
+  uint32_t hash;
+  const AMX_NATIVE_INFO _FAR *native; /* NULL for a free entry */
+} PACKED AMX_REGENTRY;
+
+typedef struct tagAMX_REGISTRY {
+  AMX_REGENTRY _FAR *table;
+  int exponent;             /* the table has 2^exponent entries */
+  int count;                /* number of native functions in the table */
+} PACKED AMX_REGISTRY;
+
+/* The AMX_CALL structure holds a call of a public function that was looked up
+ * and checked by amx_PrepareCall(), so that amx_Invoke() can start it without
+ * repeating that work on every call.
+ */
+typedef struct tagAMX_CALL {
+  AMX _FAR *amx;
+  cell cip;                 /* entry point (offset in the overlay, for overlays) */
+  int ovl_index;            /* overlay of the function, -1 if there are no overlays */
+  int nargs;                /* number of arguments (cells) */
+  int index;                /* public function index, or AMX_EXEC_MAIN */
+} PACKED AMX_CALL;
+
+/* The AMX_BATCH structure is the state of amx_ExecBatch(); the cores that
+ * support it start the next call of the batch directly when a call returns,
+ * instead of returning to amx_ExecBatch() first.
+ */
+typedef struct tagAMX_BATCH {
+  const cell _FAR *args;    /* all argument sets, "nargs" cells each */
+  cell _FAR *results;       /* return values, or NULL */
+  int count;                /* number of calls in the batch */
+  int done;                 /* number of calls that completed */
+  int nargs;
+  cell cip;                 /* entry point of the function */
+  cell stk, hea;            /* stack and heap at the start of every call */
+} PACKED AMX_BATCH;
+
+/* The AMX_STRVIEW structure refers to a string in the memory of the abstract
+ * machine, without copying it; amx_StrView() sets it up. Use amx_StrViewChar()
+ * to read a character from either a packed or an unpacked string.
+ */
+typedef struct tagAMX_STRVIEW {
+  const cell _FAR *cells;   /* start of the string in the abstract machine */
+  int length;               /* number of characters, excluding the '\0' */
+  int packed;               /* non-zero for a packed string */
+} PACKED AMX_STRVIEW;
+
+#define amx_StrViewChar(view,index)                                         \
+  ((view)->packed                                                           \
+    ? (cell)(unsigned char)((ucell)(view)->cells[(index)/sizeof(cell)]      \
+                            >> (sizeof(cell)-1-(index)%sizeof(cell))*8)     \
+    : (view)->cells[index])
+
+/* The AMX_AOTINFO structure describes a program that amx2c translated to C.
+ * The translation exports it under the name "amx_aotinfo"; a host that loads
+ * the compiled translation passes it to amx_InitAOT(), which checks that it
+ * belongs to the program that the abstract machine holds. From then on,
+ * amx_Exec() runs the translation instead of the P-code. When the abstract
+ * machine has the default callback, amx_Exec() passes the native function
+ * table to the translation, which then calls native functions directly.
+ */
+#define AMX_AOT_VERSION 2
+typedef struct tagAMX_AOTINFO {
+  int version;              /* AMX_AOT_VERSION */
+  int cellsize;             /* size of a cell in bytes */
+  int amxsize;              /* size of the AMX structure (it depends on the build options) */
+  int32_t cod, dat, hea, stp; /* the same fields in the header of the program */
+  uint32_t hash;            /* FNV-1a hash of the P-code */
+  AMX_AOTRUN run;           /* runs the program from amx->cip, like amx_exec_run() */
+} PACKED AMX_AOTINFO;
+
+/* The AMX_PROFILEDATA structure holds the counters of an abstract machine that
+ * is built with AMX_PROFILE; amx_ProfileInit() sets it up, on a block of
+ * counters that the host allocates. The "ticks" are processor cycles on x86
+ * and x86-64, and nanoseconds on other systems; the time of a native function
+ * includes that of any public functions that it calls.
+ */
+#if defined _I64_MAX || defined INT64_MAX || defined HAVE_I64
+typedef struct tagAMX_PROFILEDATA {
+  int numopcodes;           /* number of entries in "opcodes" */
+  int numnatives;           /* number of entries in "natcalls" and "natticks" */
+  int numpublics;           /* number of entries in "pubcalls" */
+  uint64_t _FAR *opcodes;   /* instructions executed, per opcode */
+  uint64_t _FAR *natcalls;  /* calls, per native function */
+  uint64_t _FAR *natticks;  /* cumulative time, per native function */
+  uint64_t _FAR *pubcalls;  /* calls from the host, per public function */
+  uint64_t maincalls;       /* calls of main() from the host */
+} PACKED AMX_PROFILEDATA;
+#endif
+
 #define AMX_MAGIC_16    0xf1e2
 #define AMX_MAGIC_32    0xf1e0
 #define AMX_MAGIC_64    0xf1e1
@@ -368,6 +518,7 @@ enum {
   AMX_ERR_DIVIDE,       /* divide by zero */
   AMX_ERR_SLEEP,        /* go into sleepmode - code can be restarted */
   AMX_ERR_INVSTATE,     /* no implementation for this state, no fall-back */
+  AMX_ERR_FUEL,         /* instruction budget exhausted, see amx_SetFuel() */
 
   AMX_ERR_MEMORY = 16,  /* out of memory */
   AMX_ERR_FORMAT,       /* invalid file format */
@@ -384,12 +535,28 @@ enum {
   AMX_ERR_OVERLAY,      /* overlays are unsupported (JIT) or uninitialized */
 };
 
+/* Actions for an exhausted instruction budget (amx_SetFuel()). In the first
+ * two cases, amx_Exec() returns AMX_ERR_FUEL; after AMX_FUEL_SUSPEND, the
+ * abstract machine can be continued with AMX_EXEC_CONT (after giving it new
+ * fuel), like after a "sleep"; after AMX_FUEL_ABORT, it is reset. With
+ * AMX_FUEL_HOOK, the abstract machine calls the fuel hook and runs on (see
+ * amx_SetFuelHook()).
+ */
+#define AMX_FUEL_NONE     0     /* no budget (the default) */
+#define AMX_FUEL_SUSPEND  1
+#define AMX_FUEL_ABORT    2
+#define AMX_FUEL_HOOK     3
+
 #define AMX_FLAG_OVERLAY  0x01  /* all function calls use overlays */
 #define AMX_FLAG_DEBUG    0x02  /* symbolic info. available */
 #define AMX_FLAG_NOCHECKS 0x04  /* no array bounds checking; no BREAK opcodes */
 #define AMX_FLAG_SLEEP    0x08  /* script uses the sleep instruction (possible re-entry or power-down mode) */
 #define AMX_FLAG_CRYPT    0x10  /* file is encrypted */
 #define AMX_FLAG_DSEG_INIT 0x20 /* data section is explicitly initialized */
+#define AMX_FLAG_VERIFIED 0x80  /* P-code was verified on an earlier load, see amx_BuildID() (set before amx_Init()) */
+#define AMX_FLAG_PROVE  0x100   /* drop memory checks that the verifier proves redundant (set before amx_Init()) */
+#define AMX_FLAG_ROCODE 0x200   /* P-code is not written to after amx_Init(), so it may be shared (set before amx_Init()) */
+#define AMX_FLAG_FUSE   0x400   /* fuse common instruction pairs into superinstructions (set before amx_Init()) */
 #define AMX_FLAG_SYSREQN 0x800  /* script uses new (optimized) version of SYSREQ opcode */
 #define AMX_FLAG_NTVREG 0x1000  /* all native functions are registered */
 #define AMX_FLAG_JITC   0x2000  /* abstract machine is JIT compiled */
@@ -433,24 +600,24 @@ enum {
 #if defined __STDC_VERSION__ && __STDC_VERSION__ >= 199901L
   /* C99: use variable-length arrays */
   #define amx_StrParam_Type(amx,param,result,type)                          \
-    int result##_length_;                                                   \
-    amx_StrLen(amx_Address(amx,param),&result##_length_);                   \
-    char result##_vla_[(result##_length_+1)*sizeof(*(result))];             \
+    AMX_STRVIEW result##_view_;                                             \
+    amx_StrView(amx_Address(amx,param),&result##_view_);                    \
+    char result##_vla_[(result##_view_.length+1)*sizeof(*(result))];        \
     (result)=(type)result##_vla_;                                           \
-    amx_GetString((char*)(result),amx_Address(amx,param),                   \
-                  sizeof(*(result))>1,result##_length_+1)
+    amx_StrViewGet((char*)(result),&result##_view_,                         \
+                   sizeof(*(result))>1,result##_view_.length+1)
   #define amx_StrParam(amx,param,result) \
     amx_StrParam_Type(amx,param,result,void*)
 #else
   /* macro using alloca() */
   #define amx_StrParam_Type(amx,param,result,type)                          \
     do {                                                                    \
-      int result##_length_;                                                 \
-      amx_StrLen(amx_Address(amx,param),&result##_length_);                 \
-      if (result##_length_>0 &&                                             \
-          ((result)=(type)alloca((result##_length_+1)*sizeof(*(result))))!=NULL) \
-        amx_GetString((char*)(result),amx_Address(amx,param),               \
-                      sizeof(*(result))>1,result##_length_+1);              \
+      AMX_STRVIEW result##_view_;                                           \
+      amx_StrView(amx_Address(amx,param),&result##_view_);                  \
+      if (result##_view_.length>0 &&                                        \
+          ((result)=(type)alloca((result##_view_.length+1)*sizeof(*(result))))!=NULL) \
+        amx_StrViewGet((char*)(result),&result##_view_,                     \
+                       sizeof(*(result))>1,result##_view_.length+1);        \
       else (result) = NULL;                                                 \
     } while (0)
   #define amx_StrParam(amx,param,result) \
@@ -463,15 +630,22 @@ uint32_t * AMXAPI amx_Align32(uint32_t *v);
   uint64_t * AMXAPI amx_Align64(uint64_t *v);
 #endif
 int AMXAPI amx_Allot(AMX *amx, int cells, cell **address);
+int AMXAPI amx_BuildID(uint32_t *id);
+int AMXAPI amx_BuildIndex(AMX *amx, void *index);
 int AMXAPI amx_Callback(AMX *amx, cell index, cell *result, const cell *params);
 int AMXAPI amx_Cleanup(AMX *amx);
 int AMXAPI amx_Clone(AMX *amxClone, AMX *amxSource, void *data);
 int AMXAPI amx_Exec(AMX *amx, cell *retval, int index);
+int AMXAPI amx_ExecBatch(AMX *amx, int index, const cell *argblocks, int count, int nargs, cell *results, int *processed);
 int AMXAPI amx_FindNative(AMX *amx, const char *name, int *index);
 int AMXAPI amx_FindPublic(AMX *amx, const char *name, int *index);
+int AMXAPI amx_FindPublics(AMX *amx, const char * const names[], int number, int index[]);
 int AMXAPI amx_FindPubVar(AMX *amx, const char *name, cell **address);
 int AMXAPI amx_FindTagId(AMX *amx, cell tag_id, char *tagname);
 int AMXAPI amx_Flags(AMX *amx,uint16_t *flags);
+int AMXAPI amx_GetFuel(AMX *amx, long *fuel);
+int AMXAPI amx_GetStackLimit(AMX *amx, long *limit);
+int AMXAPI amx_GetModuleData(AMX *amx, long tag, AMX_MODULEDATA **data);
 int AMXAPI amx_GetNative(AMX *amx, int index, char *name);
 int AMXAPI amx_GetPublic(AMX *amx, int index, char *name, ucell *address);
 int AMXAPI amx_GetPubVar(AMX *amx, int index, char *name, cell **address);
@@ -479,7 +653,10 @@ int AMXAPI amx_GetString(char *dest,const cell *source, int use_wchar, size_t si
 int AMXAPI amx_GetTag(AMX *amx, int index, char *tagname, cell *tag_id);
 int AMXAPI amx_GetUserData(AMX *amx, long tag, void **ptr);
 int AMXAPI amx_Init(AMX *amx, void *program);
+int AMXAPI amx_IndexSize(AMX *amx, size_t *size);
+int AMXAPI amx_InitAOT(AMX *amx, const AMX_AOTINFO *info);
 int AMXAPI amx_InitJIT(AMX *amx, void *reloc_table, void *native_code);
+int AMXAPI amx_Invoke(AMX_CALL *call, const cell *args, cell *retval);
 int AMXAPI amx_MemInfo(AMX *amx, long *codesize, long *datasize, long *stackheap);
 int AMXAPI amx_NameLength(AMX *amx, int *length);
 AMX_NATIVE_INFO * AMXAPI amx_NativeInfo(const char *name, AMX_NATIVE func);
@@ -487,18 +664,37 @@ int AMXAPI amx_NumNatives(AMX *amx, int *number);
 int AMXAPI amx_NumPublics(AMX *amx, int *number);
 int AMXAPI amx_NumPubVars(AMX *amx, int *number);
 int AMXAPI amx_NumTags(AMX *amx, int *number);
+int AMXAPI amx_PrepareCall(AMX *amx, int index, int nargs, AMX_CALL *call);
+#if defined _I64_MAX || defined INT64_MAX || defined HAVE_I64
+  int AMXAPI amx_ProfileInit(AMX *amx, AMX_PROFILEDATA *profile, void *counters);
+  int AMXAPI amx_ProfileOpcode(int opcode, const char **name);
+  int AMXAPI amx_ProfileReset(AMX *amx);
+  int AMXAPI amx_ProfileSize(AMX *amx, size_t *size);
+#endif
 int AMXAPI amx_Push(AMX *amx, cell value);
 int AMXAPI amx_PushAddress(AMX *amx, cell *address);
 int AMXAPI amx_PushArray(AMX *amx, cell **address, const cell array[], int numcells);
 int AMXAPI amx_PushString(AMX *amx, cell **address, const char *string, int pack, int use_wchar);
 int AMXAPI amx_RaiseError(AMX *amx, int error);
 int AMXAPI amx_Register(AMX *amx, const AMX_NATIVE_INFO *nativelist, int number);
+int AMXAPI amx_RegisterRegistry(AMX *amx, const AMX_REGISTRY *registry);
+int AMXAPI amx_RegistryAdd(AMX_REGISTRY *registry, const AMX_NATIVE_INFO *nativelist, int number);
+int AMXAPI amx_RegistryInit(AMX_REGISTRY *registry, AMX_REGENTRY *table, int exponent);
 int AMXAPI amx_Release(AMX *amx, cell *address);
+int AMXAPI amx_Restore(AMX *amx, AMX_SNAPSHOT *snapshot);
 int AMXAPI amx_SetCallback(AMX *amx, AMX_CALLBACK callback);
 int AMXAPI amx_SetDebugHook(AMX *amx, AMX_DEBUG debug);
+int AMXAPI amx_SetFuel(AMX *amx, long fuel, int mode);
+int AMXAPI amx_SetFuelHook(AMX *amx, AMX_DEBUG hook);
+int AMXAPI amx_SetModuleData(AMX *amx, long tag, AMX_MODULEDATA *data);
+int AMXAPI amx_SetStackHook(AMX *amx, AMX_DEBUG hook);
+int AMXAPI amx_SetStackLimit(AMX *amx, long limit);
 int AMXAPI amx_SetString(cell *dest, const char *source, int pack, int use_wchar, size_t size);
 int AMXAPI amx_SetUserData(AMX *amx, long tag, void *ptr);
+int AMXAPI amx_Snapshot(AMX *amx, AMX_SNAPSHOT *snapshot, void *image);
 int AMXAPI amx_StrLen(const cell *cstring, int *length);
+int AMXAPI amx_StrView(const cell *cstring, AMX_STRVIEW *view);
+int AMXAPI amx_StrViewGet(char *dest, const AMX_STRVIEW *view, int use_wchar, size_t size);
 int AMXAPI amx_UTF8Check(const char *string, int *length);
 int AMXAPI amx_UTF8Get(const char *string, const char **endptr, cell *value);
 int AMXAPI amx_UTF8Len(const cell *cstr, int *length);
@@ -203,13 +203,26 @@ static const TCHAR *tokenize(const TCHAR *string, int index, int *length)
   return start;
 }
 
-static const TCHAR *matcharg(const TCHAR *key, int skip, int *length)
+/* compares the option name with the key, which is read from the abstract
+ * machine directly
+ */
+static int matchkey(const TCHAR *option, const AMX_STRVIEW *key)
+{
+  int i;
+
+  for (i = 0; i < key->length; i++)
+    if (option[i] != (TCHAR)amx_StrViewChar(key, i))
+      return 0;
+  return 1;
+}
+
+static const TCHAR *matcharg(const AMX_STRVIEW *key, int skip, int *length)
 {
   const TCHAR *cmdline = rawcmdline();
   int index, optlen, keylen;
   const TCHAR *option, *vptr;
 
-  keylen = (key != NULL) ? (int)_tcslen(key) : 0;
+  keylen = key->length;
   index = 0;
   while ((option = tokenize(cmdline, index, length)) != NULL) {
     /* check for a colon or an equal sign (':' or '=') */
@@ -222,7 +235,7 @@ static const TCHAR *matcharg(const TCHAR *key, int skip, int *length)
       vptr = NULL;
     optlen = (vptr != NULL) ? (int)(vptr - option) : 0;
     if (keylen == 0 && vptr == NULL
-        || keylen > 0 && keylen == optlen && _tcsncmp(option, key, optlen) == 0)
+        || keylen > 0 && keylen == optlen && matchkey(option, key))
     {
       if (vptr != NULL)
         optlen++;               /* if ':' or '=' was found, skip it too */
@@ -281,7 +294,8 @@ static cell AMX_NATIVE_CALL n_argindex(AMX *amx, const cell *params)
  */
 static cell AMX_NATIVE_CALL n_argstr(AMX *amx, const cell *params)
 {
-  const TCHAR *option, *key;
+  AMX_STRVIEW key;
+  const TCHAR *option;
   int length, max;
   TCHAR *str;
   cell *cptr;
@@ -289,10 +303,10 @@ static cell AMX_NATIVE_CALL n_argstr(AMX *amx, const cell *params)
   max = (int)params[4];
   if (max <= 0)
     return 0;
-  amx_StrParam(amx, params[2], key);
+  amx_StrView(amx_Address(amx, params[2]), &key);
   cptr = amx_Address(amx, params[3]);
 
-  option = matcharg(key, (int)params[1], &length);
+  option = matcharg(&key, (int)params[1], &length);
   if (option == NULL)
     return 0;           /* option not found */
 
@@ -324,14 +338,15 @@ static cell AMX_NATIVE_CALL n_argstr(AMX *amx, const cell *params)
  */
 static cell AMX_NATIVE_CALL n_argvalue(AMX *amx, const cell *params)
 {
-  const TCHAR *option, *key;
+  AMX_STRVIEW key;
+  const TCHAR *option;
   int length;
   cell *cptr;
 
-  amx_StrParam(amx, params[2], key);
+  amx_StrView(amx_Address(amx, params[2]), &key);
   cptr = amx_Address(amx, params[3]);
 
-  option = matcharg(key, (int)params[1], &length);
+  option = matcharg(&key, (int)params[1], &length);
   if (option == NULL)
     return 0;
 
@@ -21,6 +21,16 @@
 #include <string.h>
 #include "amx.h"
 #include "amxaux.h"
+#if defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #define AUX_COWCLONE
+  #if !defined MAP_ANONYMOUS
+    #define MAP_ANONYMOUS MAP_ANON
+  #endif
+#endif
 
 size_t AMXAPI aux_ProgramSize(const char *filename)
 {
@@ -111,7 +121,7 @@ static char *messages[] = {
       /* AMX_ERR_DIVIDE    */ "Divide by zero",
       /* AMX_ERR_SLEEP     */ "(sleep mode)",
       /* AMX_ERR_INVSTATE  */ "Invalid state",
-      /* 14 */                "(reserved)",
+      /* AMX_ERR_FUEL      */ "Instruction budget exhausted",
       /* 15 */                "(reserved)",
       /* AMX_ERR_MEMORY    */ "Out of memory",
       /* AMX_ERR_FORMAT    */ "Invalid/unsupported P-code file format",
@@ -162,3 +172,612 @@ int AMXAPI aux_GetSection(const AMX *amx, int section, cell **start, size_t *siz
   } /* switch */
   return AMX_ERR_NONE;
 }
+
+#if defined AUX_COWCLONE
+
+static size_t pageround(size_t size)
+{
+  size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+  return (size + pagesize - 1) & ~(pagesize - 1);
+}
+
+/* allocdata() allocates a block for the data, heap and stack of an abstract
+ * machine, as demand-zero memory: only the pages that the abstract machine
+ * touches take physical memory, so a large stack costs nothing until it is
+ * used. A guard page (no access) sits at either side of the block, so that a
+ * native function (or code that runs without checks, see AMX_FLAG_PROVE)
+ * that writes past the block faults instead of overwriting other memory.
+ * Note that the guard pages do not separate the heap from the stack: the
+ * cores still check for a collision of the two.
+ */
+static unsigned char *allocdata(size_t size)
+{
+  size_t guard = (size_t)sysconf(_SC_PAGESIZE);
+  unsigned char *block;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+  #if defined MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+  #endif
+  block = mmap(NULL, size + 2 * guard, PROT_NONE, flags, -1, 0);
+  if (block == MAP_FAILED)
+    return NULL;
+  if (mprotect(block + guard, size, PROT_READ | PROT_WRITE) != 0) {
+    munmap(block, size + 2 * guard);
+    return NULL;
+  } /* if */
+  return block + guard;
+}
+
+static void freedata(unsigned char *data, size_t size)
+{
+  size_t guard = (size_t)sysconf(_SC_PAGESIZE);
+  munmap(data - guard, size + 2 * guard);
+}
+
+/* readheader() reads the header of the program in an open file and checks
+ * the fields that the mapping relies on
+ */
+static int readheader(int fd, AMX_HEADER *hdr)
+{
+  struct stat st;
+
+  if (fstat(fd, &st) != 0 || pread(fd, hdr, sizeof *hdr, 0) != (ssize_t)sizeof *hdr)
+    return AMX_ERR_FORMAT;
+  amx_Align16(&hdr->magic);
+  amx_Align16((uint16_t *)&hdr->flags);
+  amx_Align32((uint32_t *)&hdr->size);
+  amx_Align32((uint32_t *)&hdr->cod);
+  amx_Align32((uint32_t *)&hdr->dat);
+  amx_Align32((uint32_t *)&hdr->hea);
+  amx_Align32((uint32_t *)&hdr->stp);
+  if (hdr->magic != AMX_MAGIC || hdr->size > st.st_size || hdr->cod > hdr->dat
+      || hdr->dat > hdr->size || hdr->hea < hdr->dat || hdr->stp <= hdr->hea)
+    return AMX_ERR_FORMAT;
+  if ((hdr->flags & AMX_FLAG_OVERLAY) != 0)
+    return AMX_ERR_OVERLAY;
+  return AMX_ERR_NONE;
+}
+
+/* mapamx() maps the program from an open file (only the program, not the
+ * debug information that may follow it) and initializes the abstract
+ * machine; "init" holds the fields that must be set before amx_Init() and
+ * "stackheap" is the size for the stack and heap (if it is larger than what
+ * the header specifies)
+ */
+static int mapamx(AMX *amx, int fd, const AMX_HEADER *hdr, const AMX *init, size_t stackheap)
+{
+  unsigned char *base, *data;
+  size_t datasize;
+  int result;
+
+  datasize = pageround((size_t)(hdr->stp - hdr->dat));
+  if (stackheap > (size_t)(hdr->stp - hdr->hea)) {
+    datasize = pageround((size_t)(hdr->hea - hdr->dat) + stackheap);
+    if (datasize > (size_t)(INT32_MAX - hdr->dat))
+      return AMX_ERR_PARAMS;
+  } /* if */
+  base = mmap(NULL, (size_t)hdr->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED)
+    return AMX_ERR_MEMORY;
+  if ((data = allocdata(datasize)) == NULL) {
+    munmap(base, (size_t)hdr->size);
+    return AMX_ERR_MEMORY;
+  } /* if */
+  if ((size_t)(hdr->stp - hdr->dat) != datasize) {
+    /* the header is in a private mapping, so this does not change the file;
+     * the stored value must have the byte order of the file
+     */
+    uint32_t stp = (uint32_t)(hdr->dat + datasize);
+    amx_Align32(&stp);
+    memcpy(&((AMX_HEADER *)base)->stp, &stp, sizeof stp);
+  } /* if */
+
+  /* amx_Init() copies the data section into the data block; the code must
+   * not be patched at run time, because that would copy its pages
+   */
+  memset(amx, 0, sizeof *amx);
+  amx->data = data;
+  amx->flags = init->flags | AMX_FLAG_ROCODE;
+  amx->fused = init->fused;
+  amx->unchecked = init->unchecked;
+  result = amx_Init(amx, base);
+  if (result != AMX_ERR_NONE) {
+    freedata(data, datasize);
+    munmap(base, (size_t)hdr->size);
+    memset(amx, 0, sizeof *amx);
+  } /* if */
+  return result;
+}
+
+/* aux_MapProgram() maps the file into memory instead of reading it: the
+ * header, the name tables and the code are used from the mapping, and only
+ * the data section is copied, into a separate block for the data, heap and
+ * stack. The mapping is private, so the pages that amx_Init() or
+ * amx_Register() modify (such as the native function table) are copied on
+ * the first write; all other pages are shared with the file cache, and thus
+ * with all other processes that map the same program. This includes the code,
+ * unless amx_Init() rewrites it (to relocate the opcodes to the addresses of
+ * a threaded core, or for AMX_FLAG_FUSE). The file must not be modified while
+ * it is mapped.
+ */
+int AMXAPI aux_MapProgram(AMX *amx, const char *filename)
+{
+  return aux_MapProgramStack(amx, filename, 0);
+}
+
+/* aux_MapProgramStack() maps the program like aux_MapProgram(), but with a
+ * stack and heap of (at least) "stackheap" bytes, instead of the size that
+ * the program was compiled with (see #pragma dynamic). The memory for the
+ * stack and heap is only reserved: pages are allocated when the script first
+ * uses them, so a host can give each script a generous stack, at no cost for
+ * the scripts that do not need it. When "stackheap" is smaller than the size
+ * in the header, the size in the header is used. The block does not move
+ * while the script runs (the stack cannot be relocated), so "stackheap" is
+ * the maximum; to keep a script to a smaller budget that grows when the host
+ * allows it, see amx_SetStackLimit().
+ */
+int AMXAPI aux_MapProgramStack(AMX *amx, const char *filename, size_t stackheap)
+{
+  AMX_HEADER hdr;
+  AMX init;
+  int fd, result;
+
+  if (amx == NULL || filename == NULL)
+    return AMX_ERR_PARAMS;
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return AMX_ERR_NOTFOUND;
+  memset(&init, 0, sizeof init);
+  if ((result = readheader(fd, &hdr)) == AMX_ERR_NONE)
+    result = mapamx(amx, fd, &hdr, &init, stackheap);
+  close(fd);            /* the mapping stays valid */
+  return result;
+}
+
+/* A ready-to-run image is a copy of the program with the code as amx_Init()
+ * left it (verified and possibly rewritten), followed by this record.
+ */
+#define IMAGE_MAGIC   0x52584d41L   /* "AMXR" */
+#define IMAGE_VERSION 2
+typedef struct tagAUX_IMAGEINFO {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t flags;       /* AMX_FLAG_FUSE and AMX_FLAG_PROVE, as requested */
+  uint32_t buildid;     /* see amx_BuildID() */
+  uint32_t size;        /* size of the program */
+  uint64_t filehash;    /* hash of the program in the .amx file */
+  uint64_t imagehash;   /* hash of the image and the fields below, see hashimage() */
+  uint16_t initflags;   /* AMX_FLAG_SYSREQN, as amx_Init() set it */
+  uint16_t reserved;
+  int32_t fused;        /* "fused" and "unchecked" fields of the AMX */
+  int32_t unchecked;
+} AUX_IMAGEINFO;
+
+#define HASH_BASIS  14695981039346656037ULL
+
+static uint64_t hashblock(uint64_t hash, const void *block, size_t size)
+{
+  const unsigned char *bytes = (const unsigned char *)block;
+  uint64_t word;
+  size_t i;
+
+  /* FNV-1a, on 64-bit words */
+  for (i = 0; i + sizeof word <= size; i += sizeof word) {
+    memcpy(&word, bytes + i, sizeof word);
+    hash = (hash ^ word) * 1099511628211ULL;
+  } /* for */
+  for ( ; i < size; i++)
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  return hash;
+}
+
+/* hashimage() hashes an image as saveimage() writes it: the header and the
+ * data section of the program with the code segment in between, plus the
+ * fields of the record that are passed on to amx_Init(); a truncated or
+ * damaged image then does not pass for one that was verified
+ */
+static uint64_t hashimage(const AMX_HEADER *hdr, const unsigned char *program,
+                          const unsigned char *code, const AUX_IMAGEINFO *info)
+{
+  int32_t fields[3];
+  uint64_t hash;
+
+  hash = hashblock(HASH_BASIS, program, (size_t)hdr->cod);
+  hash = hashblock(hash, code, (size_t)(hdr->dat - hdr->cod));
+  hash = hashblock(hash, program + hdr->dat, (size_t)(hdr->size - hdr->dat));
+  fields[0] = info->initflags;
+  fields[1] = info->fused;
+  fields[2] = info->unchecked;
+  return hashblock(hash, fields, sizeof fields);
+}
+
+static int writeall(int fd, const void *buffer, size_t size, off_t offset)
+{
+  ssize_t count;
+
+  while (size > 0) {
+    if ((count = pwrite(fd, buffer, size, offset)) <= 0)
+      return 0;
+    buffer = (const unsigned char *)buffer + count;
+    size -= (size_t)count;
+    offset += count;
+  } /* while */
+  return 1;
+}
+
+/* saveimage() writes the image under a temporary name and then renames it,
+ * so that other processes never see a partial image; the header and the
+ * data section come from the original file, because amx_Init() marks the
+ * loaded libraries (and the native functions of these) in the header
+ */
+static void saveimage(const AMX *amx, const unsigned char *program, const char *imagename,
+                      const AUX_IMAGEINFO *info)
+{
+  const AMX_HEADER *hdr = (const AMX_HEADER *)program;
+  char *tmpname;
+  int fd, ok;
+
+  if ((tmpname = malloc(strlen(imagename) + 8)) == NULL)
+    return;
+  strcpy(tmpname, imagename);
+  strcat(tmpname, ".XXXXXX");
+  if ((fd = mkstemp(tmpname)) < 0) {
+    free(tmpname);
+    return;
+  } /* if */
+  ok = writeall(fd, program, (size_t)hdr->cod, 0)
+       && writeall(fd, amx->code, (size_t)(hdr->dat - hdr->cod), (off_t)hdr->cod)
+       && writeall(fd, program + hdr->dat, (size_t)(hdr->size - hdr->dat), (off_t)hdr->dat)
+       && writeall(fd, info, sizeof *info, (off_t)hdr->size);
+  fchmod(fd, 0644);
+  close(fd);
+  if (!ok || rename(tmpname, imagename) != 0)
+    unlink(tmpname);
+  free(tmpname);
+}
+
+/* checkimage() compares the hash of the image in an open file with the one
+ * in its record
+ */
+static int checkimage(int fd, const AMX_HEADER *hdr, const AUX_IMAGEINFO *image)
+{
+  unsigned char *program;
+  int ok;
+
+  program = mmap(NULL, (size_t)hdr->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (program == MAP_FAILED)
+    return 0;
+  ok = (hashimage(hdr, program, program + hdr->cod, image) == image->imagehash);
+  munmap(program, (size_t)hdr->size);
+  return ok;
+}
+
+/* aux_MapImage() loads a program like aux_MapProgram(), but it first looks
+ * for a ready-to-run image of the program in the file "imagename". When the
+ * image is valid (it was made from a program with the same contents, with the
+ * same "flags" and by an abstract machine with the same build identifier),
+ * the code is mapped from the image and amx_Init() does not verify it again;
+ * otherwise, the program is loaded from "filename" and the image is written
+ * (replacing an old one). The parameter "flags" may hold AMX_FLAG_FUSE and
+ * AMX_FLAG_PROVE. The image is checked against the hash that it was saved
+ * with, which catches an image that is damaged or truncated, but not one that
+ * was crafted on purpose: the directory for the images must be as trusted as
+ * the programs themselves. When the core cannot use images (see amx_BuildID()),
+ * the function just maps the program. Free the abstract machine with
+ * aux_UnmapProgram().
+ */
+int AMXAPI aux_MapImage(AMX *amx, const char *filename, const char *imagename, int flags)
+{
+  AMX_HEADER hdr;
+  AMX init;
+  AUX_IMAGEINFO info, image;
+  unsigned char *program;
+  uint32_t buildid;
+  int fd, imgfd, result;
+
+  if (amx == NULL || filename == NULL || imagename == NULL)
+    return AMX_ERR_PARAMS;
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return AMX_ERR_NOTFOUND;
+  if ((result = readheader(fd, &hdr)) != AMX_ERR_NONE) {
+    close(fd);
+    return result;
+  } /* if */
+  memset(&init, 0, sizeof init);
+  init.flags = flags & (AMX_FLAG_FUSE | AMX_FLAG_PROVE);
+  if (amx_BuildID(&buildid) != AMX_ERR_NONE) {
+    result = mapamx(amx, fd, &hdr, &init, 0);
+    close(fd);
+    return result;
+  } /* if */
+  program = mmap(NULL, (size_t)hdr.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (program == MAP_FAILED) {
+    close(fd);
+    return AMX_ERR_MEMORY;
+  } /* if */
+
+  memset(&info, 0, sizeof info);
+  info.magic = IMAGE_MAGIC;
+  info.version = IMAGE_VERSION;
+  info.flags = (uint16_t)init.flags;
+  info.buildid = buildid;
+  info.size = (uint32_t)hdr.size;
+  info.filehash = hashblock(HASH_BASIS, program, (size_t)hdr.size);
+
+  /* try the image */
+  if ((imgfd = open(imagename, O_RDONLY)) >= 0) {
+    AMX_HEADER imghdr;
+    if (readheader(imgfd, &imghdr) == AMX_ERR_NONE
+        && pread(imgfd, &image, sizeof image, (off_t)hdr.size) == (ssize_t)sizeof image
+        && image.magic == info.magic && image.version == info.version
+        && image.flags == info.flags && image.buildid == info.buildid
+        && image.size == info.size && image.filehash == info.filehash
+        && imghdr.size == hdr.size && imghdr.cod == hdr.cod && imghdr.dat == hdr.dat
+        && checkimage(imgfd, &hdr, &image))
+    {
+      init.flags |= AMX_FLAG_VERIFIED | (image.initflags & AMX_FLAG_SYSREQN);
+      init.fused = image.fused;
+      init.unchecked = image.unchecked;
+      result = mapamx(amx, imgfd, &hdr, &init, 0);
+      close(imgfd);
+      if (result == AMX_ERR_NONE) {
+        munmap(program, (size_t)hdr.size);
+        close(fd);
+        return result;
+      } /* if */
+      init.flags = info.flags;  /* fall back to the program */
+      init.fused = init.unchecked = 0;
+    } else {
+      close(imgfd);
+    } /* if */
+  } /* if */
+
+  /* load the program, and save the image */
+  result = mapamx(amx, fd, &hdr, &init, 0);
+  close(fd);
+  if (result == AMX_ERR_NONE) {
+    info.initflags = (uint16_t)(amx->flags & AMX_FLAG_SYSREQN);
+    info.fused = amx->fused;
+    info.unchecked = amx->unchecked;
+    info.imagehash = hashimage(&hdr, program, amx->code, &info);
+    saveimage(amx, program, imagename, &info);
+  } /* if */
+  munmap(program, (size_t)hdr.size);
+  return result;
+}
+
+/* aux_UnmapProgram() cleans up and unmaps a program that was loaded with
+ * aux_MapProgram()
+ */
+int AMXAPI aux_UnmapProgram(AMX *amx)
+{
+  AMX_HEADER *hdr;
+
+  if (amx == NULL)
+    return AMX_ERR_PARAMS;
+  if (amx->base != NULL) {
+    amx_Cleanup(amx);
+    hdr = (AMX_HEADER *)amx->base;
+    freedata(amx->data, pageround((size_t)(hdr->stp - hdr->dat)));
+    munmap(amx->base, (size_t)hdr->size);
+    memset(amx, 0, sizeof(AMX));
+  } /* if */
+  return AMX_ERR_NONE;
+}
+
+/* aux_CreateTemplate() stores a snapshot of the data section of an abstract
+ * machine in an anonymous file (sealed, on Linux), from which any number of
+ * clones can be made with aux_CloneTemplate(). The abstract machine must be
+ * initialized (and its native functions registered); it must stay loaded as
+ * long as there are clones, because the clones share its code.
+ */
+int AMXAPI aux_CreateTemplate(AUX_TEMPLATE *tpl, AMX *amx)
+{
+  AMX_HEADER *hdr;
+  unsigned char *data;
+  size_t size, done;
+  ssize_t count;
+  int fd;
+
+  if (tpl == NULL || amx == NULL)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT) == 0)
+    return AMX_ERR_INIT;
+  hdr = (AMX_HEADER *)amx->base;
+  data = (amx->data != NULL) ? amx->data : amx->base + (int)hdr->dat;
+  size = (size_t)(hdr->hea - hdr->dat);
+
+  #if defined __LINUX__ && defined MFD_ALLOW_SEALING
+    fd = memfd_create("amx-template", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  #else
+    {
+      char name[] = "/tmp/amxXXXXXX";
+      if ((fd = mkstemp(name)) >= 0)
+        unlink(name);
+    }
+  #endif
+  if (fd < 0)
+    return AMX_ERR_GENERAL;
+  /* the image is padded with zeros to a whole page; the tail of the last
+   * page is where the heap starts
+   */
+  if (ftruncate(fd, (off_t)pageround(size)) != 0) {
+    close(fd);
+    return AMX_ERR_MEMORY;
+  } /* if */
+  for (done = 0; done < size; done += (size_t)count) {
+    count = pwrite(fd, data + done, size - done, (off_t)done);
+    if (count <= 0) {
+      close(fd);
+      return AMX_ERR_MEMORY;
+    } /* if */
+  } /* for */
+  #if defined __LINUX__ && defined F_SEAL_WRITE
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+  #endif
+
+  tpl->amx = amx;
+  tpl->fd = fd;
+  tpl->datasize = pageround(size);
+  tpl->size = pageround((size_t)(hdr->stp - hdr->dat));
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI aux_DeleteTemplate(AUX_TEMPLATE *tpl)
+{
+  if (tpl == NULL)
+    return AMX_ERR_PARAMS;
+  if (tpl->amx != NULL)
+    close(tpl->fd);     /* existing clones keep their mapping of the image */
+  memset(tpl, 0, sizeof(AUX_TEMPLATE));
+  return AMX_ERR_NONE;
+}
+
+/* aux_CloneTemplate() makes a clone whose data section is a private mapping
+ * of the template image: a page is copied only when the clone writes to it,
+ * and the heap and stack are demand-zero memory. Making a clone therefore
+ * takes constant time and memory, regardless of the size of the data. Fields
+ * like "callback" and "debug" may be set in the AMX structure before the
+ * call (as for amx_Clone()); all other fields should be zero.
+ */
+int AMXAPI aux_CloneTemplate(AMX *amxClone, const AUX_TEMPLATE *tpl)
+{
+  unsigned char *block;
+  int err;
+
+  if (amxClone == NULL || tpl == NULL || tpl->amx == NULL)
+    return AMX_ERR_PARAMS;
+  if ((block = allocdata(tpl->size)) == NULL)
+    return AMX_ERR_MEMORY;
+  if (tpl->datasize > 0
+      && mmap(block, tpl->datasize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, tpl->fd, 0) == MAP_FAILED)
+  {
+    freedata(block, tpl->size);
+    return AMX_ERR_MEMORY;
+  } /* if */
+
+  amxClone->flags |= AMX_FLAG_DSEG_INIT;  /* amx_Clone() must not copy the data */
+  err = amx_Clone(amxClone, tpl->amx, block);
+  if (err != AMX_ERR_NONE)
+    freedata(block, tpl->size);
+  return err;
+}
+
+int AMXAPI aux_FreeClone(AMX *amxClone)
+{
+  AMX_HEADER *hdr;
+
+  if (amxClone == NULL)
+    return AMX_ERR_PARAMS;
+  if (amxClone->data != NULL) {
+    hdr = (AMX_HEADER *)amxClone->base;
+    freedata(amxClone->data, pageround((size_t)(hdr->stp - hdr->dat)));
+    memset(amxClone, 0, sizeof(AMX));
+  } /* if */
+  return AMX_ERR_NONE;
+}
+
+/* aux_TrimStack() gives the pages between the heap and the stack (the part
+ * of the stack and heap that is not in use) back to the system; on Linux,
+ * they become demand-zero pages again (other systems may take it as a hint).
+ * A host calls it on an idle abstract machine (after amx_Exec() returned, also
+ * when it returned AMX_ERR_SLEEP), so that an instance that once ran deep
+ * keeps no more physical memory than its data, heap and stack need. Together
+ * with a generous stack that is only reserved (see aux_MapProgramStack()),
+ * each instance effectively grows its stack on demand, up to the reserved
+ * size, and shrinks it again afterwards; amx_SetStackLimit() and its hook
+ * let the host decide on each step of the growth. The block may have been
+ * allocated in any way; only the pages that lie completely in the free gap
+ * are released. When "released" is not NULL, it is set to the
+ * size of these pages in bytes (whether or not they were resident).
+ */
+int AMXAPI aux_TrimStack(AMX *amx, size_t *released)
+{
+  AMX_HEADER *hdr;
+  unsigned char *data;
+  uintptr_t start, end;
+  size_t pagesize;
+
+  if (amx == NULL)
+    return AMX_ERR_PARAMS;
+  if ((amx->flags & AMX_FLAG_INIT) == 0)
+    return AMX_ERR_INIT;
+  hdr = (AMX_HEADER *)amx->base;
+  data = (amx->data != NULL) ? amx->data : amx->base + (int)hdr->dat;
+  pagesize = (size_t)sysconf(_SC_PAGESIZE);
+  start = ((uintptr_t)(data + (int)amx->hea) + pagesize - 1) & ~(uintptr_t)(pagesize - 1);
+  end = (uintptr_t)(data + (int)amx->stk) & ~(uintptr_t)(pagesize - 1);
+  if (released != NULL)
+    *released = 0;
+  if (end > start) {
+    #if defined MADV_DONTNEED
+      if (madvise((void *)start, (size_t)(end - start), MADV_DONTNEED) != 0)
+        return AMX_ERR_GENERAL;
+    #else
+      if (posix_madvise((void *)start, (size_t)(end - start), POSIX_MADV_DONTNEED) != 0)
+        return AMX_ERR_GENERAL;
+    #endif
+    if (released != NULL)
+      *released = (size_t)(end - start);
+  } /* if */
+  return AMX_ERR_NONE;
+}
+
+/* aux_CloneStats() returns the number of pages that a clone made with
+ * aux_CloneTemplate() has written to (so these are private copies), and the
+ * total number of pages of its data, heap and stack. Only Linux provides the
+ * page information (in /proc/self/pagemap); on other systems, the function
+ * returns AMX_ERR_GENERAL.
+ */
+int AMXAPI aux_CloneStats(const AMX *amxClone, size_t *dirty, size_t *total)
+{
+  #if defined __LINUX__
+    #define PM_SWAP       ((uint64_t)1 << 62)
+    #define PM_PRESENT    ((uint64_t)1 << 63)
+    #define PM_FILE       ((uint64_t)1 << 61)   /* file page or shared anonymous page */
+    #define PM_EXCLUSIVE  ((uint64_t)1 << 56)   /* mapped only here */
+    AMX_HEADER *hdr;
+    uint64_t entries[256];
+    size_t pagesize, first, num, i, j, count;
+    ssize_t bytes;
+    int fd;
+
+    if (amxClone == NULL || amxClone->data == NULL || dirty == NULL || total == NULL)
+      return AMX_ERR_PARAMS;
+    hdr = (AMX_HEADER *)amxClone->base;
+    pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    first = (size_t)(intptr_t)amxClone->data / pagesize;
+    num = pageround((size_t)(hdr->stp - hdr->dat)) / pagesize;
+    if ((fd = open("/proc/self/pagemap", O_RDONLY)) < 0)
+      return AMX_ERR_GENERAL;
+    *dirty = 0;
+    for (i = 0; i < num; i += count) {
+      count = num - i;
+      if (count > sizeof entries / sizeof entries[0])
+        count = sizeof entries / sizeof entries[0];
+      bytes = pread(fd, entries, count * sizeof entries[0], (off_t)((first + i) * sizeof entries[0]));
+      if (bytes != (ssize_t)(count * sizeof entries[0])) {
+        close(fd);
+        return AMX_ERR_GENERAL;
+      } /* if */
+      for (j = 0; j < count; j++) {
+        /* a page that was copied on a write is a private anonymous page; a
+         * page that was only read is either the file page or the zero page
+         */
+        uint64_t e = entries[j];
+        if ((e & PM_SWAP) != 0 || (e & (PM_PRESENT | PM_FILE | PM_EXCLUSIVE)) == (PM_PRESENT | PM_EXCLUSIVE))
+          *dirty += 1;
+      } /* for */
+    } /* for */
+    close(fd);
+    *total = num;
+    return AMX_ERR_NONE;
+  #else
+    (void)amxClone;
+    (void)dirty;
+    (void)total;
+    return AMX_ERR_GENERAL;
+  #endif
+}
+
+#endif /* AUX_COWCLONE */
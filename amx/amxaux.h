@@ -30,6 +30,12 @@ size_t AMXAPI aux_ProgramSize(const char *filename);
 int AMXAPI aux_LoadProgram(AMX *amx, const char *filename, void *memblock);
 int AMXAPI aux_FreeProgram(AMX *amx);
 
+/* loading programs through a shared memory mapping (Linux/Unix only) */
+int AMXAPI aux_MapProgram(AMX *amx, const char *filename);
+int AMXAPI aux_MapProgramStack(AMX *amx, const char *filename, size_t stackheap);
+int AMXAPI aux_MapImage(AMX *amx, const char *filename, const char *imagename, int flags);
+int AMXAPI aux_UnmapProgram(AMX *amx);
+
 /* a readable error message from an error code */
 char * AMXAPI aux_StrError(int errnum);
 
@@ -43,6 +49,22 @@ enum {
 };
 int AMXAPI aux_GetSection(const AMX *amx, int section, cell **start, size_t *size);
 
+/* copy-on-write clones of an abstract machine (Linux/Unix only) */
+typedef struct tagAUX_TEMPLATE {
+  AMX *amx;                 /* abstract machine that clones are made from */
+  int fd;                   /* (sealed) file with the image of the data section */
+  size_t datasize;          /* size of the image, rounded up to whole pages */
+  size_t size;              /* size of data + heap + stack, rounded up to whole pages */
+} AUX_TEMPLATE;
+int AMXAPI aux_CreateTemplate(AUX_TEMPLATE *tpl, AMX *amx);
+int AMXAPI aux_DeleteTemplate(AUX_TEMPLATE *tpl);
+int AMXAPI aux_CloneTemplate(AMX *amxClone, const AUX_TEMPLATE *tpl);
+int AMXAPI aux_FreeClone(AMX *amxClone);
+int AMXAPI aux_CloneStats(const AMX *amxClone, size_t *dirty, size_t *total);
+
+/* releasing the unused pages of the stack and heap (Linux/Unix only) */
+int AMXAPI aux_TrimStack(AMX *amx, size_t *released);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -292,12 +292,31 @@
       assert(val=='\r');    /* ANSI driver adds CR to the end of the command */
     #endif
   }
+  /* the terminal is shared by all threads, and so are its attributes; the
+   * lock keeps the recorded attributes in sync with the codes sent to the
+   * terminal when several abstract machines print in colour concurrently
+   */
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    static SRWLOCK attrlock = SRWLOCK_INIT;
+    #define attr_lock()     AcquireSRWLockExclusive(&attrlock)
+    #define attr_unlock()   ReleaseSRWLockExclusive(&attrlock)
+  #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
+    #include <pthread.h>
+    static pthread_mutex_t attrlock = PTHREAD_MUTEX_INITIALIZER;
+    #define attr_lock()     pthread_mutex_lock(&attrlock)
+    #define attr_unlock()   pthread_mutex_unlock(&attrlock)
+  #else
+    #define attr_lock()
+    #define attr_unlock()
+  #endif
   unsigned int amx_setattr(int foregr,int backgr,int highlight)
   {
     static short current=(0 << 8) | 7;
-    short prev = current;
+    short prev;
     char str[30];
 
+    attr_lock();
+    prev=current;
     if (foregr>=0) {
       _stprintf(str,"\x1b[%dm",foregr+30);
       amx_putstr(str);
@@ -313,6 +332,7 @@
       amx_putstr(str);
       current=(current & 0x7fff) | ((highlight & 0x01) << 15);
     } /* if */
+    attr_unlock();
     return prev;
   }
   void amx_console(int columns, int lines, int flags)
@@ -1383,22 +1403,30 @@ static cell AMX_NATIVE_CALL n_console(AMX *amx,const cell *params)
 
 
 #if !defined AMXCONSOLE_NOIDLE
-static AMX_IDLE PrevIdle = NULL;
-static int idxKeyPressed = -1;
+/* the idle hook is set per abstract machine */
+typedef struct tagCONSDATA {
+  AMX_MODULEDATA header;
+  AMX_IDLE PrevIdle;
+  int idxKeyPressed;
+} CONSDATA;
+#define CONSDATA_TAG  AMX_USERTAG('C','o','n','s')
 
 static int AMXAPI amx_ConsoleIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
 {
   int err=0, key;
+  CONSDATA *data;
 
-  assert(idxKeyPressed >= 0);
+  if (amx_GetModuleData(amx, CONSDATA_TAG, (AMX_MODULEDATA**)&data) != AMX_ERR_NONE)
+    return AMX_ERR_NONE;    /* module was cleaned up */
+  assert(data->idxKeyPressed >= 0);
 
-  if (PrevIdle != NULL)
-    PrevIdle(amx, Exec);
+  if (data->PrevIdle != NULL)
+    data->PrevIdle(amx, Exec);
 
   if (amx_kbhit()) {
     key = amx_getch();
     amx_Push(amx, key);
-    err = Exec(amx, NULL, idxKeyPressed);
+    err = Exec(amx, NULL, data->idxKeyPressed);
     while (err == AMX_ERR_SLEEP)
       err = Exec(amx, NULL, AMX_EXEC_CONT);
   } /* if */
@@ -1429,10 +1457,22 @@ const AMX_NATIVE_INFO console_Natives[] = {
 int AMXEXPORT AMXAPI amx_ConsoleInit(AMX *amx)
 {
   #if !defined AMXCONSOLE_NOIDLE
+    int index;
+    CONSDATA *data;
+
     /* see whether there is an @keypressed() function */
-    if (amx_FindPublic(amx, "@keypressed", &idxKeyPressed) == AMX_ERR_NONE) {
-      if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&PrevIdle) != AMX_ERR_NONE)
-        PrevIdle = NULL;
+    if (amx_FindPublic(amx, "@keypressed", &index) == AMX_ERR_NONE
+        && amx_GetModuleData(amx, CONSDATA_TAG, (AMX_MODULEDATA**)&data) != AMX_ERR_NONE)
+    {
+      if ((data = (CONSDATA*)malloc(sizeof(CONSDATA))) == NULL)
+        return AMX_ERR_MEMORY;
+      if (amx_SetModuleData(amx, CONSDATA_TAG, &data->header) != AMX_ERR_NONE) {
+        free(data);
+        return AMX_ERR_USERDATA;
+      } /* if */
+      data->idxKeyPressed = index;
+      if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&data->PrevIdle) != AMX_ERR_NONE)
+        data->PrevIdle = NULL;
       amx_SetUserData(amx, AMX_USERTAG('I','d','l','e'), (void*)amx_ConsoleIdle);
     } /* if */
   #endif
@@ -1442,9 +1482,14 @@ int AMXEXPORT AMXAPI amx_ConsoleInit(AMX *amx)
 
 int AMXEXPORT AMXAPI amx_ConsoleCleanup(AMX *amx)
 {
-  (void)amx;
   #if !defined AMXCONSOLE_NOIDLE
-    PrevIdle = NULL;
+    CONSDATA *data;
+    if (amx_GetModuleData(amx, CONSDATA_TAG, (AMX_MODULEDATA**)&data) == AMX_ERR_NONE) {
+      amx_SetModuleData(amx, CONSDATA_TAG, NULL);
+      free(data);
+    } /* if */
+  #else
+    (void)amx;
   #endif
   return AMX_ERR_NONE;
 }
@@ -40,6 +40,22 @@
 #if defined __WIN32__ || defined _WIN32 || defined WIN32 || defined _Windows
   #include <windows.h>
 #endif
+#if !defined AMX_NOPROPLIST
+  /* the property list is shared by all abstract machines, in all threads */
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    static SRWLOCK proplock = SRWLOCK_INIT;
+    #define prop_lock()     AcquireSRWLockExclusive(&proplock)
+    #define prop_unlock()   ReleaseSRWLockExclusive(&proplock)
+  #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
+    #include <pthread.h>
+    static pthread_mutex_t proplock = PTHREAD_MUTEX_INITIALIZER;
+    #define prop_lock()     pthread_mutex_lock(&proplock)
+    #define prop_unlock()   pthread_mutex_unlock(&proplock)
+  #else
+    #define prop_lock()
+    #define prop_unlock()
+  #endif
+#endif
 
 /* A few compilers do not provide the ANSI C standard "time" functions */
 #if !defined SN_TARGET_PS2 && !defined _WIN32_WCE && !defined __ICC430__
@@ -70,6 +86,7 @@ typedef struct _property_list {
 } proplist;
 
 static proplist proproot = { NULL, 0, NULL, 0 };
+static int propusers = 0;   /* number of abstract machines that called amx_CoreInit() */
 
 static proplist *list_additem(proplist *root)
 {
@@ -338,18 +355,22 @@ static cell AMX_NATIVE_CALL getproperty(AMX *amx,const cell *params)
   cell *cstr;
   char *name;
   proplist *item;
+  cell value;
 
   (void)amx;
   cstr=amx_Address(amx,params[2]);
   name=MakePackedString(cstr);
+  prop_lock();
   item=list_finditem(&proproot,params[1],name,params[3],NULL);
   /* if list_finditem() found the value, store the name */
   if (item!=NULL && item->value==params[3] && strlen(name)==0) {
     cstr=amx_Address(amx,params[4]);
     amx_SetString(cstr,item->name,1,0,params[5]);
   } /* if */
+  value=(item!=NULL) ? item->value : 0;
+  prop_unlock();
   free(name);
-  return (item!=NULL) ? item->value : 0;
+  return value;
 }
 
 /* setproperty(id=0, const name[]="", value=cellmin, const string[]="") */
@@ -357,11 +378,18 @@ static cell AMX_NATIVE_CALL setproperty(AMX *amx,const cell *params)
 {
   cell prev=0;
   cell *cstr;
-  char *name;
+  char *name,*string;
   proplist *item;
 
   cstr=amx_Address(amx,params[2]);
   name=MakePackedString(cstr);
+  if (strlen(name)==0) {
+    cstr=amx_Address(amx,params[4]);
+    string=MakePackedString(cstr);
+  } else {
+    string=NULL;
+  } /* if */
+  prop_lock();
   item=list_finditem(&proproot,params[1],name,params[3],NULL);
   if (item==NULL)
     item=list_additem(&proproot);
@@ -369,14 +397,12 @@ static cell AMX_NATIVE_CALL setproperty(AMX *amx,const cell *params)
     amx_RaiseError(amx,AMX_ERR_MEMORY);
   } else {
     prev=item->value;
-    if (strlen(name)==0) {
-      free(name);
-      cstr=amx_Address(amx,params[4]);
-      name=MakePackedString(cstr);
-    } /* if */
-    list_setitem(item,params[1],name,params[3]);
+    list_setitem(item,params[1],(string!=NULL) ? string : name,params[3]);
   } /* if */
+  prop_unlock();
   free(name);
+  if (string!=NULL)
+    free(string);
   return prev;
 }
 
@@ -391,11 +417,13 @@ static cell AMX_NATIVE_CALL delproperty(AMX *amx,const cell *params)
   (void)amx;
   cstr=amx_Address(amx,params[2]);
   name=MakePackedString(cstr);
+  prop_lock();
   item=list_finditem(&proproot,params[1],name,params[3],&pred);
   if (item!=NULL) {
     prev=item->value;
     list_delete(pred,item);
   } /* if */
+  prop_unlock();
   free(name);
   return prev;
 }
@@ -410,12 +438,30 @@ static cell AMX_NATIVE_CALL existproperty(AMX *amx,const cell *params)
   (void)amx;
   cstr=amx_Address(amx,params[2]);
   name=MakePackedString(cstr);
+  prop_lock();
   item=list_finditem(&proproot,params[1],name,params[3],NULL);
+  prop_unlock();
   free(name);
   return (item!=NULL);
 }
 #endif
 
+#if !defined AMX_NORANDOM || !defined AMX_NOPROPLIST
+/* every abstract machine that is set up with amx_CoreInit() has its own
+ * seed; a host that registers the core_Natives table directly shares the
+ * seed in IL_StandardRandom_seed. The module data also marks that the
+ * abstract machine is counted in propusers, so that calling amx_CoreInit()
+ * twice on the same abstract machine does not count it twice.
+ */
+typedef struct tagCOREDATA {
+  AMX_MODULEDATA header;
+  #if !defined AMX_NORANDOM
+    unsigned long seed;
+  #endif
+} COREDATA;
+#define COREDATA_TAG  AMX_USERTAG('C','o','r','e')
+#endif
+
 #if !defined AMX_NORANDOM
 /* This routine comes from the book "Inner Loops" by Rick Booth, Addison-Wesley
  * (ISBN 0-201-47960-5). This is a "multiplicative congruential random number
@@ -423,27 +469,31 @@ static cell AMX_NATIVE_CALL existproperty(AMX *amx,const cell *params)
  * only 15-bits).
  */
 #define INITIAL_SEED  0xcaa938dbL
-static unsigned long IL_StandardRandom_seed = INITIAL_SEED; /* always use a non-zero seed */
 #define IL_RMULT 1103515245L
-#if defined __BORLANDC__ || defined __WATCOMC__
-  #pragma argsused
-#endif
+
+static unsigned long IL_StandardRandom_seed = INITIAL_SEED; /* always use a non-zero seed */
+
 static cell AMX_NATIVE_CALL core_random(AMX *amx,const cell *params)
 {
     unsigned long lo, hi, ll, lh, hh, hl;
     unsigned long result;
+    unsigned long *seed;
+    COREDATA *data;
+
+    if (amx_GetModuleData(amx, COREDATA_TAG, (AMX_MODULEDATA**)&data) == AMX_ERR_NONE)
+        seed = &data->seed;
+    else
+        seed = &IL_StandardRandom_seed;
 
     /* one-time initialization (or, mostly one-time) */
     #if !defined SN_TARGET_PS2 && !defined _WIN32_WCE && !defined __ICC430__
-        if (IL_StandardRandom_seed == INITIAL_SEED)
-            IL_StandardRandom_seed=(unsigned long)time(NULL);
+        if (*seed == INITIAL_SEED)
+            *seed = (unsigned long)time(NULL) ^ (unsigned long)(intptr_t)amx;
     #endif
 
-    (void)amx;
-
-    lo = IL_StandardRandom_seed & 0xffff;
-    hi = IL_StandardRandom_seed >> 16;
-    IL_StandardRandom_seed = IL_StandardRandom_seed * IL_RMULT + 12345;
+    lo = *seed & 0xffff;
+    hi = *seed >> 16;
+    *seed = *seed * IL_RMULT + 12345;
     ll = lo * (IL_RMULT  & 0xffff);
     lh = lo * (IL_RMULT >> 16    );
     hl = hi * (IL_RMULT  & 0xffff);
@@ -486,15 +536,48 @@ const AMX_NATIVE_INFO core_Natives[] = {
 
 int AMXEXPORT AMXAPI amx_CoreInit(AMX *amx)
 {
+  #if !defined AMX_NORANDOM || !defined AMX_NOPROPLIST
+    COREDATA *data;
+    if (amx_GetModuleData(amx, COREDATA_TAG, (AMX_MODULEDATA**)&data) != AMX_ERR_NONE) {
+      if ((data = (COREDATA*)malloc(sizeof(COREDATA))) == NULL)
+        return AMX_ERR_MEMORY;
+      #if !defined AMX_NORANDOM
+        data->seed = INITIAL_SEED;
+      #endif
+      if (amx_SetModuleData(amx, COREDATA_TAG, &data->header) != AMX_ERR_NONE) {
+        free(data);
+        return AMX_ERR_USERDATA;
+      } /* if */
+      /* only count an abstract machine on its first initialization */
+      #if !defined AMX_NOPROPLIST
+        prop_lock();
+        propusers++;
+        prop_unlock();
+      #endif
+    } /* if */
+  #endif
   return amx_Register(amx, core_Natives, -1);
 }
 
 int AMXEXPORT AMXAPI amx_CoreCleanup(AMX *amx)
 {
-  (void)amx;
-  #if !defined AMX_NOPROPLIST
-    while (proproot.next!=NULL)
-      list_delete(&proproot,proproot.next);
+  #if !defined AMX_NORANDOM || !defined AMX_NOPROPLIST
+    COREDATA *data;
+    if (amx_GetModuleData(amx, COREDATA_TAG, (AMX_MODULEDATA**)&data) == AMX_ERR_NONE) {
+      amx_SetModuleData(amx, COREDATA_TAG, NULL);
+      free(data);
+      /* the property list is deleted when the last abstract machine quits */
+      #if !defined AMX_NOPROPLIST
+        prop_lock();
+        assert(propusers > 0);
+        if (--propusers == 0)
+          while (proproot.next!=NULL)
+            list_delete(&proproot,proproot.next);
+        prop_unlock();
+      #endif
+    } /* if */
+  #else
+    (void)amx;
   #endif
   return AMX_ERR_NONE;
 }
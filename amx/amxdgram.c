@@ -21,6 +21,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "osdefs.h"
 #if defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
@@ -52,8 +53,6 @@
   #define SOCKET          int
 #endif
 
-static SOCKET sLocal;
-
 static unsigned long udp_GetHostAddr(const char *host,int index)
 {
   unsigned long addr=inet_addr(host);
@@ -71,28 +70,35 @@ static unsigned long udp_GetHostAddr(const char *host,int index)
   return addr;
 }
 
-static int udp_Open(void)
+static SOCKET udp_Open(void)
 {
 #if defined __WIN32 || defined _WIN32 || defined WIN32
   WORD wVersionRequested = MAKEWORD(1,1);
   WSADATA wsaData;
 #endif
   int optval = 1;
+  SOCKET sLocal;
 
   #if defined __WIN32 || defined _WIN32 || defined WIN32
     WSAStartup(wVersionRequested, &wsaData);
   #endif
 
   if ((sLocal=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == INVALID_SOCKET)
-    return -1;
+    return INVALID_SOCKET;
 
-  if (setsockopt(sLocal, SOL_SOCKET, SO_BROADCAST, (void*)&optval, sizeof optval) == -1)
-    return -1;
+  if (setsockopt(sLocal, SOL_SOCKET, SO_BROADCAST, (void*)&optval, sizeof optval) == -1) {
+    #if defined __WIN32 || defined _WIN32 || defined WIN32
+      closesocket(sLocal);
+    #else
+      close(sLocal);
+    #endif
+    return INVALID_SOCKET;
+  } /* if */
 
-  return (int)sLocal;
+  return sLocal;
 }
 
-static int udp_Close(void)
+static int udp_Close(SOCKET sLocal)
 {
   if (sLocal!=INVALID_SOCKET) {
     #if defined __WIN32 || defined _WIN32 || defined WIN32
@@ -109,7 +115,7 @@ static int udp_Close(void)
   return 0;
 }
 
-static int udp_Send(const char *host,short port,const char *message,int size)
+static int udp_Send(SOCKET sLocal,const char *host,short port,const char *message,int size)
 {
   struct sockaddr_in sRemote;
 
@@ -131,7 +137,7 @@ static int udp_Send(const char *host,short port,const char *message,int size)
  * if source is not NULL, it must point to a buffer that can contain at least
  * 22 characters.
  */
-static int udp_Receive(char *message,size_t maxmsg,char *source)
+static int udp_Receive(SOCKET sLocal,char *message,size_t maxmsg,char *source)
 {
   struct sockaddr_in sSource;
   unsigned slen=sizeof(sSource);
@@ -151,7 +157,7 @@ static int udp_Receive(char *message,size_t maxmsg,char *source)
   return size;
 }
 
-static int udp_IsPacket(void)
+static int udp_IsPacket(SOCKET sLocal)
 {
   int result;
   fd_set rdset;
@@ -172,7 +178,7 @@ static int udp_IsPacket(void)
   return result != 0;
 }
 
-static int udp_Listen(short port)
+static int udp_Listen(SOCKET sLocal,short port)
 {
   struct sockaddr_in sFrom;
 
@@ -186,11 +192,25 @@ static int udp_Listen(short port)
   return 0;
 }
 
-static AMX_IDLE PrevIdle = NULL;
-static int idxReceiveString = -1;
-static int idxReceivePacket = -1;
-static short dgramPort = 0;
-static int dgramBound = 0;
+/* every abstract machine has its own socket */
+typedef struct tagDGRAMDATA {
+  AMX_MODULEDATA header;
+  SOCKET sLocal;
+  AMX_IDLE PrevIdle;
+  int idxReceiveString;
+  int idxReceivePacket;
+  short dgramPort;
+  int dgramBound;
+} DGRAMDATA;
+#define DGRAMDATA_TAG AMX_USERTAG('D','G','r','m')
+
+static DGRAMDATA *getdgramdata(AMX *amx)
+{
+  DGRAMDATA *data;
+  if (amx_GetModuleData(amx,DGRAMDATA_TAG,(AMX_MODULEDATA**)&data)!=AMX_ERR_NONE)
+    return NULL;
+  return data;
+}
 
 /* sendstring(const message[], const destination[]="")
  * destination has the format "127.0.0.1:9930"; when set to an empty string,
@@ -206,7 +226,10 @@ static cell AMX_NATIVE_CALL n_sendstring(AMX *amx, const cell *params)
   cell *cstr;
   char *host, *message, *ptr;
   short port=AMX_DGRAMPORT;
+  DGRAMDATA *data;
 
+  if ((data = getdgramdata(amx)) == NULL)
+    return 0;
   cstr = amx_Address(amx, params[1]);
   amx_UTF8Len(cstr, &length);
 
@@ -230,7 +253,7 @@ static cell AMX_NATIVE_CALL n_sendstring(AMX *amx, const cell *params)
       *ptr++='\0';
       port=(short)atoi(ptr);
     } /* if */
-    r= (udp_Send(host,port,message,(int)strlen(message)+1) > 0);
+    r= (udp_Send(data->sLocal,host,port,message,(int)strlen(message)+1) > 0);
   } /* if */
 
   return r;
@@ -246,14 +269,17 @@ static cell AMX_NATIVE_CALL n_sendpacket(AMX *amx, const cell *params)
   cell *cstr;
   char *host, *ptr;
   short port=AMX_DGRAMPORT;
+  DGRAMDATA *data;
 
+  if ((data = getdgramdata(amx)) == NULL)
+    return 0;
   cstr = amx_Address(amx, params[1]);
   amx_StrParam(amx, params[3], host);
   if (host != NULL && (ptr=strchr(host,':'))!=NULL && isdigit(ptr[1])) {
     *ptr++='\0';
     port=(short)atoi(ptr);
   } /* if */
-  return (udp_Send(host,port,(const char *)cstr,params[2] * sizeof(cell)) > 0);
+  return (udp_Send(data->sLocal,host,port,(const char *)cstr,params[2] * sizeof(cell)) > 0);
 }
 
 /* listenport(port)
@@ -262,8 +288,10 @@ static cell AMX_NATIVE_CALL n_sendpacket(AMX *amx, const cell *params)
  */
 static cell AMX_NATIVE_CALL n_listenport(AMX *amx, const cell *params)
 {
-  (void)amx;
-  dgramPort = (short)params[1];
+  DGRAMDATA *data;
+
+  if ((data = getdgramdata(amx)) != NULL)
+    data->dgramPort = (short)params[1];
   return 0;
 }
 
@@ -273,34 +301,37 @@ static int AMXAPI amx_DGramIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
   cell *amx_addr_src;
   int len, chars;
   int err=0;
+  DGRAMDATA *data;
 
-  assert(idxReceiveString >= 0 || idxReceivePacket >= 0);
+  if ((data=getdgramdata(amx))==NULL)
+    return AMX_ERR_NONE;    /* module was cleaned up */
+  assert(data->idxReceiveString >= 0 || data->idxReceivePacket >= 0);
 
-  if (PrevIdle != NULL)
-    PrevIdle(amx, Exec);
+  if (data->PrevIdle != NULL)
+    data->PrevIdle(amx, Exec);
 
   /* set up listener (first call only) */
-  if (!dgramBound) {
-    if (dgramPort==0)
-      dgramPort=AMX_DGRAMPORT;  /* use default port if none was set */
-    if (udp_Listen(dgramPort)==-1)
+  if (!data->dgramBound) {
+    if (data->dgramPort==0)
+      data->dgramPort=AMX_DGRAMPORT;  /* use default port if none was set */
+    if (udp_Listen(data->sLocal,data->dgramPort)==-1)
       return AMX_ERR_GENERAL;
-    dgramBound=1;
+    data->dgramBound=1;
   } /* if */
 
-  if (udp_IsPacket()) {
-    len=udp_Receive(message, sizeof message / sizeof message[0], source);
+  if (udp_IsPacket(data->sLocal)) {
+    len=udp_Receive(data->sLocal, message, sizeof message / sizeof message[0], source);
     amx_PushString(amx,&amx_addr_src,source,1,0);
     /* check the presence of a byte order mark: if it is absent, the received
      * packet is no string; also check the packet size against string length
      */
     if ((message[0]!='\xef' || message[1]!='\xbb' || message[2]!='\xbf'
-        || len!=(int)strlen(message)+1 || idxReceiveString<0) && idxReceivePacket>=0)
+        || len!=(int)strlen(message)+1 || data->idxReceiveString<0) && data->idxReceivePacket>=0)
     {
       /* receive as "packet" */
       amx_Push(amx,len);
       amx_PushArray(amx,NULL,(cell*)message,len);
-      err=Exec(amx,NULL,idxReceivePacket);
+      err=Exec(amx,NULL,data->idxReceivePacket);
     } else {
       const char *msg=message;
       if (msg[0]=='\xef' && msg[1]=='\xbb' && msg[2]=='\xbf')
@@ -318,7 +349,7 @@ static int AMXAPI amx_DGramIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
       } else {
         amx_PushString(amx,NULL,msg,1,0);
       } /* if */
-      err=Exec(amx,NULL,idxReceiveString);
+      err=Exec(amx,NULL,data->idxReceiveString);
     } /* if */
     while (err==AMX_ERR_SLEEP)
       err=Exec(amx,NULL,AMX_EXEC_CONT);
@@ -338,18 +369,35 @@ AMX_NATIVE_INFO dgram_Natives[] = {
   { NULL, NULL }        /* terminator */
 };
 
+int AMXEXPORT AMXAPI amx_DGramCleanup(AMX *amx);
+
 int AMXEXPORT AMXAPI amx_DGramInit(AMX *amx)
 {
-  dgramBound = 0;
-  if (udp_Open()==-1)
+  DGRAMDATA *data;
+
+  if (getdgramdata(amx)!=NULL)
+    amx_DGramCleanup(amx);
+  if ((data=(DGRAMDATA*)malloc(sizeof(DGRAMDATA)))==NULL)
+    return AMX_ERR_MEMORY;
+  memset(data,0,sizeof(DGRAMDATA));
+  data->idxReceiveString=-1;
+  data->idxReceivePacket=-1;
+  if ((data->sLocal=udp_Open())==INVALID_SOCKET) {
+    free(data);
     return AMX_ERR_GENERAL;
+  } /* if */
+  if (amx_SetModuleData(amx,DGRAMDATA_TAG,&data->header)!=AMX_ERR_NONE) {
+    udp_Close(data->sLocal);
+    free(data);
+    return AMX_ERR_USERDATA;
+  } /* if */
 
   /* see whether there is an @receivestring() function */
-  if (amx_FindPublic(amx,"@receivestring",&idxReceiveString)==AMX_ERR_NONE
-      || amx_FindPublic(amx,"@receivepacket",&idxReceivePacket)==AMX_ERR_NONE)
+  if (amx_FindPublic(amx,"@receivestring",&data->idxReceiveString)==AMX_ERR_NONE
+      || amx_FindPublic(amx,"@receivepacket",&data->idxReceivePacket)==AMX_ERR_NONE)
   {
-    if (amx_GetUserData(amx,AMX_USERTAG('I','d','l','e'),(void**)&PrevIdle)!=AMX_ERR_NONE)
-      PrevIdle=NULL;
+    if (amx_GetUserData(amx,AMX_USERTAG('I','d','l','e'),(void**)&data->PrevIdle)!=AMX_ERR_NONE)
+      data->PrevIdle=NULL;
     amx_SetUserData(amx,AMX_USERTAG('I','d','l','e'),amx_DGramIdle);
   } /* if */
 
@@ -358,7 +406,12 @@ int AMXEXPORT AMXAPI amx_DGramInit(AMX *amx)
 
 int AMXEXPORT AMXAPI amx_DGramCleanup(AMX *amx)
 {
-  (void)amx;
-  udp_Close();
+  DGRAMDATA *data;
+
+  if ((data=getdgramdata(amx))!=NULL) {
+    amx_SetModuleData(amx,DGRAMDATA_TAG,NULL);
+    udp_Close(data->sLocal);
+    free(data);
+  } /* if */
   return AMX_ERR_NONE;
 }
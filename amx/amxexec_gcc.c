@@ -31,8 +31,10 @@
 #if defined __ECOS__
   /* eCos puts include files in cyg/package_name */
   #include <cyg/pawn/amx.h>
+  #include <cyg/pawn/amxsimd.h>
 #else
   #include "amx.h"
+  #include "amxsimd.h"
 #endif
 
 #if !(defined __GNUC__ || defined __ICC)
@@ -85,17 +87,62 @@
 #define ABORT(amx,v)    { (amx)->stk=reset_stk; (amx)->hea=reset_hea; return v; }
 
 #define STKMARGIN       ((cell)(16*sizeof(cell)))
-#define CHKMARGIN()     if (hea+STKMARGIN>stk) return AMX_ERR_STACKERR
+#define CHKMARGIN()     if (hea+STKMARGIN+amx->stkreserve>stk && stackout(amx,hea,stk)) \
+                          return AMX_ERR_STACKERR
 #define CHKSTACK()      if (stk>amx->stp) return AMX_ERR_STACKLOW
 #define CHKHEAP()       if (hea<amx->hlw) return AMX_ERR_HEAPLOW
 
 #define JUMPREL(ip)     ((cell*)((unsigned long)(ip)+*(cell*)(ip)-sizeof(cell)))
 
+/* FUEL() takes one unit from the instruction budget, on calls and on backward
+ * jumps; "n" is the number of parameters of the instruction that were read,
+ * see amx_Exec() in AMX.C
+ */
+#define FUEL(n)         if (--amx->fuel<0 && fuelout(amx,(cell)((unsigned char *)(cip-(n)-1)-amx->code),frm)) \
+                          { cip-=(n)+1; offs=AMX_ERR_FUEL; goto __halt; }
+#define TAKEJUMP(n)     do { if (*cip<=0) FUEL(n); cip=JUMPREL(cip); } while (0)
+
+/* NATIVECALL() calls a native function through the callback; with the
+ * profiler, it also counts and times the call, see amx_Exec() in AMX.C
+ */
+#if defined AMX_PROFILE
+  extern uint64_t amx_profile_ticks(void);
+  #define NATIVECALL(err,index,params) \
+    { uint64_t start_=amx_profile_ticks(); \
+      err=amx->callback(amx,index,&pri,params); \
+      if (profile!=NULL && (ucell)(index)<(ucell)profile->numnatives) { \
+        profile->natcalls[index]++; \
+        profile->natticks[index]+=amx_profile_ticks()-start_; \
+      } }
+#else
+  #define NATIVECALL(err,index,params) ( err=amx->callback(amx,index,&pri,params) )
+#endif
 
-#if !defined AMX_NO_PACKED_OPC && !defined AMX_TOKENTHREADING
-  #define AMX_TOKENTHREADING    /* packed opcodes require token threading */
+/* RETSITE() checks that a return address lies directly behind a CALL, when
+ * memory checks were dropped, see amx_Exec() in AMX.C; the code is not
+ * relocated in that case, so it holds plain opcodes. The opcode enum is
+ * private to AMX.C, which checks that OP_CALL has this value; amx_exec_run()
+ * checks that the label table agrees.
+ */
+#define OPCODE_CALL     33
+#define RETSITE(offs)   ((offs)==0 || ((offs)>=2*(cell)sizeof(cell) \
+                         && *(cell *)(amx->code+(int)(offs)-2*sizeof(cell))==OPCODE_CALL))
+
+
+#if (!defined AMX_NO_PACKED_OPC || defined AMX_PROFILE) && !defined AMX_TOKENTHREADING
+  #define AMX_TOKENTHREADING    /* packed opcodes and the profiler require token threading */
 #endif
-#if defined AMX_TOKENTHREADING
+#if defined AMX_PROFILE
+  /* count every instruction, see amx_ProfileInit() in AMX.C */
+  #if defined AMX_NO_PACKED_OPC
+    #define OPINDEX(op)  (op)
+  #else
+    #define OPINDEX(op)  ((op) & ((1 << sizeof(cell)*4)-1))
+  #endif
+  #define NEXT(cip,op)   do { op=*cip++; \
+                              if (profile!=NULL) profile->opcodes[OPINDEX(op)]++; \
+                              goto *amx_opcodelist[OPINDEX(op)]; } while (0)
+#elif defined AMX_TOKENTHREADING
   #if defined AMX_NO_PACKED_OPC
     #define NEXT(cip,op) goto *amx_opcodelist[*cip++]
   #else
@@ -107,6 +154,77 @@
   #endif
   #define NEXT(cip,op)   goto **cip++
 #endif
+#if defined AMX_NO_MACRO_INSTR && !defined AMX_NO_FUSED_OPC
+  #define AMX_NO_FUSED_OPC      /* superinstructions are built from macro instructions */
+#endif
+
+/* fuelout() is called when the instruction budget drops below zero; it
+ * returns 0 if no budget was set or if the fuel hook lets the abstract machine
+ * run on, or 1 if the abstract machine must stop
+ */
+static int fuelout(AMX *amx,cell cip,cell frm)
+{
+  if (amx->fuelmode==AMX_FUEL_NONE) {
+    amx->fuel=LONG_MAX;
+    return 0;
+  } /* if */
+  if (amx->fuelmode==AMX_FUEL_HOOK) {
+    amx->fuel=LONG_MAX;
+    amx->cip=cip;
+    amx->frm=frm;
+    if (amx->fuelhook==NULL || amx->fuelhook(amx)==AMX_ERR_NONE)
+      return 0;
+  } /* if */
+  amx->fuel=0;
+  return 1;
+}
+
+/* stackout() is called when the heap and the stack come closer than the
+ * limit of amx_SetStackLimit() allows; it returns 0 if the stack hook raised
+ * the limit far enough for the abstract machine to run on
+ */
+static int stackout(AMX *amx,cell hea,cell stk)
+{
+  if (amx->stkreserve==0 || amx->stackhook==NULL)
+    return 1;
+  amx->hea=hea;
+  amx->stk=stk;
+  if (amx->stackhook(amx)!=AMX_ERR_NONE)
+    return 1;
+  return hea+STKMARGIN+amx->stkreserve>stk;
+}
+
+/* find_case() returns a pointer to the record in the case table for "value",
+ * or NULL if none matches; "cptr" points to the number of records. The
+ * records are sorted on their case value (by VerifyPcode() in AMX.C), so a
+ * dense table is indexed directly, and a sparse table is sifted with a binary
+ * search.
+ */
+static cell *find_case(cell *cptr, cell value)
+{
+  cell *rec=cptr+2;   /* skip number of records and "none-matched" target */
+  cell num=*cptr;
+  ucell diff;
+  int low,high,mid;
+
+  if (num<=0)
+    return NULL;
+  diff=(ucell)value-(ucell)rec[0];
+  if (diff>(ucell)rec[2*(num-1)]-(ucell)rec[0])
+    return NULL;        /* out of range */
+  if (diff<(ucell)num && rec[2*diff]==value)
+    return &rec[2*diff];/* dense table */
+  low=0;
+  high=(int)num-1;
+  while (low<high) {
+    mid=(low+high)/2;
+    if (rec[2*mid]<value)
+      low=mid+1;
+    else
+      high=mid;
+  } /* while */
+  return (rec[2*low]==value) ? &rec[2*low] : NULL;
+}
 
 cell amx_exec_run(AMX *amx,cell *retval,unsigned char *data)
 {
@@ -167,14 +285,42 @@ static const void * const amx_opcodelist[] = {
         &&op_dec_p,       &&op_dec_p_s,     &&op_movs_p,      &&op_cmps_p,
         &&op_fill_p,      &&op_halt_p,      &&op_bounds_p,
 #endif
+#if !defined AMX_NO_FUSED_OPC
+        /* superinstructions (created on loading, see FusePcode() in AMX.C) */
+        &&op_load_s_push, &&op_lidx_push,   &&op_push_c_call,
+        &&op_const_alt_jeq,     &&op_const_alt_jneq,    &&op_const_alt_jsless,
+        &&op_const_alt_jsleq,   &&op_const_alt_jsgrtr,  &&op_const_alt_jsgeq,
+  #if !defined AMX_NO_PACKED_OPC
+        &&op_load_p_s_push,     &&op_push_p_c_call,
+        &&op_const_p_alt_jeq,   &&op_const_p_alt_jneq,  &&op_const_p_alt_jsless,
+        &&op_const_p_alt_jsleq, &&op_const_p_alt_jsgrtr,&&op_const_p_alt_jsgeq,
+  #endif
+        /* unchecked memory accesses (created on loading, see ProvePcode() in AMX.C) */
+        &&op_load_i_nc,   &&op_lodb_i_nc,   &&op_stor_i_nc,   &&op_strb_i_nc,
+        &&op_lidx_nc,     &&op_lidx_b_nc,   &&op_movs_nc,     &&op_cmps_nc,
+        &&op_fill_nc,
+  #if !defined AMX_NO_PACKED_OPC
+        &&op_lodb_p_i_nc, &&op_strb_p_i_nc, &&op_lidx_p_b_nc, &&op_movs_p_nc,
+        &&op_cmps_p_nc,   &&op_fill_p_nc,
+  #endif
+#endif
 };
   AMX_HEADER *hdr;
+  AMX_BATCH *batch;
   cell pri,alt,stk,frm,hea;
   cell reset_stk, reset_hea, *cip;
   cell offs,val;
-  int num,i;
+  int num;
+  #if !defined _R_DEFAULT || !defined _W_DEFAULT
+    int i;      /* for the byte-wise MOVS, CMPS and FILL */
+  #endif
   #if !defined AMX_NO_PACKED_OPC
     int op;
+  #elif defined AMX_PROFILE
+    cell op;
+  #endif
+  #if defined AMX_PROFILE
+    AMX_PROFILEDATA *profile;
   #endif
 
   assert(amx!=NULL);
@@ -185,6 +331,7 @@ static const void * const amx_opcodelist[] = {
     assert(sizeof(cell)==sizeof(void *));
     assert(data==NULL);
     assert(retval!=NULL);
+    assert(amx_opcodelist[OPCODE_CALL]==&&op_call);
     *retval=(cell)amx_opcodelist;
     return sizearray(amx_opcodelist);
   } /* if */
@@ -198,8 +345,15 @@ static const void * const amx_opcodelist[] = {
   stk=amx->stk;
   reset_stk=stk;
   reset_hea=hea;
-  alt=frm=pri=0;/* just to avoid compiler warnings */
+  frm=amx->frm; /* restore the registers, for AMX_EXEC_CONT */
+  pri=amx->pri;
+  alt=amx->alt;
   num=0;        /* just to avoid compiler warnings */
+  batch=amx->batch;
+  amx->batch=NULL;  /* a native function that calls amx_Exec() runs no batch */
+  #if defined AMX_PROFILE
+    profile=amx->profile;
+  #endif
 
   /* start running */
   assert(amx->code!=NULL);
@@ -247,6 +401,9 @@ static const void * const amx_opcodelist[] = {
     /* verify address */
     if (pri>=hea && pri<stk || (ucell)pri>=(ucell)amx->stp)
       ABORT(amx,AMX_ERR_MEMACCESS);
+#if !defined AMX_NO_FUSED_OPC
+  __lodb_i_nc:
+#endif
     switch (offs) {
     case 1:
       pri=_R8(data,pri);
@@ -298,6 +455,9 @@ static const void * const amx_opcodelist[] = {
     /* verify address */
     if (alt>=hea && alt<stk || (ucell)alt>=(ucell)amx->stp)
       ABORT(amx,AMX_ERR_MEMACCESS);
+#if !defined AMX_NO_FUSED_OPC
+  __strb_i_nc:
+#endif
     switch (offs) {
     case 1:
       _W8(data,alt,pri);
@@ -412,7 +572,7 @@ static const void * const amx_opcodelist[] = {
     POP(frm);
     POP(offs);
     /* verify the return address */
-    if ((long)offs>=amx->codesize)
+    if ((long)offs>=amx->codesize || amx->unchecked>0 && !RETSITE(offs))
       ABORT(amx,AMX_ERR_MEMACCESS);
     cip=(cell *)(amx->code+(int)offs);
     NEXT(cip,op);
@@ -420,29 +580,30 @@ static const void * const amx_opcodelist[] = {
     POP(frm);
     POP(offs);
     /* verify the return address */
-    if ((long)offs>=amx->codesize)
+    if ((long)offs>=amx->codesize || amx->unchecked>0 && !RETSITE(offs))
       ABORT(amx,AMX_ERR_MEMACCESS);
     cip=(cell *)(amx->code+(int)offs);
     stk+= _R(data,stk) + sizeof(cell);  /* remove parameters from the stack */
     NEXT(cip,op);
   op_call:
+    FUEL(0);
     PUSH(((unsigned char *)cip-amx->code)+sizeof(cell));/* push address behind instruction */
     cip=JUMPREL(cip);                   /* jump to the address */
     NEXT(cip,op);
   op_jump:
     /* since the GETPARAM() macro modifies cip, you cannot
      * do GETPARAM(cip) directly */
-    cip=JUMPREL(cip);
+    TAKEJUMP(0);
     NEXT(cip,op);
   op_jzer:
     if (pri==0)
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
     else
       SKIPPARAM(1);
     NEXT(cip,op);
   op_jnz:
     if (pri!=0)
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
     else
       SKIPPARAM(1);
     NEXT(cip,op);
@@ -571,6 +732,9 @@ static const void * const amx_opcodelist[] = {
       ABORT(amx,AMX_ERR_MEMACCESS);
     if ((alt+offs)>hea && (alt+offs)<stk || (ucell)(alt+offs)>(ucell)amx->stp)
       ABORT(amx,AMX_ERR_MEMACCESS);
+#if !defined AMX_NO_FUSED_OPC
+  __movs_nc:
+#endif
     #if defined _R_DEFAULT
       memcpy(data+(int)alt, data+(int)pri, (int)offs);
     #else
@@ -598,6 +762,9 @@ static const void * const amx_opcodelist[] = {
       ABORT(amx,AMX_ERR_MEMACCESS);
     if ((alt+offs)>hea && (alt+offs)<stk || (ucell)(alt+offs)>(ucell)amx->stp)
       ABORT(amx,AMX_ERR_MEMACCESS);
+#if !defined AMX_NO_FUSED_OPC
+  __cmps_nc:
+#endif
     #if defined _R_DEFAULT
       pri=memcmp(data+(int)alt, data+(int)pri, (int)offs);
     #else
@@ -616,20 +783,42 @@ static const void * const amx_opcodelist[] = {
       ABORT(amx,AMX_ERR_MEMACCESS);
     if ((alt+offs)>hea && (alt+offs)<stk || (ucell)(alt+offs)>(ucell)amx->stp)
       ABORT(amx,AMX_ERR_MEMACCESS);
-    for (i=(int)alt; offs>=(int)sizeof(cell); i+=sizeof(cell), offs-=sizeof(cell))
-      _W32(data,i,pri);
+#if !defined AMX_NO_FUSED_OPC
+  __fill_nc:
+#endif
+    #if defined _W_DEFAULT
+      simd_fill((cell *)(data+(int)alt),pri,(size_t)offs/sizeof(cell));
+    #else
+      for (i=(int)alt; offs>=(int)sizeof(cell); i+=sizeof(cell), offs-=sizeof(cell))
+        _W(data,i,pri);
+    #endif
     NEXT(cip,op);
   op_halt:
     GETPARAM(offs);
   __halt:
     if (retval!=NULL)
       *retval=pri;
+    if (offs==AMX_ERR_NONE && batch!=NULL) {
+      /* start the next call of amx_ExecBatch() */
+      if (batch->results!=NULL)
+        batch->results[batch->done]=pri;
+      if (++batch->done<batch->count) {
+        stk=batch->stk-batch->nargs*sizeof(cell);
+        hea=batch->hea;
+        if (batch->nargs>0)
+          memcpy(data+(int)stk,batch->args+(size_t)batch->done*batch->nargs,batch->nargs*sizeof(cell));
+        PUSH(batch->nargs*sizeof(cell));
+        PUSH(0);
+        cip=(cell *)(amx->code+(int)batch->cip);
+        NEXT(cip,op);
+      } /* if */
+    } /* if */
     /* store complete status (stk and hea are already set in the ABORT macro) */
     amx->frm=frm;
     amx->pri=pri;
     amx->alt=alt;
     amx->cip=(cell)((unsigned char*)cip-amx->code);
-    if (offs==AMX_ERR_SLEEP) {
+    if (offs==AMX_ERR_SLEEP || (offs==AMX_ERR_FUEL && amx->fuelmode==AMX_FUEL_SUSPEND)) {
       amx->stk=stk;
       amx->hea=hea;
       amx->reset_stk=reset_stk;
@@ -651,7 +840,7 @@ static const void * const amx_opcodelist[] = {
     amx->hea=hea;
     amx->frm=frm;
     amx->stk=stk;
-    num=amx->callback(amx,offs,&pri,(cell *)(data+(int)stk));
+    NATIVECALL(num,offs,(cell *)(data+(int)stk));
     if (num!=AMX_ERR_NONE) {
       if (num==AMX_ERR_SLEEP) {
         amx->pri=pri;
@@ -665,12 +854,11 @@ static const void * const amx_opcodelist[] = {
     NEXT(cip,op);
   op_switch: {
     cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "casetbl" opcode */
-    cip=JUMPREL(cptr+1);        /* preset to "none-matched" case */
-    num=(int)*cptr;             /* number of records in the case table */
-    for (cptr+=2; num>0 && *cptr!=pri; num--,cptr+=2)
-      /* nothing */;
-    if (num>0)
-      cip=JUMPREL(cptr+1);      /* case found */
+    cell *rec=find_case(cptr,pri);
+    if (rec!=NULL)
+      cip=JUMPREL(rec+1);       /* case found */
+    else
+      cip=JUMPREL(cptr+1);      /* "none-matched" case */
     NEXT(cip,op);
     }
   op_swap_pri:
@@ -761,6 +949,7 @@ static const void * const amx_opcodelist[] = {
     /* overlay instructions */
 #if !defined AMX_NO_OVERLAY
   op_call_ovl:
+    FUEL(0);
     offs=(unsigned char *)cip-amx->code+sizeof(cell); /* skip address */
     assert(offs>=0 && offs<(1<<(sizeof(cell)*4)));
     PUSH((offs<<(sizeof(cell)*4)) | amx->ovl_index);
@@ -785,12 +974,11 @@ static const void * const amx_opcodelist[] = {
     NEXT(cip,op);
   op_switch_ovl: {
     cell *cptr=JUMPREL(cip)+1;  /* +1, to skip the "icasetbl" opcode */
-    amx->ovl_index=*(cptr+1);   /* preset to "none-matched" case */
-    num=(int)*cptr;             /* number of records in the case table */
-    for (cptr+=2; num>0 && *cptr!=pri; num--,cptr+=2)
-      /* nothing */;
-    if (num>0)
-      amx->ovl_index=*(cptr+1); /* case found */
+    cell *rec=find_case(cptr,pri);
+    if (rec!=NULL)
+      amx->ovl_index=*(rec+1);  /* case found */
+    else
+      amx->ovl_index=*(cptr+1); /* "none-matched" case */
     assert(amx->overlay!=NULL);
     if ((num=amx->overlay(amx,amx->ovl_index))!=AMX_ERR_NONE)
       ABORT(amx,num);
@@ -861,37 +1049,37 @@ static const void * const amx_opcodelist[] = {
     NEXT(cip,op);
   op_jeq:
     if (pri==alt)
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
     else
       SKIPPARAM(1);
     NEXT(cip,op);
   op_jneq:
     if (pri!=alt)
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
     else
       SKIPPARAM(1);
     NEXT(cip,op);
   op_jsless:
     if (pri<alt)
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
     else
       SKIPPARAM(1);
     NEXT(cip,op);
   op_jsleq:
     if (pri<=alt)
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
     else
       SKIPPARAM(1);
     NEXT(cip,op);
   op_jsgrtr:
     if (pri>alt)
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
     else
       SKIPPARAM(1);
     NEXT(cip,op);
   op_jsgeq:
     if (pri>=alt)
-      cip=JUMPREL(cip);
+      TAKEJUMP(0);
     else
       SKIPPARAM(1);
     NEXT(cip,op);
@@ -994,7 +1182,7 @@ static const void * const amx_opcodelist[] = {
     amx->hea=hea;
     amx->frm=frm;
     amx->stk=stk;
-    num=amx->callback(amx,offs,&pri,(cell *)(data+(int)stk));
+    NATIVECALL(num,offs,(cell *)(data+(int)stk));
     stk+=val+4;
     if (num!=AMX_ERR_NONE) {
       if (num==AMX_ERR_SLEEP) {
@@ -1339,6 +1527,194 @@ static const void * const amx_opcodelist[] = {
     } /* if */
     NEXT(cip,op);
 #endif
+#if !defined AMX_NO_FUSED_OPC
+  /* superinstructions; these skip the opcode of the second instruction */
+  op_load_s_push:
+    GETPARAM(offs);
+    pri=_R(data,frm+offs);
+    SKIPPARAM(1);
+    PUSH(pri);
+    NEXT(cip,op);
+  op_lidx_push:
+    offs=pri*sizeof(cell)+alt;
+    /* verify address */
+    if (offs>=hea && offs<stk || (ucell)offs>=(ucell)amx->stp)
+      ABORT(amx,AMX_ERR_MEMACCESS);
+    pri=_R(data,offs);
+    SKIPPARAM(1);
+    PUSH(pri);
+    NEXT(cip,op);
+  op_push_c_call:
+    FUEL(0);
+    GETPARAM(offs);
+    PUSH(offs);
+    SKIPPARAM(1);
+    PUSH(((unsigned char *)cip-amx->code)+sizeof(cell));/* push address behind instruction */
+    cip=JUMPREL(cip);                   /* jump to the address */
+    NEXT(cip,op);
+  op_const_alt_jeq:
+    GETPARAM(alt);
+    SKIPPARAM(1);
+    if (pri==alt)
+      TAKEJUMP(2);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_alt_jneq:
+    GETPARAM(alt);
+    SKIPPARAM(1);
+    if (pri!=alt)
+      TAKEJUMP(2);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_alt_jsless:
+    GETPARAM(alt);
+    SKIPPARAM(1);
+    if (pri<alt)
+      TAKEJUMP(2);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_alt_jsleq:
+    GETPARAM(alt);
+    SKIPPARAM(1);
+    if (pri<=alt)
+      TAKEJUMP(2);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_alt_jsgrtr:
+    GETPARAM(alt);
+    SKIPPARAM(1);
+    if (pri>alt)
+      TAKEJUMP(2);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_alt_jsgeq:
+    GETPARAM(alt);
+    SKIPPARAM(1);
+    if (pri>=alt)
+      TAKEJUMP(2);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  #if !defined AMX_NO_PACKED_OPC
+  op_load_p_s_push:
+    GETPARAM_P(offs,op);
+    pri=_R(data,frm+offs);
+    SKIPPARAM(1);
+    PUSH(pri);
+    NEXT(cip,op);
+  op_push_p_c_call:
+    FUEL(0);
+    GETPARAM_P(offs,op);
+    PUSH(offs);
+    SKIPPARAM(1);
+    PUSH(((unsigned char *)cip-amx->code)+sizeof(cell));/* push address behind instruction */
+    cip=JUMPREL(cip);                   /* jump to the address */
+    NEXT(cip,op);
+  op_const_p_alt_jeq:
+    GETPARAM_P(alt,op);
+    SKIPPARAM(1);
+    if (pri==alt)
+      TAKEJUMP(1);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_p_alt_jneq:
+    GETPARAM_P(alt,op);
+    SKIPPARAM(1);
+    if (pri!=alt)
+      TAKEJUMP(1);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_p_alt_jsless:
+    GETPARAM_P(alt,op);
+    SKIPPARAM(1);
+    if (pri<alt)
+      TAKEJUMP(1);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_p_alt_jsleq:
+    GETPARAM_P(alt,op);
+    SKIPPARAM(1);
+    if (pri<=alt)
+      TAKEJUMP(1);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_p_alt_jsgrtr:
+    GETPARAM_P(alt,op);
+    SKIPPARAM(1);
+    if (pri>alt)
+      TAKEJUMP(1);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  op_const_p_alt_jsgeq:
+    GETPARAM_P(alt,op);
+    SKIPPARAM(1);
+    if (pri>=alt)
+      TAKEJUMP(1);
+    else
+      SKIPPARAM(1);
+    NEXT(cip,op);
+  #endif
+  /* memory accesses that ProvePcode() found to be always valid */
+  op_load_i_nc:
+    pri=_R(data,pri);
+    NEXT(cip,op);
+  op_lodb_i_nc:
+    GETPARAM(offs);
+    goto __lodb_i_nc;
+  op_stor_i_nc:
+    _W(data,alt,pri);
+    NEXT(cip,op);
+  op_strb_i_nc:
+    GETPARAM(offs);
+    goto __strb_i_nc;
+  op_lidx_nc:
+    pri=_R(data,pri*sizeof(cell)+alt);
+    NEXT(cip,op);
+  op_lidx_b_nc:
+    GETPARAM(offs);
+    pri=_R(data,(pri << (int)offs)+alt);
+    NEXT(cip,op);
+  op_movs_nc:
+    GETPARAM(offs);
+    goto __movs_nc;
+  op_cmps_nc:
+    GETPARAM(offs);
+    goto __cmps_nc;
+  op_fill_nc:
+    GETPARAM(offs);
+    goto __fill_nc;
+  #if !defined AMX_NO_PACKED_OPC
+  op_lodb_p_i_nc:
+    GETPARAM_P(offs,op);
+    goto __lodb_i_nc;
+  op_strb_p_i_nc:
+    GETPARAM_P(offs,op);
+    goto __strb_i_nc;
+  op_lidx_p_b_nc:
+    GETPARAM_P(offs,op);
+    pri=_R(data,(pri << (int)offs)+alt);
+    NEXT(cip,op);
+  op_movs_p_nc:
+    GETPARAM_P(offs,op);
+    goto __movs_nc;
+  op_cmps_p_nc:
+    GETPARAM_P(offs,op);
+    goto __cmps_nc;
+  op_fill_p_nc:
+    GETPARAM_P(offs,op);
+    goto __fill_nc;
+  #endif
+#endif
 }
 
 void amx_exec_list(const AMX *amx,const cell **opcodelist,int *numopcodes)
@@ -522,25 +522,23 @@ static cell AMX_NATIVE_CALL n_fclose(AMX *amx, const cell *params)
 static cell AMX_NATIVE_CALL n_fwrite(AMX *amx, const cell *params)
 {
   size_t r = 0;
-  cell *cptr;
+  AMX_STRVIEW view;
   char *str;
-  int len;
 
   (void)amx;
-  cptr=amx_Address(amx,params[2]);
-  amx_StrLen(cptr,&len);
-  if (len==0)
+  amx_StrView(amx_Address(amx,params[2]),&view);
+  if (view.length==0)
     return 0;
 
-  if ((ucell)*cptr>UNPACKEDMAX) {
+  if (view.packed) {
     /* the string is packed, write it as an ASCII/ANSI string */
-    if ((str=(char*)alloca(len + 1))!=NULL) {
-      amx_GetString(str,cptr,0,len);
+    if ((str=(char*)alloca(view.length + 1))!=NULL) {
+      amx_StrViewGet(str,&view,0,view.length + 1);
       r=fputs(str,(FILE*)params[1]);
     } /* if */
   } else {
     /* the string is unpacked, write it as UTF-8 */
-    r=fputs_cell((FILE*)params[1],cptr,1);
+    r=fputs_cell((FILE*)params[1],(cell*)view.cells,1);
   } /* if */
   return (cell)r;
 }
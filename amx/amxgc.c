@@ -23,19 +23,6 @@
 #include "amx.h"
 #include "amxgc.h"
 
-typedef struct tagGCPAIR {
-  cell value;
-  int count;
-} GCPAIR;
-
-typedef struct tagGCINFO {
-  GCPAIR *table;
-  GC_FREE callback;
-  int exponent;
-  int flags;
-  int count;
-} GCINFO;
-
 #define SHIFT1          (sizeof(cell)*4)
 #define MASK1           (~(((cell)-1) << SHIFT1))
 #define FOLD1(p)        ( ((p) & MASK1) ^ (((p) >> SHIFT1) & MASK1) )
@@ -72,26 +59,23 @@ static unsigned char inverse[256] = {
    15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0
 };
 
-static GCINFO SharedGC;
-
-
-int gc_setcallback(GC_FREE callback)
+int gc_setcallback(GCINFO *gc, GC_FREE callback)
 {
-  SharedGC.callback=callback;
+  gc->callback=callback;
   return GC_ERR_NONE;
 }
 
-int gc_settable(int exponent, int flags)
+int gc_settable(GCINFO *gc, int exponent, int flags)
 {
   if (exponent==0) {
-    gc_clean();         /* delete all "live" objects first */
-    if (SharedGC.table!=NULL) {
-      free(SharedGC.table);
-      SharedGC.table=NULL;
+    gc_clean(gc);       /* delete all "live" objects first */
+    if (gc->table!=NULL) {
+      free(gc->table);
+      gc->table=NULL;
     } /* if */
-    SharedGC.exponent=0;
-    SharedGC.flags=0;
-    SharedGC.count=0;
+    gc->exponent=0;
+    gc->flags=0;
+    gc->count=0;
   } else {
     int size,oldsize;
     GCPAIR *table,*oldtable;
@@ -100,85 +84,85 @@ int gc_settable(int exponent, int flags)
       return GC_ERR_PARAMS;
     size=(1<<exponent);
     /* the hash table should not hold more elements than the new size */
-    if (SharedGC.count>size)
+    if (gc->count>size)
       return GC_ERR_PARAMS;
     /* allocate the new table */
     table=malloc(size*sizeof(*table));
     if (table==NULL)
       return GC_ERR_MEMORY;
     /* save the statistics of the old table */
-    oldtable=SharedGC.table;
-    oldsize=(1<<SharedGC.exponent);
+    oldtable=gc->table;
+    oldsize=(1<<gc->exponent);
     /* clear and set the new table */
     memset(table,0,size*sizeof(*table));
-    SharedGC.table=table;
-    SharedGC.exponent=exponent;
-    SharedGC.count=flags;
-    SharedGC.count=0;           /* old table in initially empty */
+    gc->table=table;
+    gc->exponent=exponent;
+    gc->flags=flags;
+    gc->count=0;           /* old table in initially empty */
     /* re-mark all objects in the old table */
     if (oldtable!=NULL) {
       int index;
       for (index=0; index<oldsize; index++)
         if (oldtable[index].value!=0)
-          gc_mark(oldtable[index].value);
+          gc_mark(gc,oldtable[index].value);
       free(oldtable);
     } /* if */
   } /* if */
   return GC_ERR_NONE;
 }
 
-int gc_tablestat(int *exponent,int *percentage)
+int gc_tablestat(GCINFO *gc, int *exponent, int *percentage)
 {
   if (exponent!=NULL)
-    *exponent=SharedGC.exponent;
+    *exponent=gc->exponent;
   if (percentage!=NULL) {
-    int size=(1L<<SharedGC.exponent);
+    int size=(1L<<gc->exponent);
     /* calculate with floating point to avoid integer overflow */
-    double p=100.0*SharedGC.count/size;
+    double p=100.0*gc->count/size;
     *percentage=(int)p;
   } /* if */
   return GC_ERR_NONE;
 }
 
-int gc_mark(cell value)
+int gc_mark(GCINFO *gc, cell value)
 {
   int index,incr,incridx,mask;
   cell v,t;
   unsigned char *minorbyte;
 
-  if (SharedGC.table==NULL)
+  if (gc->table==NULL)
     return GC_ERR_INIT;
-  if (SharedGC.count>=(1<<SharedGC.exponent)) {
+  if (gc->count>=(1<<gc->exponent)) {
     int err;
-    if ((SharedGC.flags & GC_AUTOGROW)==0)
+    if ((gc->flags & GC_AUTOGROW)==0)
       return GC_ERR_TABLEFULL;
-    err=gc_settable(SharedGC.exponent+1,SharedGC.flags);
+    err=gc_settable(gc,gc->exponent+1,gc->flags);
     if (err!=GC_ERR_NONE)
       return err;
   } /* if */
-  assert(SharedGC.count<(1<<SharedGC.exponent));
+  assert(gc->count<(1<<gc->exponent));
 
   /* first "fold" the value, to make maximum use of all bits */
   v=value;
-  if (SharedGC.exponent<SHIFT1)
+  if (gc->exponent<SHIFT1)
     v=FOLD1(v);
-  if (SharedGC.exponent<SHIFT2)
+  if (gc->exponent<SHIFT2)
     v=FOLD2(v);
-  if (SharedGC.exponent<SHIFT3)
+  if (gc->exponent<SHIFT3)
     v=FOLD3(v);
   /* swap the bits of the minor byte */
   minorbyte=(unsigned char*)&v;
   *minorbyte=inverse[*minorbyte];
   /* truncate the value to the required number of bits */
-  mask=MASK(SharedGC.exponent);
+  mask=MASK(gc->exponent);
   index=(v & mask);
 
-  incridx= (SharedGC.exponent<sizeof increments / sizeof increments[0]) ?
-              SharedGC.exponent :
+  incridx= (gc->exponent<sizeof increments / sizeof increments[0]) ?
+              gc->exponent :
               (sizeof increments / sizeof increments[0]) - 1;
   assert(incridx<sizeof increments / sizeof increments[0]);
   incr=increments[incridx];
-  while ((t=SharedGC.table[index].value)!=0 && t!=value) {
+  while ((t=gc->table[index].value)!=0 && t!=value) {
     assert(incr>0);
     index=(index+incr) & mask;
     if (incridx>0)
@@ -187,43 +171,43 @@ int gc_mark(cell value)
 
   if (t!=0) {
     assert(t==value);
-    assert(SharedGC.table[index].value==value);
+    assert(gc->table[index].value==value);
     return GC_ERR_DUPLICATE;
   } /* if */
 
-  SharedGC.table[index].value=value;
-  assert(SharedGC.table[index].count==0);
+  gc->table[index].value=value;
+  assert(gc->table[index].count==0);
 
   return GC_ERR_NONE;
 }
 
-static void scansection(cell *start,size_t size)
+static void scansection(GCINFO *gc,cell *start,size_t size)
 {
   int index,incr,incridx,incridx_org,mask;
   cell v,t;
   unsigned char *minorbyte;
 
-  assert(SharedGC.table!=NULL);
+  assert(gc->table!=NULL);
   assert((size % sizeof(cell))==0);
   assert(start!=NULL);
   size/=sizeof(cell); /* from number of bytes to number of cells */
 
-  incridx_org= (SharedGC.exponent<sizeof increments / sizeof increments[0]) ?
-                  SharedGC.exponent :
+  incridx_org= (gc->exponent<sizeof increments / sizeof increments[0]) ?
+                  gc->exponent :
                   (sizeof increments / sizeof increments[0]) - 1;
   assert(incridx_org<sizeof increments / sizeof increments[0]);
 
   minorbyte=(unsigned char*)&v;
-  mask=MASK(SharedGC.exponent);
+  mask=MASK(gc->exponent);
 
   while (size>0) {
     v=*start;
     /* first "fold" the value, to make maximum use of all bits */
-    if (SharedGC.exponent<SHIFT1)
+    if (gc->exponent<SHIFT1)
       v=FOLD1(v);
-    if (SharedGC.exponent<SHIFT2)
+    if (gc->exponent<SHIFT2)
       v=FOLD2(v);
-    if (SharedGC.exponent<SHIFT3)
+    if (gc->exponent<SHIFT3)
       v=FOLD3(v);
     /* swap the bits of the minor byte */
     assert(minorbyte==(unsigned char*)&v);
@@ -234,7 +218,7 @@ static void scansection(cell *start,size_t size)
     /* find it in the table */
     incridx=incridx_org;
     incr=increments[incridx];
-    while ((t=SharedGC.table[index].value)!=*start && t!=0) {
+    while ((t=gc->table[index].value)!=*start && t!=0) {
       assert(incr>0);
       index=(index+incr) & mask;
       if (incridx>0)
@@ -244,8 +228,8 @@ static void scansection(cell *start,size_t size)
     /* if found, mark it */
     if (t!=0) {
       assert(t==*start);
-      assert(SharedGC.table[index].value==*start);
-      SharedGC.table[index].count+=1;
+      assert(gc->table[index].value==*start);
+      gc->table[index].count+=1;
     } /* if */
 
     size--;
@@ -253,45 +237,45 @@ static void scansection(cell *start,size_t size)
   } /* while */
 }
 
-int gc_scan(AMX *amx)
+int gc_scan(GCINFO *gc, AMX *amx)
 {
   AMX_HEADER *hdr;
   unsigned char *data;
 
   if (amx==NULL)
     return GC_ERR_PARAMS;
-  if (SharedGC.table==NULL)
+  if (gc->table==NULL)
     return GC_ERR_INIT;
 
   hdr=(AMX_HEADER*)amx->base;
 
   /* scan data segment */
   data=amx->data ? amx->data : amx->base+(int)hdr->dat;
-  scansection((cell *)data, hdr->hea - hdr->dat);
+  scansection(gc,(cell *)data, hdr->hea - hdr->dat);
   /* scan stack */
-  scansection((cell *)(data + amx->hlw), amx->hea - amx->hlw);
+  scansection(gc,(cell *)(data + amx->hlw), amx->hea - amx->hlw);
   /* scan heap */
-  scansection((cell *)(data + amx->stk), amx->stp - amx->stk);
+  scansection(gc,(cell *)(data + amx->stk), amx->stp - amx->stk);
 
   return GC_ERR_NONE;
 }
 
-int gc_clean(void)
+int gc_clean(GCINFO *gc)
 {
   int size;
   GCPAIR *item;
 
-  if (SharedGC.table==NULL)
+  if (gc->table==NULL)
     return GC_ERR_INIT;
-  if (SharedGC.callback==NULL)
+  if (gc->callback==NULL)
     return GC_ERR_CALLBACK;
 
-  size=(1<<SharedGC.exponent);
-  item=SharedGC.table;
+  size=(1<<gc->exponent);
+  item=gc->table;
   while (size>0) {
     if (item->value!=0) {
       if (item->count==0) {
-        SharedGC.callback(item->value);
+        gc->callback(item->value);
         item->value=0;
       } /* if */
       item->count=0;
@@ -34,17 +34,35 @@ enum {
 /* flags */
 #define GC_AUTOGROW   1 /* gc_mark() may grow the hash table when it fills up */
 
-int gc_setcallback(GC_FREE callback);
+typedef struct tagGCPAIR {
+  cell value;
+  int count;
+} GCPAIR;
 
-int gc_settable(int exponent,int flags);
-int gc_tablestat(int *exponent,int *percentage);
+/* The GCINFO structure holds the state of a garbage collector; it must be
+ * set to zero before the first call. A garbage collector may be shared by
+ * several abstract machines, but the functions below must then not be called
+ * concurrently on the same GCINFO (the host must serialize the calls).
+ */
+typedef struct tagGCINFO {
+  GCPAIR *table;
+  GC_FREE callback;
+  int exponent;
+  int flags;
+  int count;
+} GCINFO;
+
+int gc_setcallback(GCINFO *gc, GC_FREE callback);
+
+int gc_settable(GCINFO *gc, int exponent, int flags);
+int gc_tablestat(GCINFO *gc, int *exponent, int *percentage);
         /* Upon return, "exponent" will hold the values passed to gc_settable();
          * "percentage" is the level (in percent) that the hash table is filled
          * up. Either parameter may be set to NULL.
          */
 
-int gc_mark(cell value);
-int gc_scan(AMX *amx);
-int gc_clean(void);
+int gc_mark(GCINFO *gc, cell value);
+int gc_scan(GCINFO *gc, AMX *amx);
+int gc_clean(GCINFO *gc);
 
 #endif /* AMXGC_H */
@@ -0,0 +1,1782 @@
+/*  Just-In-Time compiler for the Pawn Abstract Machine, x86-64 (System V ABI)
+ *
+ *  This JIT translates the P-code of a verified abstract machine into native
+ *  x86-64 code. It supports the complete instruction set, including the macro
+ *  instructions and the packed opcodes (but not overlays). Complex
+ *  instructions (native function calls, SWITCH, the block memory instructions
+ *  and the debug hook) are handled by small helper functions in C; all other
+ *  instructions are translated inline.
+ *
+ *  The compiled image has the layout:
+ *    [prefix] [exit stubs] [address map] [P-code size] [native code] [data]
+ *  where the "address map" translates P-code addresses into offsets into the
+ *  native code. The abstract machine's CIP register, the return addresses on
+ *  the stack and the public function addresses all remain P-code addresses,
+ *  so that the debugger interface and the API work unmodified. The generated
+ *  code uses only relative jumps for destinations within the image, so the
+ *  image may be moved in memory after compilation (e.g. to a block of memory
+ *  with execute permission).
+ *
+ *  Register usage in the generated code:
+ *    rbx = DAT, r12d = PRI, r13d = ALT, r14d = STK, r15d = FRM,
+ *    rbp = pointer to the JIT context (holding HEA, STP, HLW and the
+ *          other state of the abstract machine)
+ *
+ *  Copyright (c) CompuPhase, 1998-2020
+ *
+ *  This software is provided "as-is", without any express or implied warranty.
+ *  In no event will the authors be held liable for any damages arising from
+ *  the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1.  The origin of this software must not be misrepresented; you must not
+ *      claim that you wrote the original software. If you use this software in
+ *      a product, an acknowledgment in the product documentation would be
+ *      appreciated but is not required.
+ *  2.  Altered source versions must be plainly marked as such, and must not be
+ *      misrepresented as being the original software.
+ *  3.  This notice may not be removed or altered from any source distribution.
+ *
+ *  Version: $Id$
+ */
+#include <assert.h>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+#include "osdefs.h"
+#if defined __ECOS__
+  /* eCos puts include files in cyg/package_name */
+  #include <cyg/pawn/amx.h>
+  #include <cyg/pawn/amxsimd.h>
+#else
+  #include "amx.h"
+  #include "amxsimd.h"
+#endif
+
+#if !(defined __GNUC__ || defined __ICC) || !defined __x86_64__ || defined _WIN64
+  #error The x86-64 JIT requires GNU GCC (or compatible) and the System V ABI.
+#endif
+#if PAWN_CELL_SIZE!=32
+  #error The x86-64 JIT supports only 32-bit cells.
+#endif
+
+/* The opcodes must match the list in AMX.C (which is private to that file);
+ * the JIT always supports the macro instructions and the packed opcodes.
+ */
+typedef enum {
+  OP_NOP,
+  OP_LOAD_PRI,
+  OP_LOAD_ALT,
+  OP_LOAD_S_PRI,
+  OP_LOAD_S_ALT,
+  OP_LREF_S_PRI,
+  OP_LREF_S_ALT,
+  OP_LOAD_I,
+  OP_LODB_I,
+  OP_CONST_PRI,
+  OP_CONST_ALT,
+  OP_ADDR_PRI,
+  OP_ADDR_ALT,
+  OP_STOR,
+  OP_STOR_S,
+  OP_SREF_S,
+  OP_STOR_I,
+  OP_STRB_I,
+  OP_ALIGN_PRI,
+  OP_LCTRL,
+  OP_SCTRL,
+  OP_XCHG,
+  OP_PUSH_PRI,
+  OP_PUSH_ALT,
+  OP_PUSHR_PRI,
+  OP_POP_PRI,
+  OP_POP_ALT,
+  OP_PICK,
+  OP_STACK,
+  OP_HEAP,
+  OP_PROC,
+  OP_RET,
+  OP_RETN,
+  OP_CALL,
+  OP_JUMP,
+  OP_JZER,
+  OP_JNZ,
+  OP_SHL,
+  OP_SHR,
+  OP_SSHR,
+  OP_SHL_C_PRI,
+  OP_SHL_C_ALT,
+  OP_SMUL,
+  OP_SDIV,
+  OP_ADD,
+  OP_SUB,
+  OP_AND,
+  OP_OR,
+  OP_XOR,
+  OP_NOT,
+  OP_NEG,
+  OP_INVERT,
+  OP_EQ,
+  OP_NEQ,
+  OP_SLESS,
+  OP_SLEQ,
+  OP_SGRTR,
+  OP_SGEQ,
+  OP_INC_PRI,
+  OP_INC_ALT,
+  OP_INC_I,
+  OP_DEC_PRI,
+  OP_DEC_ALT,
+  OP_DEC_I,
+  OP_MOVS,
+  OP_CMPS,
+  OP_FILL,
+  OP_HALT,
+  OP_BOUNDS,
+  OP_SYSREQ,
+  OP_SWITCH,
+  OP_SWAP_PRI,
+  OP_SWAP_ALT,
+  OP_BREAK,
+  OP_CASETBL,
+  /* patched instructions */
+  OP_SYSREQ_D,
+  OP_SYSREQ_ND,
+  /* overlay instructions */
+  OP_CALL_OVL,
+  OP_RETN_OVL,
+  OP_SWITCH_OVL,
+  OP_CASETBL_OVL,
+  /* supplemental & macro instructions */
+  OP_LIDX,
+  OP_LIDX_B,
+  OP_IDXADDR,
+  OP_IDXADDR_B,
+  OP_PUSH_C,
+  OP_PUSH,
+  OP_PUSH_S,
+  OP_PUSH_ADR,
+  OP_PUSHR_C,
+  OP_PUSHR_S,
+  OP_PUSHR_ADR,
+  OP_JEQ,
+  OP_JNEQ,
+  OP_JSLESS,
+  OP_JSLEQ,
+  OP_JSGRTR,
+  OP_JSGEQ,
+  OP_SDIV_INV,
+  OP_SUB_INV,
+  OP_ADD_C,
+  OP_SMUL_C,
+  OP_ZERO_PRI,
+  OP_ZERO_ALT,
+  OP_ZERO,
+  OP_ZERO_S,
+  OP_EQ_C_PRI,
+  OP_EQ_C_ALT,
+  OP_INC,
+  OP_INC_S,
+  OP_DEC,
+  OP_DEC_S,
+  /* macro instructions */
+  OP_SYSREQ_N,
+  OP_PUSHM_C,
+  OP_PUSHM,
+  OP_PUSHM_S,
+  OP_PUSHM_ADR,
+  OP_PUSHRM_C,
+  OP_PUSHRM_S,
+  OP_PUSHRM_ADR,
+  OP_LOAD2,
+  OP_LOAD2_S,
+  OP_CONST,
+  OP_CONST_S,
+  /* packed instructions */
+  OP_LOAD_P_PRI,
+  OP_LOAD_P_ALT,
+  OP_LOAD_P_S_PRI,
+  OP_LOAD_P_S_ALT,
+  OP_LREF_P_S_PRI,
+  OP_LREF_P_S_ALT,
+  OP_LODB_P_I,
+  OP_CONST_P_PRI,
+  OP_CONST_P_ALT,
+  OP_ADDR_P_PRI,
+  OP_ADDR_P_ALT,
+  OP_STOR_P,
+  OP_STOR_P_S,
+  OP_SREF_P_S,
+  OP_STRB_P_I,
+  OP_LIDX_P_B,
+  OP_IDXADDR_P_B,
+  OP_ALIGN_P_PRI,
+  OP_PUSH_P_C,
+  OP_PUSH_P,
+  OP_PUSH_P_S,
+  OP_PUSH_P_ADR,
+  OP_PUSHR_P_C,
+  OP_PUSHR_P_S,
+  OP_PUSHR_P_ADR,
+  OP_PUSHM_P_C,
+  OP_PUSHM_P,
+  OP_PUSHM_P_S,
+  OP_PUSHM_P_ADR,
+  OP_PUSHRM_P_C,
+  OP_PUSHRM_P_S,
+  OP_PUSHRM_P_ADR,
+  OP_STACK_P,
+  OP_HEAP_P,
+  OP_SHL_P_C_PRI,
+  OP_SHL_P_C_ALT,
+  OP_ADD_P_C,
+  OP_SMUL_P_C,
+  OP_ZERO_P,
+  OP_ZERO_P_S,
+  OP_EQ_P_C_PRI,
+  OP_EQ_P_C_ALT,
+  OP_INC_P,
+  OP_INC_P_S,
+  OP_DEC_P,
+  OP_DEC_P_S,
+  OP_MOVS_P,
+  OP_CMPS_P,
+  OP_FILL_P,
+  OP_HALT_P,
+  OP_BOUNDS_P,
+  /* ----- */
+  OP_NUM_OPCODES
+} OPCODE;
+
+/* the unpacked instruction that each packed instruction is a short form of */
+static const unsigned char packed_base[] = {
+  OP_LOAD_PRI,    OP_LOAD_ALT,    OP_LOAD_S_PRI,  OP_LOAD_S_ALT,
+  OP_LREF_S_PRI,  OP_LREF_S_ALT,  OP_LODB_I,      OP_CONST_PRI,
+  OP_CONST_ALT,   OP_ADDR_PRI,    OP_ADDR_ALT,    OP_STOR,
+  OP_STOR_S,      OP_SREF_S,      OP_STRB_I,      OP_LIDX_B,
+  OP_IDXADDR_B,   OP_ALIGN_PRI,   OP_PUSH_C,      OP_PUSH,
+  OP_PUSH_S,      OP_PUSH_ADR,    OP_PUSHR_C,     OP_PUSHR_S,
+  OP_PUSHR_ADR,   OP_PUSHM_C,     OP_PUSHM,       OP_PUSHM_S,
+  OP_PUSHM_ADR,   OP_PUSHRM_C,    OP_PUSHRM_S,    OP_PUSHRM_ADR,
+  OP_STACK,       OP_HEAP,        OP_SHL_C_PRI,   OP_SHL_C_ALT,
+  OP_ADD_C,       OP_SMUL_C,      OP_ZERO,        OP_ZERO_S,
+  OP_EQ_C_PRI,    OP_EQ_C_ALT,    OP_INC,         OP_INC_S,
+  OP_DEC,         OP_DEC_S,       OP_MOVS,        OP_CMPS,
+  OP_FILL,        OP_HALT,        OP_BOUNDS
+};
+
+#define JIT_CELLBOUND   80      /* upper bound of native code (in bytes) per P-code cell */
+#define JIT_CASEGUARD   8       /* size of the guard in front of a case table */
+#define STKMARGIN       ((cell)(16*sizeof(cell)))
+
+/* The context is passed to the generated code in register rbp. The first
+ * fields are also accessed from the entry/exit trampolines (assembler, below),
+ * so their offsets must not change.
+ */
+typedef struct tagJITCTX {
+  void *rsp;            /* host stack pointer on entry of the compiled code */
+  unsigned char *data;  /* data segment (copied in rbx) */
+  unsigned char *code;  /* start of the native code */
+  int32_t *map;         /* P-code address -> native code offset */
+  AMX *amx;
+  unsigned char *jump;  /* target of a computed jump (SWITCH, SCTRL 6) */
+  cell pri, alt, stk, frm;  /* registers, spilled around calls to helpers */
+  cell hea, stp, hlw;
+  cell cip;             /* P-code address for a BOUNDS error */
+  cell codesize;        /* size of the P-code (and of the map) */
+  int error;
+  cell *retval;
+  cell margin;          /* STKMARGIN plus the reserve of amx_SetStackLimit() */
+} JITCTX;
+
+#define CTX_RSP   0
+#define CTX_DATA  8
+#define CTX_PRI   48
+#define CTX_ALT   52
+#define CTX_STK   56
+#define CTX_FRM   60
+
+/* amx_jit_enter() saves the callee-saved registers, loads the registers of
+ * the abstract machine from the context and jumps into the compiled code;
+ * the generated code leaves via amx_jit_leave(), which restores the host
+ * stack and returns from amx_jit_enter()
+ */
+extern void amx_jit_enter(JITCTX *ctx, void *target);
+extern void amx_jit_leave(void);
+
+#if defined __APPLE__
+  #define JIT_SYMBOL(name)  "_" #name
+  #define JIT_FUNCTYPE(name)
+#else
+  #define JIT_SYMBOL(name)  #name
+  #define JIT_FUNCTYPE(name) "  .hidden " #name "\n  .type " #name ",@function\n"
+#endif
+
+__asm__ (
+  "  .text\n"
+  "  .globl " JIT_SYMBOL(amx_jit_enter) "\n"
+  JIT_FUNCTYPE(amx_jit_enter)
+  JIT_SYMBOL(amx_jit_enter) ":\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq  $8,%rsp\n"           /* keep the stack 16-byte aligned */
+  "  movq  %rsp,0(%rdi)\n"      /* CTX_RSP */
+  "  movq  %rdi,%rbp\n"
+  "  movq  8(%rbp),%rbx\n"      /* CTX_DATA */
+  "  movl  48(%rbp),%r12d\n"    /* CTX_PRI */
+  "  movl  52(%rbp),%r13d\n"    /* CTX_ALT */
+  "  movl  56(%rbp),%r14d\n"    /* CTX_STK */
+  "  movl  60(%rbp),%r15d\n"    /* CTX_FRM */
+  "  jmp   *%rsi\n"
+  "  .globl " JIT_SYMBOL(amx_jit_leave) "\n"
+  JIT_FUNCTYPE(amx_jit_leave)
+  JIT_SYMBOL(amx_jit_leave) ":\n"
+  "  movq  0(%rbp),%rsp\n"
+  "  addq  $8,%rsp\n"
+  "  popq  %r15\n"
+  "  popq  %r14\n"
+  "  popq  %r13\n"
+  "  popq  %r12\n"
+  "  popq  %rbx\n"
+  "  popq  %rbp\n"
+  "  ret\n"
+);
+
+
+/* ----- helper functions, called from the generated code -----
+ * All helpers receive the context plus up to three parameters; the registers
+ * are spilled into the context before the call and reloaded after it. A
+ * helper returns 0 to continue execution, or 1 to leave the compiled code
+ * with the error code in ctx->error.
+ */
+
+static int jit_jumpto(JITCTX *ctx,cell target)
+{
+  if ((ucell)target>=(ucell)ctx->codesize || (target & (sizeof(cell)-1))!=0
+      || ctx->map[target/sizeof(cell)]<0)
+  {
+    ctx->error=AMX_ERR_MEMACCESS;
+    return 1;
+  } /* if */
+  ctx->jump=ctx->code+ctx->map[target/sizeof(cell)];
+  return 0;
+}
+
+static int jit_sysreq(JITCTX *ctx,cell index,cell cip,cell unused)
+{
+  AMX *amx=ctx->amx;
+  int i;
+
+  (void)unused;
+  amx->cip=cip;
+  amx->hea=ctx->hea;
+  amx->frm=ctx->frm;
+  amx->stk=ctx->stk;
+  i=amx->callback(amx,index,&ctx->pri,(cell *)(ctx->data+(int)ctx->stk));
+  if (i!=AMX_ERR_NONE) {
+    if (i==AMX_ERR_SLEEP) {
+      amx->pri=ctx->pri;
+      amx->alt=ctx->alt;
+    } /* if */
+    ctx->error=i;
+    return 1;
+  } /* if */
+  return 0;
+}
+
+static int jit_sysreq_n(JITCTX *ctx,cell index,cell nbytes,cell cip)
+{
+  AMX *amx=ctx->amx;
+  int i;
+
+  ctx->stk-=sizeof(cell);
+  *(cell *)(ctx->data+(int)ctx->stk)=nbytes;
+  amx->cip=cip;
+  amx->hea=ctx->hea;
+  amx->frm=ctx->frm;
+  amx->stk=ctx->stk;
+  i=amx->callback(amx,index,&ctx->pri,(cell *)(ctx->data+(int)ctx->stk));
+  ctx->stk+=nbytes+sizeof(cell);
+  if (i!=AMX_ERR_NONE) {
+    if (i==AMX_ERR_SLEEP) {
+      amx->pri=ctx->pri;
+      amx->alt=ctx->alt;
+      amx->stk=ctx->stk;
+    } /* if */
+    ctx->error=i;
+    return 1;
+  } /* if */
+  return 0;
+}
+
+static int jit_sysreq_d(JITCTX *ctx,cell address,cell nbytes,cell cip)
+{
+  /* SYSREQ.D and SYSREQ.ND (with nbytes>=0); the native function address
+   * only fits in a cell on a 64-bit platform if the program was patched
+   * explicitly, the JIT never patches SYSREQ instructions itself
+   */
+  AMX *amx=ctx->amx;
+
+  if (nbytes>=0) {
+    ctx->stk-=sizeof(cell);
+    *(cell *)(ctx->data+(int)ctx->stk)=nbytes;
+  } /* if */
+  amx->cip=cip;
+  amx->hea=ctx->hea;
+  amx->frm=ctx->frm;
+  amx->stk=ctx->stk;
+  amx->error=AMX_ERR_NONE;
+  ctx->pri=((AMX_NATIVE)(intptr_t)address)(amx,(cell *)(ctx->data+(int)ctx->stk));
+  if (nbytes>=0)
+    ctx->stk+=nbytes+sizeof(cell);
+  if (amx->error!=AMX_ERR_NONE) {
+    if (amx->error==AMX_ERR_SLEEP) {
+      amx->pri=ctx->pri;
+      amx->alt=ctx->alt;
+      amx->stk=ctx->stk;
+    } /* if */
+    ctx->error=amx->error;
+    return 1;
+  } /* if */
+  return 0;
+}
+
+static int jit_halt(JITCTX *ctx,cell code,cell cip,cell unused)
+{
+  AMX *amx=ctx->amx;
+
+  (void)unused;
+  if (ctx->retval!=NULL)
+    *ctx->retval=ctx->pri;
+  amx->frm=ctx->frm;
+  amx->pri=ctx->pri;
+  amx->alt=ctx->alt;
+  amx->cip=cip;
+  if (code==AMX_ERR_SLEEP) {
+    amx->stk=ctx->stk;
+    amx->hea=ctx->hea;
+  } /* if */
+  ctx->error=(int)code;
+  return 1;
+}
+
+static int jit_fuel(JITCTX *ctx,cell cip,cell unused1,cell unused2)
+{
+  AMX *amx=ctx->amx;
+
+  (void)unused1;
+  (void)unused2;
+  if (amx->fuelmode==AMX_FUEL_NONE) {
+    amx->fuel=LONG_MAX;
+    return 0;
+  } /* if */
+  if (amx->fuelmode==AMX_FUEL_HOOK) {
+    amx->fuel=LONG_MAX;
+    amx->cip=cip;
+    amx->frm=ctx->frm;
+    if (amx->fuelhook==NULL || amx->fuelhook(amx)==AMX_ERR_NONE)
+      return 0;
+  } /* if */
+  /* the instruction at "cip" restarts on AMX_EXEC_CONT */
+  amx->fuel=0;
+  amx->frm=ctx->frm;
+  amx->pri=ctx->pri;
+  amx->alt=ctx->alt;
+  amx->stk=ctx->stk;
+  amx->hea=ctx->hea;
+  amx->cip=cip;
+  ctx->error=AMX_ERR_FUEL;
+  return 1;
+}
+
+/* the heap and the stack came closer than ctx->margin; see stackout() in AMX.C */
+static int jit_stack(JITCTX *ctx,cell unused1,cell unused2,cell unused3)
+{
+  AMX *amx=ctx->amx;
+
+  (void)unused1;
+  (void)unused2;
+  (void)unused3;
+  if (amx->stkreserve>0 && amx->stackhook!=NULL) {
+    amx->hea=ctx->hea;
+    amx->stk=ctx->stk;
+    if (amx->stackhook(amx)==AMX_ERR_NONE) {
+      ctx->margin=STKMARGIN+amx->stkreserve;
+      if (ctx->hea+ctx->margin<=ctx->stk)
+        return 0;
+    } /* if */
+  } /* if */
+  ctx->error=AMX_ERR_STACKERR;
+  return 1;
+}
+
+static int jit_break(JITCTX *ctx,cell cip,cell unused1,cell unused2)
+{
+  AMX *amx=ctx->amx;
+  int i;
+
+  (void)unused1;
+  (void)unused2;
+  assert(amx->debug!=NULL);
+  amx->frm=ctx->frm;
+  amx->stk=ctx->stk;
+  amx->hea=ctx->hea;
+  amx->cip=cip;
+  i=amx->debug(amx);
+  if (i!=AMX_ERR_NONE) {
+    if (i==AMX_ERR_SLEEP) {
+      amx->pri=ctx->pri;
+      amx->alt=ctx->alt;
+    } /* if */
+    ctx->error=i;
+    return 1;
+  } /* if */
+  return 0;
+}
+
+static int jit_switch(JITCTX *ctx,cell casetbl,cell unused1,cell unused2)
+{
+  const cell *cptr,*rec;
+  cell num,value;
+  ucell diff;
+  int low,high,mid;
+
+  (void)unused1;
+  (void)unused2;
+  /* the case table was copied into the native code, behind a guard; the
+   * jump targets in the table are absolute P-code addresses; the records
+   * are sorted on their case value (VerifyPcode() sees to that), so a dense
+   * table is indexed directly and a sparse table gets a binary search
+   */
+  assert(ctx->map[casetbl/sizeof(cell)]>=0);
+  cptr=(const cell *)(ctx->code+ctx->map[casetbl/sizeof(cell)]+JIT_CASEGUARD);
+  num=cptr[0];                  /* number of records in the case table */
+  rec=cptr+2;
+  value=ctx->pri;
+  if (num>0) {
+    diff=(ucell)value-(ucell)rec[0];
+    if (diff<(ucell)num && rec[2*diff]==value)
+      return jit_jumpto(ctx,rec[2*diff+1]);
+    if (diff<=(ucell)rec[2*(num-1)]-(ucell)rec[0]) {
+      low=0;
+      high=(int)num-1;
+      while (low<high) {
+        mid=(low+high)/2;
+        if (rec[2*mid]<value)
+          low=mid+1;
+        else
+          high=mid;
+      } /* while */
+      if (rec[2*low]==value)
+        return jit_jumpto(ctx,rec[2*low+1]);
+    } /* if */
+  } /* if */
+  return jit_jumpto(ctx,cptr[1]); /* "none-matched" case */
+}
+
+static int jit_sctrl_cip(JITCTX *ctx,cell unused1,cell unused2,cell unused3)
+{
+  (void)unused1;
+  (void)unused2;
+  (void)unused3;
+  return jit_jumpto(ctx,ctx->pri);
+}
+
+static int verify_range(const JITCTX *ctx,cell addr,cell size)
+{
+  if (addr>=ctx->hea && addr<ctx->stk || (ucell)addr>=(ucell)ctx->stp)
+    return 0;
+  if ((addr+size)>ctx->hea && (addr+size)<ctx->stk || (ucell)(addr+size)>(ucell)ctx->stp)
+    return 0;
+  return 1;
+}
+
+static int jit_movs(JITCTX *ctx,cell size,cell unused1,cell unused2)
+{
+  (void)unused1;
+  (void)unused2;
+  if (!verify_range(ctx,ctx->pri,size) || !verify_range(ctx,ctx->alt,size)) {
+    ctx->error=AMX_ERR_MEMACCESS;
+    return 1;
+  } /* if */
+  memcpy(ctx->data+(int)ctx->alt,ctx->data+(int)ctx->pri,(int)size);
+  return 0;
+}
+
+static int jit_cmps(JITCTX *ctx,cell size,cell unused1,cell unused2)
+{
+  (void)unused1;
+  (void)unused2;
+  if (!verify_range(ctx,ctx->pri,size) || !verify_range(ctx,ctx->alt,size)) {
+    ctx->error=AMX_ERR_MEMACCESS;
+    return 1;
+  } /* if */
+  ctx->pri=memcmp(ctx->data+(int)ctx->alt,ctx->data+(int)ctx->pri,(int)size);
+  return 0;
+}
+
+static int jit_fill(JITCTX *ctx,cell size,cell unused1,cell unused2)
+{
+  (void)unused1;
+  (void)unused2;
+  if (!verify_range(ctx,ctx->alt,size)) {
+    ctx->error=AMX_ERR_MEMACCESS;
+    return 1;
+  } /* if */
+  simd_fill((cell *)(ctx->data+(int)ctx->alt),ctx->pri,(size_t)size/sizeof(cell));
+  return 0;
+}
+
+
+/* ----- code emitter ----- */
+
+enum {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8,  R9,  R10, R11, R12, R13, R14, R15
+};
+#define PRI   R12
+#define ALT   R13
+#define STK   R14
+#define FRM   R15
+#define DAT   RBX
+#define CTX   RBP
+#define NOREG (-1)
+#define SCALE4(reg) ((reg) | 0x200) /* index register, scaled by 4 */
+
+/* condition codes */
+enum {
+  CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+  CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G,
+  CC_ALWAYS = -1
+};
+
+/* the "reg" fields in the ModR/M byte for the group-1 ALU instructions and
+ * for the shifts
+ */
+#define ALU_ADD 0
+#define ALU_OR  1
+#define ALU_AND 4
+#define ALU_SUB 5
+#define ALU_XOR 6
+#define ALU_CMP 7
+#define SHIFT_SHL 4
+#define SHIFT_SHR 5
+#define SHIFT_SAR 7
+
+enum {
+  STUB_CALL,            /* spill registers, call helper in rax, reload registers */
+  STUB_EXIT,            /* leave the compiled code (registers already spilled) */
+  STUB_EXIT_SPILL,      /* spill registers and leave */
+  STUB_ERR_STACKERR,    /* set an error code and leave */
+  STUB_ERR_BOUNDS,
+  STUB_ERR_MEMACCESS,
+  STUB_ERR_INVINSTR,
+  STUB_ERR_STACKLOW,
+  STUB_ERR_HEAPLOW,
+  STUB_ERR_DIVIDE,
+  NUM_STUBS
+};
+
+typedef struct tagJITSTATE {
+  unsigned char *ip;    /* current position in the native code */
+  unsigned char *code;  /* start of the native code */
+  int32_t *map;         /* P-code address -> native code offset */
+  unsigned char *stub[NUM_STUBS];
+  int32_t *fixups;      /* list of {native position, P-code target} pairs */
+  int numfixups;
+} JITSTATE;
+
+static void e8(JITSTATE *j,int v)
+{
+  *j->ip++=(unsigned char)v;
+}
+
+static void e32(JITSTATE *j,int32_t v)
+{
+  memcpy(j->ip,&v,sizeof v);
+  j->ip+=sizeof v;
+}
+
+static void e64(JITSTATE *j,int64_t v)
+{
+  memcpy(j->ip,&v,sizeof v);
+  j->ip+=sizeof v;
+}
+
+/* REX prefix, only emitted when needed; "w" selects a 64-bit operand */
+static void rex(JITSTATE *j,int w,int reg,int index,int base)
+{
+  int r=0x40;
+  if (w)
+    r|=0x08;
+  if (reg>=0 && (reg & 8)!=0)
+    r|=0x04;
+  if (index>=0 && (index & 8)!=0)
+    r|=0x02;
+  if (base>=0 && (base & 8)!=0)
+    r|=0x01;
+  if (r!=0x40)
+    e8(j,r);
+}
+
+/* opcodes above 0xff are two-byte opcodes (0x0f prefix) */
+static void opcode(JITSTATE *j,int opc)
+{
+  if (opc>0xff)
+    e8(j,opc>>8);
+  e8(j,opc & 0xff);
+}
+
+/* <opc> reg, rm   -- register/register form */
+static void op_rr(JITSTATE *j,int w,int opc,int reg,int rm)
+{
+  rex(j,w,reg,NOREG,rm);
+  opcode(j,opc);
+  e8(j,0xc0 | ((reg & 7)<<3) | (rm & 7));
+}
+
+/* <opc> reg, [base + index + disp]   -- register/memory form */
+static void op_rm(JITSTATE *j,int w,int opc,int reg,int base,int index,int32_t disp)
+{
+  int mod,scale=0;
+
+  if (index>=0) {
+    scale=(index>>8) & 3;
+    index&=0x0f;
+  } /* if */
+  assert(index!=RSP);
+  rex(j,w,reg,index,base);
+  opcode(j,opc);
+  if (disp==0 && (base & 7)!=RBP)
+    mod=0;
+  else if (disp>=-128 && disp<=127)
+    mod=1;
+  else
+    mod=2;
+  if (index>=0 || (base & 7)==RSP) {
+    e8(j,(mod<<6) | ((reg & 7)<<3) | 4);
+    e8(j,(scale<<6) | (((index>=0) ? index : RSP) & 7)<<3 | (base & 7));
+  } else {
+    e8(j,(mod<<6) | ((reg & 7)<<3) | (base & 7));
+  } /* if */
+  if (mod==1)
+    e8(j,disp);
+  else if (mod==2)
+    e32(j,disp);
+}
+
+#define mov_rr(j,dst,src)           op_rr((j),0,0x89,(src),(dst))
+#define mov_rm(j,reg,base,idx,disp) op_rm((j),0,0x8b,(reg),(base),(idx),(disp))
+#define mov_mr(j,base,idx,disp,reg) op_rm((j),0,0x89,(reg),(base),(idx),(disp))
+#define lea(j,reg,base,idx,disp)    op_rm((j),0,0x8d,(reg),(base),(idx),(disp))
+
+static void mov_ri(JITSTATE *j,int reg,int32_t imm)
+{
+  rex(j,0,NOREG,NOREG,reg);
+  e8(j,0xb8 + (reg & 7));
+  e32(j,imm);
+}
+
+static void mov_ri64(JITSTATE *j,int reg,const void *imm)
+{
+  rex(j,1,NOREG,NOREG,reg);
+  e8(j,0xb8 + (reg & 7));
+  e64(j,(int64_t)(intptr_t)imm);
+}
+
+/* mov dword [base + index + disp], imm */
+static void mov_mi(JITSTATE *j,int base,int index,int32_t disp,int32_t imm)
+{
+  op_rm(j,0,0xc7,0,base,index,disp);
+  e32(j,imm);
+}
+
+/* <alu> reg, imm */
+static void alu_ri(JITSTATE *j,int w,int alu,int reg,int32_t imm)
+{
+  if (imm>=-128 && imm<=127) {
+    op_rr(j,w,0x83,alu,reg);
+    e8(j,imm);
+  } else {
+    op_rr(j,w,0x81,alu,reg);
+    e32(j,imm);
+  } /* if */
+}
+
+/* <alu> dword [base + index + disp], imm */
+static void alu_mi(JITSTATE *j,int alu,int base,int index,int32_t disp,int32_t imm)
+{
+  if (imm>=-128 && imm<=127) {
+    op_rm(j,0,0x83,alu,base,index,disp);
+    e8(j,imm);
+  } else {
+    op_rm(j,0,0x81,alu,base,index,disp);
+    e32(j,imm);
+  } /* if */
+}
+
+/* reg = (reg <cc> imm) ? 1 : 0, or reg = (reg <cc> other) when imm is not used */
+static void setcc(JITSTATE *j,int cc,int dst)
+{
+  opcode(j,0x0f90 | cc);        /* setcc al */
+  e8(j,0xc0);
+  rex(j,0,dst,NOREG,RAX);
+  opcode(j,0x0fb6);             /* movzx dst, al */
+  e8(j,0xc0 | ((dst & 7)<<3));
+}
+
+/* jump (conditional or unconditional) to a known native address */
+static void jmp_to(JITSTATE *j,int cc,const unsigned char *target)
+{
+  if (cc==CC_ALWAYS)
+    e8(j,0xe9);
+  else
+    opcode(j,0x0f80 | cc);
+  e32(j,(int32_t)(target - (j->ip+4)));
+}
+
+/* short forward jump, resolved with patch_short() */
+static unsigned char *jmp_short(JITSTATE *j,int cc)
+{
+  e8(j,(cc==CC_ALWAYS) ? 0xeb : 0x70 | cc);
+  e8(j,0);
+  return j->ip;
+}
+
+static void patch_short(JITSTATE *j,unsigned char *from)
+{
+  assert(j->ip-from<=127);
+  from[-1]=(unsigned char)(j->ip-from);
+}
+
+/* jump to a P-code address; the offset is resolved after the complete code
+ * has been generated
+ */
+static void jmp_pcode(JITSTATE *j,int cc,cell target)
+{
+  if (cc==CC_ALWAYS)
+    e8(j,0xe9);
+  else
+    opcode(j,0x0f80 | cc);
+  j->fixups[2*j->numfixups]=(int32_t)(j->ip - j->code);
+  j->fixups[2*j->numfixups+1]=target;
+  j->numfixups++;
+  e32(j,0);
+}
+
+static void push_reg(JITSTATE *j,int reg)
+{
+  alu_ri(j,0,ALU_SUB,STK,sizeof(cell));
+  mov_mr(j,DAT,STK,0,reg);
+}
+
+static void push_imm(JITSTATE *j,cell value)
+{
+  alu_ri(j,0,ALU_SUB,STK,sizeof(cell));
+  mov_mi(j,DAT,STK,0,value);
+}
+
+static void pop_reg(JITSTATE *j,int reg)
+{
+  mov_rm(j,reg,DAT,STK,0);
+  alu_ri(j,0,ALU_ADD,STK,sizeof(cell));
+}
+
+static void spill(JITSTATE *j)
+{
+  mov_mr(j,CTX,NOREG,CTX_PRI,PRI);
+  mov_mr(j,CTX,NOREG,CTX_ALT,ALT);
+  mov_mr(j,CTX,NOREG,CTX_STK,STK);
+  mov_mr(j,CTX,NOREG,CTX_FRM,FRM);
+}
+
+static void reload(JITSTATE *j)
+{
+  mov_rm(j,PRI,CTX,NOREG,CTX_PRI);
+  mov_rm(j,ALT,CTX,NOREG,CTX_ALT);
+  mov_rm(j,STK,CTX,NOREG,CTX_STK);
+  mov_rm(j,FRM,CTX,NOREG,CTX_FRM);
+}
+
+static void call_helper(JITSTATE *j,int (*helper)(JITCTX*,cell,cell,cell),cell p1,cell p2,cell p3)
+{
+  mov_ri(j,RSI,p1);
+  mov_ri(j,RDX,p2);
+  mov_ri(j,RCX,p3);
+  mov_ri64(j,RAX,(const void *)helper);
+  e8(j,0xe8);                   /* call STUB_CALL */
+  e32(j,(int32_t)(j->stub[STUB_CALL] - (j->ip+4)));
+  op_rr(j,0,0x85,RAX,RAX);      /* test eax, eax */
+  jmp_to(j,CC_NE,j->stub[STUB_EXIT]);
+}
+
+/* jump to the native address that a helper stored in ctx->jump */
+static void jmp_computed(JITSTATE *j)
+{
+  op_rm(j,0,0xff,4,CTX,NOREG,offsetof(JITCTX,jump));
+}
+
+/* verify an address in a register against the data segment and the stack,
+ * excluding the gap between the heap and the stack
+ */
+static void verify_addr(JITSTATE *j,int reg)
+{
+  unsigned char *skip;
+
+  op_rm(j,0,0x3b,reg,CTX,NOREG,offsetof(JITCTX,stp));  /* cmp reg, stp */
+  jmp_to(j,CC_AE,j->stub[STUB_ERR_MEMACCESS]);
+  op_rm(j,0,0x3b,reg,CTX,NOREG,offsetof(JITCTX,hea));  /* cmp reg, hea */
+  skip=jmp_short(j,CC_B);
+  op_rr(j,0,0x3b,reg,STK);                              /* cmp reg, stk */
+  jmp_to(j,CC_B,j->stub[STUB_ERR_MEMACCESS]);
+  patch_short(j,skip);
+}
+
+static void chk_margin(JITSTATE *j)
+{
+  unsigned char *skip;
+
+  mov_rm(j,RAX,CTX,NOREG,offsetof(JITCTX,hea));
+  op_rm(j,0,0x03,RAX,CTX,NOREG,offsetof(JITCTX,margin)); /* add eax, margin */
+  op_rr(j,0,0x3b,RAX,STK);                              /* cmp eax, stk */
+  skip=jmp_short(j,CC_G ^ 1);
+  call_helper(j,jit_stack,0,0,0);
+  patch_short(j,skip);
+}
+
+/* decrement the instruction budget of the abstract machine, for the
+ * instruction at "cip"
+ */
+static void chk_fuel(JITSTATE *j,cell cip)
+{
+  unsigned char *skip;
+
+  op_rm(j,1,0x8b,RAX,CTX,NOREG,offsetof(JITCTX,amx));  /* mov rax, amx */
+  op_rm(j,sizeof(long)==8,0x83,ALU_SUB,RAX,NOREG,offsetof(AMX,fuel)); /* sub [rax+fuel], 1 */
+  e8(j,1);
+  skip=jmp_short(j,CC_NS);
+  call_helper(j,jit_fuel,cip,0,0);
+  patch_short(j,skip);
+}
+
+/* conditional jump of the instruction at "cip" to the relative offset "p";
+ * a backward jump that is taken consumes instruction budget
+ */
+static void jmp_cond(JITSTATE *j,int cc,cell cip,cell p)
+{
+  unsigned char *skip;
+
+  if (p>0) {
+    jmp_pcode(j,cc,cip+p);
+    return;
+  } /* if */
+  skip=jmp_short(j,cc ^ 1);     /* inverse condition */
+  chk_fuel(j,cip);
+  jmp_pcode(j,CC_ALWAYS,cip+p);
+  patch_short(j,skip);
+}
+
+/* floored division: quotient in PRI and remainder in ALT */
+static void sdiv(JITSTATE *j,int dividend,int divisor)
+{
+  unsigned char *skip1,*skip2,*skip3;
+
+  op_rr(j,0,0x85,divisor,divisor);                      /* test divisor, divisor */
+  jmp_to(j,CC_E,j->stub[STUB_ERR_DIVIDE]);
+  mov_rr(j,RAX,dividend);
+  alu_ri(j,0,ALU_CMP,divisor,-1);                       /* avoid the overflow trap */
+  skip1=jmp_short(j,CC_NE);
+  op_rr(j,0,0xf7,3,RAX);                                /* neg eax */
+  op_rr(j,0,0x31,RDX,RDX);                              /* xor edx, edx */
+  skip2=jmp_short(j,CC_ALWAYS);
+  patch_short(j,skip1);
+  e8(j,0x99);                                           /* cdq */
+  op_rr(j,0,0xf7,7,divisor);                            /* idiv divisor */
+  op_rr(j,0,0x85,RDX,RDX);                              /* test edx, edx */
+  skip1=jmp_short(j,CC_E);
+  mov_rr(j,RCX,RDX);
+  op_rr(j,0,0x31,divisor,RCX);                          /* xor ecx, divisor */
+  skip3=jmp_short(j,CC_NS);
+  alu_ri(j,0,ALU_SUB,RAX,1);
+  op_rr(j,0,0x01,divisor,RDX);                          /* add edx, divisor */
+  patch_short(j,skip1);
+  patch_short(j,skip3);
+  patch_short(j,skip2);
+  mov_rr(j,PRI,RAX);
+  mov_rr(j,ALT,RDX);
+}
+
+/* jump to the P-code address in eax, which was popped from the stack */
+static void jmp_return(JITSTATE *j)
+{
+  op_rm(j,0,0x3b,RAX,CTX,NOREG,offsetof(JITCTX,codesize)); /* cmp eax, codesize */
+  jmp_to(j,CC_AE,j->stub[STUB_ERR_MEMACCESS]);
+  e8(j,0xa8);                                           /* test al, 3 */
+  e8(j,sizeof(cell)-1);
+  jmp_to(j,CC_NE,j->stub[STUB_ERR_MEMACCESS]);
+  op_rm(j,1,0x8b,RCX,CTX,NOREG,offsetof(JITCTX,map));   /* mov rcx, map */
+  op_rm(j,1,0x63,RAX,RCX,RAX,0);                        /* movsxd rax, [rcx+rax] */
+  alu_ri(j,1,ALU_CMP,RAX,0);                            /* cmp rax, 0 */
+  jmp_to(j,CC_L,j->stub[STUB_ERR_MEMACCESS]);
+  op_rm(j,1,0x03,RAX,CTX,NOREG,offsetof(JITCTX,code));  /* add rax, code */
+  op_rr(j,0,0xff,4,RAX);                                /* jmp rax */
+}
+
+static void emit_stubs(JITSTATE *j)
+{
+  static const int errors[] = {
+    AMX_ERR_STACKERR, AMX_ERR_BOUNDS, AMX_ERR_MEMACCESS, AMX_ERR_INVINSTR,
+    AMX_ERR_STACKLOW, AMX_ERR_HEAPLOW, AMX_ERR_DIVIDE
+  };
+  int i;
+
+  j->stub[STUB_CALL]=j->ip;
+  spill(j);
+  alu_ri(j,1,ALU_SUB,RSP,8);    /* align the stack for the call */
+  op_rr(j,1,0x89,CTX,RDI);      /* mov rdi, rbp */
+  op_rr(j,0,0xff,2,RAX);        /* call rax */
+  alu_ri(j,1,ALU_ADD,RSP,8);
+  reload(j);
+  e8(j,0xc3);                   /* ret */
+
+  j->stub[STUB_EXIT_SPILL]=j->ip;
+  spill(j);
+  j->stub[STUB_EXIT]=j->ip;
+  mov_ri64(j,RAX,(const void *)amx_jit_leave);
+  op_rr(j,0,0xff,4,RAX);        /* jmp rax */
+
+  assert(sizeof errors/sizeof errors[0]==NUM_STUBS-STUB_ERR_STACKERR);
+  for (i=0; i<NUM_STUBS-STUB_ERR_STACKERR; i++) {
+    j->stub[STUB_ERR_STACKERR+i]=j->ip;
+    mov_mi(j,CTX,NOREG,offsetof(JITCTX,error),errors[i]);
+    jmp_to(j,CC_ALWAYS,j->stub[STUB_EXIT_SPILL]);
+  } /* for */
+}
+
+/* number of parameters of an unpacked instruction, for instructions with
+ * a variable number of parameters, the count is in the first parameter
+ */
+static int numparams(int op,const cell *params)
+{
+  switch (op) {
+  case OP_NOP:
+  case OP_LOAD_I:
+  case OP_STOR_I:
+  case OP_XCHG:
+  case OP_PUSH_PRI:
+  case OP_PUSH_ALT:
+  case OP_PUSHR_PRI:
+  case OP_POP_PRI:
+  case OP_POP_ALT:
+  case OP_PROC:
+  case OP_RET:
+  case OP_RETN:
+  case OP_SHL:
+  case OP_SHR:
+  case OP_SSHR:
+  case OP_SMUL:
+  case OP_SDIV:
+  case OP_ADD:
+  case OP_SUB:
+  case OP_AND:
+  case OP_OR:
+  case OP_XOR:
+  case OP_NOT:
+  case OP_NEG:
+  case OP_INVERT:
+  case OP_EQ:
+  case OP_NEQ:
+  case OP_SLESS:
+  case OP_SLEQ:
+  case OP_SGRTR:
+  case OP_SGEQ:
+  case OP_INC_PRI:
+  case OP_INC_ALT:
+  case OP_INC_I:
+  case OP_DEC_PRI:
+  case OP_DEC_ALT:
+  case OP_DEC_I:
+  case OP_SWAP_PRI:
+  case OP_SWAP_ALT:
+  case OP_BREAK:
+  case OP_RETN_OVL:
+  case OP_LIDX:
+  case OP_IDXADDR:
+  case OP_SDIV_INV:
+  case OP_SUB_INV:
+  case OP_ZERO_PRI:
+  case OP_ZERO_ALT:
+    return 0;
+  case OP_SYSREQ_N:
+  case OP_SYSREQ_ND:
+  case OP_LOAD2:
+  case OP_LOAD2_S:
+  case OP_CONST:
+  case OP_CONST_S:
+    return 2;
+  case OP_PUSHM_C:
+  case OP_PUSHM:
+  case OP_PUSHM_S:
+  case OP_PUSHM_ADR:
+  case OP_PUSHRM_C:
+  case OP_PUSHRM_S:
+  case OP_PUSHRM_ADR:
+    return 1+(int)params[0];
+  case OP_CASETBL:
+  case OP_CASETBL_OVL:
+    return 2+2*(int)params[0];
+  default:
+    return 1;
+  } /* switch */
+}
+
+/* amx_jit_compile()
+ * Translates the P-code (of an AMX that was verified with AMX_FLAG_JITC set)
+ * into the block "nativecode", whose size must be at least the size that
+ * VerifyPcode() estimated. The prefix of the file (up to the code section) must
+ * already have been copied into "nativecode". The "jumparray" is scratch
+ * memory for the jump fixups.
+ */
+cell amx_jit_compile(void *pcode,void *jumparray,void *nativecode)
+{
+  AMX_HEADER *hdr=(AMX_HEADER *)pcode;
+  AMX_HEADER *nhdr=(AMX_HEADER *)nativecode;
+  unsigned char *code=(unsigned char *)pcode+(int)hdr->cod;
+  unsigned char *start;
+  cell codesize=hdr->dat-hdr->cod;
+  cell cip,ncip,p,datstart;
+  const cell *args;
+  int op,count,i;
+  JITSTATE j;
+
+  assert_static(offsetof(JITCTX,rsp)==CTX_RSP);
+  assert_static(offsetof(JITCTX,data)==CTX_DATA);
+  assert_static(offsetof(JITCTX,pri)==CTX_PRI);
+  assert_static(offsetof(JITCTX,alt)==CTX_ALT);
+  assert_static(offsetof(JITCTX,stk)==CTX_STK);
+  assert_static(offsetof(JITCTX,frm)==CTX_FRM);
+  assert_static(OP_CASETBL==74);
+  assert_static(OP_LOAD2==120);
+  assert_static(OP_BOUNDS_P==174);
+  assert_static(sizeof packed_base==OP_NUM_OPCODES-OP_LOAD_P_PRI);
+
+  memset(&j,0,sizeof j);
+  j.ip=(unsigned char *)nativecode+(int)hdr->cod;
+  j.fixups=(int32_t *)jumparray;
+  emit_stubs(&j);
+
+  /* the address map (one entry per P-code cell), followed by the size of
+   * the P-code, precedes the native code
+   */
+  j.map=(int32_t *)j.ip;
+  memset(j.map,0xff,(size_t)codesize);
+  j.ip+=codesize;
+  e32(&j,codesize);
+  j.code=j.ip;
+
+  for (cip=0; cip<codesize; cip=ncip) {
+    start=j.ip;
+    j.map[cip/sizeof(cell)]=(int32_t)(j.ip-j.code);
+    op=(int)(*(cell *)(code+(int)cip) & 0xffff);
+    if (op>=OP_NUM_OPCODES)
+      return AMX_ERR_INVINSTR;
+    if (op>=OP_LOAD_P_PRI) {
+      /* packed opcode: the parameter is in the upper half of the cell, any
+       * additional parameters follow the instruction
+       */
+      p=*(cell *)(code+(int)cip) >> (int)(sizeof(cell)*4);
+      args=(const cell *)(code+(int)cip+sizeof(cell));
+      op=packed_base[op-OP_LOAD_P_PRI];
+      count=numparams(op,&p)-1;
+      ncip=cip+(1+count)*sizeof(cell);
+    } else {
+      p=*(cell *)(code+(int)cip+sizeof(cell));
+      args=(const cell *)(code+(int)cip+2*sizeof(cell));
+      count=numparams(op,&p);
+      ncip=cip+(1+count)*sizeof(cell);
+    } /* if */
+    if (ncip>codesize)
+      return AMX_ERR_INVINSTR;
+
+    switch (op) {
+    case OP_NOP:
+      break;
+    case OP_LOAD_PRI:
+      mov_rm(&j,PRI,DAT,NOREG,p);
+      break;
+    case OP_LOAD_ALT:
+      mov_rm(&j,ALT,DAT,NOREG,p);
+      break;
+    case OP_LOAD_S_PRI:
+      mov_rm(&j,PRI,DAT,FRM,p);
+      break;
+    case OP_LOAD_S_ALT:
+      mov_rm(&j,ALT,DAT,FRM,p);
+      break;
+    case OP_LREF_S_PRI:
+      mov_rm(&j,RAX,DAT,FRM,p);
+      mov_rm(&j,PRI,DAT,RAX,0);
+      break;
+    case OP_LREF_S_ALT:
+      mov_rm(&j,RAX,DAT,FRM,p);
+      mov_rm(&j,ALT,DAT,RAX,0);
+      break;
+    case OP_LOAD_I:
+      verify_addr(&j,PRI);
+      mov_rm(&j,PRI,DAT,PRI,0);
+      break;
+    case OP_LODB_I:
+      verify_addr(&j,PRI);
+      if (p==1)
+        op_rm(&j,0,0x0fb6,PRI,DAT,PRI,0);     /* movzx pri, byte [dat+pri] */
+      else if (p==2)
+        op_rm(&j,0,0x0fb7,PRI,DAT,PRI,0);     /* movzx pri, word [dat+pri] */
+      else if (p==4)
+        mov_rm(&j,PRI,DAT,PRI,0);
+      break;
+    case OP_CONST_PRI:
+      mov_ri(&j,PRI,p);
+      break;
+    case OP_CONST_ALT:
+      mov_ri(&j,ALT,p);
+      break;
+    case OP_ADDR_PRI:
+      lea(&j,PRI,FRM,NOREG,p);
+      break;
+    case OP_ADDR_ALT:
+      lea(&j,ALT,FRM,NOREG,p);
+      break;
+    case OP_STOR:
+      mov_mr(&j,DAT,NOREG,p,PRI);
+      break;
+    case OP_STOR_S:
+      mov_mr(&j,DAT,FRM,p,PRI);
+      break;
+    case OP_SREF_S:
+      mov_rm(&j,RAX,DAT,FRM,p);
+      mov_mr(&j,DAT,RAX,0,PRI);
+      break;
+    case OP_STOR_I:
+      verify_addr(&j,ALT);
+      mov_mr(&j,DAT,ALT,0,PRI);
+      break;
+    case OP_STRB_I:
+      verify_addr(&j,ALT);
+      if (p==1) {
+        op_rm(&j,0,0x88,PRI,DAT,ALT,0);       /* mov byte [dat+alt], pri */
+      } else if (p==2) {
+        e8(&j,0x66);
+        op_rm(&j,0,0x89,PRI,DAT,ALT,0);       /* mov word [dat+alt], pri */
+      } else if (p==4) {
+        mov_mr(&j,DAT,ALT,0,PRI);
+      } /* if */
+      break;
+    case OP_ALIGN_PRI:
+      if ((size_t)p<sizeof(cell))
+        alu_ri(&j,0,ALU_XOR,PRI,sizeof(cell)-p);
+      break;
+    case OP_LCTRL:
+      switch ((int)p) {
+      case 0:
+      case 1:
+        op_rm(&j,1,0x8b,RAX,CTX,NOREG,offsetof(JITCTX,amx));
+        op_rm(&j,1,0x8b,RAX,RAX,NOREG,offsetof(AMX,base));
+        mov_rm(&j,PRI,RAX,NOREG,(p==0) ? offsetof(AMX_HEADER,cod) : offsetof(AMX_HEADER,dat));
+        break;
+      case 2:
+        mov_rm(&j,PRI,CTX,NOREG,offsetof(JITCTX,hea));
+        break;
+      case 3:
+        mov_rm(&j,PRI,CTX,NOREG,offsetof(JITCTX,stp));
+        break;
+      case 4:
+        mov_rr(&j,PRI,STK);
+        break;
+      case 5:
+        mov_rr(&j,PRI,FRM);
+        break;
+      case 6:
+        mov_ri(&j,PRI,ncip);
+        break;
+      } /* switch */
+      break;
+    case OP_SCTRL:
+      switch ((int)p) {
+      case 2:
+        mov_mr(&j,CTX,NOREG,offsetof(JITCTX,hea),PRI);
+        break;
+      case 4:
+        mov_rr(&j,STK,PRI);
+        break;
+      case 5:
+        mov_rr(&j,FRM,PRI);
+        break;
+      case 6:
+        call_helper(&j,jit_sctrl_cip,0,0,0);
+        jmp_computed(&j);
+        break;
+      } /* switch */
+      break;
+    case OP_XCHG:
+      mov_rr(&j,RAX,PRI);
+      mov_rr(&j,PRI,ALT);
+      mov_rr(&j,ALT,RAX);
+      break;
+    case OP_PUSH_PRI:
+      push_reg(&j,PRI);
+      break;
+    case OP_PUSH_ALT:
+      push_reg(&j,ALT);
+      break;
+    case OP_PUSHR_PRI:
+      lea(&j,RAX,DAT,PRI,0);
+      push_reg(&j,RAX);
+      break;
+    case OP_POP_PRI:
+      pop_reg(&j,PRI);
+      break;
+    case OP_POP_ALT:
+      pop_reg(&j,ALT);
+      break;
+    case OP_PICK:
+      mov_rm(&j,PRI,DAT,STK,p);
+      break;
+    case OP_STACK:
+      alu_ri(&j,0,ALU_ADD,STK,p);
+      mov_rr(&j,ALT,STK);
+      chk_margin(&j);
+      op_rm(&j,0,0x3b,STK,CTX,NOREG,offsetof(JITCTX,stp));    /* cmp stk, stp */
+      jmp_to(&j,CC_G,j.stub[STUB_ERR_STACKLOW]);
+      break;
+    case OP_HEAP:
+      mov_rm(&j,ALT,CTX,NOREG,offsetof(JITCTX,hea));
+      alu_mi(&j,ALU_ADD,CTX,NOREG,offsetof(JITCTX,hea),p);
+      chk_margin(&j);
+      mov_rm(&j,RAX,CTX,NOREG,offsetof(JITCTX,hea));
+      op_rm(&j,0,0x3b,RAX,CTX,NOREG,offsetof(JITCTX,hlw));    /* cmp hea, hlw */
+      jmp_to(&j,CC_L,j.stub[STUB_ERR_HEAPLOW]);
+      break;
+    case OP_PROC:
+      push_reg(&j,FRM);
+      mov_rr(&j,FRM,STK);
+      chk_margin(&j);
+      break;
+    case OP_RET:
+    case OP_RETN:
+      pop_reg(&j,FRM);
+      pop_reg(&j,RAX);
+      if (op==OP_RETN) {
+        op_rm(&j,0,0x03,STK,DAT,STK,0);       /* add stk, [dat+stk] */
+        alu_ri(&j,0,ALU_ADD,STK,sizeof(cell));
+      } /* if */
+      jmp_return(&j);
+      break;
+    case OP_CALL:
+      chk_fuel(&j,cip);
+      push_imm(&j,ncip);
+      jmp_pcode(&j,CC_ALWAYS,cip+p);
+      break;
+    case OP_JUMP:
+      if (p<=0)
+        chk_fuel(&j,cip);
+      jmp_pcode(&j,CC_ALWAYS,cip+p);
+      break;
+    case OP_JZER:
+    case OP_JNZ:
+      op_rr(&j,0,0x85,PRI,PRI);               /* test pri, pri */
+      jmp_cond(&j,(op==OP_JZER) ? CC_E : CC_NE,cip,p);
+      break;
+    case OP_JEQ:
+    case OP_JNEQ:
+    case OP_JSLESS:
+    case OP_JSLEQ:
+    case OP_JSGRTR:
+    case OP_JSGEQ: {
+      static const unsigned char cc[] = { CC_E, CC_NE, CC_L, CC_LE, CC_G, CC_GE };
+      op_rr(&j,0,0x39,ALT,PRI);               /* cmp pri, alt */
+      jmp_cond(&j,cc[op-OP_JEQ],cip,p);
+      break;
+    } /* case */
+    case OP_SHL:
+    case OP_SHR:
+    case OP_SSHR:
+      mov_rr(&j,RCX,ALT);
+      op_rr(&j,0,0xd3,(op==OP_SHL) ? SHIFT_SHL : (op==OP_SHR) ? SHIFT_SHR : SHIFT_SAR,PRI);
+      break;
+    case OP_SHL_C_PRI:
+      op_rr(&j,0,0xc1,SHIFT_SHL,PRI);
+      e8(&j,p);
+      break;
+    case OP_SHL_C_ALT:
+      op_rr(&j,0,0xc1,SHIFT_SHL,ALT);
+      e8(&j,p);
+      break;
+    case OP_SMUL:
+      op_rr(&j,0,0x0faf,PRI,ALT);             /* imul pri, alt */
+      break;
+    case OP_SDIV:
+      sdiv(&j,ALT,PRI);
+      break;
+    case OP_SDIV_INV:
+      sdiv(&j,PRI,ALT);
+      break;
+    case OP_ADD:
+      op_rr(&j,0,0x01,ALT,PRI);
+      break;
+    case OP_SUB:
+      op_rr(&j,0,0xf7,3,PRI);                 /* neg pri */
+      op_rr(&j,0,0x01,ALT,PRI);               /* add pri, alt */
+      break;
+    case OP_SUB_INV:
+      op_rr(&j,0,0x29,ALT,PRI);
+      break;
+    case OP_AND:
+      op_rr(&j,0,0x21,ALT,PRI);
+      break;
+    case OP_OR:
+      op_rr(&j,0,0x09,ALT,PRI);
+      break;
+    case OP_XOR:
+      op_rr(&j,0,0x31,ALT,PRI);
+      break;
+    case OP_NOT:
+      op_rr(&j,0,0x85,PRI,PRI);
+      setcc(&j,CC_E,PRI);
+      break;
+    case OP_NEG:
+      op_rr(&j,0,0xf7,3,PRI);
+      break;
+    case OP_INVERT:
+      op_rr(&j,0,0xf7,2,PRI);
+      break;
+    case OP_EQ:
+    case OP_NEQ:
+    case OP_SLESS:
+    case OP_SLEQ:
+    case OP_SGRTR:
+    case OP_SGEQ: {
+      static const unsigned char cc[] = { CC_E, CC_NE, CC_L, CC_LE, CC_G, CC_GE };
+      op_rr(&j,0,0x39,ALT,PRI);               /* cmp pri, alt */
+      setcc(&j,cc[op-OP_EQ],PRI);
+      break;
+    } /* case */
+    case OP_INC_PRI:
+      alu_ri(&j,0,ALU_ADD,PRI,1);
+      break;
+    case OP_INC_ALT:
+      alu_ri(&j,0,ALU_ADD,ALT,1);
+      break;
+    case OP_INC_I:
+      alu_mi(&j,ALU_ADD,DAT,PRI,0,1);
+      break;
+    case OP_DEC_PRI:
+      alu_ri(&j,0,ALU_SUB,PRI,1);
+      break;
+    case OP_DEC_ALT:
+      alu_ri(&j,0,ALU_SUB,ALT,1);
+      break;
+    case OP_DEC_I:
+      alu_mi(&j,ALU_SUB,DAT,PRI,0,1);
+      break;
+    case OP_MOVS:
+      call_helper(&j,jit_movs,p,0,0);
+      break;
+    case OP_CMPS:
+      call_helper(&j,jit_cmps,p,0,0);
+      break;
+    case OP_FILL:
+      call_helper(&j,jit_fill,p,0,0);
+      break;
+    case OP_HALT:
+      call_helper(&j,jit_halt,p,ncip,0);
+      break;
+    case OP_BOUNDS: {
+      unsigned char *skip;
+      alu_ri(&j,0,ALU_CMP,PRI,p);
+      skip=jmp_short(&j,CC_BE);
+      mov_mi(&j,CTX,NOREG,offsetof(JITCTX,cip),ncip);
+      jmp_to(&j,CC_ALWAYS,j.stub[STUB_ERR_BOUNDS]);
+      patch_short(&j,skip);
+      break;
+    } /* case */
+    case OP_SYSREQ:
+      call_helper(&j,jit_sysreq,p,ncip,0);
+      break;
+    case OP_SYSREQ_N:
+      call_helper(&j,jit_sysreq_n,p,args[0],ncip);
+      break;
+    case OP_SYSREQ_D:
+      call_helper(&j,jit_sysreq_d,p,-1,ncip);
+      break;
+    case OP_SYSREQ_ND:
+      call_helper(&j,jit_sysreq_d,p,args[0],ncip);
+      break;
+    case OP_SWITCH:
+      call_helper(&j,jit_switch,cip+p,0,0);
+      jmp_computed(&j);
+      break;
+    case OP_SWAP_PRI:
+    case OP_SWAP_ALT: {
+      int reg=(op==OP_SWAP_PRI) ? PRI : ALT;
+      mov_rm(&j,RAX,DAT,STK,0);
+      mov_mr(&j,DAT,STK,0,reg);
+      mov_rr(&j,reg,RAX);
+      break;
+    } /* case */
+    case OP_BREAK: {
+      unsigned char *skip;
+      op_rm(&j,1,0x8b,RAX,CTX,NOREG,offsetof(JITCTX,amx));
+      op_rm(&j,1,0x83,ALU_CMP,RAX,NOREG,offsetof(AMX,debug));  /* cmp qword [rax+debug], 0 */
+      e8(&j,0);
+      skip=jmp_short(&j,CC_E);
+      call_helper(&j,jit_break,ncip,0,0);
+      patch_short(&j,skip);
+      break;
+    } /* case */
+    case OP_CASETBL:
+      /* copy the table behind a guard (in case the code would run into
+       * it); convert the relative jump addresses to absolute P-code
+       * addresses
+       */
+      jmp_to(&j,CC_ALWAYS,j.stub[STUB_ERR_INVINSTR]);
+      while (j.ip-start<JIT_CASEGUARD)
+        e8(&j,0xcc);
+      e32(&j,p);
+      for (i=0; i<=(int)p; i++) {
+        cell offs=cip+2*sizeof(cell)+2*i*sizeof(cell);
+        if (i>0)
+          e32(&j,*(cell *)(code+(int)offs-sizeof(cell)));
+        e32(&j,*(cell *)(code+(int)offs)+offs-sizeof(cell));
+      } /* for */
+      break;
+    case OP_LIDX:
+      lea(&j,RAX,ALT,SCALE4(PRI),0);
+      verify_addr(&j,RAX);
+      mov_rm(&j,PRI,DAT,RAX,0);
+      break;
+    case OP_LIDX_B:
+      mov_rr(&j,RAX,PRI);
+      op_rr(&j,0,0xc1,SHIFT_SHL,RAX);
+      e8(&j,p);
+      op_rr(&j,0,0x01,ALT,RAX);
+      verify_addr(&j,RAX);
+      mov_rm(&j,PRI,DAT,RAX,0);
+      break;
+    case OP_IDXADDR:
+      lea(&j,PRI,ALT,SCALE4(PRI),0);
+      break;
+    case OP_IDXADDR_B:
+      op_rr(&j,0,0xc1,SHIFT_SHL,PRI);
+      e8(&j,p);
+      op_rr(&j,0,0x01,ALT,PRI);
+      break;
+    case OP_PUSH_C:
+      push_imm(&j,p);
+      break;
+    case OP_PUSH:
+      mov_rm(&j,RAX,DAT,NOREG,p);
+      push_reg(&j,RAX);
+      break;
+    case OP_PUSH_S:
+      mov_rm(&j,RAX,DAT,FRM,p);
+      push_reg(&j,RAX);
+      break;
+    case OP_PUSH_ADR:
+      lea(&j,RAX,FRM,NOREG,p);
+      push_reg(&j,RAX);
+      break;
+    case OP_PUSHR_C:
+      lea(&j,RAX,DAT,NOREG,p);
+      push_reg(&j,RAX);
+      break;
+    case OP_PUSHR_S:
+      mov_rm(&j,RAX,DAT,FRM,p);
+      lea(&j,RAX,DAT,RAX,0);
+      push_reg(&j,RAX);
+      break;
+    case OP_PUSHR_ADR:
+      lea(&j,RAX,DAT,FRM,p);
+      push_reg(&j,RAX);
+      break;
+    case OP_ADD_C:
+      alu_ri(&j,0,ALU_ADD,PRI,p);
+      break;
+    case OP_SMUL_C:
+      op_rr(&j,0,0x69,PRI,PRI);               /* imul pri, pri, imm32 */
+      e32(&j,p);
+      break;
+    case OP_ZERO_PRI:
+      op_rr(&j,0,0x31,PRI,PRI);
+      break;
+    case OP_ZERO_ALT:
+      op_rr(&j,0,0x31,ALT,ALT);
+      break;
+    case OP_ZERO:
+      mov_mi(&j,DAT,NOREG,p,0);
+      break;
+    case OP_ZERO_S:
+      mov_mi(&j,DAT,FRM,p,0);
+      break;
+    case OP_EQ_C_PRI:
+    case OP_EQ_C_ALT:
+      alu_ri(&j,0,ALU_CMP,(op==OP_EQ_C_PRI) ? PRI : ALT,p);
+      setcc(&j,CC_E,PRI);
+      break;
+    case OP_INC:
+      alu_mi(&j,ALU_ADD,DAT,NOREG,p,1);
+      break;
+    case OP_INC_S:
+      alu_mi(&j,ALU_ADD,DAT,FRM,p,1);
+      break;
+    case OP_DEC:
+      alu_mi(&j,ALU_SUB,DAT,NOREG,p,1);
+      break;
+    case OP_DEC_S:
+      alu_mi(&j,ALU_SUB,DAT,FRM,p,1);
+      break;
+    case OP_PUSHM_C:
+    case OP_PUSHM:
+    case OP_PUSHM_S:
+    case OP_PUSHM_ADR:
+    case OP_PUSHRM_C:
+    case OP_PUSHRM_S:
+    case OP_PUSHRM_ADR:
+      /* adjust STK once, then store the values (the first parameter ends
+       * up at the highest address)
+       */
+      alu_ri(&j,0,ALU_SUB,STK,p*sizeof(cell));
+      for (i=0; i<(int)p; i++) {
+        cell dest=(p-1-i)*sizeof(cell);
+        switch (op) {
+        case OP_PUSHM_C:
+          mov_mi(&j,DAT,STK,dest,args[i]);
+          continue;
+        case OP_PUSHM:
+          mov_rm(&j,RAX,DAT,NOREG,args[i]);
+          break;
+        case OP_PUSHM_S:
+          mov_rm(&j,RAX,DAT,FRM,args[i]);
+          break;
+        case OP_PUSHM_ADR:
+          lea(&j,RAX,FRM,NOREG,args[i]);
+          break;
+        case OP_PUSHRM_C:
+          lea(&j,RAX,DAT,NOREG,args[i]);
+          break;
+        case OP_PUSHRM_S:
+          mov_rm(&j,RAX,DAT,FRM,args[i]);
+          lea(&j,RAX,DAT,RAX,0);
+          break;
+        case OP_PUSHRM_ADR:
+          lea(&j,RAX,DAT,FRM,args[i]);
+          break;
+        } /* switch */
+        mov_mr(&j,DAT,STK,dest,RAX);
+      } /* for */
+      break;
+    case OP_LOAD2:
+      mov_rm(&j,PRI,DAT,NOREG,p);
+      mov_rm(&j,ALT,DAT,NOREG,args[0]);
+      break;
+    case OP_LOAD2_S:
+      mov_rm(&j,PRI,DAT,FRM,p);
+      mov_rm(&j,ALT,DAT,FRM,args[0]);
+      break;
+    case OP_CONST:
+      mov_mi(&j,DAT,NOREG,p,args[0]);
+      break;
+    case OP_CONST_S:
+      mov_mi(&j,DAT,FRM,p,args[0]);
+      break;
+    default:
+      /* overlay instructions are not supported (and they should have been
+       * rejected in VerifyPcode() already)
+       */
+      return AMX_ERR_OVERLAY;
+    } /* switch */
+    assert(j.ip-start<=(ncip-cip)/(cell)sizeof(cell)*JIT_CELLBOUND);
+  } /* for */
+
+  /* resolve the jumps */
+  for (i=0; i<j.numfixups; i++) {
+    int32_t pos=j.fixups[2*i];
+    cell target=j.fixups[2*i+1];
+    int32_t rel;
+    if ((ucell)target>=(ucell)codesize || (target & (sizeof(cell)-1))!=0 || j.map[target/sizeof(cell)]<0)
+      return AMX_ERR_INIT_JIT;
+    rel=j.map[target/sizeof(cell)]-(pos+4);
+    memcpy(j.code+pos,&rel,sizeof rel);
+  } /* for */
+
+  /* copy the data section (aligned) behind the code and adjust the header */
+  datstart=(cell)(j.ip-(unsigned char *)nativecode);
+  datstart=(datstart+15) & ~15;
+  memcpy((unsigned char *)nativecode+(int)datstart,(unsigned char *)pcode+(int)hdr->dat,(size_t)(hdr->hea-hdr->dat));
+  nhdr->cod=(int32_t)(j.code-(unsigned char *)nativecode);
+  nhdr->dat=datstart;
+  nhdr->hea=datstart+(hdr->hea-hdr->dat);
+  nhdr->stp=datstart+(hdr->stp-hdr->dat);
+  nhdr->size=nhdr->hea;
+  /* the sentinel at the top of the stack */
+  *(cell *)((unsigned char *)nativecode+(int)nhdr->stp-sizeof(cell))=0;
+  return AMX_ERR_NONE;
+}
+
+/* amx_jit_run()
+ * Runs the compiled code, starting at the P-code address in amx->cip (a
+ * function entry point, or the resume point after a "sleep").
+ */
+cell amx_jit_run(AMX *amx,cell *retval,unsigned char *data)
+{
+  AMX_HEADER *hdr=(AMX_HEADER *)amx->base;
+  unsigned char *code=amx->base+(int)hdr->cod;
+  JITCTX ctx;
+
+  /* the code pointer is recalculated from the header, because the host
+   * may have moved the image after compilation
+   */
+  amx->code=code;
+  memset(&ctx,0,sizeof ctx);
+  ctx.codesize=*(cell *)(code-sizeof(cell));
+  ctx.map=(int32_t *)(code-sizeof(cell)-ctx.codesize);
+  ctx.code=code;
+  ctx.data=data;
+  ctx.amx=amx;
+  ctx.retval=retval;
+  ctx.pri=amx->pri;
+  ctx.alt=amx->alt;
+  ctx.frm=amx->frm;
+  ctx.stk=amx->stk;
+  ctx.hea=amx->hea;
+  ctx.stp=amx->stp;
+  ctx.hlw=amx->hlw;
+  ctx.margin=STKMARGIN+amx->stkreserve;
+  if (jit_jumpto(&ctx,amx->cip)!=0)
+    return ctx.error;
+  amx_jit_enter(&ctx,ctx.jump);
+  if (ctx.error==AMX_ERR_BOUNDS)
+    amx->cip=ctx.cip;
+  return ctx.error;
+}
+
+/* amx_jit_list()
+ * There is no opcode relocation for the JIT (opcodelist is set to NULL); the
+ * return value is an upper bound for the native code size per P-code cell,
+ * including the address map.
+ */
+int amx_jit_list(const AMX *amx,const cell **opcodelist,int *numopcodes)
+{
+  (void)amx;
+  assert(opcodelist!=NULL);
+  *opcodelist=NULL;
+  assert(numopcodes!=NULL);
+  *numopcodes=OP_NUM_OPCODES;
+  return JIT_CELLBOUND+sizeof(cell);
+}
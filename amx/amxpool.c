@@ -45,28 +45,38 @@ typedef struct tagARENA {
   unsigned short lru;
 } ARENA;
 
-static void *pool_base;
-static unsigned pool_size;
-static unsigned short pool_lru;
+/* the pool state is stored at the start of the pool itself, so that several
+ * pools (for example, one per thread) can be used at the same time
+ */
+typedef struct tagPOOL {
+  unsigned size;    /* size of the pool, excluding this header */
+  unsigned short lru;
+  unsigned short reserved;
+} POOL;
 
-static void touchblock(ARENA *hdr);
-static ARENA *findblock(int index);
+#define POOL_BASE(pool) ((char*)(pool)+sizeof(POOL))
 
-/* amx_poolinit() initializes the memory pool for the allocated blocks.
- * If parameter pool is NULL, the existing pool is cleared (without changing
- * its position or size).
+static void touchblock(POOL *pool, ARENA *hdr);
+static ARENA *findblock(POOL *pool, int index);
+
+/* amx_poolinit() initializes the memory pool for the allocated blocks; a part
+ * of the memory is used for the pool administration. The return value is the
+ * pool handle, which must be passed to the other functions.
+ * If parameter size is 0, the existing pool is cleared (without changing its
+ * position or size).
  */
-void amx_poolinit(void *pool, unsigned size)
+void *amx_poolinit(void *pool, unsigned size)
 {
-  assert(pool!=NULL || pool_base!=NULL);
-  if (pool!=NULL) {
-    assert(size>sizeof(ARENA));
-    /* save parameters in global variables, then "free" the entire pool */
-    pool_base=pool;
-    pool_size=size;
+  POOL *p=(POOL*)pool;
+
+  assert(p!=NULL);
+  if (size>0) {
+    assert(size>sizeof(POOL)+sizeof(ARENA));
+    p->size=size-sizeof(POOL);
   } /* if */
-  pool_lru=0;
-  amx_poolfree(NULL);
+  p->lru=0;
+  amx_poolfree(p,NULL);
+  return p;
 }
 
 /* amx_poolfree() releases a block allocated earlier. The parameter must have
@@ -76,40 +86,41 @@ void amx_poolinit(void *pool, unsigned size)
  * When parameter "block" is NULL, the pool is re-initialized (meaning that
  * all blocks are freed).
  */
-void amx_poolfree(void *block)
+void amx_poolfree(void *pool, void *block)
 {
+  POOL *p=(POOL*)pool;
   ARENA *hdr,*hdr2;
   unsigned sz;
 
-  assert(pool_base!=NULL);
-  assert(pool_size>sizeof(ARENA));
+  assert(p!=NULL);
+  assert(p->size>sizeof(ARENA));
 
   /* special case: if "block" is NULL, create a single free space */
   if (block==NULL) {
     /* store an arena header at the start of the pool */
-    hdr=(ARENA*)pool_base;
-    hdr->blocksize=pool_size-sizeof(ARENA);
+    hdr=(ARENA*)POOL_BASE(p);
+    hdr->blocksize=p->size-sizeof(ARENA);
     hdr->index=-1;
     hdr->lru=0;
   } else {
     hdr=(ARENA*)((char*)block-sizeof(ARENA));
-    assert((char*)hdr>=(char*)pool_base && (char*)hdr<(char*)pool_base+pool_size);
-    assert(hdr->blocksize<pool_size);
+    assert((char*)hdr>=POOL_BASE(p) && (char*)hdr<POOL_BASE(p)+p->size);
+    assert(hdr->blocksize<p->size);
 
     /* free this block */
     hdr->index=-1;
 
     /* try to coalesce with the next block */
     hdr2=(ARENA*)((char*)hdr+hdr->blocksize+sizeof(ARENA));
-    if (hdr2->index==-1)
+    if ((char*)hdr2<POOL_BASE(p)+p->size && hdr2->index==-1)
       hdr->blocksize+=hdr2->blocksize+sizeof(ARENA);
 
     /* try to coalesce with the previous block */
-    if ((void*)hdr!=pool_base) {
-      sz=pool_size;
-      hdr2=(ARENA*)pool_base;
+    if ((char*)hdr!=POOL_BASE(p)) {
+      sz=p->size;
+      hdr2=(ARENA*)POOL_BASE(p);
       while (sz>0 && (char*)hdr2+hdr2->blocksize+sizeof(ARENA)!=(char*)hdr) {
-        assert(sz<=pool_size);
+        assert(sz<=p->size);
         sz-=hdr2->blocksize+sizeof(ARENA);
         hdr2=(ARENA*)((char*)hdr2+hdr2->blocksize+sizeof(ARENA));
       } /* while */
@@ -136,20 +147,22 @@ void amx_poolfree(void *block)
  * every iteration (without considering the size of the block or whether that
  * block is adjacent to a free block).
  */
-void *amx_poolalloc(unsigned size,int index)
+void *amx_poolalloc(void *pool, unsigned size, int index)
 {
+  POOL *p=(POOL*)pool;
   ARENA *hdr,*hdrlru;
   unsigned sz;
   unsigned short minlru;
 
+  assert(p!=NULL);
   assert(size>0);
   assert(index>=0 && index<=SHRT_MAX);
-  assert(findblock(index)==NULL);
+  assert(findblock(p,index)==NULL);
 
   /* align the size to a cell boundary */
   if ((size % sizeof(cell))!=0)
     size+=sizeof(cell)-(size % sizeof(cell));
-  if (size+sizeof(ARENA)>pool_size)
+  if (size+sizeof(ARENA)>p->size)
     return NULL;  /* requested block does not fit in the pool */
 
   /* find a block large enough to get the size plus an arena header; at
@@ -158,13 +171,13 @@ void *amx_poolalloc(unsigned size,int index)
    * the block with the lowest LRU count and tries again
    */
   do {
-    sz=pool_size;
-    hdr=(ARENA*)pool_base;
+    sz=p->size;
+    hdr=(ARENA*)POOL_BASE(p);
     hdrlru=hdr;
     minlru=USHRT_MAX;
     while (sz>0) {
-      assert(sz<=pool_size);
-      assert((char*)hdr>=(char*)pool_base && (char*)hdr<(char*)pool_base+pool_size);
+      assert(sz<=p->size);
+      assert((char*)hdr>=POOL_BASE(p) && (char*)hdr<POOL_BASE(p)+p->size);
       if (hdr->index==-1 && hdr->blocksize>=size)
         break;
       if (hdr->index!=-1 && hdr->lru<minlru) {
@@ -174,11 +187,11 @@ void *amx_poolalloc(unsigned size,int index)
       sz-=hdr->blocksize+sizeof(ARENA);
       hdr=(ARENA*)((char*)hdr+hdr->blocksize+sizeof(ARENA));
     } /* while */
-    assert(sz<=pool_size);
+    assert(sz<=p->size);
     if (sz==0) {
       /* free up memory and try again */
       assert(hdrlru->index!=-1);
-      amx_poolfree((char*)hdrlru+sizeof(ARENA));
+      amx_poolfree(p,(char*)hdrlru+sizeof(ARENA));
     } /* if */
   } while (sz==0);
 
@@ -194,7 +207,7 @@ void *amx_poolalloc(unsigned size,int index)
   } /* if */
   hdr->blocksize=size;
   hdr->index=(short)index;
-  touchblock(hdr);    /* set LRU field */
+  touchblock(p,hdr);  /* set LRU field */
 
   return (void*)((char*)hdr+sizeof(ARENA));
 }
@@ -204,65 +217,67 @@ void *amx_poolalloc(unsigned size,int index)
  * -1 represents a free block (actually, only positive values are valid).
  * When amx_poolfind() finds the block, it increments its LRU count.
  */
-void *amx_poolfind(int index)
+void *amx_poolfind(void *pool, int index)
 {
-  ARENA *hdr=findblock(index);
+  ARENA *hdr=findblock((POOL*)pool,index);
   if (hdr==NULL)
     return NULL;
-  touchblock(hdr);
+  touchblock((POOL*)pool,hdr);
   return (void*)((char*)hdr+sizeof(ARENA));
 }
 
-int amx_poolprotect(int index)
+int amx_poolprotect(void *pool, int index)
 {
-  ARENA *hdr=findblock(index);
+  ARENA *hdr=findblock((POOL*)pool,index);
   if (hdr==NULL)
     return AMX_ERR_GENERAL;
   hdr->lru=PROTECT_LRU;
   return AMX_ERR_NONE;
 }
 
-static ARENA *findblock(int index)
+static ARENA *findblock(POOL *pool, int index)
 {
   ARENA *hdr;
   unsigned sz;
 
+  assert(pool!=NULL);
   assert(index>=0);
-  sz=pool_size;
-  hdr=(ARENA*)pool_base;
+  sz=pool->size;
+  hdr=(ARENA*)POOL_BASE(pool);
   while (sz>0 && hdr->index!=index) {
-    assert(sz<=pool_size);
-    assert((char*)hdr>=(char*)pool_base && (char*)hdr<(char*)pool_base+pool_size);
+    assert(sz<=pool->size);
+    assert((char*)hdr>=POOL_BASE(pool) && (char*)hdr<POOL_BASE(pool)+pool->size);
     sz-=hdr->blocksize+sizeof(ARENA);
     hdr=(ARENA*)((char*)hdr+hdr->blocksize+sizeof(ARENA));
   } /* while */
-  assert(sz<=pool_size);
+  assert(sz<=pool->size);
   return (sz>0 && hdr->index==index) ? hdr : NULL;
 }
 
-static void touchblock(ARENA *hdr)
+static void touchblock(POOL *pool, ARENA *hdr)
 {
+  assert(pool!=NULL);
   assert(hdr!=NULL);
-  if (++pool_lru >= PROTECT_LRU)
-    pool_lru=0;
-  hdr->lru=pool_lru;
+  if (++pool->lru >= PROTECT_LRU)
+    pool->lru=0;
+  hdr->lru=pool->lru;
 
   /* special case: if the overlay LRU count wrapped back to zero, set the
    * LRU count of all blocks to zero, but set the count of the block just
    * touched to 1 (skip blocks marked as protected, too)
    */
-  if (pool_lru==0) {
+  if (pool->lru==0) {
     ARENA *hdr2;
-    unsigned sz=pool_size;
-    hdr2=(ARENA*)pool_base;
+    unsigned sz=pool->size;
+    hdr2=(ARENA*)POOL_BASE(pool);
     while (sz>0) {
-      assert(sz<=pool_size);
+      assert(sz<=pool->size);
       if (hdr2->lru!=PROTECT_LRU)
         hdr2->lru=0;
       sz-=hdr2->blocksize+sizeof(ARENA);
       hdr2=(ARENA*)((char*)hdr2+hdr2->blocksize+sizeof(ARENA));
     } /* while */
     assert(sz==0);
-    hdr->lru=++pool_lru;
+    hdr->lru=++pool->lru;
   } /* if */
 }
@@ -20,11 +20,11 @@
 #ifndef AMXPOOL_H_INCLUDED
 #define AMXPOOL_H_INCLUDED
 
-void  amx_poolinit(void *pool, unsigned size);
-void *amx_poolalloc(unsigned size, int index);
-void  amx_poolfree(void *block);
-void *amx_poolfind(int index);
-int   amx_poolprotect(int index);
+void *amx_poolinit(void *pool, unsigned size);
+void *amx_poolalloc(void *pool, unsigned size, int index);
+void  amx_poolfree(void *pool, void *block);
+void *amx_poolfind(void *pool, int index);
+int   amx_poolprotect(void *pool, int index);
 
 
 #endif /* AMXPOOL_H_INCLUDED */
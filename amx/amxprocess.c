@@ -81,10 +81,6 @@
 #endif
 
 
-#if defined HAVE_DYNCALL_H || defined WIN32_FFI
-
-#define MAXPARAMS 32    /* maximum number of parameters to a called function */
-
 typedef struct tagMODlIST {
   struct tagMODlIST _FAR *next;
   TCHAR _FAR *name;
@@ -92,6 +88,36 @@ typedef struct tagMODlIST {
   AMX *amx;
 } MODLIST;
 
+/* the loaded libraries and the pipes are kept per abstract machine */
+typedef struct tagPROCDATA {
+  AMX_MODULEDATA header;
+  MODLIST ModRoot;
+  #if defined HAVE_DYNCALL_H
+    DCCallVM *dcVM;       /* VM handle for dyncall */
+  #endif
+  /* pipes for I/O redirection */
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    HANDLE newstdin,newstdout,read_stdout,write_stdin;
+  #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
+    int pipe_to[2];
+    int pipe_from[2];
+  #endif
+} PROCDATA;
+#define PROCDATA_TAG  AMX_USERTAG('P','r','o','c')
+
+static PROCDATA *getprocdata(AMX *amx)
+{
+  PROCDATA *data;
+  if (amx_GetModuleData(amx, PROCDATA_TAG, (AMX_MODULEDATA**)&data) != AMX_ERR_NONE)
+    return NULL;
+  return data;
+}
+
+
+#if defined HAVE_DYNCALL_H || defined WIN32_FFI
+
+#define MAXPARAMS 32    /* maximum number of parameters to a called function */
+
 typedef struct tagPARAM {
   union {
     void *ptr;
@@ -104,11 +130,6 @@ typedef struct tagPARAM {
 
 #define BYREF 0x80  /* stored in the "type" field fo the PARAM structure */
 
-static MODLIST ModRoot = { NULL };
-#if defined HAVE_DYNCALL_H
-  static DCCallVM *dcVM=NULL;       /* VM handle for dyncall */
-#endif
-
 
 static const TCHAR *skippath(const TCHAR *name)
 {
@@ -207,13 +228,6 @@ static int freelib(MODLIST *root, AMX *amx, const TCHAR *name)
       count++;
     } /* if */
   } /* for */
-  #if defined HAVE_DYNCALL_H
-    if (root->next==NULL && dcVM!=NULL) {
-      /* free the VM after closing the last DLL/library */
-      dcFree(dcVM);
-      dcVM=NULL;
-    } /* if */
-  #endif
   return count;
 }
 
@@ -403,12 +417,18 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
   int paramidx, typeidx, idx;
   PARAM ps[MAXPARAMS];
   cell *cptr,result;
+  AMX_STRVIEW view;
   LIBFUNC LibFunc;
+  PROCDATA *data;
 
+  if ((data = getprocdata(amx)) == NULL) {
+    amx_RaiseError(amx, AMX_ERR_NATIVE);
+    return 0;
+  } /* if */
   amx_StrParam(amx, params[1], libname);
-  item = findlib(&ModRoot, amx, libname);
+  item = findlib(&data->ModRoot, amx, libname);
   if (item == NULL)
-    item = addlib(&ModRoot, amx, libname);
+    item = addlib(&data->ModRoot, amx, libname);
   if (item == NULL) {
     amx_RaiseError(amx, AMX_ERR_NATIVE);
     return 0;
@@ -424,11 +444,11 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
 
   #if defined HAVE_DYNCALL_H
     /* (re-)initialize the dyncall library */
-    if (dcVM==NULL) {
-      dcVM=dcNewCallVM(4096);
-      dcMode(dcVM,DC_CALL_C_X86_WIN32_STD);
+    if (data->dcVM==NULL) {
+      data->dcVM=dcNewCallVM(4096);
+      dcMode(data->dcVM,DC_CALL_C_X86_WIN32_STD);
     } /* if */
-    dcReset(dcVM);
+    dcReset(data->dcVM);
   #endif
 
   /* decode the parameters */
@@ -491,11 +511,9 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
     case 's':
     case 'p' | BYREF:
     case 's' | BYREF:
+      amx_StrView(cptr,&view);
       if (ps[paramidx].type=='s' || ps[paramidx].type=='p') {
-        int len;
-        /* get length of input string */
-        amx_StrLen(cptr,&len);
-        len++;            /* include '\0' */
+        int len=view.length+1;  /* include '\0' */
         /* check max. size */
         if (len<ps[paramidx].range)
           len=ps[paramidx].range;
@@ -504,7 +522,7 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
       ps[paramidx].v.ptr=malloc(ps[paramidx].range*sizeof(TCHAR));
       if (ps[paramidx].v.ptr==NULL)
         return amx_RaiseError(amx, AMX_ERR_NATIVE);
-      amx_GetString((char *)ps[paramidx].v.ptr,cptr,sizeof(TCHAR)>1,UNLIMITED);
+      amx_StrViewGet((char *)ps[paramidx].v.ptr,&view,sizeof(TCHAR)>1,ps[paramidx].range);
       break;
     default:
       /* invalid parameter type */
@@ -520,19 +538,19 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
       if ((ps[idx].type=='i' || ps[idx].type=='u' || ps[idx].type=='f') && ps[idx].range==1) {
         switch (ps[idx].size) {
         case 8:
-          dcArgChar(dcVM,(unsigned char)(ps[idx].v.val & 0xff));
+          dcArgChar(data->dcVM,(unsigned char)(ps[idx].v.val & 0xff));
           break;
         case 16:
-          dcArgShort(dcVM,(unsigned short)(ps[idx].v.val & 0xffff));
+          dcArgShort(data->dcVM,(unsigned short)(ps[idx].v.val & 0xffff));
           break;
         default:
-          dcArgLong(dcVM,ps[idx].v.val);
+          dcArgLong(data->dcVM,ps[idx].v.val);
         } /* switch */
       } else {
-        dcArgPointer(dcVM,ps[idx].v.ptr);
+        dcArgPointer(data->dcVM,ps[idx].v.ptr);
       } /* if */
     } /* for */
-    result=(cell)dcCallPointer(dcVM,(void*)LibFunc);
+    result=(cell)dcCallPointer(data->dcVM,(void*)LibFunc);
   #else /* HAVE_DYNCALL_H */
     /* push the parameters to the stack (left-to-right in 16-bit; right-to-left
      * in 32-bit)
@@ -629,8 +647,12 @@ static cell AMX_NATIVE_CALL n_libcall(AMX *amx, const cell *params)
 static cell AMX_NATIVE_CALL n_libfree(AMX *amx, const cell *params)
 {
   const TCHAR *libname;
+  PROCDATA *data;
+
+  if ((data = getprocdata(amx)) == NULL)
+    return 0;
   amx_StrParam(amx,params[1],libname);
-  return freelib(&ModRoot,amx,libname) > 0;
+  return freelib(&data->ModRoot,amx,libname) > 0;
 }
 
 #else /* HAVE_DYNCALL_H || WIN32_FFI */
@@ -650,49 +672,41 @@ static cell AMX_NATIVE_CALL n_libfree(AMX *amx, const cell *params)
 
 #endif /* HAVE_DYNCALL_H || WIN32_FFI */
 
-/* pipes for I/O redirection */
-#if defined __WIN32__ || defined _WIN32 || defined WIN32
-  static HANDLE newstdin,newstdout,read_stdout,write_stdin;
-#elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-  static int pipe_to[2]={-1,-1};
-  static int pipe_from[2]={-1,-1};
-#endif
-
-static void closepipe(void)
+static void closepipe(PROCDATA *data)
 {
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
-    if (newstdin!=NULL) {
-      CloseHandle(newstdin);
-      newstdin=NULL;
+    if (data->newstdin!=NULL) {
+      CloseHandle(data->newstdin);
+      data->newstdin=NULL;
     } /* if */
-    if (newstdout!=NULL) {
-      CloseHandle(newstdout);
-      newstdout=NULL;
+    if (data->newstdout!=NULL) {
+      CloseHandle(data->newstdout);
+      data->newstdout=NULL;
     } /* if */
-    if (read_stdout!=NULL) {
-      CloseHandle(read_stdout);
-      read_stdout=NULL;
+    if (data->read_stdout!=NULL) {
+      CloseHandle(data->read_stdout);
+      data->read_stdout=NULL;
     } /* if */
-    if (write_stdin!=NULL) {
-      CloseHandle(write_stdin);
-      write_stdin=NULL;
+    if (data->write_stdin!=NULL) {
+      CloseHandle(data->write_stdin);
+      data->write_stdin=NULL;
     } /* if */
   #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-    if (pipe_to[0]>=0) {
-      close(pipe_to[0]);
-      pipe_to[0]=-1;
+    if (data->pipe_to[0]>=0) {
+      close(data->pipe_to[0]);
+      data->pipe_to[0]=-1;
     } /* if */
-    if (pipe_to[1]>=0) {
-      close(pipe_to[1]);
-      pipe_to[1]=-1;
+    if (data->pipe_to[1]>=0) {
+      close(data->pipe_to[1]);
+      data->pipe_to[1]=-1;
     } /* if */
-    if (pipe_from[0]>=0) {
-      close(pipe_from[0]);
-      pipe_from[0]=-1;
+    if (data->pipe_from[0]>=0) {
+      close(data->pipe_from[0]);
+      data->pipe_from[0]=-1;
     } /* if */
-    if (pipe_from[1]>=0) {
-      close(pipe_from[1]);
-      pipe_from[1]=-1;
+    if (data->pipe_from[1]>=0) {
+      close(data->pipe_from[1]);
+      data->pipe_from[1]=-1;
     } /* if */
   #endif
 }
@@ -716,14 +730,19 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
   #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
   	pid_t pid;
   #endif
+  PROCDATA *data;
 
+  if ((data=getprocdata(amx))==NULL) {
+    amx_RaiseError(amx, AMX_ERR_NATIVE);
+    return 0;
+  } /* if */
   amx_StrParam(amx,params[1],pgmname);
 
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
     /* most of this code comes from a "Borland Network" article, combined
      * with some knowledge gained from a CodeProject article
      */
-    closepipe();
+    closepipe(data);
 
     VerInfo.dwOSVersionInfoSize=sizeof(OSVERSIONINFO);
     GetVersionEx(&VerInfo);
@@ -739,12 +758,12 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
     sa.nLength = sizeof(SECURITY_ATTRIBUTES);
     sa.bInheritHandle = TRUE;         //allow inheritable handles
 
-    if (!CreatePipe(&newstdin,&write_stdin,&sa,0)) { //create stdin pipe
+    if (!CreatePipe(&data->newstdin,&data->write_stdin,&sa,0)) { //create stdin pipe
       amx_RaiseError(amx, AMX_ERR_NATIVE);
       return 0;
     } /* if */
-    if (!CreatePipe(&read_stdout,&newstdout,&sa,0)) { //create stdout pipe
-      closepipe();
+    if (!CreatePipe(&data->read_stdout,&data->newstdout,&sa,0)) { //create stdout pipe
+      closepipe(data);
       amx_RaiseError(amx, AMX_ERR_NATIVE);
       return 0;
     } /* if */
@@ -752,13 +771,13 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
     GetStartupInfo(&si);      //set startupinfo for the spawned process
     si.dwFlags = STARTF_USESTDHANDLES|STARTF_USESHOWWINDOW;
     si.wShowWindow = SW_SHOWNORMAL;
-    si.hStdOutput = newstdout;
-    si.hStdError = newstdout;     //set the new handles for the child process
-    si.hStdInput = newstdin;
+    si.hStdOutput = data->newstdout;
+    si.hStdError = data->newstdout;     //set the new handles for the child process
+    si.hStdInput = data->newstdin;
 
     /* spawn the child process */
     if (!CreateProcess(NULL,(TCHAR*)pgmname,NULL,NULL,TRUE,CREATE_NEW_CONSOLE,NULL,NULL,&si,&pi)) {
-      closepipe();
+      closepipe(data);
       return 0;
     } /* if */
     CloseHandle(pi.hThread);
@@ -772,16 +791,16 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
     return (cell)hinst;
   #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
     /* set up communication pipes first */
-    closepipe();
-    if (pipe(pipe_to)!=0 || pipe(pipe_from)!=0) {
-      closepipe();
+    closepipe(data);
+    if (pipe(data->pipe_to)!=0 || pipe(data->pipe_from)!=0) {
+      closepipe(data);
       amx_RaiseError(amx, AMX_ERR_NATIVE);
       return 0;
     } /* if */
 
     /* attempt to fork */
     if ((pid=fork())<0) {
-      closepipe();
+      closepipe(data);
       amx_RaiseError(amx, AMX_ERR_NATIVE);
       return 0;
     } /* if */
@@ -791,16 +810,16 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
       #define MAX_ARGS  10
       TCHAR *args[MAX_ARGS];
       int i;
-      dup2(pipe_to[0],STDIN_FILENO);    /* replace stdin with the in side of the pipe */
-      dup2(pipe_from[1],STDOUT_FILENO); /* replace stdout with the out side of the pipe */
-      close(pipe_to[0]);                /* the pipes are no longer needed */
-      close(pipe_to[1]);
-      close(pipe_from[0]);
-      close(pipe_from[1]);
-      pipe_to[0]=-1;
-      pipe_to[1]=-1;
-      pipe_from[0]=-1;
-      pipe_from[1]=-1;
+      dup2(data->pipe_to[0],STDIN_FILENO);    /* replace stdin with the in side of the pipe */
+      dup2(data->pipe_from[1],STDOUT_FILENO); /* replace stdout with the out side of the pipe */
+      close(data->pipe_to[0]);                /* the pipes are no longer needed */
+      close(data->pipe_to[1]);
+      close(data->pipe_from[0]);
+      close(data->pipe_from[1]);
+      data->pipe_to[0]=-1;
+      data->pipe_to[1]=-1;
+      data->pipe_from[0]=-1;
+      data->pipe_from[1]=-1;
       /* split off the option(s) */
       assert(MAX_ARGS>=2);              /* args[0] is reserved */
       memset(args,0,MAX_ARGS*sizeof(TCHAR*));
@@ -815,10 +834,10 @@ static cell AMX_NATIVE_CALL n_procexec(AMX *amx, const cell *params)
       if(execvp(pgmname,args)<0)
         return 0;
     } else {
-      close(pipe_to[0]);                /* close unused pipes */
-      close(pipe_from[1]);
-      pipe_to[0]=-1;
-      pipe_from[1]=-1;
+      close(data->pipe_to[0]);                /* close unused pipes */
+      close(data->pipe_from[1]);
+      data->pipe_to[0]=-1;
+      data->pipe_from[1]=-1;
     } /* if */
     return pid;
   #else
@@ -832,20 +851,23 @@ static cell AMX_NATIVE_CALL n_procwrite(AMX *amx, const cell *params)
 {
   const TCHAR *line;
   unsigned long num;
+  PROCDATA *data;
 
+  if ((data=getprocdata(amx))==NULL)
+    return 0;
   amx_StrParam(amx,params[1],line);
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
-    if (write_stdin==NULL)
+    if (data->write_stdin==NULL)
       return 0;
-    WriteFile(write_stdin,line,(DWORD)_tcslen(line),&num,NULL); //send it to stdin
+    WriteFile(data->write_stdin,line,(DWORD)_tcslen(line),&num,NULL); //send it to stdin
     if (params[2])
-      WriteFile(write_stdin,__T("\n"),1,&num,NULL);
+      WriteFile(data->write_stdin,__T("\n"),1,&num,NULL);
   #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-    if (pipe_to[1]<0)
+    if (data->pipe_to[1]<0)
       return 0;
-    write(pipe_to[1],line,_tcslen(line));
+    write(data->pipe_to[1],line,_tcslen(line));
     if (params[2])
-      write(pipe_to[1],__T("\n"),1);
+      write(data->pipe_to[1],__T("\n"),1);
   #endif
   return 1;
 }
@@ -858,21 +880,24 @@ static cell AMX_NATIVE_CALL n_procread(AMX *amx, const cell *params)
   cell *cptr;
   unsigned long num;
   int index;
+  PROCDATA *data;
 
+  if ((data=getprocdata(amx))==NULL)
+    return 0;
   index=0;
   #if defined __WIN32__ || defined _WIN32 || defined WIN32
-    if (read_stdout==NULL)
+    if (data->read_stdout==NULL)
       return 0;
     do {
-      if (!ReadFile(read_stdout,line+index,1,&num,NULL))
+      if (!ReadFile(data->read_stdout,line+index,1,&num,NULL))
         break;
       index++;
     } while (index<sizeof(line)/sizeof(line[0])-1 && line[index-1]!=__T('\n'));
   #elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
-    if (pipe_from[0]<0)
+    if (data->pipe_from[0]<0)
       return 0;
     do {
-      if (read(pipe_from[0],line+index,1)<0)
+      if (read(data->pipe_from[0],line+index,1)<0)
         break;
       index++;
     } while (index<sizeof(line)/sizeof(line[0])-1 && line[index-1]!=__T('\n'));
@@ -928,14 +953,40 @@ AMX_NATIVE_INFO process_Natives[] = {
 
 int AMXEXPORT AMXAPI amx_ProcessInit(AMX *amx)
 {
+  PROCDATA *data;
+
+  if ((data=getprocdata(amx))==NULL) {
+    if ((data=(PROCDATA*)malloc(sizeof(PROCDATA)))==NULL)
+      return AMX_ERR_MEMORY;
+    memset(data, 0, sizeof(PROCDATA));
+    #if !(defined __WIN32__ || defined _WIN32 || defined WIN32) \
+        && (defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__)
+      data->pipe_to[0]=data->pipe_to[1]=-1;
+      data->pipe_from[0]=data->pipe_from[1]=-1;
+    #endif
+    if (amx_SetModuleData(amx, PROCDATA_TAG, &data->header)!=AMX_ERR_NONE) {
+      free(data);
+      return AMX_ERR_USERDATA;
+    } /* if */
+  } /* if */
   return amx_Register(amx, process_Natives, -1);
 }
 
 int AMXEXPORT AMXAPI amx_ProcessCleanup(AMX *amx)
 {
+  PROCDATA *data;
+
+  if ((data=getprocdata(amx))==NULL)
+    return AMX_ERR_NONE;
+  amx_SetModuleData(amx, PROCDATA_TAG, NULL);
   #if defined HAVE_DYNCALL_H || defined WIN32_FFI
-    freelib(&ModRoot, amx, NULL);
+    freelib(&data->ModRoot, amx, NULL);
+  #endif
+  #if defined HAVE_DYNCALL_H
+    if (data->dcVM!=NULL)
+      dcFree(data->dcVM);
   #endif
-  closepipe();
+  closepipe(data);
+  free(data);
   return AMX_ERR_NONE;
 }
@@ -0,0 +1,344 @@
+/*  Sampling profiler for the Pawn Abstract Machine
+ *
+ *  The sampler installs itself as the fuel hook of an abstract machine. The
+ *  hook reads the clock; when a sampling period has passed, it walks the chain
+ *  of stack frames from the current instruction outward and adds the call
+ *  stack to a hash table (the frames are mapped to the start addresses of the
+ *  functions first, so that each function occurs once per stack level). It
+ *  then sets a new instruction budget, scaled such that the clock is checked
+ *  a few times per period; between two checks, the abstract machine runs at
+ *  full speed.
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "osdefs.h"
+#include "amxsampler.h"
+
+#if defined __WIN32__ || defined _WIN32 || defined WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+
+#define SAMPLER_TAG     AMX_USERTAG('S','m','p','l')
+#define MAXDEPTH        128     /* deeper stacks are cut off at the outer end */
+#define CHECKS          4       /* clock checks per sampling period */
+#define MINBUDGET       16L
+#define MAXBUDGET       (1L << 30)
+
+typedef struct tagFUNCRANGE {
+  ucell start, end;
+} FUNCRANGE;
+
+typedef struct tagSTACKENTRY {
+  uint32_t hash;
+  int depth;            /* 0 for a free entry */
+  long count;           /* number of samples */
+  size_t frames;        /* index of the innermost frame in the pool */
+} STACKENTRY;
+
+struct tagAMX_SAMPLER {
+  AMX *amx;
+  AMX_DBG *amxdbg;      /* may be NULL */
+  FUNCRANGE *funcs;     /* sorted on the start address */
+  int numfuncs;
+  STACKENTRY *table;    /* hash table of the distinct call stacks */
+  unsigned size;        /* number of entries in the table (a power of 2) */
+  unsigned count;       /* number of entries in use */
+  ucell *pool;          /* frames of all call stacks, innermost first */
+  size_t poolsize;
+  size_t poolused;
+  int64_t period;       /* sampling period, in nanoseconds */
+  int64_t lastsample;
+  int64_t lastcheck;
+  long budget;          /* instruction budget between two clock checks */
+  long samples;
+};
+
+static int64_t gettime_ns(void)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    if (freq.QuadPart==0)
+      QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (int64_t)(count.QuadPart / freq.QuadPart) * 1000000000
+           + (int64_t)(count.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+  #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+  #endif
+}
+
+static int cmpfunc(const void *a, const void *b)
+{
+  ucell sa=((const FUNCRANGE*)a)->start;
+  ucell sb=((const FUNCRANGE*)b)->start;
+  return (sa<sb) ? -1 : (sa>sb) ? 1 : 0;
+}
+
+/* funcstart() returns the start address of the function that "address" is in,
+ * or "address" itself if it is not in any known function
+ */
+static ucell funcstart(const AMX_SAMPLER *sampler, ucell address)
+{
+  int low=0, high=sampler->numfuncs-1, mid;
+
+  while (low<=high) {
+    mid=(low+high)/2;
+    if (sampler->funcs[mid].start>address)
+      high=mid-1;
+    else if (sampler->funcs[mid].end<=address)
+      low=mid+1;
+    else
+      return sampler->funcs[mid].start;
+  } /* while */
+  return address;
+}
+
+static int growtable(AMX_SAMPLER *sampler)
+{
+  unsigned newsize=2*sampler->size;
+  STACKENTRY *table=(STACKENTRY*)calloc(newsize, sizeof(STACKENTRY));
+  unsigned i, j;
+
+  if (table==NULL)
+    return 0;
+  for (i=0; i<sampler->size; i++) {
+    if (sampler->table[i].depth==0)
+      continue;
+    for (j=sampler->table[i].hash & (newsize-1); table[j].depth!=0; j=(j+1) & (newsize-1))
+      /* nothing */;
+    table[j]=sampler->table[i];
+  } /* for */
+  free(sampler->table);
+  sampler->table=table;
+  sampler->size=newsize;
+  return 1;
+}
+
+/* addstack() counts a sample of the call stack in "frames" */
+static void addstack(AMX_SAMPLER *sampler, const ucell *frames, int depth)
+{
+  STACKENTRY *entry;
+  uint32_t hash=2166136261u;    /* FNV-1a */
+  unsigned i;
+  int d;
+
+  for (d=0; d<depth; d++)
+    hash=(hash ^ (uint32_t)frames[d]) * 16777619u;
+  for (i=hash & (sampler->size-1); (entry=&sampler->table[i])->depth!=0; i=(i+1) & (sampler->size-1)) {
+    if (entry->hash==hash && entry->depth==depth
+        && memcmp(sampler->pool+entry->frames, frames, depth*sizeof(ucell))==0)
+    {
+      entry->count++;
+      return;
+    } /* if */
+  } /* for */
+
+  /* a new call stack, the entry is free */
+  if (sampler->poolused+depth>sampler->poolsize) {
+    size_t newsize=2*sampler->poolsize+depth;
+    ucell *pool=(ucell*)realloc(sampler->pool, newsize*sizeof(ucell));
+    if (pool==NULL)
+      return;                   /* drop the sample */
+    sampler->pool=pool;
+    sampler->poolsize=newsize;
+  } /* if */
+  memcpy(sampler->pool+sampler->poolused, frames, depth*sizeof(ucell));
+  entry->hash=hash;
+  entry->depth=depth;
+  entry->count=1;
+  entry->frames=sampler->poolused;
+  sampler->poolused+=depth;
+  if (++sampler->count>sampler->size*3/4)
+    growtable(sampler);         /* on failure, the table just fills up more */
+}
+
+/* takesample() walks the stack frames, starting at the instruction and the
+ * frame that the fuel hook got; every frame holds the frame pointer of the
+ * caller and the return address, and the outermost frame has a return
+ * address of zero (see amx_Exec())
+ */
+static void takesample(AMX_SAMPLER *sampler)
+{
+  AMX *amx=sampler->amx;
+  AMX_HEADER *hdr=(AMX_HEADER*)amx->base;
+  unsigned char *data=(amx->data!=NULL) ? amx->data : amx->base+(int)hdr->dat;
+  ucell frames[MAXDEPTH];
+  cell frm, ret;
+  int depth=0;
+
+  frames[depth++]=funcstart(sampler, (ucell)amx->cip);
+  for (frm=amx->frm; depth<MAXDEPTH; frm=*(cell*)(data+(int)frm)) {
+    if (frm<amx->hlw || frm>amx->stp-2*(cell)sizeof(cell) || (frm % sizeof(cell))!=0)
+      break;                    /* not a valid frame */
+    ret=*(cell*)(data+(int)frm+sizeof(cell));
+    if (ret<=0)
+      break;
+    frames[depth++]=funcstart(sampler, (ucell)ret-sizeof(cell)); /* address of the CALL */
+  } /* for */
+  addstack(sampler, frames, depth);
+  sampler->samples++;
+}
+
+static int AMXAPI samplehook(AMX *amx)
+{
+  AMX_SAMPLER *sampler;
+  int64_t now, interval;
+
+  if (amx_GetUserData(amx, SAMPLER_TAG, (void**)&sampler)!=AMX_ERR_NONE || sampler==NULL)
+    return AMX_ERR_NONE;
+  now=gettime_ns();
+  if (now-sampler->lastsample>=sampler->period) {
+    takesample(sampler);
+    sampler->lastsample=now;
+  } /* if */
+
+  /* scale the budget towards CHECKS clock checks per period, but by no more
+   * than a factor of 4 at a time (the interval also includes any time that
+   * the abstract machine did not run)
+   */
+  interval=now-sampler->lastcheck;
+  sampler->lastcheck=now;
+  if (interval*CHECKS*4<sampler->period)
+    sampler->budget*=4;
+  else if (interval*CHECKS>sampler->period*4)
+    sampler->budget/=4;
+  else if (interval>0)
+    sampler->budget=(long)(sampler->budget*(sampler->period/CHECKS)/interval);
+  if (sampler->budget<MINBUDGET)
+    sampler->budget=MINBUDGET;
+  else if (sampler->budget>MAXBUDGET)
+    sampler->budget=MAXBUDGET;
+  amx_SetFuel(amx, sampler->budget, AMX_FUEL_HOOK);
+  return AMX_ERR_NONE;
+}
+
+/* amx_SamplerCreate() starts sampling the abstract machine, at "frequency"
+ * samples per second; the debug information in "amxdbg" is optional, but if
+ * it is given, it must stay valid until the sampler is deleted.
+ */
+AMX_SAMPLER * AMXAPI amx_SamplerCreate(AMX *amx, AMX_DBG *amxdbg, int frequency)
+{
+  AMX_SAMPLER *sampler;
+  int i;
+
+  if (amx==NULL || frequency<=0)
+    return NULL;
+  if ((sampler=(AMX_SAMPLER*)calloc(1, sizeof(AMX_SAMPLER)))==NULL)
+    return NULL;
+  sampler->amx=amx;
+  sampler->amxdbg=amxdbg;
+  sampler->size=256;
+  sampler->poolsize=1024;
+  sampler->table=(STACKENTRY*)calloc(sampler->size, sizeof(STACKENTRY));
+  sampler->pool=(ucell*)malloc(sampler->poolsize*sizeof(ucell));
+  if (amxdbg!=NULL && amxdbg->hdr->symbols>0)
+    sampler->funcs=(FUNCRANGE*)malloc(amxdbg->hdr->symbols*sizeof(FUNCRANGE));
+  if (sampler->table==NULL || sampler->pool==NULL
+      || (amxdbg!=NULL && amxdbg->hdr->symbols>0 && sampler->funcs==NULL)
+      || amx_SetUserData(amx, SAMPLER_TAG, sampler)!=AMX_ERR_NONE)
+  {
+    free(sampler->funcs);
+    free(sampler->pool);
+    free(sampler->table);
+    free(sampler);
+    return NULL;
+  } /* if */
+
+  /* collect the address ranges of the functions */
+  if (sampler->funcs!=NULL) {
+    for (i=0; i<amxdbg->hdr->symbols; i++) {
+      const AMX_DBG_SYMBOL *sym=amxdbg->symboltbl[i];
+      if (sym->ident==iFUNCTN && sym->codestart<sym->codeend) {
+        sampler->funcs[sampler->numfuncs].start=sym->codestart;
+        sampler->funcs[sampler->numfuncs].end=sym->codeend;
+        sampler->numfuncs++;
+      } /* if */
+    } /* for */
+    qsort(sampler->funcs, sampler->numfuncs, sizeof(FUNCRANGE), cmpfunc);
+  } /* if */
+
+  sampler->period=1000000000/frequency;
+  sampler->budget=1000;
+  sampler->lastsample=sampler->lastcheck=gettime_ns();
+  amx_SetFuelHook(amx, samplehook);
+  amx_SetFuel(amx, sampler->budget, AMX_FUEL_HOOK);
+  return sampler;
+}
+
+/* amx_SamplerDelete() stops sampling and frees the sampler; the abstract
+ * machine has no instruction budget afterwards
+ */
+int AMXAPI amx_SamplerDelete(AMX_SAMPLER *sampler)
+{
+  if (sampler==NULL)
+    return AMX_ERR_PARAMS;
+  amx_SetFuel(sampler->amx, 0, AMX_FUEL_NONE);
+  amx_SetFuelHook(sampler->amx, NULL);
+  amx_SetUserData(sampler->amx, SAMPLER_TAG, NULL);
+  free(sampler->funcs);
+  free(sampler->pool);
+  free(sampler->table);
+  free(sampler);
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI amx_SamplerCount(AMX_SAMPLER *sampler, long *samples, long *stacks)
+{
+  if (sampler==NULL)
+    return AMX_ERR_PARAMS;
+  if (samples!=NULL)
+    *samples=sampler->samples;
+  if (stacks!=NULL)
+    *stacks=(long)sampler->count;
+  return AMX_ERR_NONE;
+}
+
+/* amx_SamplerWrite() writes the samples in the "folded stacks" format */
+int AMXAPI amx_SamplerWrite(AMX_SAMPLER *sampler, FILE *fp)
+{
+  const STACKENTRY *entry;
+  const char *name;
+  unsigned i;
+  int d;
+
+  if (sampler==NULL || fp==NULL)
+    return AMX_ERR_PARAMS;
+  for (i=0; i<sampler->size; i++) {
+    entry=&sampler->table[i];
+    if (entry->depth==0)
+      continue;
+    for (d=entry->depth-1; d>=0; d--) {
+      ucell address=sampler->pool[entry->frames+d];
+      if (sampler->amxdbg!=NULL && dbg_LookupFunction(sampler->amxdbg, address, &name)==AMX_ERR_NONE)
+        fprintf(fp, "%s", name);
+      else
+        fprintf(fp, "0x%lx", (unsigned long)address);
+      fputc((d>0) ? ';' : ' ', fp);
+    } /* for */
+    fprintf(fp, "%ld\n", entry->count);
+  } /* for */
+  return ferror(fp) ? AMX_ERR_GENERAL : AMX_ERR_NONE;
+}
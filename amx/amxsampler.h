@@ -0,0 +1,61 @@
+/*  Sampling profiler for the Pawn Abstract Machine
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef AMXSAMPLER_H_INCLUDED
+#define AMXSAMPLER_H_INCLUDED
+
+#include <stdio.h>
+#include "amx.h"
+#include "amxdbg.h"
+
+#ifdef  __cplusplus
+extern  "C" {
+#endif
+
+/* The sampler records the call stack of an abstract machine at a regular
+ * interval while it runs, and writes the samples as "folded stacks": one line
+ * per distinct call stack, with the names of the functions from the outermost
+ * to the innermost, separated by semicolons, followed by the number of
+ * samples. This is the input format of flamegraph.pl and similar tools.
+ *
+ * The sampler runs from the fuel hook of the abstract machine (AMX_FUEL_HOOK,
+ * see amx_SetFuelHook()), so it works with the cores that keep the instruction
+ * budget (the ANSI C core, the GNU GCC core and the x86-64 JIT), and the
+ * abstract machine cannot have an instruction budget of its own while it is
+ * sampled. The clock is checked on function calls and backward jumps, after
+ * a budget that the sampler adjusts to the frequency; time that is spent in
+ * a native function is attributed to the function that called it.
+ *
+ * With debug information (see dbg_LoadInfo()), the stacks hold function
+ * names; without it, they hold code addresses. The sampler stores a pointer
+ * to its state in the user data of the abstract machine (tag "Smpl").
+ * Overlays are not supported.
+ */
+
+typedef struct tagAMX_SAMPLER AMX_SAMPLER;
+
+AMX_SAMPLER * AMXAPI amx_SamplerCreate(AMX *amx, AMX_DBG *amxdbg, int frequency);
+int AMXAPI amx_SamplerDelete(AMX_SAMPLER *sampler);
+int AMXAPI amx_SamplerCount(AMX_SAMPLER *sampler, long *samples, long *stacks);
+int AMXAPI amx_SamplerWrite(AMX_SAMPLER *sampler, FILE *fp);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* AMXSAMPLER_H_INCLUDED */
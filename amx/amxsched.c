@@ -0,0 +1,948 @@
+/*  Multi-threaded scheduler for the Pawn Abstract Machine
+ *
+ *  The scheduler runs abstract machines on a pool of worker threads, one per
+ *  processor core by default. Every worker has its own run queue; it takes
+ *  tasks from the head of its queue and appends tasks that yield (sleep with
+ *  a zero delay) to the tail, so that all runnable tasks get their turn. A
+ *  worker whose queue is empty steals half of the queue of another worker.
+ *  Tasks that sleep for a period, or that wait for amx_SchedWake(), are kept
+ *  in a timer heap that is shared by all workers; the workers move the tasks
+ *  whose time-out expired into their own queue.
+ *
+ *  Locking: each run queue has its own lock, and so has each task; the lock
+ *  of the scheduler protects the timer heap, the list of all tasks and the
+ *  counters. When both a task lock and the scheduler lock are needed, the
+ *  task lock is taken first. Running a task (the hot path) only takes the
+ *  lock of the worker's own queue and that of the task.
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "osdefs.h"
+#include "amxsched.h"
+
+#if defined __WIN32__ || defined _WIN32 || defined WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+  #include <process.h>
+  typedef SRWLOCK MUTEX;
+  typedef CONDITION_VARIABLE CONDVAR;
+  typedef HANDLE THREAD;
+  #define mutex_init(m)         InitializeSRWLock(m)
+  #define mutex_delete(m)       (void)(m)
+  #define mutex_lock(m)         AcquireSRWLockExclusive(m)
+  #define mutex_unlock(m)       ReleaseSRWLockExclusive(m)
+  #define cond_init(c)          InitializeConditionVariable(c)
+  #define cond_delete(c)        (void)(c)
+  #define cond_signal(c)        WakeConditionVariable(c)
+  #define cond_broadcast(c)     WakeAllConditionVariable(c)
+  #define atomic_get(p)         InterlockedCompareExchange((p),0,0)
+  #define atomic_set(p,v)       InterlockedExchange((p),(v))
+  #define THREADFUNC            unsigned __stdcall
+#else
+  #include <pthread.h>
+  #include <time.h>
+  #include <unistd.h>
+  typedef pthread_mutex_t MUTEX;
+  typedef pthread_cond_t CONDVAR;
+  typedef pthread_t THREAD;
+  #define mutex_init(m)         pthread_mutex_init((m),NULL)
+  #define mutex_delete(m)       pthread_mutex_destroy(m)
+  #define mutex_lock(m)         pthread_mutex_lock(m)
+  #define mutex_unlock(m)       pthread_mutex_unlock(m)
+  #define cond_init(c)          pthread_cond_init((c),NULL)
+  #define cond_delete(c)        pthread_cond_destroy(c)
+  #define cond_signal(c)        pthread_cond_signal(c)
+  #define cond_broadcast(c)     pthread_cond_broadcast(c)
+  #define atomic_get(p)         __atomic_load_n((p),__ATOMIC_ACQUIRE)
+  #define atomic_set(p,v)       __atomic_store_n((p),(v),__ATOMIC_RELEASE)
+  #define THREADFUNC            void *
+#endif
+
+#define NEVER           INT64_MAX
+#define STEAL_MAX       32      /* maximum number of tasks moved in one steal */
+#define TIMER_CHECK     64      /* check the timers at least every so many dispatches */
+#define TIMER_BATCH     32      /* maximum number of expired timers moved at once */
+
+typedef struct tagRUNQUEUE {
+  MUTEX lock;
+  AMX_TASK **items;     /* circular buffer */
+  int head;             /* index of the first task */
+  int count;            /* number of tasks in the queue */
+  int size;             /* size of the buffer (in tasks) */
+} RUNQUEUE;
+
+typedef struct tagWORKER {
+  AMX_SCHED *sched;
+  THREAD thread;
+  RUNQUEUE queue;
+  unsigned long seed;   /* for picking a victim to steal from */
+  unsigned long ticks;  /* number of dispatches */
+} WORKER;
+
+struct tagAMX_TASK {
+  struct tagAMX_TASK *next, *prev;  /* list of all tasks (scheduler lock) */
+  MUTEX lock;
+  AMX *amx;
+  void *userdata;
+  AMX_IDLE idlefunc;
+  int index;            /* function to start, AMX_EXEC_CONT once started */
+  int state;
+  int error;
+  cell retval;
+  long runs;
+  int64_t cputime;      /* in microseconds */
+  int64_t deadline;     /* time at which a sleeping task must continue */
+  int64_t lastpoll;     /* time of the last call to the idle function */
+  int64_t timer;        /* time at which the task must be checked (heap key) */
+  int heapidx;          /* position in the timer heap, -1 if not in the heap */
+  unsigned char queued; /* task is in a run queue (or taken from the heap) */
+  unsigned char wakeup; /* amx_SchedWake() was called */
+  unsigned char cancel; /* amx_SchedRemove() was called */
+  unsigned char finished; /* done callback has returned */
+  unsigned char release;  /* free the task when it is finished */
+};
+
+struct tagAMX_SCHED {
+  MUTEX lock;
+  CONDVAR workcond;     /* signalled when work is available for idle workers */
+  CONDVAR donecond;     /* signalled when the last active task is done */
+  WORKER *workers;
+  int numworkers;
+  int pollinterval;     /* in milliseconds */
+  long slice;           /* instruction budget per time slice, 0 = no preemption */
+  AMX_TASKDONE done;
+  AMX_TASK *tasks;      /* list of all tasks */
+  AMX_TASK **heap;      /* timer heap (a binary min-heap on AMX_TASK.timer) */
+  int heapcount;
+  int heapsize;
+  long active;          /* number of tasks that are not done */
+  unsigned long next;   /* for distributing new tasks over the workers */
+  /* the fields below are read without the lock (as hints), so they are
+   * accessed with atomic_get() and atomic_set(); they are only changed with
+   * the lock held
+   */
+  long idle;            /* number of workers waiting for work */
+  long stop;
+};
+
+static int64_t gettime_ms(void)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    return (int64_t)GetTickCount64();
+  #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+  #endif
+}
+
+static int64_t getcputime_us(void)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+      return 0;
+    return ((((int64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime)
+            + (((int64_t)user.dwHighDateTime << 32) | user.dwLowDateTime)) / 10;
+  #else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+  #endif
+}
+
+static void cond_wait(CONDVAR *cond, MUTEX *mutex, int64_t timeout)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    SleepConditionVariableSRW(cond, mutex, (timeout==NEVER) ? INFINITE : (DWORD)timeout, 0);
+  #else
+    if (timeout==NEVER) {
+      pthread_cond_wait(cond, mutex);
+    } else {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += (time_t)(timeout / 1000);
+      ts.tv_nsec += (long)(timeout % 1000) * 1000000L;
+      if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+      } /* if */
+      pthread_cond_timedwait(cond, mutex, &ts);
+    } /* if */
+  #endif
+}
+
+static int getcpucount(void)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+  #elif defined _SC_NPROCESSORS_ONLN
+    long count=sysconf(_SC_NPROCESSORS_ONLN);
+    return (count>0) ? (int)count : 1;
+  #else
+    return 1;
+  #endif
+}
+
+/* ----- run queues ----- */
+
+static int rq_push(RUNQUEUE *rq, AMX_TASK *task)
+{
+  mutex_lock(&rq->lock);
+  if (rq->count==rq->size) {
+    int newsize=(rq->size>0) ? 2*rq->size : 64;
+    AMX_TASK **items=(AMX_TASK**)malloc(newsize*sizeof(AMX_TASK*));
+    int i;
+    if (items==NULL) {
+      mutex_unlock(&rq->lock);
+      return 0;
+    } /* if */
+    for (i=0; i<rq->count; i++)
+      items[i]=rq->items[(rq->head+i) % rq->size];
+    free(rq->items);
+    rq->items=items;
+    rq->head=0;
+    rq->size=newsize;
+  } /* if */
+  rq->items[(rq->head+rq->count) % rq->size]=task;
+  rq->count++;
+  mutex_unlock(&rq->lock);
+  return 1;
+}
+
+static AMX_TASK *rq_pop(RUNQUEUE *rq)
+{
+  AMX_TASK *task=NULL;
+
+  mutex_lock(&rq->lock);
+  if (rq->count>0) {
+    task=rq->items[rq->head];
+    rq->head=(rq->head+1) % rq->size;
+    rq->count--;
+  } /* if */
+  mutex_unlock(&rq->lock);
+  return task;
+}
+
+/* rq_steal() removes up to half of the tasks from the tail of the queue */
+static int rq_steal(RUNQUEUE *rq, AMX_TASK **list, int max)
+{
+  int count, i;
+
+  mutex_lock(&rq->lock);
+  count=(rq->count+1)/2;
+  if (count>max)
+    count=max;
+  for (i=count; i>0; i--) {
+    rq->count--;
+    list[i-1]=rq->items[(rq->head+rq->count) % rq->size];
+  } /* for */
+  mutex_unlock(&rq->lock);
+  return count;
+}
+
+static int rq_count(RUNQUEUE *rq)
+{
+  int count;
+
+  mutex_lock(&rq->lock);
+  count=rq->count;
+  mutex_unlock(&rq->lock);
+  return count;
+}
+
+/* ----- timer heap (scheduler lock must be held) ----- */
+
+static void heap_swap(AMX_SCHED *sched, int a, int b)
+{
+  AMX_TASK *t=sched->heap[a];
+  sched->heap[a]=sched->heap[b];
+  sched->heap[b]=t;
+  sched->heap[a]->heapidx=a;
+  sched->heap[b]->heapidx=b;
+}
+
+static void heap_up(AMX_SCHED *sched, int i)
+{
+  while (i>0 && sched->heap[(i-1)/2]->timer > sched->heap[i]->timer) {
+    heap_swap(sched, i, (i-1)/2);
+    i=(i-1)/2;
+  } /* while */
+}
+
+static void heap_down(AMX_SCHED *sched, int i)
+{
+  for ( ;; ) {
+    int c=2*i+1;
+    if (c>=sched->heapcount)
+      break;
+    if (c+1<sched->heapcount && sched->heap[c+1]->timer < sched->heap[c]->timer)
+      c++;
+    if (sched->heap[i]->timer <= sched->heap[c]->timer)
+      break;
+    heap_swap(sched, i, c);
+    i=c;
+  } /* for */
+}
+
+static int heap_insert(AMX_SCHED *sched, AMX_TASK *task)
+{
+  if (sched->heapcount==sched->heapsize) {
+    int newsize=(sched->heapsize>0) ? 2*sched->heapsize : 256;
+    AMX_TASK **heap=(AMX_TASK**)realloc(sched->heap, newsize*sizeof(AMX_TASK*));
+    if (heap==NULL)
+      return 0;
+    sched->heap=heap;
+    sched->heapsize=newsize;
+  } /* if */
+  task->heapidx=sched->heapcount++;
+  sched->heap[task->heapidx]=task;
+  heap_up(sched, task->heapidx);
+  return 1;
+}
+
+static void heap_remove(AMX_SCHED *sched, AMX_TASK *task)
+{
+  int i=task->heapidx;
+
+  assert(i>=0 && i<sched->heapcount && sched->heap[i]==task);
+  task->heapidx=-1;
+  if (i!=--sched->heapcount) {
+    sched->heap[i]=sched->heap[sched->heapcount];
+    sched->heap[i]->heapidx=i;
+    heap_up(sched, i);
+    heap_down(sched, sched->heap[i]->heapidx);
+  } /* if */
+}
+
+/* ----- scheduling ----- */
+
+static void pushtask(RUNQUEUE *rq, AMX_TASK *task)
+{
+  while (!rq_push(rq, task)) {
+    /* out of memory, retry later (the run queues rarely grow) */
+    #if defined __WIN32__ || defined _WIN32 || defined WIN32
+      Sleep(1);
+    #else
+      usleep(1000);
+    #endif
+  } /* while */
+}
+
+/* enqueue() adds a task to a run queue and wakes up an idle worker, if any;
+ * the task lock must be held; "local" is true if the queue is that of the
+ * calling worker: then the worker runs the task itself if no other worker
+ * picks it up, and the count of idle workers is only read as a hint (avoiding
+ * the scheduler lock on the path of tasks that yield)
+ */
+static void enqueue(AMX_SCHED *sched, RUNQUEUE *rq, AMX_TASK *task, int local)
+{
+  task->queued=1;
+  pushtask(rq, task);
+  if (!local || atomic_get(&sched->idle)>0) {
+    mutex_lock(&sched->lock);
+    if (sched->idle>0)
+      cond_signal(&sched->workcond);
+    mutex_unlock(&sched->lock);
+  } /* if */
+}
+
+static RUNQUEUE *pickqueue(AMX_SCHED *sched)
+{
+  unsigned long n;
+
+  mutex_lock(&sched->lock);
+  n=sched->next++;
+  mutex_unlock(&sched->lock);
+  return &sched->workers[n % sched->numworkers].queue;
+}
+
+/* finish() sets the task as done and invokes the callback; the task lock is
+ * held on entry and it is released on exit
+ */
+static void finish(AMX_SCHED *sched, AMX_TASK *task, int error, cell retval)
+{
+  AMX_TASKINFO info;
+
+  task->state=AMX_TASK_DONE;
+  task->error=error;
+  task->retval=retval;
+  info.amx=task->amx;
+  info.userdata=task->userdata;
+  info.state=task->state;
+  info.error=task->error;
+  info.retval=task->retval;
+  info.runs=task->runs;
+  info.cputime=task->cputime;
+  mutex_unlock(&task->lock);
+
+  if (sched->done!=NULL)
+    sched->done(task, &info);
+
+  mutex_lock(&sched->lock);
+  task->finished=1;
+  if (task->release) {
+    if (task->prev!=NULL)
+      task->prev->next=task->next;
+    else
+      sched->tasks=task->next;
+    if (task->next!=NULL)
+      task->next->prev=task->prev;
+    mutex_delete(&task->lock);
+    free(task);
+  } /* if */
+  if (--sched->active==0)
+    cond_broadcast(&sched->donecond);
+  mutex_unlock(&sched->lock);
+}
+
+/* park() puts a sleeping or idle task in the timer heap; the task lock must
+ * be held
+ */
+static void park(AMX_SCHED *sched, AMX_TASK *task, int64_t now)
+{
+  task->timer=task->deadline;
+  if (task->idlefunc!=NULL && task->lastpoll+sched->pollinterval<task->timer)
+    task->timer=task->lastpoll+sched->pollinterval;
+  if (task->timer==NEVER)
+    return;             /* wait for amx_SchedWake() */
+  if (task->timer<now)
+    task->timer=now;
+  mutex_lock(&sched->lock);
+  if (heap_insert(sched, task)) {
+    /* if this is the earliest timer, idle workers must shorten their wait */
+    if (task->heapidx==0 && sched->idle>0)
+      cond_signal(&sched->workcond);
+  } else {
+    task->timer=NEVER;  /* out of memory: the task now depends on amx_SchedWake() */
+  } /* if */
+  mutex_unlock(&sched->lock);
+}
+
+static int pollidle(AMX_TASK *task, int64_t now, int nested)
+{
+  int err;
+
+  assert(task->idlefunc!=NULL);
+  task->lastpoll=now;
+  if (nested) {
+    /* the function has not returned yet, run the events on a copy of the
+     * abstract machine, so that the "restart point" is preserved
+     */
+    AMX nested=*task->amx;
+    err=task->idlefunc(&nested, amx_Exec);
+  } else {
+    err=task->idlefunc(task->amx, amx_Exec);
+  } /* if */
+  return err;
+}
+
+static void dispatch(AMX_SCHED *sched, WORKER *worker, AMX_TASK *task)
+{
+  int state, err, result;
+  cell retval=0;
+  int64_t now, start;
+  AMX *amx=task->amx;
+
+  mutex_lock(&task->lock);
+  task->queued=0;
+  if (task->cancel) {
+    finish(sched, task, AMX_ERR_EXIT, 0);
+    return;
+  } /* if */
+  assert(task->state!=AMX_TASK_RUNNING && task->state!=AMX_TASK_DONE);
+  state=task->state;
+  if ((state==AMX_TASK_SLEEPING || state==AMX_TASK_IDLE) && task->wakeup) {
+    task->wakeup=0;     /* wake-up is handled in this time slice */
+    task->deadline=0;
+  } /* if */
+  task->state=AMX_TASK_RUNNING;
+  task->runs++;
+  mutex_unlock(&task->lock);
+
+  if (sched->slice>0)
+    amx_SetFuel(amx, sched->slice, AMX_FUEL_SUSPEND);
+  start=getcputime_us();
+  now=gettime_ms();
+  result=AMX_ERR_SLEEP;
+  err=AMX_ERR_NONE;
+  switch (state) {
+  case AMX_TASK_RUNNABLE:
+    if (task->idlefunc!=NULL && task->index==AMX_EXEC_CONT && now-task->lastpoll>=sched->pollinterval)
+      err=pollidle(task, now, 1);    /* a task that keeps yielding still handles its events */
+    if (err==AMX_ERR_NONE) {
+      result=amx_Exec(amx, &retval, task->index);
+      task->index=AMX_EXEC_CONT;
+    } /* if */
+    break;
+  case AMX_TASK_SLEEPING:
+    if (now>=task->deadline) {
+      result=amx_Exec(amx, &retval, AMX_EXEC_CONT);
+    } else {
+      err=pollidle(task, now, 1);    /* woken up for the idle function only */
+      result=-1;
+    } /* if */
+    break;
+  case AMX_TASK_IDLE:
+    task->deadline=NEVER;
+    err=pollidle(task, now, 0);
+    result=-1;
+    break;
+  } /* switch */
+  now=gettime_ms();
+
+  mutex_lock(&task->lock);
+  task->cputime+=getcputime_us()-start;
+  if (task->cancel) {
+    finish(sched, task, AMX_ERR_EXIT, 0);
+    return;
+  } /* if */
+  if (err!=AMX_ERR_NONE) {
+    finish(sched, task, err, task->retval);
+    return;
+  } /* if */
+  if (result==-1) {
+    /* idle function was polled, the task keeps its state */
+    task->state=state;
+    if (task->wakeup) {
+      task->wakeup=0;
+      task->deadline=0;
+      enqueue(sched, &worker->queue, task, 1);
+    } else {
+      park(sched, task, now);
+    } /* if */
+  } else if (result==AMX_ERR_FUEL && sched->slice>0) {
+    /* preempted, the task continues in a next time slice */
+    task->state=AMX_TASK_RUNNABLE;
+    enqueue(sched, &worker->queue, task, 1);
+  } else if (result==AMX_ERR_SLEEP) {
+    if (task->wakeup || amx->pri==0) {
+      /* yield, or amx_SchedWake() was called while the task was running */
+      task->wakeup=0;
+      task->state=AMX_TASK_RUNNABLE;
+      enqueue(sched, &worker->queue, task, 1);
+    } else {
+      task->state=AMX_TASK_SLEEPING;
+      task->deadline=(amx->pri>0) ? now+amx->pri : NEVER;
+      park(sched, task, now);
+    } /* if */
+  } else if (task->idlefunc!=NULL
+             && (result==AMX_ERR_NONE || (result==AMX_ERR_INDEX && task->runs==1)))
+  {
+    /* event-driven program: keep polling the idle function (the program need
+     * not have a main() function)
+     */
+    task->retval=retval;
+    task->state=AMX_TASK_IDLE;
+    task->deadline=NEVER;
+    park(sched, task, now);
+  } else {
+    finish(sched, task, result, retval);
+    return;
+  } /* if */
+  mutex_unlock(&task->lock);
+}
+
+/* checktimers() moves the tasks whose timer expired to the run queue of the
+ * worker; it returns the time-out until the next timer
+ */
+static int64_t checktimers(AMX_SCHED *sched, WORKER *worker)
+{
+  AMX_TASK *list[TIMER_BATCH];
+  int count=0, i;
+  int64_t now=gettime_ms();
+  int64_t timeout=NEVER;
+
+  mutex_lock(&sched->lock);
+  while (sched->heapcount>0 && count<TIMER_BATCH) {
+    AMX_TASK *task=sched->heap[0];
+    if (task->timer>now) {
+      timeout=task->timer-now;
+      break;
+    } /* if */
+    heap_remove(sched, task);
+    task->queued=1;     /* so that amx_SchedWake() does not enqueue it too */
+    list[count++]=task;
+  } /* while */
+  if (count==TIMER_BATCH)
+    timeout=0;
+  mutex_unlock(&sched->lock);
+
+  for (i=0; i<count; i++)
+    pushtask(&worker->queue, list[i]);
+  if (count>1 && atomic_get(&sched->idle)>0) {
+    mutex_lock(&sched->lock);
+    cond_signal(&sched->workcond);
+    mutex_unlock(&sched->lock);
+  } /* if */
+  return timeout;
+}
+
+static AMX_TASK *steal(AMX_SCHED *sched, WORKER *worker)
+{
+  AMX_TASK *list[STEAL_MAX];
+  int i, j, count;
+
+  if (sched->numworkers<2)
+    return NULL;
+  /* start at a random victim, so that thieves spread out */
+  worker->seed=worker->seed*1103515245UL+12345UL;
+  j=(int)((worker->seed>>16) % (unsigned long)sched->numworkers);
+  for (i=0; i<sched->numworkers; i++, j=(j+1) % sched->numworkers) {
+    WORKER *victim=&sched->workers[j];
+    if (victim==worker)
+      continue;
+    count=rq_steal(&victim->queue, list, STEAL_MAX);
+    if (count>0) {
+      /* run the first stolen task, queue the others */
+      for (i=1; i<count; i++)
+        pushtask(&worker->queue, list[i]);
+      return list[0];
+    } /* if */
+  } /* for */
+  return NULL;
+}
+
+static void waitforwork(AMX_SCHED *sched, WORKER *worker, int64_t timeout)
+{
+  int i;
+
+  mutex_lock(&sched->lock);
+  atomic_set(&sched->idle, sched->idle+1);
+  /* check again, now that the other threads know that this worker is idle
+   * (a task pushed after this check will signal the condition variable)
+   */
+  for (i=0; i<sched->numworkers; i++)
+    if (rq_count(&sched->workers[i].queue)>0)
+      break;
+  if (i==sched->numworkers && !sched->stop) {
+    if (sched->heapcount>0) {
+      int64_t t=sched->heap[0]->timer-gettime_ms();
+      if (t<timeout)
+        timeout=(t>0) ? t : 0;
+    } /* if */
+    /* a worker that queues a yielding task reads the count of idle workers
+     * without lock, so it may miss this worker; limit the wait
+     */
+    if (timeout>10*(int64_t)sched->pollinterval)
+      timeout=10*(int64_t)sched->pollinterval;
+    if (timeout>0)
+      cond_wait(&sched->workcond, &sched->lock, timeout);
+  } /* if */
+  atomic_set(&sched->idle, sched->idle-1);
+  mutex_unlock(&sched->lock);
+  (void)worker;
+}
+
+static THREADFUNC workerthread(void *arg)
+{
+  WORKER *worker=(WORKER*)arg;
+  AMX_SCHED *sched=worker->sched;
+  AMX_TASK *task;
+  int64_t timeout;
+
+  while (!atomic_get(&sched->stop)) {
+    timeout=NEVER;
+    task=NULL;
+    if (++worker->ticks % TIMER_CHECK != 0)
+      task=rq_pop(&worker->queue);
+    if (task==NULL) {
+      timeout=checktimers(sched, worker);
+      task=rq_pop(&worker->queue);
+    } /* if */
+    if (task==NULL)
+      task=steal(sched, worker);
+    if (task!=NULL)
+      dispatch(sched, worker, task);
+    else
+      waitforwork(sched, worker, timeout);
+  } /* while */
+  return 0;
+}
+
+/* amx_SchedCreate() creates a scheduler with the given number of worker
+ * threads (zero or negative for one thread per processor core); the idle
+ * functions of the extension modules are polled every "pollinterval"
+ * milliseconds (zero for the default); the "done" callback is called from
+ * a worker thread when a task ends, and it may be NULL.
+ */
+AMX_SCHED * AMXAPI amx_SchedCreate(int workers, int pollinterval, AMX_TASKDONE done)
+{
+  AMX_SCHED *sched;
+  int i;
+
+  if (workers<=0)
+    workers=getcpucount();
+  if (pollinterval<=0)
+    pollinterval=10;
+  if ((sched=(AMX_SCHED*)malloc(sizeof(AMX_SCHED)))==NULL)
+    return NULL;
+  memset(sched, 0, sizeof(AMX_SCHED));
+  if ((sched->workers=(WORKER*)malloc(workers*sizeof(WORKER)))==NULL) {
+    free(sched);
+    return NULL;
+  } /* if */
+  memset(sched->workers, 0, workers*sizeof(WORKER));
+  mutex_init(&sched->lock);
+  cond_init(&sched->workcond);
+  cond_init(&sched->donecond);
+  sched->pollinterval=pollinterval;
+  sched->done=done;
+  for (i=0; i<workers; i++) {
+    WORKER *worker=&sched->workers[i];
+    worker->sched=sched;
+    worker->seed=(unsigned long)i*2654435761UL+1;
+    mutex_init(&worker->queue.lock);
+  } /* for */
+  /* workers must be set up before any thread starts, because of stealing */
+  sched->numworkers=workers;
+  for (i=0; i<workers; i++) {
+    WORKER *worker=&sched->workers[i];
+    #if defined __WIN32__ || defined _WIN32 || defined WIN32
+      worker->thread=(HANDLE)_beginthreadex(NULL, 0, workerthread, worker, 0, NULL);
+      if (worker->thread==0)
+        break;
+    #else
+      if (pthread_create(&worker->thread, NULL, workerthread, worker)!=0)
+        break;
+    #endif
+  } /* for */
+  if (i<workers) {
+    /* stop the threads that were started, keep the queues (they are empty) */
+    int count=i;
+    mutex_lock(&sched->lock);
+    atomic_set(&sched->stop, 1);
+    cond_broadcast(&sched->workcond);
+    mutex_unlock(&sched->lock);
+    for (i=0; i<count; i++) {
+      #if defined __WIN32__ || defined _WIN32 || defined WIN32
+        WaitForSingleObject(sched->workers[i].thread, INFINITE);
+        CloseHandle(sched->workers[i].thread);
+      #else
+        pthread_join(sched->workers[i].thread, NULL);
+      #endif
+    } /* for */
+    for (i=0; i<workers; i++)
+      mutex_delete(&sched->workers[i].queue.lock);
+    cond_delete(&sched->donecond);
+    cond_delete(&sched->workcond);
+    mutex_delete(&sched->lock);
+    free(sched->workers);
+    free(sched);
+    return NULL;
+  } /* if */
+  return sched;
+}
+
+/* amx_SchedDelete() stops all worker threads (each thread first completes
+ * the task that it is running) and frees all tasks; the "done" callback is
+ * not called for tasks that had not ended yet.
+ */
+int AMXAPI amx_SchedDelete(AMX_SCHED *sched)
+{
+  AMX_TASK *task;
+  int i;
+
+  if (sched==NULL)
+    return AMX_ERR_PARAMS;
+  mutex_lock(&sched->lock);
+  atomic_set(&sched->stop, 1);
+  cond_broadcast(&sched->workcond);
+  mutex_unlock(&sched->lock);
+  for (i=0; i<sched->numworkers; i++) {
+    #if defined __WIN32__ || defined _WIN32 || defined WIN32
+      WaitForSingleObject(sched->workers[i].thread, INFINITE);
+      CloseHandle(sched->workers[i].thread);
+    #else
+      pthread_join(sched->workers[i].thread, NULL);
+    #endif
+  } /* for */
+  for (i=0; i<sched->numworkers; i++) {
+    free(sched->workers[i].queue.items);
+    mutex_delete(&sched->workers[i].queue.lock);
+  } /* for */
+  while ((task=sched->tasks)!=NULL) {
+    sched->tasks=task->next;
+    mutex_delete(&task->lock);
+    free(task);
+  } /* while */
+  free(sched->heap);
+  free(sched->workers);
+  cond_delete(&sched->donecond);
+  cond_delete(&sched->workcond);
+  mutex_delete(&sched->lock);
+  free(sched);
+  return AMX_ERR_NONE;
+}
+
+/* amx_SchedSetSlice() sets the instruction budget (see amx_SetFuel()) that
+ * each task gets per time slice; a task that exhausts it is preempted and
+ * moved to the back of the run queue. A budget of zero (the default) turns
+ * preemption off. This function must be called before the first task is
+ * added.
+ */
+int AMXAPI amx_SchedSetSlice(AMX_SCHED *sched, long fuel)
+{
+  if (sched==NULL || fuel<0)
+    return AMX_ERR_PARAMS;
+  sched->slice=fuel;
+  return AMX_ERR_NONE;
+}
+
+/* amx_SchedAdd() queues an abstract machine to run the function at "index"
+ * (a public function index or AMX_EXEC_MAIN); the "task" parameter may be
+ * NULL if the caller does not need a handle.
+ */
+int AMXAPI amx_SchedAdd(AMX_SCHED *sched, AMX *amx, int index, void *userdata, AMX_TASK **task)
+{
+  AMX_TASK *t;
+
+  if (task!=NULL)
+    *task=NULL;
+  if (sched==NULL || amx==NULL || amx->base==NULL)
+    return AMX_ERR_PARAMS;
+  if ((t=(AMX_TASK*)malloc(sizeof(AMX_TASK)))==NULL)
+    return AMX_ERR_MEMORY;
+  memset(t, 0, sizeof(AMX_TASK));
+  mutex_init(&t->lock);
+  t->amx=amx;
+  t->userdata=userdata;
+  t->index=index;
+  t->state=AMX_TASK_RUNNABLE;
+  t->heapidx=-1;
+  t->deadline=NEVER;
+  t->timer=NEVER;
+  t->lastpoll=gettime_ms();
+  if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&t->idlefunc)!=AMX_ERR_NONE)
+    t->idlefunc=NULL;
+
+  mutex_lock(&sched->lock);
+  t->next=sched->tasks;
+  if (t->next!=NULL)
+    t->next->prev=t;
+  sched->tasks=t;
+  sched->active++;
+  mutex_unlock(&sched->lock);
+
+  if (task!=NULL)
+    *task=t;
+  mutex_lock(&t->lock);
+  enqueue(sched, pickqueue(sched), t, 0);
+  mutex_unlock(&t->lock);
+  return AMX_ERR_NONE;
+}
+
+/* amx_SchedRemove() ends a task (if it has not ended yet) and releases the
+ * handle. A task that is running completes its current time slice first; the
+ * "done" callback is called with the error code AMX_ERR_EXIT.
+ */
+int AMXAPI amx_SchedRemove(AMX_SCHED *sched, AMX_TASK *task)
+{
+  if (sched==NULL || task==NULL)
+    return AMX_ERR_PARAMS;
+  mutex_lock(&task->lock);
+  if (task->state!=AMX_TASK_DONE) {
+    task->cancel=1;
+    if ((task->state==AMX_TASK_SLEEPING || task->state==AMX_TASK_IDLE) && !task->queued) {
+      mutex_lock(&sched->lock);
+      if (task->heapidx>=0)
+        heap_remove(sched, task);
+      mutex_unlock(&sched->lock);
+      enqueue(sched, pickqueue(sched), task, 0);
+    } /* if */
+  } /* if */
+  mutex_unlock(&task->lock);
+
+  mutex_lock(&sched->lock);
+  if (task->finished) {
+    if (task->prev!=NULL)
+      task->prev->next=task->next;
+    else
+      sched->tasks=task->next;
+    if (task->next!=NULL)
+      task->next->prev=task->prev;
+    mutex_delete(&task->lock);
+    free(task);
+  } else {
+    task->release=1;
+  } /* if */
+  mutex_unlock(&sched->lock);
+  return AMX_ERR_NONE;
+}
+
+/* amx_SchedWake() wakes up a sleeping task, or it polls the idle function of
+ * an idle task right away. If the task is not sleeping, the wake-up is kept
+ * for the next time that it goes to sleep. This function may be called from
+ * any thread, including from a native function of another task.
+ */
+int AMXAPI amx_SchedWake(AMX_SCHED *sched, AMX_TASK *task)
+{
+  if (sched==NULL || task==NULL)
+    return AMX_ERR_PARAMS;
+  mutex_lock(&task->lock);
+  if (task->state!=AMX_TASK_DONE) {
+    task->wakeup=1;
+    if (task->state==AMX_TASK_SLEEPING || task->state==AMX_TASK_IDLE) {
+      int requeue;
+      mutex_lock(&sched->lock);
+      requeue=!task->queued;    /* a worker may just have taken it from the heap */
+      if (requeue && task->heapidx>=0)
+        heap_remove(sched, task);
+      mutex_unlock(&sched->lock);
+      if (requeue)
+        enqueue(sched, pickqueue(sched), task, 0);
+    } /* if */
+  } /* if */
+  mutex_unlock(&task->lock);
+  return AMX_ERR_NONE;
+}
+
+/* amx_SchedWait() waits until all tasks have ended; note that event-driven
+ * tasks (in the "idle" state) only end when they are removed, or when the
+ * idle function returns an error.
+ */
+int AMXAPI amx_SchedWait(AMX_SCHED *sched)
+{
+  if (sched==NULL)
+    return AMX_ERR_PARAMS;
+  mutex_lock(&sched->lock);
+  while (sched->active>0)
+    cond_wait(&sched->donecond, &sched->lock, NEVER);
+  mutex_unlock(&sched->lock);
+  return AMX_ERR_NONE;
+}
+
+int AMXAPI amx_SchedInfo(AMX_SCHED *sched, AMX_TASK *task, AMX_TASKINFO *info)
+{
+  if (sched==NULL || task==NULL || info==NULL)
+    return AMX_ERR_PARAMS;
+  mutex_lock(&task->lock);
+  info->amx=task->amx;
+  info->userdata=task->userdata;
+  info->state=task->state;
+  info->error=task->error;
+  info->retval=task->retval;
+  info->runs=task->runs;
+  info->cputime=task->cputime;
+  mutex_unlock(&task->lock);
+  return AMX_ERR_NONE;
+}
@@ -0,0 +1,89 @@
+/*  Multi-threaded scheduler for the Pawn Abstract Machine
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef AMXSCHED_H_INCLUDED
+#define AMXSCHED_H_INCLUDED
+
+#include "amx.h"
+
+#ifdef  __cplusplus
+extern  "C" {
+#endif
+
+/* The scheduler runs a (large) number of abstract machines on a pool of
+ * worker threads. Each worker has a queue of runnable abstract machines;
+ * a worker whose queue runs empty steals work from the queues of the other
+ * workers. An abstract machine that goes to "sleep" is parked: if the value
+ * of the sleep instruction (in PRI) is zero or positive, the abstract machine
+ * is resumed after that many milliseconds; if it is negative, the abstract
+ * machine stays parked until amx_SchedWake() is called for it.
+ *
+ * An abstract machine is handed over to the scheduler with amx_SchedAdd();
+ * from then on, the host must not touch it until the task is done (the
+ * "done" callback is invoked) or the scheduler is deleted. Any parameters
+ * for the function to run must be pushed before calling amx_SchedAdd().
+ *
+ * If an extension module installed an "idle" function (user data tag "Idle",
+ * see amx_TimeInit() and amx_ConsoleInit()), the scheduler polls it while the
+ * abstract machine sleeps, and after the function has returned; in the latter
+ * case, the task only ends when the idle function returns an error code (or
+ * when the task is removed).
+ *
+ * By default, tasks run without preemption: an abstract machine keeps its
+ * worker until it sleeps or returns. With amx_SchedSetSlice(), each task gets
+ * an instruction budget per time slice, and it is preempted when the budget
+ * runs out.
+ */
+
+typedef struct tagAMX_SCHED AMX_SCHED;
+typedef struct tagAMX_TASK AMX_TASK;
+
+enum {
+  AMX_TASK_RUNNABLE,    /* waiting in a run queue */
+  AMX_TASK_RUNNING,     /* running on a worker thread */
+  AMX_TASK_SLEEPING,    /* parked, waiting for a time-out or amx_SchedWake() */
+  AMX_TASK_IDLE,        /* function returned, polling the idle function */
+  AMX_TASK_DONE         /* finished (successfully or with an error) */
+};
+
+typedef struct tagAMX_TASKINFO {
+  AMX *amx;
+  void *userdata;       /* as passed to amx_SchedAdd() */
+  int state;            /* one of the AMX_TASK_xxx values */
+  int error;            /* exit code, valid when the state is AMX_TASK_DONE */
+  cell retval;          /* return value of the function, idem */
+  long runs;            /* number of times the task was dispatched */
+  int64_t cputime;      /* CPU time used by the task, in microseconds */
+} AMX_TASKINFO;
+
+typedef void (AMXAPI *AMX_TASKDONE)(AMX_TASK *task, const AMX_TASKINFO *info);
+
+AMX_SCHED * AMXAPI amx_SchedCreate(int workers, int pollinterval, AMX_TASKDONE done);
+int AMXAPI amx_SchedDelete(AMX_SCHED *sched);
+int AMXAPI amx_SchedSetSlice(AMX_SCHED *sched, long fuel);
+int AMXAPI amx_SchedAdd(AMX_SCHED *sched, AMX *amx, int index, void *userdata, AMX_TASK **task);
+int AMXAPI amx_SchedRemove(AMX_SCHED *sched, AMX_TASK *task);
+int AMXAPI amx_SchedWake(AMX_SCHED *sched, AMX_TASK *task);
+int AMXAPI amx_SchedWait(AMX_SCHED *sched);
+int AMXAPI amx_SchedInfo(AMX_SCHED *sched, AMX_TASK *task, AMX_TASKINFO *info);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* AMXSCHED_H_INCLUDED */
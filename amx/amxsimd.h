@@ -0,0 +1,248 @@
+/*  Vector kernels for the string functions of the Pawn Abstract Machine
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef AMXSIMD_H_INCLUDED
+#define AMXSIMD_H_INCLUDED
+
+#include <string.h>
+#include "amx.h"
+
+/* The string kernels are used by AMX.C and AMXSTRING.C. Each kernel only
+ * handles whole blocks of characters and returns how many characters it
+ * handled; the caller does the remainder with the plain C code, which is also
+ * the code that runs on other processors and for other cell sizes. The memory
+ * kernels (for the FILL instruction) are shared by the abstract machine cores
+ * and the JIT; they work for all cell sizes.
+ *
+ * SSE2 is part of the x86-64 instruction set (and the compilers only set the
+ * macros below when they may use it on 32-bit x86), so the kernels are chosen
+ * at compile time and there is no run-time check. Wider kernels (AVX2) would
+ * need such a check, with a second set of functions; the strings that scripts
+ * handle are too short for that to pay off. Define AMX_NOSIMD to compile
+ * without the kernels; test/simdtest.c compares both builds.
+ */
+#if !defined AMX_NOSIMD \
+    && (defined __SSE2__ || defined _M_X64 || defined _M_AMD64 || defined _M_IX86_FP && _M_IX86_FP>=2)
+  #define AMX_SSE2
+  #include <emmintrin.h>
+#endif
+#if defined AMX_SSE2 && PAWN_CELL_SIZE==32 && BYTE_ORDER==LITTLE_ENDIAN
+  #define AMX_SIMD_SSE2         /* string kernels */
+#endif
+
+/* The kernels for the cores are kept out of line: inlined in the interpreter
+ * loop of amx_Exec(), they take registers from all other instructions.
+ */
+#if defined _MSC_VER
+  #define SIMDFUNC static __inline
+  #define SIMDCORE static __declspec(noinline)
+#elif defined __GNUC__ || defined __clang__ || defined __ICC
+  #define SIMDFUNC static __inline__  /* no warning when a file does not use it */
+  #define SIMDCORE static __attribute__((noinline,unused))
+#else
+  #define SIMDFUNC static
+  #define SIMDCORE static
+#endif
+
+/* Stores "value" in "count" cells; the destination need not be aligned. */
+SIMDCORE void simd_fill(cell *dest,cell value,size_t count)
+{
+  size_t i=0;
+
+  if (value==0) {
+    memset(dest,0,count*sizeof(cell));  /* the most common case */
+    return;
+  } /* if */
+  #if defined AMX_SSE2
+  {
+    #if PAWN_CELL_SIZE==16
+      __m128i v=_mm_set1_epi16((short)value);
+    #elif PAWN_CELL_SIZE==32
+      __m128i v=_mm_set1_epi32((int)value);
+    #else
+      __m128i v=_mm_set1_epi64x((long long)value);
+    #endif
+    for ( ; i+16/sizeof(cell)<=count; i+=16/sizeof(cell))
+      _mm_storeu_si128((__m128i*)(dest+i),v);
+  }
+  #endif
+  for ( ; i<count; i++)
+    dest[i]=value;
+}
+
+#if defined AMX_SIMD_SSE2
+
+/* reverse the bytes in every 32-bit cell */
+SIMDFUNC __m128i simd_swap32(__m128i x)
+{
+  x=_mm_shufflehi_epi16(_mm_shufflelo_epi16(x,0xb1),0xb1);
+  return _mm_or_si128(_mm_slli_epi16(x,8),_mm_srli_epi16(x,8));
+}
+
+/* Returns the index of the first zero cell. The loads are aligned, so that
+ * they do not run into a page that the string does not touch.
+ */
+SIMDFUNC int simd_cellzero(const cell *str)
+{
+  const cell *ptr=str;
+  __m128i zero=_mm_setzero_si128();
+  int mask;
+
+  while (((uintptr_t)ptr & 15)!=0) {
+    if (*ptr==0)
+      return (int)(ptr-str);
+    ptr++;
+  } /* while */
+  while ((mask=_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_load_si128((const __m128i*)ptr),zero)))==0)
+    ptr+=4;
+  while ((mask & 1)==0) {
+    mask>>=4;           /* 4 bits per cell in the mask */
+    ptr++;
+  } /* while */
+  return (int)(ptr-str);
+}
+
+/* Returns the number of leading bytes that are ASCII (1..127), in blocks of 16
+ * bytes; the string must be zero-terminated.
+ */
+SIMDFUNC int simd_asciibytes(const unsigned char *str)
+{
+  const unsigned char *ptr=str;
+  __m128i zero=_mm_setzero_si128();
+  __m128i x;
+
+  while (((uintptr_t)ptr & 15)!=0) {
+    if (*ptr==0 || *ptr>=0x80)
+      return (int)(ptr-str);
+    ptr++;
+  } /* while */
+  for ( ;; ) {
+    x=_mm_load_si128((const __m128i*)ptr);
+    if (_mm_movemask_epi8(_mm_or_si128(x,_mm_cmpeq_epi8(x,zero)))!=0)
+      break;
+    ptr+=16;
+  } /* for */
+  return (int)(ptr-str);
+}
+
+/* Returns the number of leading cells (of "count") that hold ASCII characters,
+ * in blocks of 4 cells.
+ */
+SIMDFUNC int simd_asciicells(const cell *str,int count)
+{
+  __m128i high=_mm_set1_epi32(~0x7f);
+  __m128i zero=_mm_setzero_si128();
+  __m128i x;
+  int i;
+
+  for (i=0; i+4<=count; i+=4) {
+    x=_mm_and_si128(_mm_loadu_si128((const __m128i*)(str+i)),high);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(x,zero))!=0xffff)
+      break;
+  } /* for */
+  return i;
+}
+
+/* Copies "count" cells to "dest" with the bytes in every cell reversed, in
+ * blocks of 4 cells; "dest" may be the same as "source" and it need not be
+ * aligned.
+ */
+SIMDFUNC int simd_swapcells(void *dest,const void *source,int count)
+{
+  int i;
+
+  for (i=0; i+4<=count; i+=4) {
+    __m128i x=_mm_loadu_si128((const __m128i*)source+i/4);
+    _mm_storeu_si128((__m128i*)dest+i/4,simd_swap32(x));
+  } /* for */
+  return i;
+}
+
+/* returns the low bytes of 16 cells */
+SIMDFUNC __m128i simd_narrow16(const cell *source)
+{
+  __m128i lowbyte=_mm_set1_epi32(0xff);
+  __m128i a=_mm_and_si128(_mm_loadu_si128((const __m128i*)source),lowbyte);
+  __m128i b=_mm_and_si128(_mm_loadu_si128((const __m128i*)(source+4)),lowbyte);
+  __m128i c=_mm_and_si128(_mm_loadu_si128((const __m128i*)(source+8)),lowbyte);
+  __m128i d=_mm_and_si128(_mm_loadu_si128((const __m128i*)(source+12)),lowbyte);
+  return _mm_packus_epi16(_mm_packs_epi32(a,b),_mm_packs_epi32(c,d));
+}
+
+/* Stores the low byte of "count" cells in "dest", in blocks of 16 cells. */
+SIMDFUNC int simd_narrow(unsigned char *dest,const cell *source,int count)
+{
+  int i;
+
+  for (i=0; i+16<=count; i+=16)
+    _mm_storeu_si128((__m128i*)(dest+i),simd_narrow16(source+i));
+  return i;
+}
+
+/* stores 16 bytes as 16 cells, with or without sign extension */
+SIMDFUNC void simd_widen16(cell *dest,__m128i x,int sign)
+{
+  __m128i zero=_mm_setzero_si128();
+  __m128i lo=_mm_unpacklo_epi8(x,sign ? _mm_cmpgt_epi8(zero,x) : zero);
+  __m128i hi=_mm_unpackhi_epi8(x,sign ? _mm_cmpgt_epi8(zero,x) : zero);
+  _mm_storeu_si128((__m128i*)dest,_mm_unpacklo_epi16(lo,sign ? _mm_srai_epi16(lo,15) : zero));
+  _mm_storeu_si128((__m128i*)(dest+4),_mm_unpackhi_epi16(lo,sign ? _mm_srai_epi16(lo,15) : zero));
+  _mm_storeu_si128((__m128i*)(dest+8),_mm_unpacklo_epi16(hi,sign ? _mm_srai_epi16(hi,15) : zero));
+  _mm_storeu_si128((__m128i*)(dest+12),_mm_unpackhi_epi16(hi,sign ? _mm_srai_epi16(hi,15) : zero));
+}
+
+/* Stores "count" bytes as cells, in blocks of 16 bytes; "sign" is true when
+ * the bytes must be sign-extended (as for "char" on most compilers).
+ */
+SIMDFUNC int simd_widen(cell *dest,const unsigned char *source,int count,int sign)
+{
+  int i;
+
+  for (i=0; i+16<=count; i+=16)
+    simd_widen16(dest+i,_mm_loadu_si128((const __m128i*)(source+i)),sign);
+  return i;
+}
+
+/* Packs "count" characters from an unpacked string into a packed string, in
+ * blocks of 16 characters; "dest" may be the same as "source".
+ */
+SIMDFUNC int simd_pack(cell *dest,const cell *source,int count)
+{
+  int i;
+
+  for (i=0; i+16<=count; i+=16)
+    _mm_storeu_si128((__m128i*)(dest+i/4),simd_swap32(simd_narrow16(source+i)));
+  return i;
+}
+
+/* Unpacks the characters from a packed string, in blocks of 16 characters,
+ * working from the top down, so that the string can be unpacked in place. The
+ * characters above the last whole block must be unpacked first.
+ */
+SIMDFUNC int simd_unpack(cell *dest,const cell *source,int count)
+{
+  int i;
+
+  for (i=count-count%16-16; i>=0; i-=16)
+    simd_widen16(dest+i,simd_swap32(_mm_loadu_si128((const __m128i*)(source+i/4))),0);
+  return count-count%16;
+}
+
+#endif /* AMX_SIMD_SSE2 */
+
+#endif /* AMXSIMD_H_INCLUDED */
@@ -43,6 +43,7 @@
 # define _tcslen        strlen
 #endif
 #include "amxcons.h"
+#include "amxsimd.h"
 
 #if !defined isdigit
 # define isdigit(c)     ((unsigned)((c)-'0')<10u)
@@ -87,8 +88,10 @@ static int amx_StrPack(cell *dest,cell *source,int len,int offs)
     mask=(~(ucell)0) >> (offs*CHARBITS);
     c=*dest & ~mask;
     for (i=0; i<len+offs+1; i+=sizeof(cell)) {
-      *dest=c | ((*source >> (offs*CHARBITS)) & mask);
-      c=(*source << ((sizeof(cell)-offs)*CHARBITS)) & ~mask;
+      /* the last iteration may be past the terminating cell of the source */
+      cell s=(i<=len) ? *source : 0;
+      *dest=c | ((s >> (offs*CHARBITS)) & mask);
+      c=(s << ((sizeof(cell)-offs)*CHARBITS)) & ~mask;
       dest++;
       source++;
     } /* for */
@@ -110,7 +113,15 @@ static int amx_StrPack(cell *dest,cell *source,int len,int offs)
      * criterion (so that the number of iterations stays the same)
      */
     assert(offs>=0 && offs<sizeof(cell));
-    for (i=offs; i<len+offs; i++) {
+    i=offs;
+    #if defined AMX_SIMD_SSE2
+      if (offs==0) {
+        i=simd_pack(dest,source,len);
+        dest+=i/sizeof(cell);
+        source+=i;
+      } /* if */
+    #endif
+    for ( ; i<len+offs; i++) {
       c=(c<<CHARBITS) | (*source++ & 0xff);
       if (i%sizeof(cell)==sizeof(cell)-1) {
         *dest++=c;
@@ -135,11 +146,17 @@ static int amx_StrUnpack(cell *dest,cell *source,int len)
   if ((ucell)*source>UNPACKEDMAX) {
     /* unpack string, from bottom up (so string can be unpacked in place) */
     cell c;
-    int i;
-    for (i=len-1; i>=0; i--) {
+    int i,low=0;
+    #if defined AMX_SIMD_SSE2
+      low=len-len%16;   /* the whole blocks are done after the loop */
+    #endif
+    for (i=len-1; i>=low; i--) {
       c=source[i/sizeof(cell)] >> (sizeof(cell)-i%sizeof(cell)-1)*CHARBITS;
       dest[i]=c & UCHAR_MAX;
     } /* for */
+    #if defined AMX_SIMD_SSE2
+      simd_unpack(dest,source,len);
+    #endif
     dest[len]=0;        /* zero-terminate */
   } else {
     /* source string is already unpacked */
@@ -161,6 +178,19 @@ static unsigned char *packedptr(cell *string,int index)
   return ptr;
 }
 
+static cell lowerchar(cell c)
+{
+  #if defined __WIN32__ || defined _WIN32 || defined WIN32
+    c=(cell)CharLower((LPTSTR)c);
+  #elif defined _Windows
+    c=(cell)AnsiLower((LPSTR)c);
+  #else
+    if ((unsigned int)(c-'A')<26u)
+      c+='a'-'A';
+  #endif
+  return c;
+}
+
 static cell extractchar(cell *string,int index,int mklower)
 {
   cell c;
@@ -169,16 +199,8 @@ static cell extractchar(cell *string,int index,int mklower)
     c=*packedptr(string,index);
   else
     c=string[index];
-  if (mklower) {
-    #if defined __WIN32__ || defined _WIN32 || defined WIN32
-      c=(cell)CharLower((LPTSTR)c);
-    #elif defined _Windows
-      c=(cell)AnsiLower((LPSTR)c);
-    #else
-      if ((unsigned int)(c-'A')<26u)
-        c+='a'-'A';
-    #endif
-  } /* if */
+  if (mklower)
+    c=lowerchar(c);
   return c;
 }
 
@@ -304,17 +326,23 @@ static cell AMX_NATIVE_CALL n_strcopy(AMX *amx,const cell *params)
   return len;
 }
 
-static int compare(cell *cstr1,cell *cstr2,int ignorecase,int length,int offs1)
+static int compare(const AMX_STRVIEW *str1,const AMX_STRVIEW *str2,int ignorecase,int length,int offs1)
 {
   int index;
   cell c1=0,c2=0;
 
   for (index=0; index<length; index++) {
-    c1=extractchar(cstr1,index+offs1,ignorecase);
-    c2=extractchar(cstr2,index,ignorecase);
+    c1=amx_StrViewChar(str1,index+offs1);
+    c2=amx_StrViewChar(str2,index);
     assert(c1!=0 && c2!=0); /* string lengths are already checked, so zero-bytes should not occur */
-    if (c1!=c2)
-      break;
+    if (c1!=c2) {
+      if (!ignorecase)
+        break;
+      c1=lowerchar(c1);
+      c2=lowerchar(c2);
+      if (c1!=c2)
+        break;
+    } /* if */
   } /* for */
 
   if (c1<c2)
@@ -328,17 +356,17 @@ static int compare(cell *cstr1,cell *cstr2,int ignorecase,int length,int offs1)
  */
 static cell AMX_NATIVE_CALL n_strcmp(AMX *amx,const cell *params)
 {
-  cell *cstr1,*cstr2;
+  AMX_STRVIEW str1,str2;
   int len1,len2,len;
   cell result;
 
   (void)(amx);
-  cstr1=amx_Address(amx,params[1]);
-  cstr2=amx_Address(amx,params[2]);
+  amx_StrView(amx_Address(amx,params[1]),&str1);
+  amx_StrView(amx_Address(amx,params[2]),&str2);
 
   /* get the maximum length to compare */
-  amx_StrLen(cstr1,&len1);
-  amx_StrLen(cstr2,&len2);
+  len1=str1.length;
+  len2=str2.length;
   len=len1;
   if (len>len2)
     len=len2;
@@ -350,7 +378,7 @@ static cell AMX_NATIVE_CALL n_strcmp(AMX *amx,const cell *params)
     else
       result=(len1<len2) ? -1 : 1;
   } else {
-    result=compare(cstr1,cstr2,params[3],len,0);
+    result=compare(&str1,&str2,params[3],len,0);
     if (result==0 && len!=params[4] && len1!=len2)
       result=(len1<len2) ? -1 : 1;
   }
@@ -361,31 +389,38 @@ static cell AMX_NATIVE_CALL n_strcmp(AMX *amx,const cell *params)
  */
 static cell AMX_NATIVE_CALL n_strfind(AMX *amx,const cell *params)
 {
-  cell *cstr,*csub;
+  AMX_STRVIEW str,sub;
   int lenstr,lensub,offs;
   cell c,f;
 
   (void)(amx);
-  cstr=amx_Address(amx,params[1]);
-  csub=amx_Address(amx,params[2]);
+  amx_StrView(amx_Address(amx,params[1]),&str);
+  amx_StrView(amx_Address(amx,params[2]),&sub);
 
   /* get the maximum length to compare */
-  amx_StrLen(cstr,&lenstr);
-  amx_StrLen(csub,&lensub);
+  lenstr=str.length;
+  lensub=sub.length;
   if (lensub==0)
     return -1;
 
   /* get the start character of the substring, for quicker searching */
-  f=extractchar(csub,0,params[3]);
+  f=amx_StrViewChar(&sub,0);
+  if (params[3])
+    f=lowerchar(f);
   assert(f!=0);         /* string length is already checked */
 
-  for (offs=(int)params[4]; offs+lensub<=lenstr; offs++) {
+  offs=(int)params[4];
+  if (offs<0)
+    offs=0;
+  for ( ; offs+lensub<=lenstr; offs++) {
     /* find the initial character */
-    c=extractchar(csub,0,params[3]);
+    c=amx_StrViewChar(&str,offs);
     assert(c!=0);      /* string length is already checked */
+    if (params[3])
+      c=lowerchar(c);
     if (c!=f)
       continue;
-    if (compare(cstr,csub,params[3],lensub,offs)==0)
+    if (compare(&str,&sub,params[3],lensub,offs)==0)
       return offs;
   } /* for */
   return -1;
@@ -563,54 +598,35 @@ static cell AMX_NATIVE_CALL n_strins(AMX *amx,const cell *params)
  */
 static cell AMX_NATIVE_CALL n_strval(AMX *amx,const cell *params)
 {
-  TCHAR str[50],*ptr;
-  cell *cstr,result;
+  AMX_STRVIEW str;
+  cell result;
   int len,negate=0;
   int offset=0;
 
   (void)(amx);
   /* get parameters */
-  cstr=amx_Address(amx,params[1]);
-  amx_StrLen(cstr,&len);
+  amx_StrView(amx_Address(amx,params[1]),&str);
+  len=str.length;
   if ((unsigned)params[0]>=2*sizeof(cell))
     offset=params[2];
+  if (offset>=len)
+    offset=len-1;
   if (offset<0)
     offset=0;
-  else if (offset>=len)
-    offset=len-1;
-
-  /* skip a number of cells */
-  if ((ucell)*cstr>UNPACKEDMAX) {
-    /* packed string */
-    while (offset>=(int)sizeof(cell)) {
-      cstr++;
-      offset-=sizeof(cell);
-      len-=sizeof(cell);
-    } /* while */
-  } else {
-    /* unpacked string, one character per cell */
-    while (offset>0) {
-      cstr++;
-      offset--;
-      len--;
-    } /* while */
-  } /* if */
 
-  amx_GetString(str,cstr,sizeof(TCHAR)>1,sizeof str);
-  assert(offset<(int)sizeof(cell) && offset>=0);
-  ptr=str+offset;
+  /* parse the number in place, the string is not copied */
   result=0;
-  while (*ptr!='\0' && *ptr<=' ')
-    ptr++;              /* skip whitespace */
-  if (*ptr=='-') {      /* handle sign */
+  while (offset<len && amx_StrViewChar(&str,offset)<=' ')
+    offset++;           /* skip whitespace */
+  if (offset<len && amx_StrViewChar(&str,offset)=='-') {  /* handle sign */
     negate=1;
-    ptr++;
-  } else if (*ptr=='+') {
-    ptr++;
+    offset++;
+  } else if (offset<len && amx_StrViewChar(&str,offset)=='+') {
+    offset++;
   } /* if */
-  while (isdigit(*ptr)) {
-    result=result*10 + (*ptr-'0');
-    ptr++;
+  while (offset<len && isdigit(amx_StrViewChar(&str,offset))) {
+    result=result*10 + (amx_StrViewChar(&str,offset)-'0');
+    offset++;
   } /* while */
   if (negate)
     result=-result;
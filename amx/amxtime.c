@@ -18,6 +18,7 @@
  */
 #include <time.h>
 #include <assert.h>
+#include <stdlib.h>
 #include "amx.h"
 #if defined __WIN32__ || defined _WIN32 || defined _Windows
   #include <windows.h>
@@ -53,9 +54,27 @@
 #else
   #define INIT_TIMER()
 #endif
-static unsigned long timestamp;
-static unsigned long timelimit;
-static int timerepeat;
+
+/* the timer state is kept per abstract machine */
+typedef struct tagTIMEDATA {
+  AMX_MODULEDATA header;
+  unsigned long timestamp;
+  unsigned long timelimit;
+  int timerepeat;
+  #if !defined AMXTIME_NOIDLE
+    AMX_IDLE PrevIdle;
+    int idxTimer;
+  #endif
+} TIMEDATA;
+#define TIMEDATA_TAG  AMX_USERTAG('T','i','m','e')
+
+static TIMEDATA *gettimedata(AMX *amx)
+{
+  TIMEDATA *data;
+  if (amx_GetModuleData(amx, TIMEDATA_TAG, (AMX_MODULEDATA**)&data) != AMX_ERR_NONE)
+    return NULL;
+  return data;
+}
 
 static const unsigned char monthdays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
 
@@ -348,11 +367,14 @@ static cell AMX_NATIVE_CALL n_delay(AMX *amx, const cell *params)
  */
 static cell AMX_NATIVE_CALL n_settimer(AMX *amx, const cell *params)
 {
-  (void)amx;
+  TIMEDATA *data;
+
   assert(params[0]==(int)(2*sizeof(cell)));
-  timestamp=gettimestamp();
-  timelimit=params[1];
-  timerepeat=(int)(params[2]==0);
+  if ((data=gettimedata(amx))==NULL)
+    return 0;   /* amx_TimeInit() was not called */
+  data->timestamp=gettimestamp();
+  data->timelimit=params[1];
+  data->timerepeat=(int)(params[2]==0);
   return 0;
 }
 
@@ -363,13 +385,15 @@ static cell AMX_NATIVE_CALL n_settimer(AMX *amx, const cell *params)
 static cell AMX_NATIVE_CALL n_gettimer(AMX *amx, const cell *params)
 {
   cell *cptr;
+  TIMEDATA *data;
 
   assert(params[0]==(int)(2*sizeof(cell)));
+  data=gettimedata(amx);
   cptr=amx_Address(amx,params[1]);
-  *cptr=timelimit;
+  *cptr=(data!=NULL) ? data->timelimit : 0;
   cptr=amx_Address(amx,params[2]);
-  *cptr=timerepeat;
-  return timelimit>0;
+  *cptr=(data!=NULL) ? data->timerepeat : 0;
+  return data!=NULL && data->timelimit>0;
 }
 
 /* settimestamp(seconds1970) sets the date and time from a single parameter: the
@@ -420,24 +444,24 @@ static cell AMX_NATIVE_CALL n_cvttimestamp(AMX *amx, const cell *params)
 
 
 #if !defined AMXTIME_NOIDLE
-static AMX_IDLE PrevIdle = NULL;
-static int idxTimer = -1;
-
 static int AMXAPI amx_TimeIdle(AMX *amx, int AMXAPI Exec(AMX *, cell *, int))
 {
   int err=0;
+  TIMEDATA *data=gettimedata(amx);
 
-  assert(idxTimer >= 0);
+  if (data == NULL)
+    return AMX_ERR_NONE;    /* module was cleaned up */
+  assert(data->idxTimer >= 0);
 
-  if (PrevIdle != NULL)
-    PrevIdle(amx, Exec);
+  if (data->PrevIdle != NULL)
+    data->PrevIdle(amx, Exec);
 
-  if (timelimit>0 && (gettimestamp()-timestamp)>=timelimit) {
-    if (timerepeat)
-      timestamp+=timelimit;
+  if (data->timelimit>0 && (gettimestamp()-data->timestamp)>=data->timelimit) {
+    if (data->timerepeat)
+      data->timestamp+=data->timelimit;
     else
-      timelimit=0;      /* do not repeat single-shot timer */
-    err = Exec(amx, NULL, idxTimer);
+      data->timelimit=0;  /* do not repeat single-shot timer */
+    err = Exec(amx, NULL, data->idxTimer);
     while (err == AMX_ERR_SLEEP)
       err = Exec(amx, NULL, AMX_EXEC_CONT);
   } /* if */
@@ -466,11 +490,26 @@ const AMX_NATIVE_INFO time_Natives[] = {
 
 int AMXEXPORT AMXAPI amx_TimeInit(AMX *amx)
 {
+  TIMEDATA *data;
+
+  if ((data=gettimedata(amx))==NULL) {
+    if ((data=(TIMEDATA*)malloc(sizeof(TIMEDATA)))==NULL)
+      return AMX_ERR_MEMORY;
+    if (amx_SetModuleData(amx, TIMEDATA_TAG, &data->header) != AMX_ERR_NONE) {
+      free(data);
+      return AMX_ERR_USERDATA;
+    } /* if */
+  } /* if */
+  data->timestamp=0;
+  data->timelimit=0;
+  data->timerepeat=0;
+
   #if !defined AMXTIME_NOIDLE
     /* see whether there is a @timer() function */
-    if (amx_FindPublic(amx,"@timer",&idxTimer) == AMX_ERR_NONE) {
-      if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&PrevIdle) != AMX_ERR_NONE)
-        PrevIdle = NULL;
+    data->PrevIdle = NULL;
+    if (amx_FindPublic(amx,"@timer",&data->idxTimer) == AMX_ERR_NONE) {
+      if (amx_GetUserData(amx, AMX_USERTAG('I','d','l','e'), (void**)&data->PrevIdle) != AMX_ERR_NONE)
+        data->PrevIdle = NULL;
       amx_SetUserData(amx, AMX_USERTAG('I','d','l','e'), amx_TimeIdle);
     } /* if */
   #endif
@@ -480,9 +519,11 @@ int AMXEXPORT AMXAPI amx_TimeInit(AMX *amx)
 
 int AMXEXPORT AMXAPI amx_TimeCleanup(AMX *amx)
 {
-  (void)amx;
-  #if !defined AMXTIME_NOIDLE
-    PrevIdle = NULL;
-  #endif
+  TIMEDATA *data;
+
+  if ((data=gettimedata(amx))!=NULL) {
+    amx_SetModuleData(amx, TIMEDATA_TAG, NULL);
+    free(data);
+  } /* if */
   return AMX_ERR_NONE;
 }
@@ -28,24 +28,27 @@ extern int amx_ConsoleCleanup(AMX *amx);
 extern int amx_CoreInit(AMX *amx);
 extern int amx_CoreCleanup(AMX *amx);
 
+/* the garbage collector; this example runs a single abstract machine */
+static GCINFO gc;
+
 
 void garbagecollect(AMX amx[], int number)
 {
   int exp, usage, n;
 
   /* see whether it may be a good time to increase the table size */
-  gc_tablestat(&exp, &usage);
+  gc_tablestat(&gc, &exp, &usage);
   if (usage > 50) {
-    if (gc_settable(exp+1, GC_AUTOGROW) != GC_ERR_NONE)
+    if (gc_settable(&gc, exp+1, GC_AUTOGROW) != GC_ERR_NONE)
       fprintf(stderr, "Warning, memory low\n");
   } /* if */
 
   /* scan all abstract machines */
   for (n = 0; n < number; n++)
-    gc_scan(&amx[n]);
+    gc_scan(&gc, &amx[n]);
 
   /* clean up unused references */
-  gc_clean();
+  gc_clean(&gc);
 }
 
 /* aux_Monitor()
@@ -95,7 +98,7 @@ static cell AMX_NATIVE_CALL n_bstring(AMX *amx, const cell *params)
   amx_StrParam(amx, params[1], cstr);
   if (cstr != NULL)
     hstr = (cell)cstr2bstr(cstr);
-  VERIFY( gc_mark(hstr) );
+  VERIFY( gc_mark(&gc, hstr) );
   return hstr;
 }
 
@@ -103,7 +106,7 @@ static cell AMX_NATIVE_CALL n_bstring(AMX *amx, const cell *params)
 static cell AMX_NATIVE_CALL n_bstrdup(AMX *amx, const cell *params)
 {
   cell hstr = (cell)bstrcpy((const bstring)params[1]);
-  VERIFY( gc_mark(hstr) );
+  VERIFY( gc_mark(&gc, hstr) );
   return hstr;
 }
 
@@ -125,7 +128,7 @@ static cell AMX_NATIVE_CALL n_bstrlen(AMX *amx, const cell *params)
 static cell AMX_NATIVE_CALL n_bstrmid(AMX *amx, const cell *params)
 {
   cell hstr = (cell)bmidstr((const bstring)params[1], (int)params[2], (int)params[3]);
-  VERIFY( gc_mark(hstr) );
+  VERIFY( gc_mark(&gc, hstr) );
   return hstr;
 }
 
@@ -181,8 +184,8 @@ int main(int argc,char *argv[])
   ExitOnError(&amx, err);
 
   /* Initialize the garbage collector, start with a small table. */
-  gc_setcallback((GC_FREE)bdestroy);
-  err = gc_settable(7, GC_AUTOGROW);
+  gc_setcallback(&gc, (GC_FREE)bdestroy);
+  err = gc_settable(&gc, 7, GC_AUTOGROW);
   ExitOnError(&amx, err);
 
   /* Run the compiled script and time it. The "sleep" instruction causes the
@@ -209,7 +212,7 @@ int main(int argc,char *argv[])
   aux_FreeProgram(&amx);
 
   /* Free the garbarge collector data and tables. */
-  gc_settable(0, 0);
+  gc_settable(&gc, 0, 0);
 
   /* Print the return code of the compiled script (often not very useful). */
   if (ret!=0)
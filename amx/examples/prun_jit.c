@@ -54,17 +54,28 @@ extern int amx_CoredCleanp(AMX *amx);
   {
     VirtualFree(ptr, 0, MEM_RELEASE);
   }
-#elif defined LINUX
+#elif defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
   #include <sys/mman.h>
+  /* mprotect() only works on whole pages, so allocate the block with mmap();
+   * the size of the block is stored in front of it (for munmap()), in a
+   * header of 16 bytes to keep the data in the image aligned
+   */
+  #define VHDR_SIZE   16
   static void *vmalloc_exec(long size)
   {
-    void *ptr = malloc(size);
-    if (ptr)
-      mprotect(ptr, size, PROT_READ | PROT_WRITE | PROT_EXEC);
-    return ptr;
+    unsigned char *ptr = mmap(NULL, size + VHDR_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+      return NULL;
+    *(long *)ptr = size + VHDR_SIZE;
+    return ptr + VHDR_SIZE;
   }
 
-  #define vfree(ptr)             free(ptr)
+  static void vfree(void *ptr)
+  {
+    unsigned char *block = (unsigned char *)ptr - VHDR_SIZE;
+    munmap(block, *(long *)block);
+  }
 #else
   #define vmalloc_exec(size)     malloc(size)
   #define vfree(ptr)             free(ptr)
@@ -192,7 +203,7 @@ static char *messages[] = {
       /* AMX_ERR_DIVIDE    */ "Divide by zero",
       /* AMX_ERR_SLEEP     */ "(sleep mode)",
       /* AMX_ERR_INVSTATE  */ "Invalid state",
-      /* 14 */                "(reserved)",
+      /* AMX_ERR_FUEL      */ "Instruction budget exhausted",
       /* 15 */                "(reserved)",
       /* AMX_ERR_MEMORY    */ "Out of memory",
       /* AMX_ERR_FORMAT    */ "Invalid/unsupported P-code file format",
@@ -0,0 +1,139 @@
+/*  Runs many instances of a script on the multi-threaded scheduler.
+ *
+ *  The script is loaded a number of times, and all instances run function
+ *  main() on a pool of worker threads (see AMXSCHED.C). A script that "sleeps"
+ *  gives up its worker, for the given number of milliseconds; "sleep 0"
+ *  yields to the other instances. With a time slice (an instruction budget,
+ *  see amx_SetFuel()), instances that do not sleep are preempted as well.
+ *  The native functions are looked up in a registry (a hash table that is
+ *  built once) instead of in the lists of each module, for every instance.
+ *
+ *  Build it with AMX.C, AMXCORE.C, AMXCONS.C and AMXSCHED.C, and link with
+ *  the pthread library on Linux/Unix.
+ *
+ *  This file may be freely used. No warranties of any kind.
+ */
+#include <stdio.h>
+#include <stdlib.h>     /* for exit() */
+#include <string.h>     /* for memset() (on some compilers) */
+#include <time.h>
+#include "amx.h"
+#include "amxsched.h"
+#include "amxaux.c"
+
+int AMXEXPORT AMXAPI amx_CoreInit(AMX *amx);
+int AMXEXPORT AMXAPI amx_CoreCleanup(AMX *amx);
+int AMXEXPORT AMXAPI amx_ConsoleInit(AMX *amx);
+int AMXEXPORT AMXAPI amx_ConsoleCleanup(AMX *amx);
+extern const AMX_NATIVE_INFO core_Natives[];
+extern const AMX_NATIVE_INFO console_Natives[];
+
+static volatile long errors = 0;
+
+void ErrorExit(AMX *amx, int errorcode)
+{
+  printf("Run time error %d: \"%s\" on address %ld\n",
+         errorcode, aux_StrError(errorcode),
+         (amx != NULL) ? amx->cip : 0);
+  exit(1);
+}
+
+void PrintUsage(char *program)
+{
+  printf("Usage: %s <filename> [instances [workers [slice]]]\n"
+         "<filename> is a compiled script; by default, one worker thread runs on\n"
+         "every processor core and the instances are not preempted.\n", program);
+  exit(1);
+}
+
+static void AMXAPI TaskDone(AMX_TASK *task, const AMX_TASKINFO *info)
+{
+  (void)task;
+  if (info->error != AMX_ERR_NONE) {
+    printf("Instance %ld: run time error %d \"%s\"\n",
+           (long)(intptr_t)info->userdata, info->error, aux_StrError(info->error));
+    errors++;   /* not atomic, but only used for the summary */
+  } /* if */
+}
+
+int main(int argc,char *argv[])
+{
+  AMX *amx;
+  AMX_TASK **tasks;
+  AMX_SCHED *sched;
+  AMX_TASKINFO info;
+  AMX_REGISTRY registry;
+  static AMX_REGENTRY regtable[256];
+  int instances = 1000, workers = 0;
+  int i, err;
+  long slice = 0, runs = 0;
+  int64_t cputime = 0, maxtime = 0;
+  clock_t start;
+
+  if (argc < 2 || argc > 5)
+    PrintUsage(argv[0]);
+  if (argc > 2)
+    instances = atoi(argv[2]);
+  if (argc > 3)
+    workers = atoi(argv[3]);
+  if (argc > 4)
+    slice = atol(argv[4]);
+  if (instances <= 0 || slice < 0)
+    PrintUsage(argv[0]);
+
+  amx = (AMX*)calloc(instances, sizeof(AMX));
+  tasks = (AMX_TASK**)calloc(instances, sizeof(AMX_TASK*));
+  if (amx == NULL || tasks == NULL)
+    ErrorExit(NULL, AMX_ERR_MEMORY);
+  amx_RegistryInit(&registry, regtable, 8);
+  amx_RegistryAdd(&registry, core_Natives, -1);
+  amx_RegistryAdd(&registry, console_Natives, -1);
+  for (i = 0; i < instances; i++) {
+    err = aux_LoadProgram(&amx[i], argv[1], NULL);
+    if (err != AMX_ERR_NONE)
+      ErrorExit(&amx[i], err);
+    /* the modules must still be initialized, but when the registry resolved
+     * all native functions, they skip the registration
+     */
+    amx_RegisterRegistry(&amx[i], &registry);
+    amx_ConsoleInit(&amx[i]);
+    err = amx_CoreInit(&amx[i]);
+    if (err != AMX_ERR_NONE)
+      ErrorExit(&amx[i], err);
+  } /* for */
+
+  sched = amx_SchedCreate(workers, 0, TaskDone);
+  if (sched == NULL)
+    ErrorExit(NULL, AMX_ERR_MEMORY);
+  amx_SchedSetSlice(sched, slice);
+  start = clock();
+  for (i = 0; i < instances; i++) {
+    err = amx_SchedAdd(sched, &amx[i], AMX_EXEC_MAIN, (void*)(intptr_t)i, &tasks[i]);
+    if (err != AMX_ERR_NONE)
+      ErrorExit(&amx[i], err);
+  } /* for */
+  amx_SchedWait(sched);
+
+  /* per-instance accounting */
+  for (i = 0; i < instances; i++) {
+    amx_SchedInfo(sched, tasks[i], &info);
+    runs += info.runs;
+    cputime += info.cputime;
+    if (info.cputime > maxtime)
+      maxtime = info.cputime;
+  } /* for */
+  printf("%d instances, %ld time slices, %ld errors\n", instances, runs, errors);
+  printf("CPU time: %.3f s in total, %.3f ms on average, %.3f ms at most\n",
+         cputime / 1000000.0, cputime / 1000.0 / instances, maxtime / 1000.0);
+  printf("Process time: %.3f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+
+  amx_SchedDelete(sched);
+  for (i = 0; i < instances; i++) {
+    amx_ConsoleCleanup(&amx[i]);
+    amx_CoreCleanup(&amx[i]);
+    aux_FreeProgram(&amx[i]);
+  } /* for */
+  free(tasks);
+  free(amx);
+  return (errors == 0) ? 0 : 1;
+}
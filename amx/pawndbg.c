@@ -2802,15 +2802,17 @@ int AMXAPI prun_Overlay(AMX *amx, int index)
   AMX_HEADER *hdr;
   AMX_OVERLAYINFO *tbl;
   FILE *ovl;
+  void *pool;
 
   assert(amx != NULL);
   hdr = (AMX_HEADER*)amx->base;
   assert((size_t)index < (hdr->nametable - hdr->overlays) / sizeof(AMX_OVERLAYINFO));
   tbl = (AMX_OVERLAYINFO*)(amx->base + hdr->overlays) + index;
+  pool = amx->data + (hdr->stp - hdr->dat); /* the overlay pool follows the stack */
   amx->codesize = tbl->size;
-  amx->code = amx_poolfind(index);
+  amx->code = amx_poolfind(pool, index);
   if (amx->code == NULL) {
-    if ((amx->code = amx_poolalloc(tbl->size, index)) == NULL)
+    if ((amx->code = amx_poolalloc(pool, tbl->size, index)) == NULL)
       return AMX_ERR_OVERLAY;   /* failure allocating memory for the overlay */
     ovl = fopen(g_filename, "rb");
     assert(ovl != NULL);
@@ -33,12 +33,20 @@
 #if !defined AMX_NODYNALOAD && defined ENABLE_BINRELOC && (defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__)
   #include <binreloc.h> /* from BinReloc, see www.autopackage.org */
 #endif
+#if !defined AMX_NODYNALOAD && defined _Windows
+  #include <windows.h>
+  #define AOT_SUPPORT
+#elif !defined AMX_NODYNALOAD && (defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__)
+  #include <dlfcn.h>
+  #define AOT_SUPPORT
+#endif
 
 #if defined AMXOVL
   #include "amxpool.h"
 #endif
 #if defined AMXDBG
   #include "amxdbg.h"
+  #include "amxsampler.h"
 #endif
 static char g_filename[_MAX_PATH];      /* for loading the debug or information
                                          * or for loading overlays */
@@ -101,15 +109,17 @@ int AMXAPI prun_Overlay(AMX *amx, int index)
   AMX_HEADER *hdr;
   AMX_OVERLAYINFO *tbl;
   FILE *ovl;
+  void *pool;
 
   assert(amx != NULL);
   hdr = (AMX_HEADER*)amx->base;
   assert((size_t)index < (hdr->nametable - hdr->overlays) / sizeof(AMX_OVERLAYINFO));
   tbl = (AMX_OVERLAYINFO*)(amx->base + hdr->overlays) + index;
+  pool = amx->data + (hdr->stp - hdr->dat); /* the overlay pool follows the stack */
   amx->codesize = tbl->size;
-  amx->code = amx_poolfind(index);
+  amx->code = amx_poolfind(pool, index);
   if (amx->code == NULL) {
-    if ((amx->code = amx_poolalloc(tbl->size, index)) == NULL)
+    if ((amx->code = amx_poolalloc(pool, tbl->size, index)) == NULL)
       return AMX_ERR_OVERLAY;   /* failure allocating memory for the overlay */
     ovl = fopen(g_filename, "rb");
     assert(ovl != NULL);
@@ -246,7 +256,7 @@ static char *messages[] = {
       /* AMX_ERR_DIVIDE    */ "Divide by zero",
       /* AMX_ERR_SLEEP     */ "(sleep mode)",
       /* AMX_ERR_INVSTATE  */ "Invalid state",
-      /* 14 */                "(reserved)",
+      /* AMX_ERR_FUEL      */ "Instruction budget exhausted",
       /* 15 */                "(reserved)",
       /* AMX_ERR_MEMORY    */ "Out of memory",
       /* AMX_ERR_FORMAT    */ "Invalid/unsupported P-code file format",
@@ -297,13 +307,123 @@ void ExitOnError(AMX *amx, int error)
   } /* if */
 }
 
+#if defined AMX_PROFILE
+/* LoadNames() loads the header of the program a second time, into "names",
+ * for looking up the names of the native functions: on a 64-bit host,
+ * registering a native function overwrites the offset of its name (and
+ * extension modules register their functions already in amx_Init()).
+ */
+static int LoadNames(AMX *names)
+{
+  FILE *fp;
+  AMX_HEADER hdr, *copy;
+  AMX_FUNCSTUB *func;
+  int32_t offs;
+
+  memset(names, 0, sizeof *names);
+  if ((fp = fopen(g_filename, "rb")) == NULL)
+    return AMX_ERR_NOTFOUND;
+  fread(&hdr, sizeof hdr, 1, fp);
+  amx_Align32((uint32_t *)&hdr.cod);
+  if ((names->base = (unsigned char*)malloc(hdr.cod)) == NULL) {
+    fclose(fp);
+    return AMX_ERR_MEMORY;
+  } /* if */
+  rewind(fp);
+  fread(names->base, 1, (size_t)hdr.cod, fp);
+  fclose(fp);
+  /* amx_GetNative() only uses these fields */
+  copy = (AMX_HEADER*)names->base;
+  amx_Align16(&copy->magic);
+  amx_Align16((uint16_t *)&copy->defsize);
+  amx_Align32((uint32_t *)&copy->natives);
+  amx_Align32((uint32_t *)&copy->libraries);
+  for (offs = copy->natives; offs < copy->libraries; offs += copy->defsize) {
+    func = (AMX_FUNCSTUB*)(names->base + offs);
+    amx_Align32(&func->nameofs);
+  } /* for */
+  return AMX_ERR_NONE;
+}
+
+static const uint64_t *sortcounts;
+static int CompareCounts(const void *a, const void *b)
+{
+  uint64_t ca = sortcounts[*(const int*)a];
+  uint64_t cb = sortcounts[*(const int*)b];
+  return (ca < cb) ? 1 : (ca > cb) ? -1 : 0;
+}
+
+/* PrintProfile() prints the counters of the profiler; the instructions are
+ * sorted on how often they ran
+ */
+static void PrintProfile(AMX *amx, const AMX_PROFILEDATA *profile)
+{
+  char name[sNAMEMAX + 1];
+  AMX names;
+  uint64_t total;
+  int *order;
+  int i;
+
+  printf("\nPublic functions     calls\n");
+  if (profile->maincalls != 0)
+    printf("  %-16s %8llu\n", "main", (unsigned long long)profile->maincalls);
+  for (i = 0; i < profile->numpublics; i++) {
+    if (profile->pubcalls[i] != 0 && amx_GetPublic(amx, i, name, NULL) == AMX_ERR_NONE)
+      printf("  %-16s %8llu\n", name, (unsigned long long)profile->pubcalls[i]);
+  } /* for */
+
+  printf("\nNative functions     calls        ticks   ticks/call\n");
+  if (LoadNames(&names) == AMX_ERR_NONE) {
+    for (i = 0; i < profile->numnatives; i++) {
+      if (profile->natcalls[i] == 0)
+        continue;
+      if (amx_GetNative(&names, i, name) != AMX_ERR_NONE)
+        sprintf(name, "#%d", i);
+      printf("  %-16s %8llu %12llu %12llu\n", name,
+             (unsigned long long)profile->natcalls[i],
+             (unsigned long long)profile->natticks[i],
+             (unsigned long long)(profile->natticks[i] / profile->natcalls[i]));
+    } /* for */
+    free(names.base);
+  } /* if */
+
+  printf("\nInstructions              count        %%\n");
+  if ((order = (int*)malloc(profile->numopcodes * sizeof(int))) == NULL)
+    return;
+  total = 0;
+  for (i = 0; i < profile->numopcodes; i++) {
+    order[i] = i;
+    total += profile->opcodes[i];
+  } /* for */
+  sortcounts = profile->opcodes;
+  qsort(order, profile->numopcodes, sizeof(int), CompareCounts);
+  for (i = 0; i < profile->numopcodes && profile->opcodes[order[i]] != 0; i++) {
+    const char *mnemonic;
+    amx_ProfileOpcode(order[i], &mnemonic);
+    printf("  %-20s %10llu %7.2f\n", mnemonic, (unsigned long long)profile->opcodes[order[i]],
+           100.0 * profile->opcodes[order[i]] / total);
+  } /* for */
+  printf("  %-20s %10llu\n", "total", (unsigned long long)total);
+  free(order);
+}
+#endif
+
 void PrintUsage(char *program)
 {
   printf("Usage: %s <filename> [options]\n\n"
          "Options:\n"
          "\t-stack\tto monitor stack usage\n"
-         "\t...\tother options are passed to the script\n"
          , program);
+  #if defined AMX_PROFILE
+    printf("\t-profile\tto count instructions and function calls\n");
+  #endif
+  #if defined AMXDBG
+    printf("\t-sample\tto write sampled call stacks to a .folded file\n");
+  #endif
+  #if defined AOT_SUPPORT
+    printf("\t-aot <library>\tto run the script as translated by amx2c\n");
+  #endif
+  printf("\t...\tother options are passed to the script\n");
   exit(1);
 }
 
@@ -316,6 +436,20 @@ int main(int argc,char *argv[])
   clock_t start = 0, end = 0;
   STACKINFO stackinfo = { 0 };
   AMX_IDLE idlefunc;
+  #if defined AMX_PROFILE
+    AMX_PROFILEDATA profile;
+    void *counters = NULL;
+  #endif
+  #if defined AMXDBG
+    AMX_SAMPLER *sampler = NULL;
+    AMX_DBG samplerdbg;
+    int hasdbg = 0;
+  #endif
+  #if defined AOT_SUPPORT && defined _Windows
+    HINSTANCE aotlib = NULL;
+  #elif defined AOT_SUPPORT
+    void *aotlib = NULL;
+  #endif
 
   if (argc < 2)
     PrintUsage(argv[0]);        /* function "usage" aborts the program */
@@ -379,6 +513,48 @@ int main(int argc,char *argv[])
       amx_SetDebugHook(&amx, prun_Monitor);
     } else if (strcmp(argv[i],"-time") == 0) {
       start=clock();
+    #if defined AMX_PROFILE
+    } else if (strcmp(argv[i],"-profile") == 0 && counters == NULL) {
+      size_t size;
+      amx_ProfileSize(&amx, &size);
+      if ((counters = malloc(size)) == NULL)
+        ExitOnError(&amx, AMX_ERR_MEMORY);
+      amx_ProfileInit(&amx, &profile, counters);
+    #endif
+    #if defined AMXDBG
+    } else if (strcmp(argv[i],"-sample") == 0 && sampler == NULL) {
+      /* the debug information is optional, without it the call stacks hold
+       * code addresses
+       */
+      FILE *fp;
+      if ((fp = fopen(g_filename,"rb")) != NULL) {
+        hasdbg = (dbg_LoadInfo(&samplerdbg,fp) == AMX_ERR_NONE);
+        fclose(fp);
+      } /* if */
+      if ((sampler = amx_SamplerCreate(&amx, hasdbg ? &samplerdbg : NULL, 1000)) == NULL)
+        ExitOnError(&amx, AMX_ERR_MEMORY);
+    #endif
+    #if defined AOT_SUPPORT
+    } else if (strcmp(argv[i],"-aot") == 0 && i + 1 < argc && aotlib == NULL) {
+      /* the library holds the translation of the script by amx2c, which
+       * must match the P-code (amx_InitAOT() verifies this)
+       */
+      const AMX_AOTINFO *info = NULL;
+      #if defined _Windows
+        if ((aotlib = LoadLibraryA(argv[++i])) != NULL)
+          info = (const AMX_AOTINFO *)GetProcAddress(aotlib, "amx_aotinfo");
+      #else
+        if ((aotlib = dlopen(argv[++i], RTLD_NOW)) != NULL)
+          info = (const AMX_AOTINFO *)dlsym(aotlib, "amx_aotinfo");
+      #endif
+      if (info == NULL) {
+        printf("Unable to load the translated script \"%s\"\n", argv[i]);
+        aux_FreeProgram(&amx);
+        exit(1);
+      } /* if */
+      err = amx_InitAOT(&amx, info);
+      ExitOnError(&amx, err);
+    #endif
     } /* if */
   } /* for */
 
@@ -429,10 +605,44 @@ int main(int argc,char *argv[])
   if (start!=0)
     end=clock();
 
+  #if defined AMX_PROFILE
+    if (counters != NULL) {
+      PrintProfile(&amx, &profile);
+      free(counters);
+    } /* if */
+  #endif
+  #if defined AMXDBG
+    if (sampler != NULL) {
+      char name[_MAX_PATH];
+      char *ext;
+      FILE *fp;
+      strcpy(name, g_filename);
+      if ((ext = strrchr(name, '.')) != NULL && strchr(ext, DIRSEP_CHAR) == NULL)
+        *ext = '\0';
+      strcat(name, ".folded");
+      if ((fp = fopen(name, "w")) != NULL) {
+        amx_SamplerWrite(sampler, fp);
+        fclose(fp);
+      } /* if */
+      amx_SamplerDelete(sampler);
+      if (hasdbg)
+        dbg_FreeInfo(&samplerdbg);
+    } /* if */
+  #endif
+
   /* Free the compiled script and resources. This also unloads and DLLs or
    * shared libraries that were registered automatically by amx_Init().
    */
   aux_FreeProgram(&amx);
+  #if defined AOT_SUPPORT
+    if (aotlib != NULL) {
+      #if defined _Windows
+        FreeLibrary(aotlib);
+      #else
+        dlclose(aotlib);
+      #endif
+    } /* if */
+  #endif
 
   /* Print the return code of the compiled script (often not very useful),
    * its run time, and its stack usage.
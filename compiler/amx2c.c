@@ -0,0 +1,1164 @@
+/* Pawn ahead-of-time translator - translates the P-code of a compiled script
+ * to a C source file
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+
+/* The host compiles the C file to a shared library (or links it into its
+ * executable), looks up the structure "amx_aotinfo" in it, and passes that
+ * structure to amx_InitAOT(). The translation includes "amx.h" (and
+ * "osdefs.h"), so it must be compiled with the same settings as the abstract
+ * machine; for example:
+ *
+ *      amx2c script.amx script.c
+ *      cc -O2 -shared -fPIC -I../amx -I../linux -o script.so script.c
+ *
+ * On Linux and the BSDs, "osdefs.h" includes "sclinux.h" from the directory
+ * "linux" of the source tree, hence the second include path.
+ *
+ * The translation has one C function per function in the P-code: a stretch of
+ * code that starts at a PROC instruction, at a public entry point or at the
+ * target of a CALL. The registers of the abstract machine are local variables
+ * of these functions. The local variables of the script stay on the stack of
+ * the abstract machine, because native functions get their addresses and
+ * because the abstract machine must be able to save its complete state when
+ * it goes to sleep.
+ *
+ * A CALL instruction calls the C function of its target directly, and the
+ * callee returns to it when its RET instruction returns to the address behind
+ * the CALL. Any other transfer of control (a RET to another address, a jump
+ * into another function, the restart after a sleep, or a call that is nested
+ * deeper than AOT_MAXDEPTH) returns to a dispatcher, which enters the function
+ * that holds the new address through a "switch" at the top of the function.
+ * So the C stack never holds more than AOT_MAXDEPTH frames, and after
+ * amx_Exec() returned with AMX_ERR_SLEEP, the next call continues where the
+ * abstract machine stopped, like it does in the interpreter.
+ *
+ * The translation does the same run-time checks as the interpreter, it keeps
+ * the instruction budget (see amx_SetFuel()), it calls the debug hook on BREAK
+ * instructions and it calls native functions through the native function
+ * table that amx_Register() filled in (or through the callback, when the host
+ * installed its own, see amx_SetCallback()). Overlays are not supported.
+ */
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined PAWN_CELL_SIZE
+  #define PAWN_CELL_SIZE 64 /* by default, maximum cell size = 64-bit */
+#endif
+#include "../amx/osdefs.h"
+#include "../amx/amx.h"
+
+#if !defined sizearray
+  #define sizearray(a)  (sizeof(a) / sizeof((a)[0]))
+#endif
+
+static AMX_HEADER amxhdr;
+static unsigned char *program;  /* the complete file */
+static unsigned char *code;     /* the code section in "program" */
+static cell codesize;
+static int pc_cellsize;
+static unsigned char *cflags;   /* per cell of the code, CF_xxx */
+static int usefuel;             /* code has calls or backward jumps */
+static cell *segment;           /* per cell of the code, start of the function */
+
+#define CF_INSTR    0x01        /* start of an instruction */
+#define CF_FUNC     0x02        /* start of a function */
+#define CF_ENTRY    0x04        /* the dispatcher can enter the function here */
+#define CF_LABEL    0x08        /* target of a jump inside the function */
+#define CF_CASETBL  0x10        /* case table (not an instruction) */
+
+#define CELLINDEX(addr) ((addr) / pc_cellsize)
+
+#define OP_PROC     30
+
+typedef cell (*OPCODE_SIZE)(cell cip);
+
+static cell parm0(cell cip);
+static cell parm1(cell cip);
+static cell parm2(cell cip);
+static cell parmx(cell cip);
+static cell parm1_p(cell cip);
+static cell parmx_p(cell cip);
+static cell casetbl(cell cip);
+
+/* The templates are C code, in which "%1" and "%2" are replaced by the first
+ * and second parameter of the instruction, and "%n" by the address of the next
+ * instruction. The macros in the templates are defined in the prologue of the
+ * translation (see below).
+ */
+enum {
+  OPK_PLAIN,            /* template */
+  OPK_RESUME,           /* template; the abstract machine may stop behind it */
+  OPK_PUSHM,            /* template for each of a variable number of parameters */
+  OPK_JUMP,             /* the template is the condition of the jump */
+  OPK_CALL,
+  OPK_SWITCH,
+  OPK_CASETBL,
+  OPK_LCTRL,
+  OPK_SCTRL,
+  OPK_INVALID,          /* not generated by the compiler, or for overlays */
+};
+
+typedef struct tagOPCODE {
+  cell opcode;
+  char *name;
+  OPCODE_SIZE size;
+  int kind;
+  char *code;
+} OPCODE;
+
+static OPCODE opcodelist[] = {
+  {  0, "nop",         parm0,   OPK_PLAIN,   "" },
+  {  1, "load.pri",    parm1,   OPK_PLAIN,   "pri=MEM(%1);" },
+  {  2, "load.alt",    parm1,   OPK_PLAIN,   "alt=MEM(%1);" },
+  {  3, "load.s.pri",  parm1,   OPK_PLAIN,   "pri=MEM(frm+%1);" },
+  {  4, "load.s.alt",  parm1,   OPK_PLAIN,   "alt=MEM(frm+%1);" },
+  {  5, "lref.s.pri",  parm1,   OPK_PLAIN,   "pri=MEM(MEM(frm+%1));" },
+  {  6, "lref.s.alt",  parm1,   OPK_PLAIN,   "alt=MEM(MEM(frm+%1));" },
+  {  7, "load.i",      parm0,   OPK_PLAIN,   "CHKADDR(pri); pri=MEM(pri);" },
+  {  8, "lodb.i",      parm1,   OPK_PLAIN,   "CHKADDR(pri); LODB(%1);" },
+  {  9, "const.pri",   parm1,   OPK_PLAIN,   "pri=%1;" },
+  { 10, "const.alt",   parm1,   OPK_PLAIN,   "alt=%1;" },
+  { 11, "addr.pri",    parm1,   OPK_PLAIN,   "pri=frm+%1;" },
+  { 12, "addr.alt",    parm1,   OPK_PLAIN,   "alt=frm+%1;" },
+  { 13, "stor",        parm1,   OPK_PLAIN,   "MEM(%1)=pri;" },
+  { 14, "stor.s",      parm1,   OPK_PLAIN,   "MEM(frm+%1)=pri;" },
+  { 15, "sref.s",      parm1,   OPK_PLAIN,   "MEM(MEM(frm+%1))=pri;" },
+  { 16, "stor.i",      parm0,   OPK_PLAIN,   "CHKADDR(alt); MEM(alt)=pri;" },
+  { 17, "strb.i",      parm1,   OPK_PLAIN,   "CHKADDR(alt); STRB(%1);" },
+  { 18, "align.pri",   parm1,   OPK_PLAIN,   "ALIGN(%1);" },
+  { 19, "lctrl",       parm1,   OPK_LCTRL,   NULL },
+  { 20, "sctrl",       parm1,   OPK_SCTRL,   NULL },
+  { 21, "xchg",        parm0,   OPK_PLAIN,   "{ cell t_=pri; pri=alt; alt=t_; }" },
+  { 22, "push.pri",    parm0,   OPK_PLAIN,   "PUSH(pri);" },
+  { 23, "push.alt",    parm0,   OPK_PLAIN,   "PUSH(alt);" },
+  { 24, "pushr.pri",   parm0,   OPK_PLAIN,   "PUSH((intptr_t)data+pri);" },
+  { 25, "pop.pri",     parm0,   OPK_PLAIN,   "POP(pri);" },
+  { 26, "pop.alt",     parm0,   OPK_PLAIN,   "POP(alt);" },
+  { 27, "pick",        parm1,   OPK_PLAIN,   "pri=MEM(stk+%1);" },
+  { 28, "stack",       parm1,   OPK_PLAIN,   "stk+=%1; alt=stk; CHKMARGIN(); CHKSTACK();" },
+  { 29, "heap",        parm1,   OPK_PLAIN,   "alt=hea; hea+=%1; CHKMARGIN(); CHKHEAP();" },
+  { 30, "proc",        parm0,   OPK_PLAIN,   "PUSH(frm); frm=stk; CHKMARGIN();" },
+  { 31, "ret",         parm0,   OPK_PLAIN,   "RET(0);" },
+  { 32, "retn",        parm0,   OPK_PLAIN,   "RET(1);" },
+  { 33, "call",        parm1,   OPK_CALL,    NULL },
+  { 34, "jump",        parm1,   OPK_JUMP,    NULL },
+  { 35, "jzer",        parm1,   OPK_JUMP,    "pri==0" },
+  { 36, "jnz",         parm1,   OPK_JUMP,    "pri!=0" },
+  { 37, "shl",         parm0,   OPK_PLAIN,   "pri<<=alt;" },
+  { 38, "shr",         parm0,   OPK_PLAIN,   "pri=(ucell)pri >> (int)alt;" },
+  { 39, "sshr",        parm0,   OPK_PLAIN,   "pri>>=alt;" },
+  { 40, "shl.c.pri",   parm1,   OPK_PLAIN,   "pri<<=%1;" },
+  { 41, "shl.c.alt",   parm1,   OPK_PLAIN,   "alt<<=%1;" },
+  { 42, "smul",        parm0,   OPK_PLAIN,   "pri*=alt;" },
+  { 43, "sdiv",        parm0,   OPK_PLAIN,   "SDIV(alt,pri);" },
+  { 44, "add",         parm0,   OPK_PLAIN,   "pri+=alt;" },
+  { 45, "sub",         parm0,   OPK_PLAIN,   "pri=alt-pri;" },
+  { 46, "and",         parm0,   OPK_PLAIN,   "pri&=alt;" },
+  { 47, "or",          parm0,   OPK_PLAIN,   "pri|=alt;" },
+  { 48, "xor",         parm0,   OPK_PLAIN,   "pri^=alt;" },
+  { 49, "not",         parm0,   OPK_PLAIN,   "pri=!pri;" },
+  { 50, "neg",         parm0,   OPK_PLAIN,   "pri=-pri;" },
+  { 51, "invert",      parm0,   OPK_PLAIN,   "pri=~pri;" },
+  { 52, "eq",          parm0,   OPK_PLAIN,   "pri=(pri==alt);" },
+  { 53, "neq",         parm0,   OPK_PLAIN,   "pri=(pri!=alt);" },
+  { 54, "sless",       parm0,   OPK_PLAIN,   "pri=(pri<alt);" },
+  { 55, "sleq",        parm0,   OPK_PLAIN,   "pri=(pri<=alt);" },
+  { 56, "sgrtr",       parm0,   OPK_PLAIN,   "pri=(pri>alt);" },
+  { 57, "sgeq",        parm0,   OPK_PLAIN,   "pri=(pri>=alt);" },
+  { 58, "inc.pri",     parm0,   OPK_PLAIN,   "pri++;" },
+  { 59, "inc.alt",     parm0,   OPK_PLAIN,   "alt++;" },
+  { 60, "inc.i",       parm0,   OPK_PLAIN,   "MEM(pri)+=1;" },
+  { 61, "dec.pri",     parm0,   OPK_PLAIN,   "pri--;" },
+  { 62, "dec.alt",     parm0,   OPK_PLAIN,   "alt--;" },
+  { 63, "dec.i",       parm0,   OPK_PLAIN,   "MEM(pri)-=1;" },
+  { 64, "movs",        parm1,   OPK_PLAIN,   "MOVS(%1);" },
+  { 65, "cmps",        parm1,   OPK_PLAIN,   "CMPS(%1);" },
+  { 66, "fill",        parm1,   OPK_PLAIN,   "FILL(%1);" },
+  { 67, "halt",        parm1,   OPK_RESUME,  "HALT(%1,%n);" },
+  { 68, "bounds",      parm1,   OPK_PLAIN,   "BOUNDS(%1,%n);" },
+  { 69, "sysreq",      parm1,   OPK_RESUME,  "SYSREQ(%1,%n);" },
+  { 70, "switch",      parm1,   OPK_SWITCH,  NULL },
+  { 71, "swap.pri",    parm0,   OPK_PLAIN,   "{ cell t_=MEM(stk); MEM(stk)=pri; pri=t_; }" },
+  { 72, "swap.alt",    parm0,   OPK_PLAIN,   "{ cell t_=MEM(stk); MEM(stk)=alt; alt=t_; }" },
+  { 73, "break",       parm0,   OPK_RESUME,  "BREAK(%n);" },
+  { 74, "casetbl",     casetbl, OPK_CASETBL, NULL },
+  { 75, "sysreq.d",    parm1,   OPK_INVALID, NULL }, /* not generated by the compiler */
+  { 76, "sysreq.nd",   parm2,   OPK_INVALID, NULL }, /* not generated by the compiler */
+  { 77, "call.ovl",    parm1,   OPK_INVALID, NULL },
+  { 78, "retn.ovl",    parm0,   OPK_INVALID, NULL },
+  { 79, "switch.ovl",  parm1,   OPK_INVALID, NULL },
+  { 80, "casetbl.ovl", casetbl, OPK_INVALID, NULL },
+  { 81, "lidx",        parm0,   OPK_PLAIN,   "{ cell a_=pri*sizeof(cell)+alt; CHKADDR(a_); pri=MEM(a_); }" },
+  { 82, "lidx.b",      parm1,   OPK_PLAIN,   "{ cell a_=(pri << %1)+alt; CHKADDR(a_); pri=MEM(a_); }" },
+  { 83, "idxaddr",     parm0,   OPK_PLAIN,   "pri=pri*sizeof(cell)+alt;" },
+  { 84, "idxaddr.b",   parm1,   OPK_PLAIN,   "pri=(pri << %1)+alt;" },
+  { 85, "push.c",      parm1,   OPK_PLAIN,   "PUSH(%1);" },
+  { 86, "push",        parm1,   OPK_PLAIN,   "PUSH(MEM(%1));" },
+  { 87, "push.s",      parm1,   OPK_PLAIN,   "PUSH(MEM(frm+%1));" },
+  { 88, "push.adr",    parm1,   OPK_PLAIN,   "PUSH(frm+%1);" },
+  { 89, "pushr.c",     parm1,   OPK_PLAIN,   "PUSH((intptr_t)data+%1);" },
+  { 90, "pushr.s",     parm1,   OPK_PLAIN,   "PUSH((intptr_t)data+MEM(frm+%1));" },
+  { 91, "pushr.adr",   parm1,   OPK_PLAIN,   "PUSH((intptr_t)data+frm+%1);" },
+  { 92, "jeq",         parm1,   OPK_JUMP,    "pri==alt" },
+  { 93, "jneq",        parm1,   OPK_JUMP,    "pri!=alt" },
+  { 94, "jsless",      parm1,   OPK_JUMP,    "pri<alt" },
+  { 95, "jsleq",       parm1,   OPK_JUMP,    "pri<=alt" },
+  { 96, "jsgrtr",      parm1,   OPK_JUMP,    "pri>alt" },
+  { 97, "jsgeq",       parm1,   OPK_JUMP,    "pri>=alt" },
+  { 98, "sdiv.inv",    parm0,   OPK_PLAIN,   "SDIV(pri,alt);" },
+  { 99, "sub.inv",     parm0,   OPK_PLAIN,   "pri-=alt;" },
+  {100, "add.c",       parm1,   OPK_PLAIN,   "pri+=%1;" },
+  {101, "smul.c",      parm1,   OPK_PLAIN,   "pri*=%1;" },
+  {102, "zero.pri",    parm0,   OPK_PLAIN,   "pri=0;" },
+  {103, "zero.alt",    parm0,   OPK_PLAIN,   "alt=0;" },
+  {104, "zero",        parm1,   OPK_PLAIN,   "MEM(%1)=0;" },
+  {105, "zero.s",      parm1,   OPK_PLAIN,   "MEM(frm+%1)=0;" },
+  {106, "eq.c.pri",    parm1,   OPK_PLAIN,   "pri=(pri==%1);" },
+  {107, "eq.c.alt",    parm1,   OPK_PLAIN,   "pri=(alt==%1);" },
+  {108, "inc",         parm1,   OPK_PLAIN,   "MEM(%1)+=1;" },
+  {109, "inc.s",       parm1,   OPK_PLAIN,   "MEM(frm+%1)+=1;" },
+  {110, "dec",         parm1,   OPK_PLAIN,   "MEM(%1)-=1;" },
+  {111, "dec.s",       parm1,   OPK_PLAIN,   "MEM(frm+%1)-=1;" },
+  {112, "sysreq.n",    parm2,   OPK_RESUME,  "SYSREQN(%1,%2,%n);" },
+  {113, "pushm.c",     parmx,   OPK_PUSHM,   "PUSH(%1);" },
+  {114, "pushm",       parmx,   OPK_PUSHM,   "PUSH(MEM(%1));" },
+  {115, "pushm.s",     parmx,   OPK_PUSHM,   "PUSH(MEM(frm+%1));" },
+  {116, "pushm.adr",   parmx,   OPK_PUSHM,   "PUSH(frm+%1);" },
+  {117, "pushrm.c",    parmx,   OPK_PUSHM,   "PUSH((intptr_t)data+%1);" },
+  {118, "pushrm.s",    parmx,   OPK_PUSHM,   "PUSH((intptr_t)data+MEM(frm+%1));" },
+  {119, "pushrm.adr",  parmx,   OPK_PUSHM,   "PUSH((intptr_t)data+frm+%1);" },
+  {120, "load2",       parm2,   OPK_PLAIN,   "pri=MEM(%1); alt=MEM(%2);" },
+  {121, "load2.s",     parm2,   OPK_PLAIN,   "pri=MEM(frm+%1); alt=MEM(frm+%2);" },
+  {122, "const",       parm2,   OPK_PLAIN,   "MEM(%1)=%2;" },
+  {123, "const.s",     parm2,   OPK_PLAIN,   "MEM(frm+%1)=%2;" },
+  {124, "load.p.pri",  parm1_p, OPK_PLAIN,   "pri=MEM(%1);" },
+  {125, "load.p.alt",  parm1_p, OPK_PLAIN,   "alt=MEM(%1);" },
+  {126, "load.p.s.pri",parm1_p, OPK_PLAIN,   "pri=MEM(frm+%1);" },
+  {127, "load.p.s.alt",parm1_p, OPK_PLAIN,   "alt=MEM(frm+%1);" },
+  {128, "lref.p.s.pri",parm1_p, OPK_PLAIN,   "pri=MEM(MEM(frm+%1));" },
+  {129, "lref.p.s.alt",parm1_p, OPK_PLAIN,   "alt=MEM(MEM(frm+%1));" },
+  {130, "lodb.p.i",    parm1_p, OPK_PLAIN,   "CHKADDR(pri); LODB(%1);" },
+  {131, "const.p.pri", parm1_p, OPK_PLAIN,   "pri=%1;" },
+  {132, "const.p.alt", parm1_p, OPK_PLAIN,   "alt=%1;" },
+  {133, "addr.p.pri",  parm1_p, OPK_PLAIN,   "pri=frm+%1;" },
+  {134, "addr.p.alt",  parm1_p, OPK_PLAIN,   "alt=frm+%1;" },
+  {135, "stor.p",      parm1_p, OPK_PLAIN,   "MEM(%1)=pri;" },
+  {136, "stor.p.s",    parm1_p, OPK_PLAIN,   "MEM(frm+%1)=pri;" },
+  {137, "sref.p.s",    parm1_p, OPK_PLAIN,   "MEM(MEM(frm+%1))=pri;" },
+  {138, "strb.p.i",    parm1_p, OPK_PLAIN,   "CHKADDR(alt); STRB(%1);" },
+  {139, "lidx.p.b",    parm1_p, OPK_PLAIN,   "{ cell a_=(pri << %1)+alt; CHKADDR(a_); pri=MEM(a_); }" },
+  {140, "idxaddr.p.b", parm1_p, OPK_PLAIN,   "pri=(pri << %1)+alt;" },
+  {141, "align.p.pri", parm1_p, OPK_PLAIN,   "ALIGN(%1);" },
+  {142, "push.p.c",    parm1_p, OPK_PLAIN,   "PUSH(%1);" },
+  {143, "push.p",      parm1_p, OPK_PLAIN,   "PUSH(MEM(%1));" },
+  {144, "push.p.s",    parm1_p, OPK_PLAIN,   "PUSH(MEM(frm+%1));" },
+  {145, "push.p.adr",  parm1_p, OPK_PLAIN,   "PUSH(frm+%1);" },
+  {146, "pushr.p.c",   parm1_p, OPK_PLAIN,   "PUSH((intptr_t)data+%1);" },
+  {147, "pushr.p.s",   parm1_p, OPK_PLAIN,   "PUSH((intptr_t)data+MEM(frm+%1));" },
+  {148, "pushr.p.adr", parm1_p, OPK_PLAIN,   "PUSH((intptr_t)data+frm+%1);" },
+  {149, "pushm.p.c",   parmx_p, OPK_PUSHM,   "PUSH(%1);" },
+  {150, "pushm.p",     parmx_p, OPK_PUSHM,   "PUSH(MEM(%1));" },
+  {151, "pushm.p.s",   parmx_p, OPK_PUSHM,   "PUSH(MEM(frm+%1));" },
+  {152, "pushm.p.adr", parmx_p, OPK_PUSHM,   "PUSH(frm+%1);" },
+  {153, "pushrm.p.c",  parmx_p, OPK_PUSHM,   "PUSH((intptr_t)data+%1);" },
+  {154, "pushrm.p.s",  parmx_p, OPK_PUSHM,   "PUSH((intptr_t)data+MEM(frm+%1));" },
+  {155, "pushrm.p.adr",parmx_p, OPK_PUSHM,   "PUSH((intptr_t)data+frm+%1);" },
+  {156, "stack.p",     parm1_p, OPK_PLAIN,   "stk+=%1; alt=stk; CHKMARGIN(); CHKSTACK();" },
+  {157, "heap.p",      parm1_p, OPK_PLAIN,   "alt=hea; hea+=%1; CHKMARGIN(); CHKHEAP();" },
+  {158, "shl.p.c.pri", parm1_p, OPK_PLAIN,   "pri<<=%1;" },
+  {159, "shl.p.c.alt", parm1_p, OPK_PLAIN,   "alt<<=%1;" },
+  {160, "add.p.c",     parm1_p, OPK_PLAIN,   "pri+=%1;" },
+  {161, "smul.p.c",    parm1_p, OPK_PLAIN,   "pri*=%1;" },
+  {162, "zero.p",      parm1_p, OPK_PLAIN,   "MEM(%1)=0;" },
+  {163, "zero.p.s",    parm1_p, OPK_PLAIN,   "MEM(frm+%1)=0;" },
+  {164, "eq.p.c.pri",  parm1_p, OPK_PLAIN,   "pri=(pri==%1);" },
+  {165, "eq.p.c.alt",  parm1_p, OPK_PLAIN,   "pri=(alt==%1);" },
+  {166, "inc.p",       parm1_p, OPK_PLAIN,   "MEM(%1)+=1;" },
+  {167, "inc.p.s",     parm1_p, OPK_PLAIN,   "MEM(frm+%1)+=1;" },
+  {168, "dec.p",       parm1_p, OPK_PLAIN,   "MEM(%1)-=1;" },
+  {169, "dec.p.s",     parm1_p, OPK_PLAIN,   "MEM(frm+%1)-=1;" },
+  {170, "movs.p",      parm1_p, OPK_PLAIN,   "MOVS(%1);" },
+  {171, "cmps.p",      parm1_p, OPK_PLAIN,   "CMPS(%1);" },
+  {172, "fill.p",      parm1_p, OPK_PLAIN,   "FILL(%1);" },
+  {173, "halt.p",      parm1_p, OPK_RESUME,  "HALT(%1,%n);" },
+  {174, "bounds.p",    parm1_p, OPK_PLAIN,   "BOUNDS(%1,%n);" },
+};
+
+/* The prologue of the translation: the state that the functions share with
+ * the dispatcher, and the macros for the templates. The macros mirror the
+ * instructions in the ANSI C core in AMX.C.
+ */
+static const char *prologue[] = {
+  "#if !defined PAWN_CELL_SIZE",
+  "  #define PAWN_CELL_SIZE AOT_CELLBITS",
+  "#endif",
+  "#include <limits.h>",
+  "#include <string.h>",
+  "#include \"osdefs.h\"",
+  "#include \"amx.h\"",
+  "",
+  "#if PAWN_CELL_SIZE!=AOT_CELLBITS",
+  "  #error This translation requires a different cell size (PAWN_CELL_SIZE)",
+  "#endif",
+  "",
+  "#define AOT_MAXDEPTH  256  /* maximum depth of nested calls on the C stack */",
+  "",
+  "/* return codes of the functions, next to the AMX_ERR_xxx codes */",
+  "#define AOT_RET       (-1) /* RET to s->cip */",
+  "#define AOT_NEXT      (-2) /* continue at s->cip */",
+  "#define AOT_HALT      (-3) /* HALT with code s->code, at s->cip */",
+  "",
+  "typedef struct tagAOT_STATE {",
+  "  AMX *amx;",
+  "  unsigned char *data;",
+  "  cell pri, alt, frm, stk, hea;",
+  "  cell cip, code;",
+  "  int depth;",
+  "  const AMX_FUNCSTUB *natives;",
+  "} AOT_STATE;",
+  "",
+  "typedef int (*AOT_FUNC)(AOT_STATE *s);",
+  "",
+  "#define AOT_REGS      AMX *amx=s->amx; unsigned char *data=s->data; \\",
+  "                      cell pri=s->pri, alt=s->alt, frm=s->frm, stk=s->stk, hea=s->hea; \\",
+  "                      const cell stp=amx->stp; \\",
+  "                      (void)data; (void)pri; (void)alt; (void)stp",
+  "#define SPILL()       ( s->pri=pri, s->alt=alt, s->frm=frm, s->stk=stk, s->hea=hea )",
+  "#define RELOAD()      ( pri=s->pri, alt=s->alt, frm=s->frm, stk=s->stk, hea=s->hea )",
+  "",
+  "#define MEM(a)        (*(cell *)(data+(int)(a)))",
+  "#define MEM8(a)       (*(unsigned char *)(data+(int)(a)))",
+  "#define MEM16(a)      (*(uint16_t *)(data+(int)(a)))",
+  "#define MEM32(a)      (*(uint32_t *)(data+(int)(a)))",
+  "#define PUSH(v)       ( stk-=sizeof(cell), MEM(stk)=(cell)(v) )",
+  "#define POP(v)        ( v=MEM(stk), stk+=sizeof(cell) )",
+  "#define IABS(a)       ((a)>=0 ? (a) : (-a))",
+  "",
+  "#define CHKADDR(a)    if ((a)>=hea && (a)<stk || (ucell)(a)>=(ucell)stp) return AMX_ERR_MEMACCESS",
+  "#define CHKEND(a)     if ((a)>hea && (a)<stk || (ucell)(a)>(ucell)stp) return AMX_ERR_MEMACCESS",
+  "#define CHKMARGIN()   if (hea+STKMARGIN+amx->stkreserve>stk && aot_stackout(amx,hea,stk)) \\",
+  "                        return AMX_ERR_STACKERR",
+  "#define CHKSTACK()    if (stk>stp) return AMX_ERR_STACKLOW",
+  "#define CHKHEAP()     if (hea<amx->hlw) return AMX_ERR_HEAPLOW",
+  "#define STKMARGIN     ((cell)(16*sizeof(cell)))",
+  "",
+  "#define JUMPOUT(addr) { s->cip=(addr); SPILL(); return AOT_NEXT; }",
+  "#define FUEL(addr)    if (--amx->fuel<0 && aot_fuelout(amx,(addr),frm)) \\",
+  "                        { s->code=AMX_ERR_FUEL; s->cip=(addr); SPILL(); return AOT_HALT; }",
+  "#define CALL(func,addr,next) \\",
+  "  do { int r_; \\",
+  "    s->cip=(addr); SPILL(); \\",
+  "    if (s->depth>=AOT_MAXDEPTH) return AOT_NEXT; \\",
+  "    s->depth++; r_=func(s); s->depth--; \\",
+  "    if (r_!=AOT_RET || s->cip!=(next)) return r_; \\",
+  "    RELOAD(); \\",
+  "  } while (0)",
+  "#define RET(n) \\",
+  "  do { cell r_; POP(frm); POP(r_); \\",
+  "    if ((ucell)r_>=(ucell)CODESIZE) return AMX_ERR_MEMACCESS; \\",
+  "    if (n) stk+=MEM(stk)+sizeof(cell); \\",
+  "    s->cip=r_; SPILL(); return AOT_RET; \\",
+  "  } while (0)",
+  "#define HALT(err,next) \\",
+  "  { s->code=(err); s->cip=(next); SPILL(); return AOT_HALT; }",
+  "#define BOUNDS(max,next) \\",
+  "  if ((ucell)pri>(ucell)(max)) { amx->cip=(next); return AMX_ERR_BOUNDS; }",
+  "/* a native function is called directly through the native function table,",
+  "   * which amx_Register() filled in, when amx_Exec() passes that table; that is",
+  "   * when the abstract machine has the default callback (see amx_Callback())",
+  "   */",
+  "#define NATIVE(index) ((const AMX_FUNCSTUB *)((const unsigned char *)s->natives+(index)*DEFSIZE))",
+  "#if defined _I64_MAX || defined __x86_64__ || defined HAVE_I64",
+  "  #define NATIVEADDR(index) \\",
+  "    ((AMX_NATIVE)((intptr_t)NATIVE(index)->address | (intptr_t)((uint64_t)NATIVE(index)->nameofs<<32)))",
+  "#else",
+  "  #define NATIVEADDR(index) ((AMX_NATIVE)(intptr_t)NATIVE(index)->address)",
+  "#endif",
+  "#define NATIVECALL(index,result,params) \\",
+  "  ( (s->natives!=NULL && (index)>=0) \\",
+  "    ? (amx->error=AMX_ERR_NONE, *(result)=NATIVEADDR(index)(amx,(params)), amx->error) \\",
+  "    : amx->callback(amx,(index),(result),(params)) )",
+  "#define SYSREQ(index,next) \\",
+  "  do { int e_; \\",
+  "    amx->cip=(next); amx->hea=hea; amx->frm=frm; amx->stk=stk; \\",
+  "    e_=NATIVECALL((index),&pri,(cell *)(data+(int)stk)); \\",
+  "    if (e_!=AMX_ERR_NONE) { \\",
+  "      if (e_==AMX_ERR_SLEEP) { amx->pri=pri; amx->alt=alt; } \\",
+  "      return e_; \\",
+  "    } \\",
+  "  } while (0)",
+  "#define SYSREQN(index,size,next) \\",
+  "  do { int e_; \\",
+  "    PUSH(size); \\",
+  "    amx->cip=(next); amx->hea=hea; amx->frm=frm; amx->stk=stk; \\",
+  "    e_=NATIVECALL((index),&pri,(cell *)(data+(int)stk)); \\",
+  "    stk+=(size)+sizeof(cell); \\",
+  "    if (e_!=AMX_ERR_NONE) { \\",
+  "      if (e_==AMX_ERR_SLEEP) { amx->pri=pri; amx->alt=alt; amx->stk=stk; } \\",
+  "      return e_; \\",
+  "    } \\",
+  "  } while (0)",
+  "#define BREAK(next) \\",
+  "  if (amx->debug!=NULL) { int e_; \\",
+  "    amx->frm=frm; amx->stk=stk; amx->hea=hea; amx->cip=(next); \\",
+  "    if ((e_=amx->debug(amx))!=AMX_ERR_NONE) { \\",
+  "      if (e_==AMX_ERR_SLEEP) { amx->pri=pri; amx->alt=alt; } \\",
+  "      return e_; \\",
+  "    } \\",
+  "  }",
+  "",
+  "#define LODB(n) \\",
+  "  switch (n) { case 1: pri=MEM8(pri); break; case 2: pri=MEM16(pri); break; case 4: pri=MEM32(pri); break; }",
+  "#define STRB(n) \\",
+  "  switch (n) { case 1: MEM8(alt)=(unsigned char)pri; break; case 2: MEM16(alt)=(uint16_t)pri; break; \\",
+  "               case 4: MEM32(alt)=(uint32_t)pri; break; }",
+  "#if BYTE_ORDER==LITTLE_ENDIAN",
+  "  #define ALIGN(n)    if ((size_t)(n)<sizeof(cell)) pri^=sizeof(cell)-(n)",
+  "#else",
+  "  #define ALIGN(n)",
+  "#endif",
+  "/* floored division, the quotient goes to pri and the remainder to alt */",
+  "#define SDIV(dividend,divisor) \\",
+  "  do { cell n_=(dividend), d_=(divisor), q_, r_; \\",
+  "    if (d_==0) return AMX_ERR_DIVIDE; \\",
+  "    q_=IABS(n_)/IABS(d_); \\",
+  "    if ((cell)(n_ ^ d_)<0) q_=-q_; \\",
+  "    r_=n_-q_*d_; \\",
+  "    if (r_!=0 && (cell)(r_ ^ d_)<0) { q_--; r_+=d_; } \\",
+  "    pri=q_; alt=r_; \\",
+  "  } while (0)",
+  "#define MOVS(n) \\",
+  "  do { CHKADDR(pri); CHKEND(pri+(n)); CHKADDR(alt); CHKEND(alt+(n)); \\",
+  "    memmove(data+(int)alt,data+(int)pri,(size_t)(n)); } while (0)",
+  "#define CMPS(n) \\",
+  "  do { CHKADDR(pri); CHKEND(pri+(n)); CHKADDR(alt); CHKEND(alt+(n)); \\",
+  "    pri=memcmp(data+(int)alt,data+(int)pri,(size_t)(n)); } while (0)",
+  "#define FILL(n) \\",
+  "  do { cell *p_; size_t k_; \\",
+  "    CHKADDR(alt); CHKEND(alt+(n)); \\",
+  "    p_=(cell *)(data+(int)alt); \\",
+  "    for (k_=0; k_<(size_t)(n)/sizeof(cell); k_++) p_[k_]=pri; \\",
+  "  } while (0)",
+  "",
+  "/* see stackout() in AMX.C */",
+  "static int aot_stackout(AMX *amx,cell hea,cell stk)",
+  "{",
+  "  if (amx->stkreserve==0 || amx->stackhook==NULL)",
+  "    return 1;",
+  "  amx->hea=hea;",
+  "  amx->stk=stk;",
+  "  if (amx->stackhook(amx)!=AMX_ERR_NONE)",
+  "    return 1;",
+  "  return hea+STKMARGIN+amx->stkreserve>stk;",
+  "}",
+  "",
+  NULL
+};
+
+/* only for scripts with calls or backward jumps */
+static const char *fuelout[] = {
+  "/* see fuelout() in AMX.C */",
+  "static int aot_fuelout(AMX *amx,cell cip,cell frm)",
+  "{",
+  "  if (amx->fuelmode==AMX_FUEL_NONE) {",
+  "    amx->fuel=LONG_MAX;",
+  "    return 0;",
+  "  }",
+  "  if (amx->fuelmode==AMX_FUEL_HOOK) {",
+  "    amx->fuel=LONG_MAX;",
+  "    amx->cip=cip;",
+  "    amx->frm=frm;",
+  "    if (amx->fuelhook==NULL || amx->fuelhook(amx)==AMX_ERR_NONE)",
+  "      return 0;",
+  "  }",
+  "  amx->fuel=0;",
+  "  return 1;",
+  "}",
+  "",
+  NULL
+};
+
+/* The epilogue: the dispatcher, the run function (see amx_exec_run() and the
+ * HALT instruction in AMX.C) and the structure for amx_InitAOT().
+ */
+static const char *epilogue[] = {
+  "static int aot_dispatch(AOT_STATE *s)",
+  "{",
+  "  int low,high,mid,r;",
+  "",
+  "  do {",
+  "    if ((ucell)s->cip>=(ucell)CODESIZE)",
+  "      return AMX_ERR_MEMACCESS;",
+  "    low=0;",
+  "    high=(int)(sizeof aot_functions / sizeof aot_functions[0])-1;",
+  "    while (low<high) {",
+  "      mid=(low+high+1)/2;",
+  "      if (aot_functions[mid].address<=s->cip)",
+  "        low=mid;",
+  "      else",
+  "        high=mid-1;",
+  "    }",
+  "    s->depth=0;",
+  "    r=aot_functions[low].func(s);",
+  "  } while (r==AOT_RET || r==AOT_NEXT);",
+  "  return r;",
+  "}",
+  "",
+  "static int AMXAPI aot_run(AMX *amx, cell *retval, unsigned char *data, const AMX_FUNCSTUB *natives)",
+  "{",
+  "  AMX_BATCH *batch;",
+  "  AOT_STATE state;",
+  "  int r;",
+  "",
+  "  state.amx=amx;",
+  "  state.data=data;",
+  "  state.pri=amx->pri;",
+  "  state.alt=amx->alt;",
+  "  state.frm=amx->frm;",
+  "  state.stk=amx->stk;",
+  "  state.hea=amx->hea;",
+  "  state.cip=amx->cip;",
+  "  state.natives=natives;",
+  "  batch=amx->batch;",
+  "  amx->batch=NULL;  /* a native function that calls amx_Exec() runs no batch */",
+  "  for ( ;; ) {",
+  "    if ((r=aot_dispatch(&state))!=AOT_HALT)",
+  "      return r;",
+  "    if (retval!=NULL)",
+  "      *retval=state.pri;",
+  "    if (state.code==AMX_ERR_NONE && batch!=NULL) {",
+  "      /* start the next call of amx_ExecBatch() */",
+  "      if (batch->results!=NULL)",
+  "        batch->results[batch->done]=state.pri;",
+  "      if (++batch->done<batch->count) {",
+  "        state.stk=batch->stk-batch->nargs*sizeof(cell);",
+  "        state.hea=batch->hea;",
+  "        if (batch->nargs>0)",
+  "          memcpy(data+(int)state.stk,batch->args+(size_t)batch->done*batch->nargs,batch->nargs*sizeof(cell));",
+  "        state.stk-=sizeof(cell);",
+  "        *(cell *)(data+(int)state.stk)=batch->nargs*sizeof(cell);",
+  "        state.stk-=sizeof(cell);",
+  "        *(cell *)(data+(int)state.stk)=0;",
+  "        state.cip=batch->cip;",
+  "        continue;",
+  "      }",
+  "    }",
+  "    amx->frm=state.frm;",
+  "    amx->pri=state.pri;",
+  "    amx->alt=state.alt;",
+  "    amx->cip=state.cip;",
+  "    if (state.code==AMX_ERR_SLEEP || (state.code==AMX_ERR_FUEL && amx->fuelmode==AMX_FUEL_SUSPEND)) {",
+  "      amx->stk=state.stk;",
+  "      amx->hea=state.hea;",
+  "    }",
+  "    return (int)state.code;",
+  "  }",
+  "}",
+  "",
+  NULL
+};
+
+
+static cell get_cell(cell addr)
+{
+  const unsigned char *ptr=code+addr;
+  switch (pc_cellsize) {
+  case 2:
+    return (cell)*(int16_t*)ptr;
+  case 4:
+    return (cell)*(int32_t*)ptr;
+  case 8:
+    return (cell)*(int64_t*)ptr;
+  default:
+    assert(0);
+  } /* switch */
+  return 0;
+}
+
+static int get_opcode(cell addr)
+{
+  ucell opc=(ucell)get_cell(addr);
+  switch (pc_cellsize) {
+  case 2:
+    opc&=0xff;
+    break;
+  case 4:
+    opc&=0xffff;
+    break;
+  case 8:
+    opc&=0xffffffffLU;
+    break;
+  default:
+    assert(0);
+  } /* switch */
+  return (opc<sizearray(opcodelist)) ? (int)opc : -1;
+}
+
+/* the parameter of a packed opcode is in the upper half of the opcode cell */
+static cell get_packed(cell addr)
+{
+  return get_cell(addr) >> (pc_cellsize*4);
+}
+
+static cell parm0(cell cip)
+{
+  (void)cip;
+  return 1;
+}
+
+static cell parm1(cell cip)
+{
+  (void)cip;
+  return 2;
+}
+
+static cell parm2(cell cip)
+{
+  (void)cip;
+  return 3;
+}
+
+static cell parmx(cell cip)
+{
+  return get_cell(cip+pc_cellsize)+2;
+}
+
+static cell parm1_p(cell cip)
+{
+  (void)cip;
+  return 1;
+}
+
+static cell parmx_p(cell cip)
+{
+  return get_packed(cip)+1;
+}
+
+static cell casetbl(cell cip)
+{
+  cell num=get_cell(cip+pc_cellsize);
+  /* a table that does not fit in the code is invalid (size 0), and checking
+   * it here keeps the size from overflowing
+   */
+  if (num<0 || num>=codesize/(2*pc_cellsize))
+    return 0;
+  return 2*(num+1)+1;
+}
+
+/* the target of a jump is relative to the instruction; the targets in a case
+ * table are relative to the cells that hold them
+ */
+static cell jumptarget(cell cip)
+{
+  return get_cell(cip+pc_cellsize)+cip;
+}
+
+static cell casetarget(cell tbl, int index)
+{
+  return get_cell(tbl+(index+1)*pc_cellsize)+tbl+index*pc_cellsize;
+}
+
+static int isinstr(cell addr)
+{
+  return addr>=0 && addr<codesize && addr%pc_cellsize==0
+         && (cflags[CELLINDEX(addr)] & (CF_INSTR | CF_CASETBL))==CF_INSTR;
+}
+
+static int error(const char *message,cell cip)
+{
+  if (cip>=0)
+    printf("%s at address %08lx\n",message,(long)cip);
+  else
+    printf("%s\n",message);
+  return 0;
+}
+
+static int scan(void)
+{
+  cell cip,size,target=0;
+  int op,idx,count,hassctrl6=0;
+
+  /* find the instructions (and the case tables) */
+  for (cip=0; cip<codesize; cip+=size*pc_cellsize) {
+    if ((op=get_opcode(cip))<0 || opcodelist[op].kind==OPK_INVALID)
+      return error("Unsupported instruction",cip);
+    assert(opcodelist[op].opcode==op);
+    size=opcodelist[op].size(cip);
+    if (size<1 || cip+size*pc_cellsize>codesize)
+      return error("Invalid instruction",cip);
+    cflags[CELLINDEX(cip)]|=(opcodelist[op].kind==OPK_CASETBL) ? (CF_INSTR | CF_CASETBL) : CF_INSTR;
+    if (opcodelist[op].kind==OPK_SCTRL && get_cell(cip+pc_cellsize)==6)
+      hassctrl6=1;
+  } /* for */
+
+  /* find the start of each function: the entry points and the targets of the
+   * CALL instructions; all code in front of the first one is a function too
+   */
+  cflags[0]|=CF_FUNC;
+  if (amxhdr.cip>=0) {
+    if (!isinstr(amxhdr.cip))
+      return error("Invalid entry point",amxhdr.cip);
+    cflags[CELLINDEX(amxhdr.cip)]|=CF_FUNC;
+  } /* if */
+  count=(amxhdr.natives-amxhdr.publics)/sizeof(AMX_FUNCSTUB);
+  for (idx=0; idx<count; idx++) {
+    AMX_FUNCSTUB *func=(AMX_FUNCSTUB*)(program+amxhdr.publics)+idx;
+    if (!isinstr((cell)func->address))
+      return error("Invalid entry point",(cell)func->address);
+    cflags[CELLINDEX(func->address)]|=CF_FUNC;
+  } /* for */
+  for (cip=0; cip<codesize; cip+=pc_cellsize) {
+    if ((cflags[CELLINDEX(cip)] & (CF_INSTR | CF_CASETBL))!=CF_INSTR)
+      continue;
+    op=get_opcode(cip);
+    if (op==OP_PROC) {
+      cflags[CELLINDEX(cip)]|=CF_FUNC;
+    } else if (opcodelist[op].kind==OPK_CALL) {
+      target=jumptarget(cip);
+      if (!isinstr(target))
+        return error("Invalid call target",cip);
+      cflags[CELLINDEX(target)]|=CF_FUNC;
+    } /* if */
+  } /* for */
+  for (cip=0; cip<codesize; cip+=pc_cellsize) {
+    if ((cflags[CELLINDEX(cip)] & CF_FUNC)!=0)
+      target=cip;
+    segment[CELLINDEX(cip)]=target;
+  } /* for */
+
+  /* find the labels and the entries of the functions */
+  for (cip=0; cip<codesize; cip+=pc_cellsize) {
+    unsigned char *flag=&cflags[CELLINDEX(cip)];
+    if ((*flag & (CF_INSTR | CF_CASETBL))!=CF_INSTR)
+      continue;
+    if ((*flag & CF_FUNC)!=0 || hassctrl6)
+      *flag|=CF_ENTRY;
+    op=get_opcode(cip);
+    size=opcodelist[op].size(cip);
+    switch (opcodelist[op].kind) {
+    case OPK_RESUME:
+      /* the abstract machine continues behind the instruction after a sleep */
+      if (cip+size*pc_cellsize<codesize)
+        cflags[CELLINDEX(cip+size*pc_cellsize)]|=CF_ENTRY;
+      break;
+    case OPK_CALL:
+      /* the return address, and the CALL itself (it restarts when it used up
+       * the instruction budget)
+       */
+      *flag|=CF_ENTRY;
+      if (cip+size*pc_cellsize<codesize)
+        cflags[CELLINDEX(cip+size*pc_cellsize)]|=CF_ENTRY;
+      usefuel=1;
+      break;
+    case OPK_JUMP:
+      target=jumptarget(cip);
+      if (!isinstr(target))
+        return error("Invalid jump target",cip);
+      if (target<=cip) {
+        *flag|=CF_ENTRY;    /* a backward jump uses the budget */
+        usefuel=1;
+      } /* if */
+      cflags[CELLINDEX(target)]|=(segment[CELLINDEX(target)]==segment[CELLINDEX(cip)]) ? CF_LABEL : CF_ENTRY;
+      break;
+    case OPK_SWITCH: {
+      cell tbl=jumptarget(cip);
+      if (tbl<0 || tbl>=codesize || (cflags[CELLINDEX(tbl)] & CF_CASETBL)==0)
+        return error("Invalid case table",cip);
+      count=(int)get_cell(tbl+pc_cellsize);
+      for (idx=0; idx<=count; idx++) {
+        target=casetarget(tbl,2*idx+1);
+        if (!isinstr(target))
+          return error("Invalid case table",tbl);
+        cflags[CELLINDEX(target)]|=(segment[CELLINDEX(target)]==segment[CELLINDEX(cip)]) ? CF_LABEL : CF_ENTRY;
+      } /* for */
+      break;
+    } /* case */
+    } /* switch */
+  } /* for */
+  return 1;
+}
+
+static void print_cell(FILE *fp,cell value)
+{
+  if (value>=0 && value<=INT32_MAX)
+    fprintf(fp,"%ld",(long)value);
+  else if (value<0 && value>-INT32_MAX)
+    fprintf(fp,"(%ld)",(long)value);
+  else if (value==INT64_MIN)
+    fprintf(fp,"((cell)(-9223372036854775807LL-1))");
+  else
+    fprintf(fp,"((cell)%" PRId64 "LL)",(int64_t)value);
+}
+
+static void print_template(FILE *fp,const char *template,const cell *params,cell next)
+{
+  for ( ; *template!='\0'; template++) {
+    if (*template!='%') {
+      fputc(*template,fp);
+      continue;
+    } /* if */
+    switch (*++template) {
+    case '1':
+      print_cell(fp,params[0]);
+      break;
+    case '2':
+      print_cell(fp,params[1]);
+      break;
+    case 'n':
+      fprintf(fp,"0x%lx",(long)next);
+      break;
+    default:
+      assert(0);
+    } /* switch */
+  } /* for */
+}
+
+/* a jump to "target", from the function that starts at "func" */
+static void print_jump(FILE *fp,cell func,cell target)
+{
+  if (segment[CELLINDEX(target)]==func)
+    fprintf(fp,"goto L%lx;",(long)target);
+  else
+    fprintf(fp,"JUMPOUT(0x%lx);",(long)target);
+}
+
+static const char *publicname(cell address)
+{
+  int idx,count;
+
+  count=(amxhdr.natives-amxhdr.publics)/sizeof(AMX_FUNCSTUB);
+  for (idx=0; idx<count; idx++) {
+    AMX_FUNCSTUB *func=(AMX_FUNCSTUB*)(program+amxhdr.publics)+idx;
+    if ((cell)func->address==address && func->nameofs<(uint32_t)amxhdr.size)
+      return (const char *)program+func->nameofs;
+  } /* for */
+  return NULL;
+}
+
+static void write_function(FILE *fp,cell func)
+{
+  cell cip,next,size,target;
+  cell params[2];
+  const char *name;
+  int op,idx,count;
+
+  if ((name=publicname(func))!=NULL)
+    fprintf(fp,"/* %s */\n",name);
+  fprintf(fp,"static int f%lx(AOT_STATE *s)\n{\n  AOT_REGS;\n\n",(long)func);
+
+  /* the entries */
+  fprintf(fp,"  switch (s->cip) {\n");
+  for (cip=func; cip<codesize && segment[CELLINDEX(cip)]==func; cip+=pc_cellsize)
+    if ((cflags[CELLINDEX(cip)] & CF_ENTRY)!=0)
+      fprintf(fp,"  case 0x%lx: goto L%lx;\n",(long)cip,(long)cip);
+  fprintf(fp,"  default:  return AMX_ERR_INVINSTR;\n  }\n\n");
+
+  for (cip=func; cip<codesize && segment[CELLINDEX(cip)]==func; cip=next) {
+    assert((cflags[CELLINDEX(cip)] & CF_INSTR)!=0);
+    op=get_opcode(cip);
+    size=opcodelist[op].size(cip);
+    next=cip+size*pc_cellsize;
+    if (opcodelist[op].kind==OPK_CASETBL)
+      continue;
+    if ((cflags[CELLINDEX(cip)] & (CF_ENTRY | CF_LABEL))!=0)
+      fprintf(fp,"L%lx:\n",(long)cip);
+    fprintf(fp,"  /* %08lx  %s */\n  ",(long)cip,opcodelist[op].name);
+    if (opcodelist[op].size==parm1_p) {
+      params[0]=get_packed(cip);
+    } else {
+      params[0]=(size>1) ? get_cell(cip+pc_cellsize) : 0;
+      params[1]=(size>2) ? get_cell(cip+2*pc_cellsize) : 0;
+    } /* if */
+    switch (opcodelist[op].kind) {
+    case OPK_PLAIN:
+    case OPK_RESUME:
+      print_template(fp,opcodelist[op].code,params,next);
+      break;
+    case OPK_PUSHM:
+      /* pushm.xxx has the count as the first parameter, pushm.p.xxx in the
+       * opcode
+       */
+      idx=(opcodelist[op].size==parmx) ? 1 : 0;
+      count=(int)(size-1-idx);
+      for ( ; count>0; count--, idx++) {
+        params[0]=get_cell(cip+(idx+1)*pc_cellsize);
+        print_template(fp,opcodelist[op].code,params,next);
+        if (count>1)
+          fprintf(fp," ");
+      } /* for */
+      break;
+    case OPK_JUMP:
+      target=jumptarget(cip);
+      if (opcodelist[op].code!=NULL)
+        fprintf(fp,"if (%s) { ",opcodelist[op].code);
+      if (target<=cip)
+        fprintf(fp,"FUEL(0x%lx); ",(long)cip);
+      print_jump(fp,func,target);
+      if (opcodelist[op].code!=NULL)
+        fprintf(fp," }");
+      break;
+    case OPK_CALL:
+      target=jumptarget(cip);
+      fprintf(fp,"FUEL(0x%lx); PUSH(0x%lx); CALL(f%lx,0x%lx,0x%lx);",
+              (long)cip,(long)next,(long)target,(long)target,(long)next);
+      break;
+    case OPK_SWITCH: {
+      cell tbl=jumptarget(cip);
+      count=(int)get_cell(tbl+pc_cellsize);
+      fprintf(fp,"switch (pri) {\n");
+      for (idx=1; idx<=count; idx++) {
+        fprintf(fp,"  case ");
+        print_cell(fp,get_cell(tbl+2*idx*pc_cellsize));
+        fprintf(fp,": ");
+        print_jump(fp,func,casetarget(tbl,2*idx+1));
+        fprintf(fp,"\n");
+      } /* for */
+      fprintf(fp,"  default: ");
+      print_jump(fp,func,casetarget(tbl,1));
+      fprintf(fp,"\n  }");
+      break;
+    } /* case */
+    case OPK_LCTRL:
+      switch ((int)params[0]) {
+      case 0:
+        fprintf(fp,"pri=%ld;",(long)amxhdr.cod);
+        break;
+      case 1:
+        fprintf(fp,"pri=%ld;",(long)amxhdr.dat);
+        break;
+      case 2:
+        fprintf(fp,"pri=hea;");
+        break;
+      case 3:
+        fprintf(fp,"pri=stp;");
+        break;
+      case 4:
+        fprintf(fp,"pri=stk;");
+        break;
+      case 5:
+        fprintf(fp,"pri=frm;");
+        break;
+      case 6:
+        fprintf(fp,"pri=0x%lx;",(long)next);
+        break;
+      } /* switch */
+      break;
+    case OPK_SCTRL:
+      switch ((int)params[0]) {
+      case 2:
+        fprintf(fp,"hea=pri;");
+        break;
+      case 4:
+        fprintf(fp,"stk=pri;");
+        break;
+      case 5:
+        fprintf(fp,"frm=pri;");
+        break;
+      case 6:
+        fprintf(fp,"JUMPOUT(pri);");
+        break;
+      } /* switch */
+      break;
+    default:
+      assert(0);
+    } /* switch */
+    fprintf(fp,"\n");
+  } /* for */
+
+  /* the code may run on into the next function */
+  if (cip<codesize)
+    fprintf(fp,"  JUMPOUT(0x%lx);\n}\n\n",(long)cip);
+  else
+    fprintf(fp,"  return AMX_ERR_MEMACCESS;\n}\n\n");
+}
+
+static void write_translation(FILE *fp,const char *source)
+{
+  uint32_t hash=2166136261u;    /* FNV-1a, see amx_InitAOT() */
+  cell cip;
+  int idx;
+
+  for (cip=0; cip<codesize; cip++)
+    hash=(hash ^ code[cip]) * 16777619u;
+
+  fprintf(fp,"/* Translation of \"%s\" by amx2c, see amx_InitAOT() */\n",source);
+  fprintf(fp,"#define AOT_CELLBITS  %d\n",8*pc_cellsize);
+  fprintf(fp,"#define CODESIZE      0x%lx\n",(long)codesize);
+  fprintf(fp,"#define DEFSIZE       %d\n",(int)amxhdr.defsize);
+  for (idx=0; prologue[idx]!=NULL; idx++)
+    fprintf(fp,"%s\n",prologue[idx]);
+  for (idx=0; usefuel && fuelout[idx]!=NULL; idx++)
+    fprintf(fp,"%s\n",fuelout[idx]);
+
+  for (cip=0; cip<codesize; cip+=pc_cellsize)
+    if ((cflags[CELLINDEX(cip)] & CF_FUNC)!=0)
+      fprintf(fp,"static int f%lx(AOT_STATE *s);\n",(long)cip);
+  fprintf(fp,"\n");
+  for (cip=0; cip<codesize; cip+=pc_cellsize)
+    if ((cflags[CELLINDEX(cip)] & CF_FUNC)!=0)
+      write_function(fp,cip);
+
+  fprintf(fp,"static const struct {\n  cell address;\n  AOT_FUNC func;\n} aot_functions[] = {\n");
+  for (cip=0; cip<codesize; cip+=pc_cellsize)
+    if ((cflags[CELLINDEX(cip)] & CF_FUNC)!=0)
+      fprintf(fp,"  { 0x%lx, f%lx },\n",(long)cip,(long)cip);
+  fprintf(fp,"};\n\n");
+
+  for (idx=0; epilogue[idx]!=NULL; idx++)
+    fprintf(fp,"%s\n",epilogue[idx]);
+  fprintf(fp,"#if defined _Windows || defined __WIN32__ || defined _WIN32\n"
+             "  __declspec(dllexport)\n"
+             "#endif\n");
+  fprintf(fp,"const AMX_AOTINFO amx_aotinfo = {\n"
+             "  AMX_AOT_VERSION, %d, (int)sizeof(AMX),\n"
+             "  %ld, %ld, %ld, %ld,\n"
+             "  0x%08lxu,\n"
+             "  aot_run\n"
+             "};\n",
+          pc_cellsize,(long)amxhdr.cod,(long)amxhdr.dat,(long)amxhdr.hea,(long)amxhdr.stp,
+          (unsigned long)hash);
+}
+
+#if defined _MSC_VER || defined __GNUC__ || defined __clang__
+/* Copy src to string dst of size siz.
+ * At most siz-1 characters * will be copied. Always NUL terminates (unless siz == 0).
+ * Returns strlen(src); if retval >= siz, truncation occurred                        .
+ *                                                                                   .
+ *  Copyright (c) 1998 Todd C. Miller <Todd.Miller@courtesan.com>, MIT license.                                                                                  .
+ */
+size_t strlcpy(char *dst, const char *src, size_t siz)
+{
+	char *d = dst;
+	const char *s = src;
+	size_t n = siz;
+
+	/* Copy as many bytes as will fit */
+	if (n != 0) {
+		while (--n != 0) {
+			if ((*d++ = *s++) == '\0')
+				break;
+		}
+	}
+
+	/* Not enough room in dst, add NUL and traverse rest of src */
+	if (n == 0) {
+		if (siz != 0)
+			*d = '\0';		/* NUL-terminate dst */
+		while (*s++)
+			;
+	}
+
+	return(s - src - 1);	/* count does not include NUL */
+}
+#endif
+
+int main(int argc,char *argv[])
+{
+  char name[_MAX_PATH];
+  FILE *fpamx,*fpc;
+  int result;
+
+  if (argc<2 || argc>3) {
+    printf("Usage: amx2c <input> [output]\n");
+    return 1;
+  } /* if */
+  if (argc==2) {
+    char *ptr;
+    strlcpy(name,argv[1],sizearray(name));
+    if ((ptr=strrchr(name,'.'))!=NULL && strpbrk(ptr,"\\/:")==NULL)
+      *ptr='\0';          /* erase existing extension */
+    strcat(name,".c");    /* append new extension */
+  } else {
+    strlcpy(name,argv[2],sizearray(name));
+  } /* if */
+  if ((fpamx=fopen(argv[1],"rb"))==NULL) {
+    printf("Unable to open input file \"%s\"\n",argv[1]);
+    return 1;
+  } /* if */
+
+  /* load header */
+  if (fread(&amxhdr,sizeof amxhdr,1,fpamx)!=1) {
+    printf("Not a valid AMX file\n");
+    fclose(fpamx);
+    return 1;
+  } /* if */
+  if (amxhdr.magic==AMX_MAGIC_16) {
+    pc_cellsize=2;
+  } else if (amxhdr.magic==AMX_MAGIC_32) {
+    pc_cellsize=4;
+  } else if (amxhdr.magic==AMX_MAGIC_64) {
+    pc_cellsize=8;
+  } else {
+    printf("Not a valid AMX file\n");
+    fclose(fpamx);
+    return 1;
+  } /* if */
+  if (amxhdr.flags & AMX_FLAG_CRYPT) {
+    printf("This is an encrypted script. Encrypted scripts cannot be translated.\n");
+    fclose(fpamx);
+    return 1;
+  } /* if */
+  if ((amxhdr.flags & AMX_FLAG_OVERLAY)!=0) {
+    printf("This script uses overlays. Overlays cannot be translated.\n");
+    fclose(fpamx);
+    return 1;
+  } /* if */
+
+  /* read the file */
+  codesize=amxhdr.dat-amxhdr.cod;
+  program=(unsigned char*)malloc(amxhdr.size);
+  cflags=(unsigned char*)calloc((size_t)CELLINDEX(codesize)+1,1);
+  segment=(cell*)calloc((size_t)CELLINDEX(codesize)+1,sizeof(cell));
+  if (program==NULL || cflags==NULL || segment==NULL) {
+    printf("Insufficient memory\n");
+    fclose(fpamx);
+    return 1;
+  } /* if */
+  rewind(fpamx);
+  if (fread(program,1,amxhdr.size,fpamx)!=(size_t)amxhdr.size || codesize<=0
+      || amxhdr.cod<(int32_t)sizeof amxhdr || amxhdr.dat>amxhdr.size
+      || amxhdr.natives<amxhdr.publics || amxhdr.natives>amxhdr.cod)
+  {
+    printf("Not a valid AMX file\n");
+    fclose(fpamx);
+    return 1;
+  } /* if */
+  fclose(fpamx);
+  code=program+amxhdr.cod;
+
+  result=0;
+  if (scan()) {
+    if ((fpc=fopen(name,"wt"))==NULL) {
+      printf("Unable to create output file \"%s\"\n",name);
+      result=1;
+    } else {
+      write_translation(fpc,argv[1]);
+      fclose(fpc);
+    } /* if */
+  } else {
+    result=1;
+  } /* if */
+
+  free(program);
+  free(cflags);
+  free(segment);
+  return result;
+}
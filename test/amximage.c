@@ -0,0 +1,67 @@
+/*  Test for the ready-to-run images of aux_MapImage()
+ *
+ *  The program loads a script with aux_MapImage(), which either takes the
+ *  code from the image (and amx_Init() does not verify it again), or loads
+ *  the script and writes the image. It prints where the code came from and
+ *  the return value of main(). The test "ready_images" (amximage.cmake) runs
+ *  two builds of this program, with a different configuration of the abstract
+ *  machine, on the same image: each build must reject the image of the other.
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "osdefs.h"
+#include "amx.h"
+#include "amxaux.h"
+
+int main(int argc, char *argv[])
+{
+  AMX amx;
+  cell ret;
+  uint32_t buildid;
+  int err;
+
+  if (argc != 3) {
+    printf("Usage: amximage <filename> <imagename>\n"
+           "<filename> is a compiled script that uses no native functions\n");
+    return 2;
+  } /* if */
+  if (amx_BuildID(&buildid) != AMX_ERR_NONE) {
+    printf("This build of the abstract machine cannot use images\n");
+    return 1;
+  } /* if */
+
+  err = aux_MapImage(&amx, argv[1], argv[2], AMX_FLAG_FUSE | AMX_FLAG_PROVE);
+  if (err != AMX_ERR_NONE) {
+    printf("%s: error %d \"%s\"\n", argv[1], err, aux_StrError(err));
+    return 1;
+  } /* if */
+  /* amx_Init() keeps AMX_FLAG_VERIFIED only if it used the code of the image */
+  printf("build %08lx, code from the %s\n", (unsigned long)buildid,
+         (amx.flags & AMX_FLAG_VERIFIED) != 0 ? "image" : "program");
+
+  ret = 0;
+  err = amx_Exec(&amx, &ret, AMX_EXEC_MAIN);
+  aux_UnmapProgram(&amx);
+  if (err != AMX_ERR_NONE) {
+    printf("%s: run-time error %d \"%s\"\n", argv[1], err, aux_StrError(err));
+    return 1;
+  } /* if */
+  printf("main() returns %ld\n", (long)ret);
+  return 0;
+}
@@ -0,0 +1,38 @@
+# Runs two builds of amximage (see amximage.c) on the same ready-to-run image:
+# a build must use its own image, but reject the image that the other build
+# saved. Run it with "cmake -P"; ctest passes these variables:
+#   DEFAULT   amximage, built with the default configuration
+#   OTHER     amximage, built with another configuration (AMX_NO_FUSED_OPC)
+#   PROGRAM   the compiled script
+#   WORKDIR   the directory for the image
+
+FILE(MAKE_DIRECTORY "${WORKDIR}")
+SET(image "${WORKDIR}/amximage.amxr")
+FILE(REMOVE "${image}")
+
+# each step: the build to run and where the code must come from
+SET(steps DEFAULT:program DEFAULT:image OTHER:program OTHER:image DEFAULT:program)
+FOREACH(step ${steps})
+  STRING(REPLACE ":" ";" step "${step}")
+  LIST(GET step 0 build)
+  LIST(GET step 1 source)
+  EXECUTE_PROCESS(COMMAND "${${build}}" "${PROGRAM}" "${image}"
+                  RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+  IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "${${build}} failed (${result}):\n${output}")
+  ENDIF()
+  IF(NOT output MATCHES "code from the ${source}\n")
+    MESSAGE(FATAL_ERROR "${build} build, expected the code from the ${source}:\n${output}")
+  ENDIF()
+  STRING(REGEX MATCH "build [0-9a-f]+" id "${output}")
+  SET(id_${build} "${id}")
+  STRING(REGEX MATCH "main\\(\\) returns [-0-9]+" ret "${output}")
+  IF(DEFINED expected AND NOT ret STREQUAL expected)
+    MESSAGE(FATAL_ERROR "${build} build, expected \"${expected}\":\n${output}")
+  ENDIF()
+  SET(expected "${ret}")
+ENDFOREACH(step)
+
+IF(id_DEFAULT STREQUAL id_OTHER)
+  MESSAGE(FATAL_ERROR "Both configurations have the same identifier (${id_DEFAULT})")
+ENDIF()
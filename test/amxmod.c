@@ -0,0 +1,155 @@
+/*  Test for the registry of extension modules in amx_Init()
+ *
+ *  Several threads each load, run and free the same compiled script many
+ *  times over. The script only uses native functions of the extension modules
+ *  amxFloat and amxTime (set AMXLIB to the directory with these), so every
+ *  amx_Init() looks the modules up in the registry, or loads them on the
+ *  first use, and registers their native functions. The return value of
+ *  main() must be the same on every run, and at the end, the modules must
+ *  still be loaded, because the registry keeps them until the process exits.
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "osdefs.h"
+#include "amx.h"
+#include "amxaux.h"
+
+typedef struct tagTHREADINFO {
+  pthread_t thread;
+  int id;
+  long errors;
+  long runs;
+} THREADINFO;
+
+static const char *filename;
+static int iterations = 100;
+static cell expected;
+
+static int RunProgram(cell *ret)
+{
+  AMX amx;
+  int err;
+
+  /* aux_LoadProgram() calls amx_Init(), which loads the modules, and
+   * aux_FreeProgram() calls amx_Cleanup()
+   */
+  err = aux_LoadProgram(&amx, filename, NULL);
+  if (err != AMX_ERR_NONE)
+    return err;
+  *ret = 0;
+  err = amx_Exec(&amx, ret, AMX_EXEC_MAIN);
+  aux_FreeProgram(&amx);
+  return err;
+}
+
+static void *RunThread(void *arg)
+{
+  THREADINFO *info = (THREADINFO*)arg;
+  cell ret;
+  int i, err;
+
+  for (i = 0; i < iterations; i++) {
+    err = RunProgram(&ret);
+    info->runs++;
+    if (err != AMX_ERR_NONE) {
+      printf("Thread %d, run %d: error %d \"%s\"\n", info->id, i, err, aux_StrError(err));
+      info->errors++;
+    } else if (ret != expected) {
+      printf("Thread %d, run %d: main() returns %ld, expected %ld\n",
+             info->id, i, (long)ret, (long)expected);
+      info->errors++;
+    } /* if */
+  } /* for */
+  return NULL;
+}
+
+/* IsLoaded() checks whether a module is in memory, without loading it */
+static int IsLoaded(const char *name)
+{
+  char libname[_MAX_PATH];
+  const char *root = getenv("AMXLIB");
+  void *handle;
+
+  snprintf(libname, sizeof libname, "%s/amx%s.so", (root != NULL) ? root : ".", name);
+  if ((handle = dlopen(libname, RTLD_NOW | RTLD_NOLOAD)) == NULL)
+    return 0;
+  dlclose(handle);
+  return 1;
+}
+
+static void usage(void)
+{
+  printf("Usage: amxmod <filename> [threads [iterations]]\n"
+         "<filename> is a compiled script that uses the Float and Time modules.\n");
+  exit(2);
+}
+
+int main(int argc,char *argv[])
+{
+  THREADINFO *threads;
+  int numthreads = 4;
+  long runs = 0, errors = 0;
+  int i, err;
+
+  if (argc < 2 || argc > 4)
+    usage();
+  filename = argv[1];
+  if (argc > 2)
+    numthreads = atoi(argv[2]);
+  if (argc > 3)
+    iterations = atoi(argv[3]);
+  if (numthreads <= 0 || iterations <= 0)
+    usage();
+
+  /* a single-threaded run gives the reference value */
+  if ((err = RunProgram(&expected)) != AMX_ERR_NONE) {
+    printf("%s: error %d \"%s\"\n", filename, err, aux_StrError(err));
+    return 1;
+  } /* if */
+
+  threads = (THREADINFO*)calloc(numthreads, sizeof(THREADINFO));
+  if (threads == NULL)
+    return 1;
+  for (i = 0; i < numthreads; i++) {
+    threads[i].id = i;
+    if (pthread_create(&threads[i].thread, NULL, RunThread, &threads[i]) != 0) {
+      printf("Failed to start thread %d\n", i);
+      numthreads = i;
+      errors++;
+      break;
+    } /* if */
+  } /* for */
+  for (i = 0; i < numthreads; i++) {
+    pthread_join(threads[i].thread, NULL);
+    runs += threads[i].runs;
+    errors += threads[i].errors;
+  } /* for */
+  free(threads);
+
+  if (!IsLoaded("Float") || !IsLoaded("Time")) {
+    printf("The modules were unloaded\n");
+    errors++;
+  } /* if */
+
+  printf("%s: %d threads, %ld runs, %ld errors\n", filename, numthreads, runs, errors);
+  return (errors == 0) ? 0 : 1;
+}
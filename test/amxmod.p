@@ -0,0 +1,16 @@
+/* Script for the test of the module registry (amxmod.c)
+ *
+ * The native functions of main() are only in the extension modules amxFloat
+ * and amxTime, which the abstract machine loads itself; the host registers
+ * nothing.
+ */
+#include <float>
+#include <time>
+
+main()
+    {
+    new Float: f = float(7) * 1.5
+    new year, month, day
+    getdate(year, month, day)
+    return floatround(f) * 1000 + _:(year > 2000 && month >= 1 && day >= 1)
+    }
@@ -0,0 +1,290 @@
+/*  Multi-threaded stress test for the Pawn Abstract Machine
+ *
+ *  Every thread loads its own set of abstract machines from the same compiled
+ *  script and runs function main() on each of them a number of times. The
+ *  return value of main() must be the same on every run; any difference (or
+ *  any run time error) points at state that is shared between abstract
+ *  machines where it should not be. The script (amxmt.p) uses the core,
+ *  console, string, datagram and process modules; after every run, each
+ *  thread also passes the abstract machine through its own garbage collector
+ *  (amxgc.c) and keeps a stamp of the run in its own memory pool (amxpool.c).
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "osdefs.h"
+#include "amx.h"
+#include "amxaux.h"
+#include "amxgc.h"
+#include "amxpool.h"
+
+extern int AMXAPI amx_ConsoleInit(AMX *amx);
+extern int AMXAPI amx_ConsoleCleanup(AMX *amx);
+extern int AMXAPI amx_CoreInit(AMX *amx);
+extern int AMXAPI amx_CoreCleanup(AMX *amx);
+extern int AMXAPI amx_DGramInit(AMX *amx);
+extern int AMXAPI amx_DGramCleanup(AMX *amx);
+extern int AMXAPI amx_ProcessInit(AMX *amx);
+extern int AMXAPI amx_ProcessCleanup(AMX *amx);
+extern int AMXAPI amx_StringInit(AMX *amx);
+extern int AMXAPI amx_StringCleanup(AMX *amx);
+
+#define POOLSIZE  768   /* holds three stamps, so that blocks are evicted */
+#define STAMPSIZE 200
+
+typedef struct tagTHREADINFO {
+  pthread_t thread;
+  int id;
+  long errors;
+  long runs;
+} THREADINFO;
+
+typedef struct tagSTAMP {
+  int thread;
+  int instance;
+  cell ret;
+} STAMP;
+
+static const char *filename;
+static int instances = 4;
+static int iterations = 100;
+static cell expected;
+
+/* the callback of the garbage collector has no context, so it counts in a
+ * variable per thread
+ */
+static __thread long gcfreed;
+
+static void gcfree(cell value)
+{
+  (void)value;
+  gcfreed++;
+}
+
+static int InitProgram(AMX *amx, int instance)
+{
+  cell *addr;
+  int err;
+
+  err = aux_LoadProgram(amx, filename, NULL);
+  if (err != AMX_ERR_NONE)
+    return err;
+  /* each module reports AMX_ERR_NOTFOUND as long as the natives of other
+   * modules are still missing; only check the full set at the end; the core
+   * module is initialized twice, which must count the abstract machine only
+   * once for the property list
+   */
+  amx_CoreInit(amx);
+  amx_CoreInit(amx);
+  amx_ConsoleInit(amx);
+  amx_StringInit(amx);
+  amx_DGramInit(amx);
+  amx_ProcessInit(amx);
+  if ((err = amx_Register(amx, NULL, 0)) != AMX_ERR_NONE)
+    return err;
+  if ((err = amx_FindPubVar(amx, "instance", &addr)) != AMX_ERR_NONE)
+    return err;
+  *addr = instance;
+  return AMX_ERR_NONE;
+}
+
+static void FreeProgram(AMX *amx)
+{
+  amx_ProcessCleanup(amx);
+  amx_DGramCleanup(amx);
+  amx_StringCleanup(amx);
+  amx_ConsoleCleanup(amx);
+  amx_CoreCleanup(amx);
+  aux_FreeProgram(amx);
+}
+
+/* CheckGC() stores an object in the abstract machine, and marks that object
+ * and one that is not referenced; a scan must release only the latter. When
+ * the abstract machine drops the reference, the next scan releases the first
+ * object as well.
+ */
+static int CheckGC(GCINFO *gc, AMX *amx, cell object)
+{
+  cell *addr;
+  long freed;
+
+  if (amx_FindPubVar(amx, "handle", &addr) != AMX_ERR_NONE)
+    return 0;
+  *addr = object;
+  freed = gcfreed;
+  if (gc_mark(gc, object) != GC_ERR_NONE || gc_mark(gc, ~object) != GC_ERR_NONE)
+    return 0;
+  gc_scan(gc, amx);
+  gc_clean(gc);
+  if (gcfreed != freed + 1)
+    return 0;
+  *addr = 0;
+  gc_scan(gc, amx);
+  gc_clean(gc);
+  return gcfreed == freed + 2;
+}
+
+/* CheckPool() looks up the stamp of the previous run of an abstract machine
+ * in the pool; the stamp may have been evicted, but if it is there, it must
+ * be intact
+ */
+static int CheckPool(void *pool, int thread, int instance, cell ret)
+{
+  STAMP *stamp;
+
+  if ((stamp = (STAMP*)amx_poolfind(pool, instance)) != NULL) {
+    if (stamp->thread != thread || stamp->instance != instance || stamp->ret != ret)
+      return 0;
+  } else {
+    if ((stamp = (STAMP*)amx_poolalloc(pool, STAMPSIZE, instance)) == NULL)
+      return 0;
+    stamp->thread = thread;
+    stamp->instance = instance;
+    stamp->ret = ret;
+  } /* if */
+  return 1;
+}
+
+static void *RunThread(void *arg)
+{
+  THREADINFO *info = (THREADINFO*)arg;
+  AMX *amx;
+  GCINFO gc;
+  cell pool[POOLSIZE / sizeof(cell)];
+  cell ret;
+  int count, i, j, err;
+
+  memset(&gc, 0, sizeof gc);
+  gc_setcallback(&gc, gcfree);
+  if (gc_settable(&gc, 7, GC_AUTOGROW) != GC_ERR_NONE) {
+    info->errors++;
+    return NULL;
+  } /* if */
+  amx_poolinit(pool, sizeof pool);
+
+  amx = (AMX*)calloc(instances, sizeof(AMX));
+  if (amx == NULL) {
+    info->errors++;
+    return NULL;
+  } /* if */
+
+  for (count = 0; count < instances; count++) {
+    err = InitProgram(&amx[count], info->id * instances + count + 1);
+    if (err != AMX_ERR_NONE) {
+      printf("Thread %d, instance %d: error %d on load \"%s\"\n",
+             info->id, count, err, aux_StrError(err));
+      info->errors++;
+      break;
+    } /* if */
+  } /* for */
+
+  /* interleave the abstract machines, so that state that leaks from one
+   * abstract machine into another shows up in the return value
+   */
+  for (j = 0; j < iterations; j++) {
+    for (i = 0; i < count; i++) {
+      ret = 0;
+      err = amx_Exec(&amx[i], &ret, AMX_EXEC_MAIN);
+      info->runs++;
+      if (err != AMX_ERR_NONE) {
+        printf("Thread %d, instance %d: run time error %d \"%s\"\n",
+               info->id, i, err, aux_StrError(err));
+        info->errors++;
+      } else if (ret != expected) {
+        printf("Thread %d, instance %d: main() returns %ld, expected %ld\n",
+               info->id, i, (long)ret, (long)expected);
+        info->errors++;
+      } else if (!CheckGC(&gc, &amx[i], (cell)((info->id << 20) | (i << 12) | (j & 0x0fff) | 0x40000000))) {
+        printf("Thread %d, instance %d: garbage collector mismatch\n", info->id, i);
+        info->errors++;
+      } else if (!CheckPool(pool, info->id, i, ret)) {
+        printf("Thread %d, instance %d: memory pool mismatch\n", info->id, i);
+        info->errors++;
+      } /* if */
+    } /* for */
+  } /* for */
+
+  for (i = 0; i < count; i++)
+    FreeProgram(&amx[i]);
+  free(amx);
+  gc_settable(&gc, 0, 0);
+  return NULL;
+}
+
+static void usage(void)
+{
+  printf("Usage: amxmt <filename> [threads [instances [iterations]]]\n"
+         "<filename> is a compiled script; main() must return the same value on every run.\n");
+  exit(2);
+}
+
+int main(int argc,char *argv[])
+{
+  AMX amx;
+  THREADINFO *threads;
+  int numthreads = 4;
+  long runs = 0, errors = 0;
+  int i, err;
+
+  if (argc < 2 || argc > 5)
+    usage();
+  filename = argv[1];
+  if (argc > 2)
+    numthreads = atoi(argv[2]);
+  if (argc > 3)
+    instances = atoi(argv[3]);
+  if (argc > 4)
+    iterations = atoi(argv[4]);
+  if (numthreads <= 0 || instances <= 0 || iterations <= 0)
+    usage();
+
+  /* a single-threaded run gives the reference value */
+  memset(&amx, 0, sizeof amx);
+  err = InitProgram(&amx, 0);
+  if (err == AMX_ERR_NONE)
+    err = amx_Exec(&amx, &expected, AMX_EXEC_MAIN);
+  if (err != AMX_ERR_NONE) {
+    printf("%s: error %d \"%s\"\n", filename, err, aux_StrError(err));
+    return 1;
+  } /* if */
+  FreeProgram(&amx);
+
+  threads = (THREADINFO*)calloc(numthreads, sizeof(THREADINFO));
+  if (threads == NULL)
+    return 1;
+  for (i = 0; i < numthreads; i++) {
+    threads[i].id = i;
+    if (pthread_create(&threads[i].thread, NULL, RunThread, &threads[i]) != 0) {
+      printf("Failed to start thread %d\n", i);
+      numthreads = i;
+      errors++;
+      break;
+    } /* if */
+  } /* for */
+  for (i = 0; i < numthreads; i++) {
+    pthread_join(threads[i].thread, NULL);
+    runs += threads[i].runs;
+    errors += threads[i].errors;
+  } /* for */
+  free(threads);
+
+  printf("\n%s: %d threads, %ld runs, %ld errors\n", filename, numthreads, runs, errors);
+  return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+/* Script for the multi-threaded stress test (amxmt.c)
+ *
+ * Function main() calls into the core, console, string, datagram and process
+ * modules. It must return the same value on every run, in every abstract
+ * machine; the host checks this.
+ */
+#include <core>
+#include <console>
+#include <datagram>
+#include <process>
+#include <string>
+
+/* the host sets these before every run */
+public instance = 0     /* a number that is unique for the abstract machine */
+public handle = 0       /* an object of the garbage collector in the host */
+#pragma unused handle
+
+main()
+    {
+    new result = 0
+
+    /* the property list is shared by all abstract machines, every abstract
+     * machine uses its own id
+     */
+    setproperty(instance, "mt", instance * 3)
+    result += getproperty(instance, "mt") - instance * 3
+    result += existproperty(instance, "mt")
+    deleteproperty(instance, "mt")
+    result += existproperty(instance, "mt")
+
+    /* string functions */
+    new buffer[40]
+    strformat(buffer, _, true, "%d:%s", 1234, "pawn")
+    result += strlen(buffer) + strval(buffer)
+    result += clamp(strfind(buffer, "pawn"), 0, 10)
+
+    /* console attributes; these are shared by all threads */
+    setattr(7, 0, 0)
+
+    /* a datagram to a (most likely) closed port on the local host */
+    result += sendstring("mt", "127.0.0.1:9") ? 100 : 200
+
+    /* read the output of a child process through the pipes of this abstract
+     * machine
+     */
+    new PID: pid = procexec("echo 4321")
+    if (pid)
+        {
+        new line[20]
+        procread(line, .striplf = true, .packed = false)
+        result += strval(line)
+        procwait(pid)
+        }
+
+    return result
+    }
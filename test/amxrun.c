@@ -0,0 +1,242 @@
+/*  Test run-time for the Pawn Abstract Machine
+ *
+ *  This program runs function main() of a compiled script in the interpreter,
+ *  in the JIT compiler (option -jit) or in a translation by amx2c (option
+ *  -aot). It prints the output of the script, the return value and the error
+ *  code with the address that the abstract machine reports, so that the
+ *  output of the run-times can be compared (see difftest.cmake). Option -d
+ *  installs a debug hook that counts the BREAK instructions, option -fuel
+ *  runs the script in time slices of the given number of calls and backward
+ *  jumps, and option -stack starts the script with a small limit on its stack
+ *  and heap, which a stack hook raises as the script needs more.
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "osdefs.h"
+#include "amx.h"
+#if defined __LINUX__ || defined __FreeBSD__ || defined __OpenBSD__ || defined __APPLE__
+  #include <dlfcn.h>
+  #include <sys/mman.h>
+  #define AOT_SUPPORT
+#endif
+
+extern int AMXAPI amx_ConsoleInit(AMX *amx);
+extern int AMXAPI amx_CoreInit(AMX *amx);
+extern int AMXAPI amx_FixedInit(AMX *amx);
+extern int AMXAPI amx_FloatInit(AMX *amx);
+extern int AMXAPI amx_StringInit(AMX *amx);
+
+static long breaks;
+static long stackstep, stackgrows;
+
+static int AMXAPI counthook(AMX *amx)
+{
+  (void)amx;
+  breaks++;
+  return AMX_ERR_NONE;
+}
+
+/* stackhook() raises the limit on the stack and heap to what the script uses
+ * now (a single instruction may take a large block) plus one step
+ */
+static int AMXAPI stackhook(AMX *amx)
+{
+  long used=(long)(amx->stp-amx->stk)+(long)(amx->hea-amx->hlw);
+
+  stackgrows++;
+  return amx_SetStackLimit(amx,used+stackstep);
+}
+
+static void *loadfile(const char *filename)
+{
+  AMX_HEADER hdr;
+  FILE *fp;
+  void *program;
+
+  if ((fp=fopen(filename,"rb"))==NULL)
+    return NULL;
+  program=NULL;
+  if (fread(&hdr,sizeof hdr,1,fp)==1) {
+    amx_Align16(&hdr.magic);
+    amx_Align32((uint32_t *)&hdr.size);
+    amx_Align32((uint32_t *)&hdr.stp);
+    if (hdr.magic==AMX_MAGIC && (program=malloc((size_t)hdr.stp))!=NULL) {
+      rewind(fp);
+      if (fread(program,1,(size_t)hdr.size,fp)!=(size_t)hdr.size) {
+        free(program);
+        program=NULL;
+      } /* if */
+    } /* if */
+  } /* if */
+  fclose(fp);
+  return program;
+}
+
+#if defined AMX_JIT
+/* initjit() compiles the P-code into executable memory, the compiled image
+ * replaces the P-code (see prun_jit.c)
+ */
+static int initjit(AMX *amx,void **image)
+{
+  void *ncode,*reloc;
+  int err;
+
+  *image=NULL;
+  if ((ncode=malloc((size_t)amx->codesize))==NULL)
+    return AMX_ERR_MEMORY;
+  reloc=(amx->reloc_size>0) ? malloc((size_t)amx->reloc_size) : NULL;
+  err=amx_InitJIT(amx,reloc,ncode);
+  free(reloc);
+  if (err==AMX_ERR_NONE) {
+    *image=mmap(NULL,(size_t)amx->codesize,PROT_READ|PROT_WRITE|PROT_EXEC,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if (*image==MAP_FAILED) {
+      *image=NULL;
+      err=AMX_ERR_MEMORY;
+    } else {
+      memcpy(*image,ncode,(size_t)amx->codesize);
+      amx->base=(unsigned char *)*image;
+    } /* if */
+  } /* if */
+  free(ncode);
+  return err;
+}
+#endif
+
+static void usage(void)
+{
+  printf("Usage: amxrun [options] <filename>\n"
+         "Options:\n"
+         "\t-d\t\tcount the BREAK instructions in a debug hook\n"
+         "\t-fuel <n>\trun the script in time slices\n"
+         "\t-stack <n>\tgrow the stack and heap in steps of n bytes\n"
+         #if defined AMX_JIT
+           "\t-jit\t\trun the script in the JIT compiler\n"
+         #endif
+         #if defined AOT_SUPPORT
+           "\t-aot <library>\trun the translation of the script by amx2c\n"
+         #endif
+         );
+  exit(2);
+}
+
+int main(int argc,char *argv[])
+{
+  AMX amx;
+  void *program,*image;
+  const char *filename,*aotname;
+  long fuel;
+  int jit,debug,err,i;
+  cell ret;
+
+  filename=aotname=NULL;
+  fuel=0;
+  jit=debug=0;
+  for (i=1; i<argc; i++) {
+    if (strcmp(argv[i],"-d")==0)
+      debug=1;
+    else if (strcmp(argv[i],"-jit")==0)
+      jit=1;
+    else if (strcmp(argv[i],"-fuel")==0 && i+1<argc)
+      fuel=atol(argv[++i]);
+    else if (strcmp(argv[i],"-stack")==0 && i+1<argc)
+      stackstep=atol(argv[++i]);
+    else if (strcmp(argv[i],"-aot")==0 && i+1<argc)
+      aotname=argv[++i];
+    else if (argv[i][0]!='-' && filename==NULL)
+      filename=argv[i];
+    else
+      usage();
+  } /* for */
+  if (filename==NULL || stackstep<0)
+    usage();
+  #if !defined AMX_JIT
+    if (jit)
+      usage();
+  #endif
+  #if !defined AOT_SUPPORT
+    if (aotname!=NULL)
+      usage();
+  #endif
+
+  if ((program=loadfile(filename))==NULL) {
+    printf("Cannot load %s\n",filename);
+    return 2;
+  } /* if */
+  memset(&amx,0,sizeof amx);
+  image=NULL;
+  if (jit)
+    amx.flags=AMX_FLAG_JITC;
+  err=amx_Init(&amx,program);
+  #if defined AMX_JIT
+    if (err==AMX_ERR_NONE && jit)
+      err=initjit(&amx,&image);
+  #endif
+  if (err==AMX_ERR_NONE) {
+    amx_ConsoleInit(&amx);
+    amx_FixedInit(&amx);
+    amx_FloatInit(&amx);
+    amx_StringInit(&amx);
+    err=amx_CoreInit(&amx);
+  } /* if */
+  #if defined AOT_SUPPORT
+    if (err==AMX_ERR_NONE && aotname!=NULL) {
+      void *lib=dlopen(aotname,RTLD_NOW);
+      const AMX_AOTINFO *info=(lib!=NULL) ? (const AMX_AOTINFO *)dlsym(lib,"amx_aotinfo") : NULL;
+      if (info==NULL) {
+        printf("Cannot load %s\n",aotname);
+        return 2;
+      } /* if */
+      err=amx_InitAOT(&amx,info);
+    } /* if */
+  #endif
+  if (debug)
+    amx_SetDebugHook(&amx,counthook);
+  if (fuel>0)
+    amx_SetFuel(&amx,fuel,AMX_FUEL_SUSPEND);
+  if (stackstep>0) {
+    amx_SetStackLimit(&amx,stackstep);
+    amx_SetStackHook(&amx,stackhook);
+  } /* if */
+
+  ret=0;
+  if (err==AMX_ERR_NONE) {
+    err=amx_Exec(&amx,&ret,AMX_EXEC_MAIN);
+    while (err==AMX_ERR_SLEEP || err==AMX_ERR_FUEL) {
+      if (err==AMX_ERR_FUEL)
+        amx_SetFuel(&amx,fuel,AMX_FUEL_SUSPEND);
+      err=amx_Exec(&amx,&ret,AMX_EXEC_CONT);
+    } /* while */
+  } /* if */
+  fflush(stdout);
+  printf("\nerror %d at %ld, return value %ld",err,(long)amx.cip,(long)ret);
+  if (debug)
+    printf(", %ld breaks",breaks);
+  if (stackstep>0)
+    printf(", stack grown %ld times",stackgrows);
+  printf("\n");
+
+  amx_Cleanup(&amx);
+  #if defined AMX_JIT
+    if (image!=NULL)
+      munmap(image,(size_t)amx.codesize);
+  #endif
+  free(program);
+  return 0;
+}
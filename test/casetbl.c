@@ -0,0 +1,193 @@
+/*  Test for the sorting of case tables in amx_Init()
+ *
+ *  The script (casetbl.p) has a switch with many sparse case values, which
+ *  the compiler emits as a sorted case table. This program loads the script
+ *  three times: once as it is, once with the records of the case table in
+ *  reverse order, which amx_Init() must sort back (the function pick() must
+ *  then return the same value for every input), and once more with the
+ *  reversed table and a stack that is too small to sort it in, for which
+ *  amx_Init() must fail with AMX_ERR_INVINSTR.
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "osdefs.h"
+#include "amx.h"
+
+#define OPCODE_CASETBL  74  /* see the opcode list in amx.c */
+#define MINRECORDS      64  /* the table in casetbl.p is at least this large */
+
+static unsigned char *image;
+static long imagesize;
+
+static int ReadImage(const char *filename)
+{
+  AMX_HEADER hdr;
+  FILE *fp;
+
+  if ((fp = fopen(filename, "rb")) == NULL)
+    return 0;
+  if (fread(&hdr, sizeof hdr, 1, fp) != 1 || hdr.magic != AMX_MAGIC || hdr.size > hdr.stp) {
+    fclose(fp);
+    return 0;
+  } /* if */
+  imagesize = hdr.stp;
+  if ((image = (unsigned char*)calloc(1, imagesize)) == NULL) {
+    fclose(fp);
+    return 0;
+  } /* if */
+  rewind(fp);
+  if (fread(image, 1, hdr.size, fp) != (size_t)hdr.size) {
+    fclose(fp);
+    return 0;
+  } /* if */
+  fclose(fp);
+  return 1;
+}
+
+/* FindCaseTable() returns the code offset of the largest CASETBL, which is the
+ * offset of the number of records (behind the opcode); there is no decoding
+ * of the instructions, so a parameter could look like the opcode, but then
+ * the number of records is unlikely to fit
+ */
+static cell FindCaseTable(const unsigned char *program)
+{
+  const AMX_HEADER *hdr = (const AMX_HEADER *)program;
+  const cell *code = (const cell *)(program + (int)hdr->cod);
+  cell num = (hdr->dat - hdr->cod) / (cell)sizeof(cell);
+  cell i, best = -1;
+
+  for (i = 0; i + 1 < num; i++)
+    if (code[i] == OPCODE_CASETBL && code[i + 1] >= MINRECORDS && i + 2 + 2 * code[i + 1] <= num
+        && (best < 0 || code[i + 1] > code[best]))
+      best = i + 1;
+  return (best < 0) ? -1 : best * (cell)sizeof(cell);
+}
+
+/* ReverseCaseTable() reverses the order of the records of the table; the jump
+ * targets are relative to the position of the record, so these are adjusted
+ */
+static void ReverseCaseTable(unsigned char *program, cell offs)
+{
+  const AMX_HEADER *hdr = (const AMX_HEADER *)program;
+  cell *rec = (cell *)(program + (int)hdr->cod + (int)offs);
+  cell num = rec[0];
+  cell i, j, value, target;
+
+  /* record 0 holds the number of records and the default target */
+  for (i = 1, j = num; i < j; i++, j--) {
+    value = rec[2 * i];
+    target = rec[2 * i + 1] + 2 * (i - j) * (cell)sizeof(cell);
+    rec[2 * i] = rec[2 * j];
+    rec[2 * i + 1] = rec[2 * j + 1] + 2 * (j - i) * (cell)sizeof(cell);
+    rec[2 * j] = value;
+    rec[2 * j + 1] = target;
+  } /* for */
+}
+
+static int Load(AMX *amx, unsigned char *program)
+{
+  memset(amx, 0, sizeof(AMX));
+  return amx_Init(amx, program);
+}
+
+static int Pick(AMX *amx, int index, cell value, cell *ret)
+{
+  amx_Push(amx, value);
+  return amx_Exec(amx, ret, index);
+}
+
+int main(int argc, char *argv[])
+{
+  AMX amx1, amx2, amx3;
+  unsigned char *program1, *program2, *program3;
+  AMX_HEADER *hdr;
+  cell offs, num, value, ret1, ret2;
+  const cell *rec;
+  int index1, index2, err, i, errors = 0;
+
+  if (argc != 2) {
+    printf("Usage: casetbl <filename>\n"
+           "<filename> is the compiled script casetbl.p\n");
+    return 2;
+  } /* if */
+  if (!ReadImage(argv[1])) {
+    printf("Cannot read \"%s\"\n", argv[1]);
+    return 1;
+  } /* if */
+  if ((offs = FindCaseTable(image)) < 0) {
+    printf("No case table with at least %d records in \"%s\"\n", MINRECORDS, argv[1]);
+    return 1;
+  } /* if */
+  hdr = (AMX_HEADER *)image;
+  rec = (const cell *)(image + (int)hdr->cod + (int)offs);
+  num = rec[0];
+
+  program1 = (unsigned char*)malloc(imagesize);
+  program2 = (unsigned char*)malloc(imagesize);
+  program3 = (unsigned char*)malloc(imagesize);
+  if (program1 == NULL || program2 == NULL || program3 == NULL)
+    return 1;
+  memcpy(program1, image, imagesize);
+  memcpy(program2, image, imagesize);
+  ReverseCaseTable(program2, offs);
+  memcpy(program3, program2, imagesize);
+
+  if ((err = Load(&amx1, program1)) != AMX_ERR_NONE
+      || (err = amx_FindPublic(&amx1, "pick", &index1)) != AMX_ERR_NONE) {
+    printf("Original table: error %d\n", err);
+    return 1;
+  } /* if */
+  if ((err = Load(&amx2, program2)) != AMX_ERR_NONE
+      || (err = amx_FindPublic(&amx2, "pick", &index2)) != AMX_ERR_NONE) {
+    printf("Reversed table: error %d\n", err);
+    return 1;
+  } /* if */
+
+  /* every case value, the values next to it and values outside the range */
+  for (i = 0; i < num; i++) {
+    for (value = rec[2 * (i + 1)] - 1; value <= rec[2 * (i + 1)] + 1; value++) {
+      if (Pick(&amx1, index1, value, &ret1) != AMX_ERR_NONE
+          || Pick(&amx2, index2, value, &ret2) != AMX_ERR_NONE || ret1 != ret2) {
+        printf("pick(%ld): %ld on the original table, %ld on the reversed table\n",
+               (long)value, (long)ret1, (long)ret2);
+        errors++;
+      } /* if */
+    } /* for */
+  } /* for */
+
+  /* with a stack/heap area that cannot hold a copy of the table, the table
+   * cannot be sorted
+   */
+  hdr = (AMX_HEADER *)program3;
+  hdr->stp = hdr->hea + num * (cell)sizeof(cell);
+  if ((err = Load(&amx3, program3)) != AMX_ERR_INVINSTR) {
+    printf("Reversed table with a small stack: error %d, expected %d\n", err, AMX_ERR_INVINSTR);
+    errors++;
+  } /* if */
+
+  amx_Cleanup(&amx1);
+  amx_Cleanup(&amx2);
+  free(program1);
+  free(program2);
+  free(program3);
+  free(image);
+  printf("%s: %ld records, %d errors\n", argv[1], (long)num, errors);
+  return (errors == 0) ? 0 : 1;
+}
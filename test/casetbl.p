@@ -0,0 +1,119 @@
+/* Script for the test of the case table sorting (casetbl.c)
+ *
+ * The switch in pick() has many sparse case values, so that the compiler
+ * emits a large case table; the host reverses the records of that table and
+ * checks that the abstract machine sorts them back.
+ */
+
+forward pick(value);
+
+public pick(value)
+    {
+    switch (value)
+        {
+        case 0: return 1
+        case -36: return 11
+        case -66: return 21
+        case -90: return 31
+        case -108: return 41
+        case -120: return 51
+        case -126: return 61
+        case -133: return 71
+        case -127: return 81
+        case -115: return 91
+        case -97: return 101
+        case -73: return 111
+        case -43: return 121
+        case -7: return 131
+        case 28: return 141
+        case 76: return 151
+        case 130: return 161
+        case 190: return 171
+        case 256: return 181
+        case 328: return 191
+        case 406: return 201
+        case 483: return 211
+        case 573: return 221
+        case 669: return 231
+        case 771: return 241
+        case 879: return 251
+        case 993: return 261
+        case 1113: return 271
+        case 1232: return 281
+        case 1364: return 291
+        case 1502: return 301
+        case 1646: return 311
+        case 1796: return 321
+        case 1952: return 331
+        case 2114: return 341
+        case 2275: return 351
+        case 2449: return 361
+        case 2629: return 371
+        case 2815: return 381
+        case 3007: return 391
+        case 3205: return 401
+        case 3409: return 411
+        case 3612: return 421
+        case 3828: return 431
+        case 4050: return 441
+        case 4278: return 451
+        case 4512: return 461
+        case 4752: return 471
+        case 4998: return 481
+        case 5243: return 491
+        case 5501: return 501
+        case 5765: return 511
+        case 6035: return 521
+        case 6311: return 531
+        case 6593: return 541
+        case 6881: return 551
+        case 7168: return 561
+        case 7468: return 571
+        case 7774: return 581
+        case 8086: return 591
+        case 8404: return 601
+        case 8728: return 611
+        case 9058: return 621
+        case 9387: return 631
+        case 9729: return 641
+        case 10077: return 651
+        case 10431: return 661
+        case 10791: return 671
+        case 11157: return 681
+        case 11529: return 691
+        case 11900: return 701
+        case 12284: return 711
+        case 12674: return 721
+        case 13070: return 731
+        case 13472: return 741
+        case 13880: return 751
+        case 14294: return 761
+        case 14707: return 771
+        case 15133: return 781
+        case 15565: return 791
+        case 16003: return 801
+        case 16447: return 811
+        case 16897: return 821
+        case 17353: return 831
+        case 17808: return 841
+        case 18276: return 851
+        case 18750: return 861
+        case 19230: return 871
+        case 19716: return 881
+        case 20208: return 891
+        case 20706: return 901
+        case 21203: return 911
+        case 21713: return 921
+        case 22229: return 931
+        case 22751: return 941
+        case 23279: return 951
+        case 23813: return 961
+        case 24353: return 971
+        case 24892: return 981
+        case 25444: return 991
+        }
+    return -1
+    }
+
+main()
+    return pick(0)
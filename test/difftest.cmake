@@ -0,0 +1,63 @@
+# Differential test: compiles a script, runs it in the interpreter and in the
+# JIT compiler (MODE=jit) or in its translation to C (MODE=aot), and compares
+# the output. Run it with "cmake -P"; ctest passes these variables:
+#   PAWNCC    the compiler
+#   AMXRUN    the test run-time (amxrun.c)
+#   SOURCE    the script
+#   INCLUDE   the include directory for the compiler
+#   WORKDIR   the directory for the compiled script and the outputs
+#   MODE      "jit" or "aot"
+#   AMX2C     the translator (for MODE=aot)
+#   CC        the C compiler (for MODE=aot)
+#   CFLAGS    the options for compiling the translation, separated by spaces;
+#             these must give the same AMX structure as for AMXRUN
+
+GET_FILENAME_COMPONENT(name "${SOURCE}" NAME_WE)
+FILE(MAKE_DIRECTORY "${WORKDIR}")
+SET(input "${WORKDIR}/${name}.in")
+FILE(WRITE "${input}" "12\n7\nhello world\n3\n")
+SEPARATE_ARGUMENTS(CFLAGS)
+
+# the script is compiled without and with debug information; the latter has
+# BREAK instructions for the debug hook
+FOREACH(options "-d0" "-O1;-d3")
+  SET(amxfile "${WORKDIR}/${name}.amx")
+  EXECUTE_PROCESS(COMMAND "${PAWNCC}" "${SOURCE}" "-i${INCLUDE}" ${options} "-o${amxfile}"
+                  RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+  IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "Compiling ${SOURCE} failed:\n${output}")
+  ENDIF()
+
+  IF(MODE STREQUAL "aot")
+    EXECUTE_PROCESS(COMMAND "${AMX2C}" "${amxfile}" "${WORKDIR}/${name}.c"
+                    RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+    IF(NOT result EQUAL 0)
+      MESSAGE(FATAL_ERROR "Translating ${amxfile} failed:\n${output}")
+    ENDIF()
+    EXECUTE_PROCESS(COMMAND "${CC}" ${CFLAGS} -shared -fPIC -o "${WORKDIR}/${name}.so" "${WORKDIR}/${name}.c"
+                    RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+    IF(NOT result EQUAL 0)
+      MESSAGE(FATAL_ERROR "Compiling ${WORKDIR}/${name}.c failed:\n${output}")
+    ENDIF()
+    SET(runtime "-aot;${WORKDIR}/${name}.so")
+  ELSE()
+    SET(runtime "-jit")
+  ENDIF()
+
+  # run with a debug hook, in time slices of a few calls and backward jumps,
+  # and with a stack and heap that start small and grow in steps of one cell
+  FOREACH(args "-d" "-fuel;7" "-stack;4")
+    EXECUTE_PROCESS(COMMAND "${AMXRUN}" ${args} "${amxfile}" INPUT_FILE "${input}"
+                    RESULT_VARIABLE result OUTPUT_VARIABLE expected ERROR_VARIABLE expected)
+    IF(NOT result EQUAL 0)
+      MESSAGE(FATAL_ERROR "Running ${amxfile} failed:\n${expected}")
+    ENDIF()
+    EXECUTE_PROCESS(COMMAND "${AMXRUN}" ${args} ${runtime} "${amxfile}" INPUT_FILE "${input}"
+                    RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+    IF(NOT result EQUAL 0 OR NOT output STREQUAL expected)
+      STRING(REPLACE ";" " " args "${options} ${args}")
+      MESSAGE(FATAL_ERROR "${name} (${args}) differs in the ${MODE} run-time\n"
+                          "--- interpreter:\n${expected}\n--- ${MODE}:\n${output}")
+    ENDIF()
+  ENDFOREACH()
+ENDFOREACH()
@@ -0,0 +1,321 @@
+/*  Differential test for the vector kernels of the string functions
+ *
+ *  This program runs the string functions of the abstract machine (and the
+ *  memory fill of the cores) on strings of many lengths, at many alignments,
+ *  and prints a hash of the results for every function and length. It is
+ *  built twice: with the kernels of amxsimd.h and with AMX_NOSIMD, and
+ *  simdtest.cmake checks that both print the same. The source strings are
+ *  also placed so that they end at the last byte of a page that is followed
+ *  by an inaccessible page, so that a kernel that reads beyond the end of
+ *  the string crashes the test.
+ *
+ *  Copyright (c) CompuPhase, 2020
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "amx.h"
+#include "amxsimd.h"
+#include "amxstring.c"  /* for the static functions amx_StrPack() and amx_StrUnpack() */
+
+#define MAXLEN    4000  /* longest string, in characters */
+#define PADDING   8     /* number of cells around the destination buffers */
+#define FILLER    0x55
+
+enum {
+  KIND_ASCII,           /* characters 1..127 */
+  KIND_BYTES,           /* characters 1..255 (mostly invalid UTF-8) */
+  KIND_MIXED,           /* ASCII with a single character above 127 */
+  KIND_UTF8,            /* valid UTF-8, the cell string holds the code points */
+  KINDS
+};
+
+static const int lengths[] = { 100, 127, 128, 129, 255, 256, 1000, 1023, MAXLEN };
+
+static unsigned char *region;   /* accessible pages followed by a guard page */
+static size_t regionsize;       /* size of the accessible part */
+static unsigned long seed = 1;
+
+static unsigned long xrandom(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed & 0xffffffffUL;
+}
+
+static unsigned long hash(unsigned long h, const void *data, size_t size)
+{
+  const unsigned char *ptr = (const unsigned char *)data;
+  while (size-- > 0)
+    h = ((h ^ *ptr++) * 16777619UL) & 0xffffffffUL;
+  return h;
+}
+
+static unsigned long hashint(unsigned long h, long value)
+{
+  return hash(h, &value, sizeof value);
+}
+
+/* makestring() creates the contents of a test string: "bytes" holds the
+ * zero-terminated byte string (UTF-8 for KIND_UTF8) and "cells" the unpacked
+ * cell string (the code points for KIND_UTF8); the function returns the
+ * number of characters in "bytes"
+ */
+static int makestring(int kind, int length, char *bytes, cell *cells)
+{
+  int i, n;
+
+  if (kind == KIND_UTF8) {
+    char *ptr = bytes;
+    for (n = 0; ptr - bytes < length - 3; n++) {
+      cell c;
+      switch (xrandom() % 4) {
+      case 0:
+        c = 0x80 + xrandom() % 0x780;           /* 2 bytes */
+        break;
+      case 1:
+        c = 0x800 + xrandom() % 0x7800;         /* 3 bytes, skipping surrogates */
+        break;
+      default:
+        c = 1 + xrandom() % 0x7f;
+        break;
+      } /* switch */
+      cells[n] = c;
+      amx_UTF8Put(ptr, &ptr, 8, c);
+    } /* for */
+    *ptr = '\0';
+    cells[n] = 0;
+    return (int)(ptr - bytes);
+  } /* if */
+
+  for (i = 0; i < length; i++) {
+    if (kind == KIND_ASCII || kind == KIND_MIXED)
+      bytes[i] = (char)(1 + xrandom() % 0x7f);
+    else
+      bytes[i] = (char)(1 + xrandom() % 0xff);
+  } /* for */
+  if (kind == KIND_MIXED && length > 0)
+    bytes[xrandom() % length] = (char)(0x80 + xrandom() % 0x80);
+  bytes[length] = '\0';
+  for (i = 0; i <= length; i++)
+    cells[i] = (unsigned char)bytes[i];
+  return length;
+}
+
+/* packs a string with plain C code, so that both builds start from the same
+ * packed string
+ */
+static void packstring(cell *dest, const char *source, size_t length)
+{
+  size_t i;
+
+  memset(dest, 0, (length / sizeof(cell) + 1) * sizeof(cell));
+  for (i = 0; i < length; i++)
+    dest[i / sizeof(cell)] |= (cell)((ucell)(unsigned char)source[i] << ((sizeof(cell) - 1 - i % sizeof(cell)) * 8));
+}
+
+/* places a copy of a string in the test region; with "offset" < 0, the string
+ * ends at the last byte before the guard page, otherwise it starts at
+ * "offset" bytes from the start of the region
+ */
+static void *place(const void *source, size_t size, long offset)
+{
+  unsigned char *ptr;
+
+  if (offset < 0)
+    ptr = region + regionsize - size;
+  else
+    ptr = region + offset;
+  memcpy(ptr, source, size);
+  return ptr;
+}
+
+static cell *fillbuffer(cell *buffer, size_t cells)
+{
+  memset(buffer, FILLER, (cells + 2 * PADDING) * sizeof(cell));
+  return buffer + PADDING;
+}
+
+static void report(const char *name, int kind, int length, unsigned long h)
+{
+  printf("%-10s kind %d length %4d: %08lx\n", name, kind, length, h);
+}
+
+static void testlength(int kind, int length, char *bytes, cell *cells, cell *packed,
+                       cell *buffer, char *chars, wchar_t *wide)
+{
+  unsigned long h_len = 2166136261UL, h_get = 2166136261UL, h_getw = 2166136261UL;
+  unsigned long h_set = 2166136261UL, h_utf8 = 2166136261UL, h_pack = 2166136261UL;
+  unsigned long h_unpack = 2166136261UL, h_fill = 2166136261UL;
+  int numbytes, numcells, len, offs, size, placement, err;
+  size_t sizes[3];
+  cell *dest;
+  int i;
+
+  numbytes = makestring(kind, length, bytes, cells);
+  for (numcells = 0; cells[numcells] != 0; numcells++)
+    /* nothing */;
+  packstring(packed, bytes, (size_t)numbytes);
+  sizes[0] = UNLIMITED;
+  sizes[1] = numbytes + 1;
+  sizes[2] = numbytes / 2 + 1;
+
+  /* the source strings are at the guard page and at all alignments in a
+   * block of 16 bytes
+   */
+  for (placement = -1; placement < 16; placement++) {
+    const char *sbytes = (const char *)place(bytes, numbytes + 1, placement);
+    const cell *scells, *spacked;
+
+    /* byte strings, at any alignment */
+    err = amx_UTF8Check(sbytes, &len);
+    h_utf8 = hashint(hashint(h_utf8, err), len);
+    for (i = 0; i < 3; i++) {
+      dest = fillbuffer(buffer, numbytes + 1);
+      amx_SetString(dest, sbytes, 0, 0, sizes[i]);
+      h_set = hash(h_set, buffer, (numbytes + 1 + 2 * PADDING) * sizeof(cell));
+      dest = fillbuffer(buffer, numbytes + 1);
+      amx_SetString(dest, sbytes, 1, 0, sizes[i] / sizeof(cell) + 1);
+      h_set = hash(h_set, buffer, (numbytes + 1 + 2 * PADDING) * sizeof(cell));
+    } /* for */
+
+    /* cell strings, at any cell alignment */
+    if (placement >= 0 && placement % sizeof(cell) != 0)
+      continue;
+    scells = (const cell *)place(cells, (numcells + 1) * sizeof(cell), placement);
+    amx_StrLen(scells, &len);
+    h_len = hashint(h_len, len);
+    err = amx_UTF8Len(scells, &len);
+    h_utf8 = hashint(hashint(h_utf8, err), len);
+    for (i = 0; i < 3; i++) {
+      memset(chars, FILLER, numcells + 16);
+      amx_GetString(chars, scells, 0, sizes[i]);
+      h_get = hash(h_get, chars, numcells + 16);
+      memset(wide, FILLER, (numcells + 16) * sizeof(wchar_t));
+      amx_GetString((char *)wide, scells, 1, sizes[i]);
+      h_getw = hash(h_getw, wide, (numcells + 16) * sizeof(wchar_t));
+    } /* for */
+    if (kind != KIND_UTF8) {
+      for (offs = 0; offs < (int)sizeof(cell); offs++) {
+        dest = fillbuffer(buffer, numbytes + 1);
+        amx_StrPack(dest, (cell *)scells, numbytes, offs);
+        h_pack = hash(h_pack, buffer, (numbytes + 1 + 2 * PADDING) * sizeof(cell));
+      } /* for */
+    } /* if */
+
+    /* packed strings */
+    if (numbytes == 0)
+      continue;         /* an empty string is not packed */
+    size = (numbytes / sizeof(cell) + 1) * sizeof(cell);
+    spacked = (const cell *)place(packed, size, placement);
+    amx_StrLen(spacked, &len);
+    h_len = hashint(h_len, len);
+    for (i = 0; i < 3; i++) {
+      memset(chars, FILLER, numbytes + 16);
+      amx_GetString(chars, spacked, 0, sizes[i]);
+      h_get = hash(h_get, chars, numbytes + 16);
+      memset(wide, FILLER, (numbytes + 16) * sizeof(wchar_t));
+      amx_GetString((char *)wide, spacked, 1, sizes[i]);
+      h_getw = hash(h_getw, wide, (numbytes + 16) * sizeof(wchar_t));
+    } /* for */
+    for (offs = 0; offs < (int)sizeof(cell); offs++) {
+      dest = fillbuffer(buffer, numbytes + 1);
+      amx_StrPack(dest, (cell *)spacked, numbytes, offs);
+      h_pack = hash(h_pack, buffer, (numbytes + 1 + 2 * PADDING) * sizeof(cell));
+    } /* for */
+    dest = fillbuffer(buffer, numbytes + 1);
+    amx_StrUnpack(dest, (cell *)spacked, numbytes);
+    h_unpack = hash(h_unpack, buffer, (numbytes + 1 + 2 * PADDING) * sizeof(cell));
+    /* in place */
+    dest = fillbuffer(buffer, numbytes + 1);
+    memcpy(dest, spacked, size);
+    amx_StrUnpack(dest, dest, numbytes);
+    h_unpack = hash(h_unpack, buffer, (numbytes + 1 + 2 * PADDING) * sizeof(cell));
+  } /* for */
+
+  /* the memory fill of the cores, at all cell alignments */
+  if (kind == KIND_ASCII) {
+    static const cell values[] = { 0, -1, 0x12345678 };
+    for (i = 0; i < 3; i++) {
+      for (offs = 0; offs < 4; offs++) {
+        dest = fillbuffer(buffer, length + 4);
+        simd_fill(dest + offs, values[i], (size_t)length);
+        h_fill = hash(h_fill, buffer, (length + 4 + 2 * PADDING) * sizeof(cell));
+      } /* for */
+    } /* for */
+    report("fill", kind, length, h_fill);
+  } /* if */
+
+  report("strlen", kind, length, h_len);
+  report("getstring", kind, length, h_get);
+  report("getwstring", kind, length, h_getw);
+  report("setstring", kind, length, h_set);
+  report("utf8", kind, length, h_utf8);
+  if (kind != KIND_UTF8)
+    report("strpack", kind, length, h_pack);
+  report("strunpack", kind, length, h_unpack);
+}
+
+int main(void)
+{
+  size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+  char *bytes, *chars;
+  cell *cells, *packed, *buffer;
+  wchar_t *wide;
+  int kind, length, i;
+
+  /* the region holds the longest string (in cells) twice, to test the
+   * placements at the start, plus a guard page
+   */
+  regionsize = ((2 * (MAXLEN + 1) * sizeof(cell) + pagesize - 1) / pagesize) * pagesize;
+  region = (unsigned char *)mmap(NULL, regionsize + pagesize, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED || mprotect(region + regionsize, pagesize, PROT_NONE) != 0) {
+    printf("Cannot set up the guard page\n");
+    return 1;
+  } /* if */
+  bytes = (char *)malloc(MAXLEN + 1);
+  chars = (char *)malloc(MAXLEN + 16);
+  wide = (wchar_t *)malloc((MAXLEN + 16) * sizeof(wchar_t));
+  cells = (cell *)malloc((MAXLEN + 1) * sizeof(cell));
+  packed = (cell *)malloc((MAXLEN + 1) * sizeof(cell));
+  buffer = (cell *)malloc((MAXLEN + 4 + 2 * PADDING) * sizeof(cell));
+  if (bytes == NULL || chars == NULL || wide == NULL || cells == NULL || packed == NULL || buffer == NULL) {
+    printf("Insufficient memory\n");
+    return 1;
+  } /* if */
+
+  for (kind = 0; kind < KINDS; kind++) {
+    for (length = 0; length < 80; length++)
+      testlength(kind, length, bytes, cells, packed, buffer, chars, wide);
+    for (i = 0; i < (int)(sizeof lengths / sizeof lengths[0]); i++)
+      testlength(kind, lengths[i], bytes, cells, packed, buffer, chars, wide);
+  } /* for */
+
+  free(bytes);
+  free(chars);
+  free(wide);
+  free(cells);
+  free(packed);
+  free(buffer);
+  munmap(region, regionsize + pagesize);
+  return 0;
+}
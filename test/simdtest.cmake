@@ -0,0 +1,21 @@
+# Compares the string functions with the SSE2 kernels against those with the
+# plain C code (see simdtest.c). Run it with "cmake -P"; ctest passes these
+# variables:
+#   SIMD      simdtest, built with the kernels
+#   SCALAR    simdtest, built with AMX_NOSIMD
+#   WORKDIR   the directory for the outputs
+
+FILE(MAKE_DIRECTORY "${WORKDIR}")
+FOREACH(build SIMD SCALAR)
+  EXECUTE_PROCESS(COMMAND "${${build}}" RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+  IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "${${build}} failed (${result}):\n${output}")
+  ENDIF()
+  FILE(WRITE "${WORKDIR}/${build}.out" "${output}")
+  SET(output_${build} "${output}")
+ENDFOREACH(build)
+
+IF(NOT output_SIMD STREQUAL output_SCALAR)
+  MESSAGE(FATAL_ERROR "The string kernels differ from the plain C code, compare "
+                      "${WORKDIR}/SIMD.out with ${WORKDIR}/SCALAR.out")
+ENDIF()